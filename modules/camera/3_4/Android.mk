@@ -47,9 +47,20 @@ v4l2_src_files := \
   arc/frame_buffer.cpp \
   arc/image_processor.cpp \
   arc/jpeg_compressor.cpp \
+  arc/jpeg_decoder.cpp \
+  arc/v4l2_m2m_jpeg_decoder.cpp \
+  arc/worker_pool.cpp \
+  arc/yuv_kernels.cpp \
+  buffer_slots.cpp \
   camera.cpp \
   capture_request.cpp \
+  conversion_pipeline.cpp \
+  fence_waiter.cpp \
+  format_cache.cpp \
   format_metadata_factory.cpp \
+  frame_dump.cpp \
+  frame_timing.cpp \
+  jpeg_encoder.cpp \
   metadata/boottime_state_delegate.cpp \
   metadata/enum_converter.cpp \
   metadata/metadata.cpp \
@@ -60,10 +71,20 @@ v4l2_src_files := \
   v4l2_camera.cpp \
   v4l2_camera_hal.cpp \
   v4l2_metadata_factory.cpp \
+  v4l2_replay_wrapper.cpp \
   v4l2_wrapper.cpp \
 
 v4l2_test_files := \
+  arc/image_processor_test.cpp \
+  arc/jpeg_decoder_test.cpp \
+  arc/worker_pool_test.cpp \
+  arc/yuv_kernels_test.cpp \
+  buffer_slots_test.cpp \
+  fence_waiter_test.cpp \
+  format_cache_test.cpp \
   format_metadata_factory_test.cpp \
+  frame_dump_test.cpp \
+  frame_timing_test.cpp \
   metadata/control_test.cpp \
   metadata/default_option_delegate_test.cpp \
   metadata/enum_converter_test.cpp \
@@ -84,11 +105,15 @@ v4l2_test_files := \
   request_tracker_test.cpp \
   static_properties_test.cpp \
 
+v4l2_benchmark_files := \
+  arc/image_processor_benchmark.cpp \
+
 # V4L2 Camera HAL.
 # ==============================================================================
 include $(CLEAR_VARS)
 LOCAL_MODULE := camera.v4l2
 LOCAL_MODULE_RELATIVE_PATH := hw
+LOCAL_INIT_RC := camera.v4l2.rc
 LOCAL_CFLAGS += $(v4l2_cflags)
 LOCAL_SHARED_LIBRARIES := $(v4l2_shared_libs)
 LOCAL_STATIC_LIBRARIES := \
@@ -116,4 +141,41 @@ LOCAL_SRC_FILES := \
 
 include $(BUILD_NATIVE_TEST)
 
+# Conversion benchmarks for V4L2 Camera HAL.
+# ==============================================================================
+include $(CLEAR_VARS)
+LOCAL_MODULE := camera.v4l2_benchmark
+LOCAL_CFLAGS += $(v4l2_cflags)
+LOCAL_SHARED_LIBRARIES := $(v4l2_shared_libs)
+LOCAL_STATIC_LIBRARIES := \
+  libgtest_prod \
+  $(v4l2_static_libs) \
+
+LOCAL_C_INCLUDES += $(v4l2_c_includes)
+LOCAL_SRC_FILES := \
+  $(v4l2_src_files) \
+  $(v4l2_benchmark_files) \
+
+include $(BUILD_NATIVE_BENCHMARK)
+
+# Replay benchmark for V4L2 Camera HAL.
+# ==============================================================================
+include $(CLEAR_VARS)
+LOCAL_MODULE := camera.v4l2_replay_benchmark
+LOCAL_CFLAGS += $(v4l2_cflags)
+LOCAL_SHARED_LIBRARIES := \
+  $(v4l2_shared_libs) \
+  libui \
+
+LOCAL_STATIC_LIBRARIES := \
+  libgtest_prod \
+  $(v4l2_static_libs) \
+
+LOCAL_C_INCLUDES += $(v4l2_c_includes)
+LOCAL_SRC_FILES := \
+  $(v4l2_src_files) \
+  replay_benchmark.cpp \
+
+include $(BUILD_EXECUTABLE)
+
 endif # USE_CAMERA_V4L2_HAL
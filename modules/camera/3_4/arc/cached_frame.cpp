@@ -7,7 +7,6 @@
 
 #include <cerrno>
 
-#include <libyuv.h>
 #include "arc/common.h"
 
 namespace arc {
@@ -16,7 +15,9 @@ using android::CameraMetadata;
 
 CachedFrame::CachedFrame()
     : source_frame_(nullptr),
-      cropped_buffer_capacity_(0),
+      rotated_frame_(new AllocatedFrameBuffer(0)),
+      min_width_(0),
+      min_height_(0),
       yu12_frame_(new AllocatedFrameBuffer(0)),
       scaled_frame_(new AllocatedFrameBuffer(0)) {}
 
@@ -37,6 +38,22 @@ int CachedFrame::SetSource(const FrameBuffer* frame, int rotate_degree) {
 
 void CachedFrame::UnsetSource() { source_frame_ = nullptr; }
 
+void CachedFrame::SetMinimumSize(uint32_t width, uint32_t height) {
+  min_width_ = width;
+  min_height_ = height;
+}
+
+void CachedFrame::PrepareDecoder(uint32_t fourcc) {
+  if (fourcc != V4L2_PIX_FMT_MJPEG) {
+    return;
+  }
+  if (!jpeg_decoder_) {
+    jpeg_decoder_ = JpegDecoder::Create();
+    LOGF(INFO) << "Decoding MJPEG with " << jpeg_decoder_->GetName();
+  }
+  jpeg_decoder_->Reset();
+}
+
 uint8_t* CachedFrame::GetSourceBuffer() const {
   return source_frame_->GetData();
 }
@@ -69,7 +86,13 @@ int CachedFrame::Convert(const CameraMetadata& metadata, FrameBuffer* out_frame,
   if (video_hack && out_frame->GetFourcc() == V4L2_PIX_FMT_YVU420) {
     out_frame->SetFourcc(V4L2_PIX_FMT_YUV420);
   }
+  return ConvertWithBuffer(metadata, out_frame, scaled_frame_.get());
+}
 
+int CachedFrame::ConvertWithBuffer(const CameraMetadata& metadata,
+                                   FrameBuffer* out_frame,
+                                   AllocatedFrameBuffer* scaled_frame,
+                                   ScaleFilter filter) const {
   FrameBuffer* source_frame = yu12_frame_.get();
   if (GetWidth() != out_frame->GetWidth() ||
       GetHeight() != out_frame->GetHeight()) {
@@ -78,19 +101,33 @@ int CachedFrame::Convert(const CameraMetadata& metadata, FrameBuffer* out_frame,
         out_frame->GetHeight());
     if (cache_size == 0) {
       return -EINVAL;
-    } else if (cache_size > scaled_frame_->GetBufferSize()) {
-      scaled_frame_.reset(new AllocatedFrameBuffer(cache_size));
     }
-    scaled_frame_->SetWidth(out_frame->GetWidth());
-    scaled_frame_->SetHeight(out_frame->GetHeight());
-    ImageProcessor::Scale(*yu12_frame_.get(), scaled_frame_.get());
+    // Grows the buffer if needed.
+    scaled_frame->SetDataSize(cache_size);
+    scaled_frame->SetWidth(out_frame->GetWidth());
+    scaled_frame->SetHeight(out_frame->GetHeight());
+    int res = ImageProcessor::Scale(*yu12_frame_.get(), scaled_frame, filter);
+    if (res) {
+      return res;
+    }
 
-    source_frame = scaled_frame_.get();
+    source_frame = scaled_frame;
   }
   return ImageProcessor::ConvertFormat(metadata, *source_frame, out_frame);
 }
 
 int CachedFrame::ConvertToYU12() {
+  if (source_frame_->GetFourcc() == V4L2_PIX_FMT_MJPEG) {
+    if (!jpeg_decoder_) {
+      jpeg_decoder_ = JpegDecoder::Create();
+      LOGF(INFO) << "Decoding MJPEG with " << jpeg_decoder_->GetName();
+    }
+    int res = jpeg_decoder_->Decode(*source_frame_, yu12_frame_.get(),
+                                    min_width_, min_height_);
+    LOGF_IF(ERROR, res) << "Failed to decode MJPEG frame: " << res;
+    return res;
+  }
+
   size_t cache_size = ImageProcessor::GetConvertedSize(
       V4L2_PIX_FMT_YUV420, source_frame_->GetWidth(),
       source_frame_->GetHeight());
@@ -113,7 +150,6 @@ int CachedFrame::ConvertToYU12() {
 }
 
 int CachedFrame::CropRotateScale(int rotate_degree) {
-  // TODO(henryhsu): Move libyuv part to ImageProcessor.
   if (yu12_frame_->GetHeight() % 2 != 0 || yu12_frame_->GetWidth() % 2 != 0) {
     LOGF(ERROR) << "yu12_frame_ has odd dimension: " << yu12_frame_->GetWidth()
                 << "x" << yu12_frame_->GetHeight();
@@ -143,48 +179,12 @@ int CachedFrame::CropRotateScale(int rotate_degree) {
     // Make cropped_width to the closest even number.
     cropped_width++;
   }
-  int cropped_height = yu12_frame_->GetHeight();
   int margin = (yu12_frame_->GetWidth() - cropped_width) / 2;
 
-  int rotated_height = cropped_width;
-  int rotated_width = cropped_height;
-
-  int rotated_y_stride = rotated_width;
-  int rotated_uv_stride = rotated_width / 2;
-  size_t rotated_size =
-      rotated_y_stride * rotated_height + rotated_uv_stride * rotated_height;
-  if (rotated_size > cropped_buffer_capacity_) {
-    cropped_buffer_.reset(new uint8_t[rotated_size]);
-    cropped_buffer_capacity_ = rotated_size;
-  }
-  uint8_t* rotated_y_plane = cropped_buffer_.get();
-  uint8_t* rotated_u_plane =
-      rotated_y_plane + rotated_y_stride * rotated_height;
-  uint8_t* rotated_v_plane =
-      rotated_u_plane + rotated_uv_stride * rotated_height / 2;
-  libyuv::RotationMode rotation_mode = libyuv::RotationMode::kRotate90;
-  switch (rotate_degree) {
-    case 90:
-      rotation_mode = libyuv::RotationMode::kRotate90;
-      break;
-    case 270:
-      rotation_mode = libyuv::RotationMode::kRotate270;
-      break;
-    default:
-      LOGF(ERROR) << "Invalid rotation degree: " << rotate_degree;
-      return -EINVAL;
-  }
-  // This libyuv method first crops the frame and then rotates it 90 degrees
-  // clockwise.
-  int res = libyuv::ConvertToI420(
-      yu12_frame_->GetData(), yu12_frame_->GetDataSize(), rotated_y_plane,
-      rotated_y_stride, rotated_u_plane, rotated_uv_stride, rotated_v_plane,
-      rotated_uv_stride, margin, 0, yu12_frame_->GetWidth(),
-      yu12_frame_->GetHeight(), cropped_width, cropped_height, rotation_mode,
-      libyuv::FourCC::FOURCC_I420);
-
+  int res = ImageProcessor::CropRotate(*yu12_frame_, margin, cropped_width,
+                                       rotate_degree, rotated_frame_.get());
   if (res) {
-    LOGF(ERROR) << "ConvertToI420 failed: " << res;
+    LOGF(ERROR) << "CropRotate failed: " << res;
     return res;
   }
 
@@ -200,18 +200,8 @@ int CachedFrame::CropRotateScale(int rotate_degree) {
   //                           ---------------------
   //
   //
-  res = libyuv::I420Scale(
-      rotated_y_plane, rotated_y_stride, rotated_u_plane, rotated_uv_stride,
-      rotated_v_plane, rotated_uv_stride, rotated_width, rotated_height,
-      yu12_frame_->GetData(), yu12_frame_->GetWidth(),
-      yu12_frame_->GetData() +
-          yu12_frame_->GetWidth() * yu12_frame_->GetHeight(),
-      yu12_frame_->GetWidth() / 2,
-      yu12_frame_->GetData() +
-          yu12_frame_->GetWidth() * yu12_frame_->GetHeight() * 5 / 4,
-      yu12_frame_->GetWidth() / 2, yu12_frame_->GetWidth(),
-      yu12_frame_->GetHeight(), libyuv::FilterMode::kFilterNone);
-  LOGF_IF(ERROR, res) << "I420Scale failed: " << res;
+  res = ImageProcessor::Scale(*rotated_frame_, yu12_frame_.get());
+  LOGF_IF(ERROR, res) << "Scale failed: " << res;
   return res;
 }
 
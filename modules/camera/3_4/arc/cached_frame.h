@@ -10,6 +10,7 @@
 
 #include <camera/CameraMetadata.h>
 #include "arc/image_processor.h"
+#include "arc/jpeg_decoder.h"
 
 namespace arc {
 
@@ -32,6 +33,16 @@ class CachedFrame {
   int SetSource(const FrameBuffer* frame, int rotate_degree);
   void UnsetSource();
 
+  // Outputs need no more than |width| x |height|, so MJPEG sources may be
+  // decoded at a reduced size no smaller than that, when the decoder can.
+  // Zero means full size, which is the default.
+  void SetMinimumSize(uint32_t width, uint32_t height);
+
+  // Frames of a new stream, in |fourcc|, are about to be set as sources.
+  // For MJPEG, this picks the decoder (which probes for hardware ones) the
+  // first time, so the first frame doesn't pay for it, and resets it.
+  void PrepareDecoder(uint32_t fourcc);
+
   uint8_t* GetSourceBuffer() const;
   size_t GetSourceDataSize() const;
   uint32_t GetSourceFourCC() const;
@@ -55,6 +66,16 @@ class CachedFrame {
   int Convert(const android::CameraMetadata& metadata, FrameBuffer* out_frame,
               bool video_hack = false);
 
+  // Same as Convert(), but scales through the caller owned |scaled_frame|
+  // instead of the internal scratch buffer. This leaves the cached frame
+  // untouched, so several outputs may be converted from it concurrently as
+  // long as each uses its own |scaled_frame|. Scaling uses |filter|, so each
+  // output may pick its own trade-off between speed and quality.
+  int ConvertWithBuffer(const android::CameraMetadata& metadata,
+                        FrameBuffer* out_frame,
+                        AllocatedFrameBuffer* scaled_frame,
+                        ScaleFilter filter = ScaleFilter::kNone) const;
+
  private:
   int ConvertToYU12();
   // When we have a landscape mounted camera and the current camera activity is
@@ -70,8 +91,13 @@ class CachedFrame {
   // const V4L2FrameBuffer* source_frame_;
 
   // Temporary buffer for cropped and rotated results.
-  std::unique_ptr<uint8_t[]> cropped_buffer_;
-  size_t cropped_buffer_capacity_;
+  std::unique_ptr<AllocatedFrameBuffer> rotated_frame_;
+
+  // Decoder for MJPEG sources, picked by PrepareDecoder(), or on first use
+  // without it.
+  std::unique_ptr<JpegDecoder> jpeg_decoder_;
+  uint32_t min_width_;
+  uint32_t min_height_;
 
   // Cache YU12 decoded results.
   std::unique_ptr<AllocatedFrameBuffer> yu12_frame_;
@@ -168,6 +168,9 @@ int GrallocFrameBuffer::Map() {
       fourcc_ == V4L2_PIX_FMT_NV21 || fourcc_ == V4L2_PIX_FMT_RGB32 ||
       fourcc_ == V4L2_PIX_FMT_BGR32) {
     buffer_size_ = ImageProcessor::GetConvertedSize(fourcc_, width_, height_);
+  } else if (fourcc_ == V4L2_PIX_FMT_JPEG) {
+    // The JPEG encoder writes directly into the locked range.
+    buffer_size_ = device_buffer_length_;
   }
 
   is_mapped_ = true;
@@ -5,14 +5,18 @@
 
 #include "arc/image_processor.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <ctime>
 #include <string>
+#include <vector>
 
 #include <libyuv.h>
 #include "arc/common.h"
 #include "arc/exif_utils.h"
 #include "arc/jpeg_compressor.h"
+#include "arc/worker_pool.h"
+#include "arc/yuv_kernels.h"
 
 namespace arc {
 
@@ -178,7 +182,6 @@ int ImageProcessor::ConvertFormat(const CameraMetadata& metadata,
       }
       case V4L2_PIX_FMT_NV21:  // NV21
       {
-        // TODO(henryhsu): Use libyuv::I420ToNV21.
         int res = YU12ToNV21(in_frame.GetData(), out_frame->GetData(),
                              in_frame.GetWidth(), in_frame.GetHeight());
         LOGF_IF(ERROR, res) << "YU12ToNV21() returns " << res;
@@ -219,7 +222,7 @@ int ImageProcessor::ConvertFormat(const CameraMetadata& metadata,
       case V4L2_PIX_FMT_JPEG: {
         bool res = ConvertToJpeg(metadata, in_frame, out_frame);
         LOGF_IF(ERROR, !res) << "ConvertToJpeg() returns " << res;
-        return res ? -EINVAL : 0;
+        return res ? 0 : -EINVAL;
       }
       default:
         LOGF(ERROR) << "Destination pixel format "
@@ -261,12 +264,91 @@ int ImageProcessor::ConvertFormat(const CameraMetadata& metadata,
   }
 }
 
-int ImageProcessor::Scale(const FrameBuffer& in_frame, FrameBuffer* out_frame) {
+namespace {
+
+// One stripe of a plane, for scaling or rotating.
+struct PlaneStripe {
+  const uint8_t* src;
+  int src_stride;
+  int src_width;
+  int src_height;
+  uint8_t* dst;
+  int dst_stride;
+  int dst_width;
+  int dst_height;
+};
+
+int Gcd(int a, int b) {
+  while (b) {
+    int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Split scaling |plane| in up to |max_stripes| stripes of rows. Source and
+// destination rows only line up every |src_height| / gcd and |dst_height| /
+// gcd rows, so stripes are made of whole such units.
+// Striping must not change the result. When scaling down with an exact 16.16
+// fixed point step between source rows, libyuv places each destination row at
+// the same source row in a stripe as in the whole plane, and picks the same
+// scaler since the ratios are the same. Filters then only blend source rows of
+// the same unit: a bilinear row sits half a step minus half a row past the
+// top of its span, so with a step above one row it never reaches the next
+// unit, and box filtering stays within its span. Upscaling positions rows
+// relative to the whole plane, so it and inexact steps are scaled a whole
+// plane at a time.
+void AddScaleStripes(const PlaneStripe& plane, size_t max_stripes,
+                     std::vector<PlaneStripe>* stripes) {
+  int units = Gcd(plane.src_height, plane.dst_height);
+  int src_unit = plane.src_height / units;
+  int dst_unit = plane.dst_height / units;
+  bool separable = plane.dst_height <= plane.src_height &&
+                   (static_cast<int64_t>(src_unit) << 16) % dst_unit == 0;
+  int count = separable ? std::min(static_cast<int>(max_stripes), units) : 1;
+  for (int i = 0; i < count; ++i) {
+    int first = units * i / count;
+    int last = units * (i + 1) / count;
+    PlaneStripe stripe = plane;
+    stripe.src += first * src_unit * plane.src_stride;
+    stripe.src_height = (last - first) * src_unit;
+    stripe.dst += first * dst_unit * plane.dst_stride;
+    stripe.dst_height = (last - first) * dst_unit;
+    stripes->push_back(stripe);
+  }
+}
+
+libyuv::FilterMode ToLibyuvFilter(ScaleFilter filter) {
+  switch (filter) {
+    case ScaleFilter::kBilinear:
+      return libyuv::FilterMode::kFilterBilinear;
+    case ScaleFilter::kBox:
+      return libyuv::FilterMode::kFilterBox;
+    case ScaleFilter::kNone:
+    default:
+      return libyuv::FilterMode::kFilterNone;
+  }
+}
+
+}  // namespace
+
+int ImageProcessor::Scale(const FrameBuffer& in_frame, FrameBuffer* out_frame,
+                          ScaleFilter filter, WorkerPool* pool) {
   if (in_frame.GetFourcc() != V4L2_PIX_FMT_YUV420) {
     LOGF(ERROR) << "Pixel format " << FormatToString(in_frame.GetFourcc())
                 << " is unsupported.";
     return -EINVAL;
   }
+  int in_width = in_frame.GetWidth();
+  int in_height = in_frame.GetHeight();
+  int out_width = out_frame->GetWidth();
+  int out_height = out_frame->GetHeight();
+  if (in_width < 2 || in_height < 2 || out_width < 2 || out_height < 2) {
+    LOGF(ERROR) << "Invalid scale from " << in_width << "x" << in_height
+                << " to " << out_width << "x" << out_height;
+    return -EINVAL;
+  }
 
   size_t data_size = GetConvertedSize(
       in_frame.GetFourcc(), out_frame->GetWidth(), out_frame->GetHeight());
@@ -281,21 +363,115 @@ int ImageProcessor::Scale(const FrameBuffer& in_frame, FrameBuffer* out_frame) {
            << in_frame.GetHeight() << " to " << out_frame->GetWidth() << "x"
            << out_frame->GetHeight();
 
-  int ret = libyuv::I420Scale(
-      in_frame.GetData(), in_frame.GetWidth(),
-      in_frame.GetData() + in_frame.GetWidth() * in_frame.GetHeight(),
-      in_frame.GetWidth() / 2,
-      in_frame.GetData() + in_frame.GetWidth() * in_frame.GetHeight() * 5 / 4,
-      in_frame.GetWidth() / 2, in_frame.GetWidth(), in_frame.GetHeight(),
-      out_frame->GetData(), out_frame->GetWidth(),
-      out_frame->GetData() + out_frame->GetWidth() * out_frame->GetHeight(),
-      out_frame->GetWidth() / 2,
-      out_frame->GetData() +
-          out_frame->GetWidth() * out_frame->GetHeight() * 5 / 4,
-      out_frame->GetWidth() / 2, out_frame->GetWidth(), out_frame->GetHeight(),
-      libyuv::FilterMode::kFilterNone);
-  LOGF_IF(ERROR, ret) << "I420Scale failed: " << ret;
-  return ret;
+  if (pool == nullptr) {
+    pool = WorkerPool::GetDefault();
+  }
+  const uint8_t* in_data = in_frame.GetData();
+  uint8_t* out_data = out_frame->GetData();
+  PlaneStripe y = {in_data, in_width, in_width, in_height,
+                   out_data, out_width, out_width, out_height};
+  PlaneStripe u = {in_data + in_width * in_height, in_width / 2,
+                   in_width / 2, in_height / 2,
+                   out_data + out_width * out_height, out_width / 2,
+                   out_width / 2, out_height / 2};
+  PlaneStripe v = u;
+  v.src = in_data + in_width * in_height * 5 / 4;
+  v.dst = out_data + out_width * out_height * 5 / 4;
+
+  std::vector<PlaneStripe> stripes;
+  for (const PlaneStripe& plane : {y, u, v}) {
+    AddScaleStripes(plane, pool->GetConcurrency(), &stripes);
+  }
+  libyuv::FilterMode mode = ToLibyuvFilter(filter);
+  pool->Run(stripes.size(), [&stripes, mode](size_t i) {
+    const PlaneStripe& s = stripes[i];
+    libyuv::ScalePlane(s.src, s.src_stride, s.src_width, s.src_height, s.dst,
+                       s.dst_stride, s.dst_width, s.dst_height, mode);
+  });
+  return 0;
+}
+
+int ImageProcessor::CropRotate(const FrameBuffer& in_frame, int crop_x,
+                               int crop_width, int rotate_degree,
+                               AllocatedFrameBuffer* out_frame,
+                               WorkerPool* pool) {
+  if (in_frame.GetFourcc() != V4L2_PIX_FMT_YUV420) {
+    LOGF(ERROR) << "Pixel format " << FormatToString(in_frame.GetFourcc())
+                << " is unsupported.";
+    return -EINVAL;
+  }
+  int in_width = in_frame.GetWidth();
+  int in_height = in_frame.GetHeight();
+  if (crop_x < 0 || crop_width < 2 || crop_width % 2 ||
+      crop_x + crop_width > in_width || in_height % 2) {
+    LOGF(ERROR) << "Invalid crop of " << crop_width << " columns at "
+                << crop_x << " from " << in_width << "x" << in_height;
+    return -EINVAL;
+  }
+  libyuv::RotationMode mode;
+  switch (rotate_degree) {
+    case 90:
+      mode = libyuv::RotationMode::kRotate90;
+      break;
+    case 270:
+      mode = libyuv::RotationMode::kRotate270;
+      break;
+    default:
+      LOGF(ERROR) << "Invalid rotation degree: " << rotate_degree;
+      return -EINVAL;
+  }
+
+  // The rotated frame is |in_height| wide and |crop_width| high.
+  int out_width = in_height;
+  int out_height = crop_width;
+  out_frame->SetWidth(out_width);
+  out_frame->SetHeight(out_height);
+  if (out_frame->SetDataSize(
+          GetConvertedSize(V4L2_PIX_FMT_YUV420, out_width, out_height))) {
+    LOGF(ERROR) << "Set data size failed";
+    return -EINVAL;
+  }
+  out_frame->SetFourcc(V4L2_PIX_FMT_YUV420);
+
+  if (pool == nullptr) {
+    pool = WorkerPool::GetDefault();
+  }
+  const uint8_t* in_data = in_frame.GetData();
+  uint8_t* out_data = out_frame->GetData();
+  PlaneStripe y = {in_data + crop_x, in_width, crop_width, in_height,
+                   out_data, out_width, out_width, out_height};
+  PlaneStripe u = {in_data + in_width * in_height + crop_x / 2, in_width / 2,
+                   crop_width / 2, in_height / 2,
+                   out_data + out_width * out_height, out_width / 2,
+                   out_width / 2, out_height / 2};
+  PlaneStripe v = u;
+  v.src = in_data + in_width * in_height * 5 / 4 + crop_x / 2;
+  v.dst = out_data + out_width * out_height * 5 / 4;
+
+  // Source rows become destination columns: rotating 90 degrees clockwise
+  // puts the first row in the last column, 270 in the first one.
+  std::vector<PlaneStripe> stripes;
+  size_t max_stripes = pool->GetConcurrency();
+  for (const PlaneStripe& plane : {y, u, v}) {
+    int count = std::min(static_cast<int>(max_stripes), plane.src_height);
+    for (int i = 0; i < count; ++i) {
+      int first = plane.src_height * i / count;
+      int last = plane.src_height * (i + 1) / count;
+      PlaneStripe stripe = plane;
+      stripe.src += first * plane.src_stride;
+      stripe.src_height = last - first;
+      stripe.dst += mode == libyuv::RotationMode::kRotate90
+                        ? plane.src_height - last
+                        : first;
+      stripes.push_back(stripe);
+    }
+  }
+  pool->Run(stripes.size(), [&stripes, mode](size_t i) {
+    const PlaneStripe& s = stripes[i];
+    libyuv::RotatePlane(s.src, s.src_stride, s.dst, s.dst_stride, s.src_width,
+                        s.src_height, mode);
+  });
+  return 0;
 }
 
 static int YU12ToYV12(const void* yu12, void* yv12, int width, int height,
@@ -319,9 +495,10 @@ static int YU12ToYV12(const void* yu12, void* yv12, int width, int height,
   const uint8_t* v_src = src + width * height * 5 / 4;
   uint8_t* v_dst = dst + dst_stride_y * height;
 
-  return libyuv::I420Copy(src, width, u_src, width / 2, v_src, width / 2, dst,
-                          dst_stride_y, u_dst, dst_stride_uv, v_dst,
-                          dst_stride_uv, width, height);
+  CopyPlane(src, width, dst, dst_stride_y, width, height);
+  CopyPlane(u_src, width / 2, u_dst, dst_stride_uv, width / 2, height / 2);
+  CopyPlane(v_src, width / 2, v_dst, dst_stride_uv, width / 2, height / 2);
+  return 0;
 }
 
 static int YU12ToNV21(const void* yu12, void* nv21, int width, int height) {
@@ -337,14 +514,9 @@ static int YU12ToNV21(const void* yu12, void* nv21, int width, int height) {
   const uint8_t* v_src = src + width * height * 5 / 4;
   uint8_t* vu_dst = dst + width * height;
 
-  memcpy(dst, src, width * height);
-
-  for (int i = 0; i < height / 2; i++) {
-    for (int j = 0; j < width / 2; j++) {
-      *vu_dst++ = *v_src++;
-      *vu_dst++ = *u_src++;
-    }
-  }
+  CopyPlane(src, width, dst, width, width, height);
+  MergeVUPlane(v_src, width / 2, u_src, width / 2, vu_dst, width, width / 2,
+               height / 2);
   return 0;
 }
 
@@ -382,10 +554,13 @@ static bool ConvertToJpeg(const CameraMetadata& metadata,
     LOGF(ERROR) << "Generating APP1 segment failed.";
     return false;
   }
+  // Compress straight into the output buffer.
   JpegCompressor compressor;
   if (!compressor.CompressImage(in_frame.GetData(), in_frame.GetWidth(),
                                 in_frame.GetHeight(), jpeg_quality,
-                                utils.GetApp1Buffer(), utils.GetApp1Length())) {
+                                utils.GetApp1Buffer(), utils.GetApp1Length(),
+                                out_frame->GetData(),
+                                out_frame->GetBufferSize())) {
     LOGF(ERROR) << "JPEG image compression failed";
     return false;
   }
@@ -393,8 +568,6 @@ static bool ConvertToJpeg(const CameraMetadata& metadata,
   if (out_frame->SetDataSize(buffer_length)) {
     return false;
   }
-  memcpy(out_frame->GetData(), compressor.GetCompressedImagePtr(),
-         buffer_length);
   return true;
 }
 
@@ -16,6 +16,11 @@
 
 namespace arc {
 
+class WorkerPool;
+
+// Filter used when scaling, from fastest to best looking.
+enum class ScaleFilter { kNone, kBilinear, kBox };
+
 // V4L2_PIX_FMT_YVU420(YV12) in ImageProcessor has alignment requirement.
 // The stride of Y, U, and V planes should a multiple of 16 pixels.
 struct ImageProcessor {
@@ -38,7 +43,22 @@ struct ImageProcessor {
   // V4L2_PIX_FMT_YUV420 format. Caller should fill |data|, |width|, |height|,
   // and |buffer_size| of |out_frame|. The function will fill |data_size| and
   // |fourcc| of |out_frame|.
-  static int Scale(const FrameBuffer& in_frame, FrameBuffer* out_frame);
+  // The planes are scaled in parallel on |pool|, or on the default pool if it
+  // is null. Downscales also split each plane in stripes of rows, where that
+  // gives exactly the same result.
+  static int Scale(const FrameBuffer& in_frame, FrameBuffer* out_frame,
+                   ScaleFilter filter = ScaleFilter::kNone,
+                   WorkerPool* pool = nullptr);
+
+  // Crop the V4L2_PIX_FMT_YUV420 |in_frame| to the |crop_width| columns
+  // starting at |crop_x|, and rotate the result |rotate_degree| (90 or 270)
+  // clockwise into |out_frame|, in parallel on |pool| like Scale(). Caller
+  // should fill |data| and |buffer_size| of |out_frame|. The function will
+  // fill |width|, |height|, |data_size| and |fourcc| of |out_frame|.
+  static int CropRotate(const FrameBuffer& in_frame, int crop_x,
+                        int crop_width, int rotate_degree,
+                        AllocatedFrameBuffer* out_frame,
+                        WorkerPool* pool = nullptr);
 };
 
 }  // namespace arc
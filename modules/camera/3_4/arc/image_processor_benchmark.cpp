@@ -0,0 +1,274 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+// Throughput of each ImageProcessor::ConvertFormat conversion at common
+// capture resolutions. Bytes are counted on the output side, so the reported
+// rate is the rate at which output buffers get filled. YU12 to JPEG is left
+// out, since its cost is dominated by libjpeg rather than these conversions.
+// Scaling and rotation are also measured for 1080p and 4K sources over a
+// growing number of threads, and MJPEG decoding for each decoder backend.
+
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <camera/CameraMetadata.h>
+
+#include "arc/frame_buffer.h"
+#include "arc/image_processor.h"
+#include "arc/jpeg_compressor.h"
+#include "arc/jpeg_decoder.h"
+#include "arc/worker_pool.h"
+#include "arc/yuv_kernels.h"
+
+namespace arc {
+
+namespace {
+
+// VGA, 720p, 1080p and 5MP.
+const int kResolutions[][2] = {
+    {640, 480}, {1280, 720}, {1920, 1080}, {2592, 1944}};
+
+void Resolutions(benchmark::internal::Benchmark* b) {
+  for (const auto& resolution : kResolutions) {
+    b->Args({resolution[0], resolution[1]});
+  }
+}
+
+size_t GetFrameSize(uint32_t fourcc, int width, int height) {
+  if (fourcc == V4L2_PIX_FMT_YUYV) {
+    return width * height * 2;
+  }
+  return ImageProcessor::GetConvertedSize(fourcc, width, height);
+}
+
+// Make a |width| x |height| frame of |fourcc| filled with a gradient.
+std::unique_ptr<AllocatedFrameBuffer> MakeFrame(uint32_t fourcc, int width,
+                                                int height) {
+  std::unique_ptr<AllocatedFrameBuffer> frame(
+      new AllocatedFrameBuffer(GetFrameSize(fourcc, width, height)));
+  frame->SetFourcc(fourcc);
+  frame->SetWidth(width);
+  frame->SetHeight(height);
+  frame->SetDataSize(frame->GetBufferSize());
+  for (size_t i = 0; i < frame->GetDataSize(); ++i) {
+    frame->GetData()[i] = static_cast<uint8_t>(i * 31 / 7);
+  }
+  return frame;
+}
+
+// Make an MJPEG frame by compressing a YU12 one.
+std::unique_ptr<AllocatedFrameBuffer> MakeMjpegFrame(int width, int height) {
+  std::unique_ptr<AllocatedFrameBuffer> yu12 =
+      MakeFrame(V4L2_PIX_FMT_YUV420, width, height);
+  JpegCompressor compressor;
+  if (!compressor.CompressImage(yu12->GetData(), width, height, 90, nullptr,
+                                0)) {
+    return nullptr;
+  }
+  std::unique_ptr<AllocatedFrameBuffer> frame(
+      new AllocatedFrameBuffer(compressor.GetCompressedImageSize()));
+  frame->SetFourcc(V4L2_PIX_FMT_MJPEG);
+  frame->SetWidth(width);
+  frame->SetHeight(height);
+  frame->SetDataSize(compressor.GetCompressedImageSize());
+  memcpy(frame->GetData(), compressor.GetCompressedImagePtr(),
+         compressor.GetCompressedImageSize());
+  return frame;
+}
+
+void BM_Convert(benchmark::State& state, uint32_t from_fourcc,
+                uint32_t to_fourcc) {
+  int width = state.range(0);
+  int height = state.range(1);
+  std::unique_ptr<AllocatedFrameBuffer> in_frame =
+      from_fourcc == V4L2_PIX_FMT_MJPEG
+          ? MakeMjpegFrame(width, height)
+          : MakeFrame(from_fourcc, width, height);
+  std::unique_ptr<AllocatedFrameBuffer> out_frame =
+      MakeFrame(to_fourcc, width, height);
+  if (!in_frame) {
+    state.SkipWithError("Failed to create input frame");
+    return;
+  }
+
+  android::CameraMetadata metadata;
+  while (state.KeepRunning()) {
+    if (ImageProcessor::ConvertFormat(metadata, *in_frame, out_frame.get())) {
+      state.SkipWithError("Conversion failed");
+      return;
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          out_frame->GetDataSize());
+  state.SetLabel(GetYuvKernelName());
+}
+
+// Scalar baseline for the NV21 chroma interleave, for comparison with the
+// SIMD version ConvertFormat uses.
+void BM_MergeVUPlaneC(benchmark::State& state) {
+  int width = state.range(0) / 2;
+  int height = state.range(1) / 2;
+  std::vector<uint8_t> v(width * height, 1);
+  std::vector<uint8_t> u(width * height, 2);
+  std::vector<uint8_t> vu(width * height * 2);
+  while (state.KeepRunning()) {
+    MergeVUPlaneC(v.data(), width, u.data(), width, vu.data(), width * 2,
+                  width, height);
+    benchmark::DoNotOptimize(vu.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          vu.size());
+}
+
+void BM_MergeVUPlane(benchmark::State& state) {
+  int width = state.range(0) / 2;
+  int height = state.range(1) / 2;
+  std::vector<uint8_t> v(width * height, 1);
+  std::vector<uint8_t> u(width * height, 2);
+  std::vector<uint8_t> vu(width * height * 2);
+  while (state.KeepRunning()) {
+    MergeVUPlane(v.data(), width, u.data(), width, vu.data(), width * 2,
+                 width, height);
+    benchmark::DoNotOptimize(vu.data());
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          vu.size());
+  state.SetLabel(GetYuvKernelName());
+}
+
+// 1080p and 4K sources, processed on 1 to 8 threads.
+void SourcesAndThreads(benchmark::internal::Benchmark* b) {
+  for (const auto& resolution : {std::make_pair(1920, 1080),
+                                 std::make_pair(3840, 2160)}) {
+    for (int threads = 1; threads <= 8; threads *= 2) {
+      b->Args({resolution.first, resolution.second, threads});
+    }
+  }
+}
+
+// Scale a frame down to half its width and height.
+void BM_Scale(benchmark::State& state, ScaleFilter filter) {
+  int width = state.range(0);
+  int height = state.range(1);
+  WorkerPool pool(state.range(2) - 1);
+  std::unique_ptr<AllocatedFrameBuffer> in_frame =
+      MakeFrame(V4L2_PIX_FMT_YUV420, width, height);
+  std::unique_ptr<AllocatedFrameBuffer> out_frame =
+      MakeFrame(V4L2_PIX_FMT_YUV420, width / 2, height / 2);
+
+  while (state.KeepRunning()) {
+    if (ImageProcessor::Scale(*in_frame, out_frame.get(), filter, &pool)) {
+      state.SkipWithError("Scaling failed");
+      return;
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          out_frame->GetDataSize());
+}
+
+// Crop a frame to a portrait frame as high as it is, and rotate it.
+void BM_CropRotate(benchmark::State& state) {
+  int width = state.range(0);
+  int height = state.range(1);
+  WorkerPool pool(state.range(2) - 1);
+  std::unique_ptr<AllocatedFrameBuffer> in_frame =
+      MakeFrame(V4L2_PIX_FMT_YUV420, width, height);
+  AllocatedFrameBuffer out_frame(0);
+  int crop_width = (height * height / width + 1) & ~1;
+
+  while (state.KeepRunning()) {
+    if (ImageProcessor::CropRotate(*in_frame, (width - crop_width) / 2,
+                                   crop_width, 90, &out_frame, &pool)) {
+      state.SkipWithError("Rotation failed");
+      return;
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          out_frame.GetDataSize());
+}
+
+// Decode an MJPEG frame with the given backend, down to |divisor| of its
+// size when the decoder can scale.
+template <typename Decoder>
+void BM_DecodeMjpeg(benchmark::State& state) {
+  int width = state.range(0);
+  int height = state.range(1);
+  int divisor = state.range(2);
+  std::unique_ptr<AllocatedFrameBuffer> in_frame =
+      MakeMjpegFrame(width, height);
+  if (!in_frame) {
+    state.SkipWithError("Failed to create input frame");
+    return;
+  }
+  Decoder decoder;
+  AllocatedFrameBuffer out_frame(0);
+  while (state.KeepRunning()) {
+    if (decoder.Decode(*in_frame, &out_frame, width / divisor,
+                       height / divisor)) {
+      state.SkipWithError("Decoding failed");
+      return;
+    }
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          out_frame.GetDataSize());
+  state.SetLabel(decoder.GetName());
+}
+
+// 1080p and 4K sources, decoded at full, half and quarter size.
+void SourcesAndDivisors(benchmark::internal::Benchmark* b) {
+  for (const auto& resolution : {std::make_pair(1920, 1080),
+                                 std::make_pair(3840, 2160)}) {
+    for (int divisor : {1, 2, 4}) {
+      b->Args({resolution.first, resolution.second, divisor});
+    }
+  }
+}
+
+}  // namespace
+
+BENCHMARK_CAPTURE(BM_Convert, YUYV_to_YU12, V4L2_PIX_FMT_YUYV,
+                  V4L2_PIX_FMT_YUV420)
+    ->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Convert, MJPEG_to_YU12, V4L2_PIX_FMT_MJPEG,
+                  V4L2_PIX_FMT_YUV420)
+    ->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Convert, YU12_to_YU12, V4L2_PIX_FMT_YUV420,
+                  V4L2_PIX_FMT_YUV420)
+    ->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Convert, YU12_to_YV12, V4L2_PIX_FMT_YUV420,
+                  V4L2_PIX_FMT_YVU420)
+    ->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Convert, YU12_to_NV21, V4L2_PIX_FMT_YUV420,
+                  V4L2_PIX_FMT_NV21)
+    ->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Convert, YU12_to_BGR32, V4L2_PIX_FMT_YUV420,
+                  V4L2_PIX_FMT_BGR32)
+    ->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Convert, YU12_to_RGB32, V4L2_PIX_FMT_YUV420,
+                  V4L2_PIX_FMT_RGB32)
+    ->Apply(Resolutions);
+BENCHMARK(BM_MergeVUPlaneC)->Apply(Resolutions);
+BENCHMARK(BM_MergeVUPlane)->Apply(Resolutions);
+BENCHMARK_CAPTURE(BM_Scale, None, ScaleFilter::kNone)
+    ->Apply(SourcesAndThreads)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Scale, Bilinear, ScaleFilter::kBilinear)
+    ->Apply(SourcesAndThreads)
+    ->UseRealTime();
+BENCHMARK_CAPTURE(BM_Scale, Box, ScaleFilter::kBox)
+    ->Apply(SourcesAndThreads)
+    ->UseRealTime();
+BENCHMARK(BM_CropRotate)->Apply(SourcesAndThreads)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_DecodeMjpeg, LibyuvJpegDecoder)
+    ->Apply(SourcesAndDivisors);
+BENCHMARK_TEMPLATE(BM_DecodeMjpeg, LibjpegJpegDecoder)
+    ->Apply(SourcesAndDivisors);
+
+}  // namespace arc
+
+BENCHMARK_MAIN();
@@ -0,0 +1,160 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "arc/image_processor.h"
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <random>
+
+#include <gtest/gtest.h>
+#include "arc/worker_pool.h"
+
+using testing::Test;
+
+namespace arc {
+
+class ImageProcessorTest : public Test {
+ protected:
+  ImageProcessorTest() : serial_(0), parallel_(3) {}
+
+  // A |width| x |height| YU12 frame of noise, so that a row or column read
+  // from the wrong place, or blended with the wrong neighbor, shows.
+  std::unique_ptr<AllocatedFrameBuffer> MakeFrame(int width, int height) {
+    size_t size =
+        ImageProcessor::GetConvertedSize(V4L2_PIX_FMT_YUV420, width, height);
+    std::unique_ptr<AllocatedFrameBuffer> frame(new AllocatedFrameBuffer(size));
+    frame->SetFourcc(V4L2_PIX_FMT_YUV420);
+    frame->SetWidth(width);
+    frame->SetHeight(height);
+    frame->SetDataSize(size);
+    std::mt19937 random(width * height);
+    for (size_t i = 0; i < size; ++i) {
+      frame->GetData()[i] = random();
+    }
+    return frame;
+  }
+
+  // An output frame of |width| x |height|, filled with a value no output
+  // should leave everywhere.
+  std::unique_ptr<AllocatedFrameBuffer> MakeOutput(int width, int height) {
+    size_t size =
+        ImageProcessor::GetConvertedSize(V4L2_PIX_FMT_YUV420, width, height);
+    std::unique_ptr<AllocatedFrameBuffer> frame(new AllocatedFrameBuffer(size));
+    frame->SetWidth(width);
+    frame->SetHeight(height);
+    memset(frame->GetData(), 0xcd, size);
+    return frame;
+  }
+
+  void ExpectSameFrame(const AllocatedFrameBuffer& expected,
+                       const AllocatedFrameBuffer& actual) {
+    ASSERT_EQ(expected.GetWidth(), actual.GetWidth());
+    ASSERT_EQ(expected.GetHeight(), actual.GetHeight());
+    ASSERT_EQ(expected.GetDataSize(), actual.GetDataSize());
+    size_t row_size = expected.GetWidth();
+    size_t y_size = row_size * expected.GetHeight();
+    for (size_t i = 0; i < expected.GetDataSize(); ++i) {
+      // Report the plane and row, which tells a seam between stripes apart
+      // from anything else.
+      size_t plane_offset = i < y_size ? i : (i - y_size) % (y_size / 4);
+      size_t plane_row_size = i < y_size ? row_size : row_size / 2;
+      ASSERT_EQ(expected.GetData()[i], actual.GetData()[i])
+          << "plane " << (i < y_size ? 0 : i < y_size * 5 / 4 ? 1 : 2)
+          << ", row " << plane_offset / plane_row_size << ", column "
+          << plane_offset % plane_row_size;
+    }
+  }
+
+  // Runs everything on the calling thread, so each plane is a single stripe.
+  WorkerPool serial_;
+  // Splits planes in up to 4 stripes.
+  WorkerPool parallel_;
+};
+
+TEST_F(ImageProcessorTest, StripedScaleMatchesSerial) {
+  // Input and output sizes, covering exact and inexact fixed point steps
+  // and the row ratios libyuv has dedicated scalers for. Chroma planes have
+  // half the rows, which leaves some with an odd number of units (the gcd
+  // of both heights) to split in stripes.
+  const int kSizes[][4] = {
+      {1920, 1080, 1280, 720},  // 3:2.
+      {1280, 720, 640, 360},    // 2:1.
+      {1920, 1080, 480, 270},   // 4:1, 135 chroma units.
+      {640, 480, 480, 360},     // 4:3.
+      {1024, 768, 384, 288},    // 8:3.
+      {1200, 600, 720, 360},    // 5:3.
+      {480, 270, 160, 90},      // 3:1, 45 chroma units.
+      {1440, 810, 480, 270},    // 3:1, 135 chroma units.
+      {640, 480, 176, 144},     // 10:3.
+      {1280, 720, 1280, 720},   // 1:1.
+      {640, 360, 1280, 720},    // 1:2.
+      {160, 90, 480, 270},      // 1:3, 45 chroma units.
+  };
+  for (ScaleFilter filter :
+       {ScaleFilter::kNone, ScaleFilter::kBilinear, ScaleFilter::kBox}) {
+    for (const auto& size : kSizes) {
+      SCOPED_TRACE(testing::Message()
+                   << "filter " << static_cast<int>(filter) << ", "
+                   << size[0] << "x" << size[1] << " to " << size[2] << "x"
+                   << size[3]);
+      std::unique_ptr<AllocatedFrameBuffer> in = MakeFrame(size[0], size[1]);
+      std::unique_ptr<AllocatedFrameBuffer> expected =
+          MakeOutput(size[2], size[3]);
+      std::unique_ptr<AllocatedFrameBuffer> actual =
+          MakeOutput(size[2], size[3]);
+      ASSERT_EQ(ImageProcessor::Scale(*in, expected.get(), filter, &serial_),
+                0);
+      ASSERT_EQ(ImageProcessor::Scale(*in, actual.get(), filter, &parallel_),
+                0);
+      ExpectSameFrame(*expected, *actual);
+    }
+  }
+}
+
+TEST_F(ImageProcessorTest, StripedCropRotateMatchesSerial) {
+  // Input size, and the columns to crop. 270 rows leave 135 chroma rows,
+  // which don't split evenly in stripes.
+  const int kCrops[][4] = {
+      {640, 480, 0, 640},
+      {640, 480, 160, 320},
+      {480, 270, 0, 480},
+      {480, 270, 66, 152},
+      {1280, 720, 438, 404},
+  };
+  for (int rotation : {90, 270}) {
+    for (const auto& crop : kCrops) {
+      SCOPED_TRACE(testing::Message()
+                   << "rotation " << rotation << ", " << crop[3]
+                   << " columns at " << crop[2] << " of " << crop[0] << "x"
+                   << crop[1]);
+      std::unique_ptr<AllocatedFrameBuffer> in = MakeFrame(crop[0], crop[1]);
+      std::unique_ptr<AllocatedFrameBuffer> expected =
+          MakeOutput(crop[1], crop[3]);
+      std::unique_ptr<AllocatedFrameBuffer> actual =
+          MakeOutput(crop[1], crop[3]);
+      ASSERT_EQ(ImageProcessor::CropRotate(*in, crop[2], crop[3], rotation,
+                                           expected.get(), &serial_),
+                0);
+      ASSERT_EQ(ImageProcessor::CropRotate(*in, crop[2], crop[3], rotation,
+                                           actual.get(), &parallel_),
+                0);
+      ExpectSameFrame(*expected, *actual);
+    }
+  }
+
+  // Only quarter turns that swap width and height are supported.
+  std::unique_ptr<AllocatedFrameBuffer> in = MakeFrame(640, 480);
+  std::unique_ptr<AllocatedFrameBuffer> out = MakeOutput(480, 640);
+  for (int rotation : {0, 180}) {
+    EXPECT_EQ(ImageProcessor::CropRotate(*in, 0, 640, rotation, out.get(),
+                                         &parallel_),
+              -EINVAL)
+        << "rotation " << rotation;
+  }
+}
+
+}  // namespace arc
@@ -19,7 +19,11 @@ struct destination_mgr {
   JpegCompressor* compressor;
 };
 
-JpegCompressor::JpegCompressor() {}
+JpegCompressor::JpegCompressor()
+    : output_buffer_(nullptr),
+      output_buffer_size_(0),
+      output_size_(0),
+      output_overflow_(false) {}
 
 JpegCompressor::~JpegCompressor() {}
 
@@ -32,6 +36,8 @@ bool JpegCompressor::CompressImage(const void* image, int width, int height,
   }
 
   result_buffer_.clear();
+  output_buffer_ = nullptr;
+  output_buffer_size_ = 0;
   if (!Encode(image, width, height, quality, app1Buffer, app1Size)) {
     return false;
   }
@@ -40,17 +46,56 @@ bool JpegCompressor::CompressImage(const void* image, int width, int height,
   return true;
 }
 
+bool JpegCompressor::CompressImage(const void* image, int width, int height,
+                                   int quality, const void* app1Buffer,
+                                   unsigned int app1Size, void* outBuffer,
+                                   size_t outBufferSize) {
+  if (width % 8 != 0 || height % 2 != 0) {
+    LOGF(ERROR) << "Image size can not be handled: " << width << "x" << height;
+    return false;
+  }
+
+  result_buffer_.clear();
+  output_buffer_ = static_cast<JOCTET*>(outBuffer);
+  output_buffer_size_ = outBufferSize;
+  output_size_ = 0;
+  output_overflow_ = false;
+  if (!Encode(image, width, height, quality, app1Buffer, app1Size)) {
+    return false;
+  }
+  if (output_overflow_) {
+    LOGF(ERROR) << "Compressed JPEG does not fit in " << outBufferSize
+                << " bytes";
+    return false;
+  }
+  LOGF(INFO) << "Compressed JPEG: " << (width * height * 12) / 8 << "[" << width
+             << "x" << height << "] -> " << output_size_ << " bytes";
+  return true;
+}
+
 const void* JpegCompressor::GetCompressedImagePtr() {
+  if (output_buffer_) {
+    return output_buffer_;
+  }
   return result_buffer_.data();
 }
 
 size_t JpegCompressor::GetCompressedImageSize() {
+  if (output_buffer_) {
+    return output_size_;
+  }
   return result_buffer_.size();
 }
 
 void JpegCompressor::InitDestination(j_compress_ptr cinfo) {
   destination_mgr* dest = reinterpret_cast<destination_mgr*>(cinfo->dest);
-  std::vector<JOCTET>& buffer = dest->compressor->result_buffer_;
+  JpegCompressor* compressor = dest->compressor;
+  if (compressor->output_buffer_) {
+    dest->mgr.next_output_byte = compressor->output_buffer_;
+    dest->mgr.free_in_buffer = compressor->output_buffer_size_;
+    return;
+  }
+  std::vector<JOCTET>& buffer = compressor->result_buffer_;
   buffer.resize(kBlockSize);
   dest->mgr.next_output_byte = &buffer[0];
   dest->mgr.free_in_buffer = buffer.size();
@@ -58,7 +103,17 @@ void JpegCompressor::InitDestination(j_compress_ptr cinfo) {
 
 boolean JpegCompressor::EmptyOutputBuffer(j_compress_ptr cinfo) {
   destination_mgr* dest = reinterpret_cast<destination_mgr*>(cinfo->dest);
-  std::vector<JOCTET>& buffer = dest->compressor->result_buffer_;
+  JpegCompressor* compressor = dest->compressor;
+  std::vector<JOCTET>& buffer = compressor->result_buffer_;
+  if (compressor->output_buffer_) {
+    // The caller's buffer is full. Let the encoder run to completion into a
+    // throwaway block so the failure can be reported cleanly afterwards.
+    compressor->output_overflow_ = true;
+    buffer.resize(kBlockSize);
+    dest->mgr.next_output_byte = &buffer[0];
+    dest->mgr.free_in_buffer = kBlockSize;
+    return true;
+  }
   size_t oldsize = buffer.size();
   buffer.resize(oldsize + kBlockSize);
   dest->mgr.next_output_byte = &buffer[oldsize];
@@ -68,7 +123,15 @@ boolean JpegCompressor::EmptyOutputBuffer(j_compress_ptr cinfo) {
 
 void JpegCompressor::TerminateDestination(j_compress_ptr cinfo) {
   destination_mgr* dest = reinterpret_cast<destination_mgr*>(cinfo->dest);
-  std::vector<JOCTET>& buffer = dest->compressor->result_buffer_;
+  JpegCompressor* compressor = dest->compressor;
+  if (compressor->output_buffer_) {
+    if (!compressor->output_overflow_) {
+      compressor->output_size_ =
+          compressor->output_buffer_size_ - dest->mgr.free_in_buffer;
+    }
+    return;
+  }
+  std::vector<JOCTET>& buffer = compressor->result_buffer_;
   buffer.resize(buffer.size() - dest->mgr.free_in_buffer);
 }
 
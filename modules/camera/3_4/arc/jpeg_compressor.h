@@ -33,6 +33,13 @@ class JpegCompressor {
   bool CompressImage(const void* image, int width, int height, int quality,
                      const void* app1Buffer, unsigned int app1Size);
 
+  // Same as above, but writes the JPEG straight into the caller owned
+  // |outBuffer| of |outBufferSize| bytes instead of an internal buffer.
+  // Returns false if the compressed image does not fit.
+  bool CompressImage(const void* image, int width, int height, int quality,
+                     const void* app1Buffer, unsigned int app1Size,
+                     void* outBuffer, size_t outBufferSize);
+
   // Returns the compressed JPEG buffer pointer. This method must be called only
   // after calling CompressImage().
   const void* GetCompressedImagePtr();
@@ -64,8 +71,17 @@ class JpegCompressor {
   // We must pass at least 16 scanlines according to libjpeg documentation.
   static const int kCompressBatchSize = 16;
 
-  // The buffer that holds the compressed result.
+  // The buffer that holds the compressed result. When compressing into a
+  // caller owned buffer, it only absorbs output past the end of that buffer.
   std::vector<JOCTET> result_buffer_;
+
+  // Caller owned output buffer, if any.
+  JOCTET* output_buffer_;
+  size_t output_buffer_size_;
+  // Bytes written to |output_buffer_|.
+  size_t output_size_;
+  // Whether the output did not fit in |output_buffer_|.
+  bool output_overflow_;
 };
 
 }  // namespace arc
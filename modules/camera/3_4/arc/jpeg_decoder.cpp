@@ -0,0 +1,226 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "arc/jpeg_decoder.h"
+
+#include <csetjmp>
+// We must include cstdio before jpeglib.h. It is a requirement of libjpeg.
+#include <cstdio>
+
+#include <camera/CameraMetadata.h>
+#include <jerror.h>
+#include <jpeglib.h>
+#include "arc/common.h"
+#include "arc/image_processor.h"
+#include "arc/v4l2_m2m_jpeg_decoder.h"
+
+namespace arc {
+
+namespace {
+
+// Turns libjpeg's fatal errors, which would otherwise exit the process, into
+// a jump back to the decoding function.
+struct ErrorManager {
+  jpeg_error_mgr mgr;
+  jmp_buf jump;
+};
+
+void OutputErrorMessage(j_common_ptr cinfo) {
+  char buffer[JMSG_LENGTH_MAX];
+  (*cinfo->err->format_message)(cinfo, buffer);
+  LOGF(ERROR) << buffer;
+}
+
+void ErrorExit(j_common_ptr cinfo) {
+  (*cinfo->err->output_message)(cinfo);
+  longjmp(reinterpret_cast<ErrorManager*>(cinfo->err)->jump, 1);
+}
+
+// Source manager reading from memory. jpeg_mem_src() is not in every
+// libjpeg version.
+void InitSource(j_decompress_ptr /*cinfo*/) {}
+
+boolean FillInputBuffer(j_decompress_ptr cinfo) {
+  // The whole frame was handed over at once: it is truncated. Insert a fake
+  // EOI marker, as libjpeg recommends, to salvage what was decoded.
+  static const JOCTET kEndOfImage[] = {0xFF, JPEG_EOI};
+  WARNMS(cinfo, JWRN_JPEG_EOF);
+  cinfo->src->next_input_byte = kEndOfImage;
+  cinfo->src->bytes_in_buffer = sizeof(kEndOfImage);
+  return TRUE;
+}
+
+void SkipInputData(j_decompress_ptr cinfo, long num_bytes) {
+  jpeg_source_mgr* src = cinfo->src;
+  if (num_bytes <= 0) {
+    return;
+  }
+  if (static_cast<size_t>(num_bytes) > src->bytes_in_buffer) {
+    FillInputBuffer(cinfo);
+    return;
+  }
+  src->next_input_byte += num_bytes;
+  src->bytes_in_buffer -= num_bytes;
+}
+
+void TermSource(j_decompress_ptr /*cinfo*/) {}
+
+}  // namespace
+
+std::unique_ptr<JpegDecoder> JpegDecoder::Create() {
+  std::unique_ptr<JpegDecoder> software;
+  if (LibjpegJpegDecoder::IsSupported()) {
+    software.reset(new LibjpegJpegDecoder());
+  } else {
+    software.reset(new LibyuvJpegDecoder());
+  }
+
+  std::unique_ptr<V4L2M2MJpegDecoder> hardware = V4L2M2MJpegDecoder::Probe();
+  if (hardware) {
+    // Hardware decoders can fail on streams the software ones cope with
+    // (e.g. unusual subsampling); keep the best of those to fall back on.
+    hardware->SetFallback(std::move(software));
+    return hardware;
+  }
+  return software;
+}
+
+int LibyuvJpegDecoder::Decode(const FrameBuffer& in_frame,
+                              AllocatedFrameBuffer* out_frame,
+                              uint32_t /*min_width*/,
+                              uint32_t /*min_height*/) {
+  out_frame->SetWidth(in_frame.GetWidth());
+  out_frame->SetHeight(in_frame.GetHeight());
+  out_frame->SetFourcc(V4L2_PIX_FMT_YUV420);
+  return ImageProcessor::ConvertFormat(android::CameraMetadata(), in_frame,
+                                       out_frame);
+}
+
+bool LibjpegJpegDecoder::IsSupported() {
+#if defined(LIBJPEG_TURBO_VERSION) || JPEG_LIB_VERSION >= 70
+  // Any scale in eighths.
+  return true;
+#else
+  return false;
+#endif
+}
+
+int LibjpegJpegDecoder::GetScaleNumerator(uint32_t width, uint32_t height,
+                                          uint32_t min_width,
+                                          uint32_t min_height) {
+  if (min_width == 0 || min_height == 0) {
+    return 8;
+  }
+  for (int num = 1; num < 8; ++num) {
+    // libjpeg rounds scaled sizes up; odd ones lose a row or column.
+    uint32_t scaled_width = ((width * num + 7) / 8) & ~1u;
+    uint32_t scaled_height = ((height * num + 7) / 8) & ~1u;
+    if (scaled_width >= min_width && scaled_height >= min_height) {
+      return num;
+    }
+  }
+  return 8;
+}
+
+int LibjpegJpegDecoder::Decode(const FrameBuffer& in_frame,
+                               AllocatedFrameBuffer* out_frame,
+                               uint32_t min_width, uint32_t min_height) {
+  int num = GetScaleNumerator(in_frame.GetWidth(), in_frame.GetHeight(),
+                              min_width, min_height);
+  if (num < 8) {
+    if (DecodeScaled(in_frame, out_frame, num, min_width, min_height) == 0) {
+      return 0;
+    }
+    LOGF(WARNING) << "Scaled decode failed, decoding at full size.";
+  }
+  return full_size_decoder_.Decode(in_frame, out_frame, min_width, min_height);
+}
+
+int LibjpegJpegDecoder::DecodeScaled(const FrameBuffer& in_frame,
+                                     AllocatedFrameBuffer* out_frame,
+                                     int scale_num, uint32_t min_width,
+                                     uint32_t min_height) {
+  jpeg_decompress_struct cinfo;
+  ErrorManager error;
+  cinfo.err = jpeg_std_error(&error.mgr);
+  error.mgr.output_message = &OutputErrorMessage;
+  error.mgr.error_exit = &ErrorExit;
+  if (setjmp(error.jump)) {
+    jpeg_destroy_decompress(&cinfo);
+    return -EINVAL;
+  }
+  jpeg_create_decompress(&cinfo);
+
+  jpeg_source_mgr source;
+  source.next_input_byte = in_frame.GetData();
+  source.bytes_in_buffer = in_frame.GetDataSize();
+  source.init_source = &InitSource;
+  source.fill_input_buffer = &FillInputBuffer;
+  source.skip_input_data = &SkipInputData;
+  source.resync_to_restart = &jpeg_resync_to_restart;
+  source.term_source = &TermSource;
+  cinfo.src = &source;
+
+  // UVC cameras leave out the Huffman tables; libjpeg-turbo fills in the
+  // standard ones.
+  jpeg_read_header(&cinfo, TRUE);
+  cinfo.out_color_space = JCS_YCbCr;
+  cinfo.scale_num = scale_num;
+  cinfo.scale_denom = 8;
+  cinfo.dct_method = JDCT_IFAST;
+  cinfo.do_fancy_upsampling = FALSE;
+  jpeg_calc_output_dimensions(&cinfo);
+
+  uint32_t width = cinfo.output_width & ~1u;
+  uint32_t height = cinfo.output_height & ~1u;
+  if (width < min_width || height < min_height ||
+      cinfo.output_components != 3) {
+    // The library rounded to a scale it supports that is too small.
+    jpeg_destroy_decompress(&cinfo);
+    return -EINVAL;
+  }
+  out_frame->SetWidth(width);
+  out_frame->SetHeight(height);
+  out_frame->SetFourcc(V4L2_PIX_FMT_YUV420);
+  if (out_frame->SetDataSize(ImageProcessor::GetConvertedSize(
+          V4L2_PIX_FMT_YUV420, width, height))) {
+    LOGF(ERROR) << "Set data size failed";
+    jpeg_destroy_decompress(&cinfo);
+    return -EINVAL;
+  }
+
+  jpeg_start_decompress(&cinfo);
+  scanline_.resize(cinfo.output_width * cinfo.output_components);
+  uint8_t* y_plane = out_frame->GetData();
+  uint8_t* u_plane = y_plane + width * height;
+  uint8_t* v_plane = u_plane + width * height / 4;
+  JSAMPROW row = scanline_.data();
+  while (cinfo.output_scanline < cinfo.output_height) {
+    uint32_t line = cinfo.output_scanline;
+    jpeg_read_scanlines(&cinfo, &row, 1);
+    if (line >= height) {
+      continue;
+    }
+    // Scanlines are interleaved YCbCr; chroma is taken from even pixels of
+    // even lines.
+    uint8_t* y = y_plane + line * width;
+    for (uint32_t x = 0; x < width; ++x) {
+      y[x] = row[x * 3];
+    }
+    if (line % 2 == 0) {
+      uint8_t* u = u_plane + line / 2 * width / 2;
+      uint8_t* v = v_plane + line / 2 * width / 2;
+      for (uint32_t x = 0; x < width / 2; ++x) {
+        u[x] = row[x * 6 + 1];
+        v[x] = row[x * 6 + 2];
+      }
+    }
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return 0;
+}
+
+}  // namespace arc
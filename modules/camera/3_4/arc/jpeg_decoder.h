@@ -0,0 +1,82 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef HAL_USB_JPEG_DECODER_H_
+#define HAL_USB_JPEG_DECODER_H_
+
+#include <memory>
+#include <vector>
+
+#include "arc/frame_buffer.h"
+
+namespace arc {
+
+// Decodes MJPEG frames from the camera into YU12. Not thread-safe.
+class JpegDecoder {
+ public:
+  virtual ~JpegDecoder() {}
+
+  // Pick the fastest decoder available on this device: a V4L2 mem-to-mem
+  // hardware decoder if there is one, else libjpeg-turbo (which can scale
+  // while decoding), else libyuv.
+  static std::unique_ptr<JpegDecoder> Create();
+
+  // Name of the backend, for logs and dumps.
+  virtual const char* GetName() const = 0;
+
+  // Called before the frames of a new stream are decoded, to drop any state
+  // kept about the previous one.
+  virtual void Reset() {}
+
+  // Decode the V4L2_PIX_FMT_MJPEG |in_frame| into |out_frame| as
+  // V4L2_PIX_FMT_YUV420. Decoders that can scale while decoding may make
+  // the output smaller than |in_frame|, but never less than |min_width| x
+  // |min_height|; others decode at full size. The function will fill
+  // |width|, |height|, |data_size| and |fourcc| of |out_frame|. Return
+  // non-zero error code on failure; return 0 on success.
+  virtual int Decode(const FrameBuffer& in_frame,
+                     AllocatedFrameBuffer* out_frame, uint32_t min_width,
+                     uint32_t min_height) = 0;
+};
+
+// Decodes at full size through libyuv::MJPGToI420.
+class LibyuvJpegDecoder : public JpegDecoder {
+ public:
+  const char* GetName() const override { return "libyuv"; }
+  int Decode(const FrameBuffer& in_frame, AllocatedFrameBuffer* out_frame,
+             uint32_t min_width, uint32_t min_height) override;
+};
+
+// Decodes through libjpeg(-turbo), scaling down by 1/8 to 7/8 in the DCT
+// when the minimum size allows, which is a lot cheaper than decoding at
+// full size and scaling afterwards. Falls back to libyuv at full size.
+class LibjpegJpegDecoder : public JpegDecoder {
+ public:
+  // Whether the libjpeg linked in supports scaled decoding.
+  static bool IsSupported();
+
+  const char* GetName() const override { return "libjpeg"; }
+  int Decode(const FrameBuffer& in_frame, AllocatedFrameBuffer* out_frame,
+             uint32_t min_width, uint32_t min_height) override;
+
+  // Smallest scale, in eighths, at which a |width| x |height| image is at
+  // least |min_width| x |min_height|. Exposed for tests.
+  static int GetScaleNumerator(uint32_t width, uint32_t height,
+                               uint32_t min_width, uint32_t min_height);
+
+ private:
+  // Decode at |scale_num| / 8 of the full size. Fails if that comes out
+  // smaller than |min_width| x |min_height| once rounded to even.
+  int DecodeScaled(const FrameBuffer& in_frame, AllocatedFrameBuffer* out_frame,
+                   int scale_num, uint32_t min_width, uint32_t min_height);
+
+  LibyuvJpegDecoder full_size_decoder_;
+  // One decoded scanline, reused across frames.
+  std::vector<uint8_t> scanline_;
+};
+
+}  // namespace arc
+
+#endif  // HAL_USB_JPEG_DECODER_H_
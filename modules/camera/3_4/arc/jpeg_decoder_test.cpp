@@ -0,0 +1,117 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "arc/jpeg_decoder.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include <gtest/gtest.h>
+#include "arc/image_processor.h"
+#include "arc/jpeg_compressor.h"
+
+using testing::Test;
+
+namespace arc {
+
+class JpegDecoderTest : public Test {
+ protected:
+  // Compress a flat |width| x |height| YU12 frame of the given color.
+  void MakeMjpegFrame(int width, int height, uint8_t y, uint8_t u,
+                      uint8_t v) {
+    size_t size =
+        ImageProcessor::GetConvertedSize(V4L2_PIX_FMT_YUV420, width, height);
+    std::unique_ptr<uint8_t[]> yu12(new uint8_t[size]);
+    memset(yu12.get(), y, width * height);
+    memset(yu12.get() + width * height, u, width * height / 4);
+    memset(yu12.get() + width * height * 5 / 4, v, width * height / 4);
+
+    JpegCompressor compressor;
+    ASSERT_TRUE(compressor.CompressImage(yu12.get(), width, height, 95,
+                                         nullptr, 0));
+    mjpeg_.reset(new AllocatedFrameBuffer(compressor.GetCompressedImageSize()));
+    mjpeg_->SetFourcc(V4L2_PIX_FMT_MJPEG);
+    mjpeg_->SetWidth(width);
+    mjpeg_->SetHeight(height);
+    mjpeg_->SetDataSize(compressor.GetCompressedImageSize());
+    memcpy(mjpeg_->GetData(), compressor.GetCompressedImagePtr(),
+           compressor.GetCompressedImageSize());
+  }
+
+  // Check every pixel of |frame| is close to the given color. JPEG is lossy,
+  // more so at the edges of scaled images.
+  void ExpectColor(const AllocatedFrameBuffer& frame, uint8_t y, uint8_t u,
+                   uint8_t v) {
+    size_t y_size = frame.GetWidth() * frame.GetHeight();
+    const uint8_t* data = frame.GetData();
+    for (size_t i = 0; i < y_size; ++i) {
+      ASSERT_LE(std::abs(data[i] - y), 4) << "Y at " << i;
+    }
+    for (size_t i = 0; i < y_size / 4; ++i) {
+      ASSERT_LE(std::abs(data[y_size + i] - u), 4) << "U at " << i;
+      ASSERT_LE(std::abs(data[y_size * 5 / 4 + i] - v), 4) << "V at " << i;
+    }
+  }
+
+  std::unique_ptr<AllocatedFrameBuffer> mjpeg_;
+};
+
+TEST_F(JpegDecoderTest, ScaleNumerator) {
+  // No minimum: full size.
+  EXPECT_EQ(LibjpegJpegDecoder::GetScaleNumerator(1920, 1080, 0, 0), 8);
+  // Exact fractions.
+  EXPECT_EQ(LibjpegJpegDecoder::GetScaleNumerator(1920, 1080, 960, 540), 4);
+  EXPECT_EQ(LibjpegJpegDecoder::GetScaleNumerator(3840, 2160, 1920, 1080), 4);
+  EXPECT_EQ(LibjpegJpegDecoder::GetScaleNumerator(1920, 1080, 240, 134), 1);
+  // Scaled sizes are rounded down to even.
+  EXPECT_EQ(LibjpegJpegDecoder::GetScaleNumerator(1920, 1080, 240, 135), 2);
+  // Just over a fraction needs the next one.
+  EXPECT_EQ(LibjpegJpegDecoder::GetScaleNumerator(1920, 1080, 962, 540), 5);
+  // The larger requirement wins.
+  EXPECT_EQ(LibjpegJpegDecoder::GetScaleNumerator(1920, 1080, 240, 1080), 8);
+  // Larger than the source.
+  EXPECT_EQ(LibjpegJpegDecoder::GetScaleNumerator(640, 480, 1280, 720), 8);
+}
+
+TEST_F(JpegDecoderTest, ScaledDecode) {
+  if (!LibjpegJpegDecoder::IsSupported()) {
+    return;
+  }
+  MakeMjpegFrame(640, 480, 100, 60, 200);
+  LibjpegJpegDecoder decoder;
+  AllocatedFrameBuffer out(0);
+  ASSERT_EQ(decoder.Decode(*mjpeg_, &out, 320, 240), 0);
+  EXPECT_EQ(out.GetWidth(), 320u);
+  EXPECT_EQ(out.GetHeight(), 240u);
+  EXPECT_EQ(out.GetFourcc(), static_cast<uint32_t>(V4L2_PIX_FMT_YUV420));
+  EXPECT_EQ(out.GetDataSize(), 320u * 240 * 3 / 2);
+  ExpectColor(out, 100, 60, 200);
+}
+
+TEST_F(JpegDecoderTest, ScaledDecodeRoundsToEven) {
+  if (!LibjpegJpegDecoder::IsSupported()) {
+    return;
+  }
+  // 5/8 of 200x128 is 125x80, rounded down to even.
+  MakeMjpegFrame(200, 128, 128, 128, 128);
+  LibjpegJpegDecoder decoder;
+  AllocatedFrameBuffer out(0);
+  ASSERT_EQ(decoder.Decode(*mjpeg_, &out, 120, 76), 0);
+  EXPECT_EQ(out.GetWidth(), 124u);
+  EXPECT_EQ(out.GetHeight(), 80u);
+  ExpectColor(out, 128, 128, 128);
+}
+
+TEST_F(JpegDecoderTest, CorruptFrame) {
+  MakeMjpegFrame(64, 64, 0, 0, 0);
+  // Keep the SOI marker, garble the headers.
+  memset(mjpeg_->GetData() + 2, 0xA5, mjpeg_->GetDataSize() - 2);
+  LibjpegJpegDecoder decoder;
+  AllocatedFrameBuffer out(0);
+  EXPECT_NE(decoder.Decode(*mjpeg_, &out, 32, 32), 0);
+}
+
+}  // namespace arc
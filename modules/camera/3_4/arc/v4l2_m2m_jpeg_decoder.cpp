@@ -0,0 +1,366 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "arc/v4l2_m2m_jpeg_decoder.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "arc/common.h"
+#include "arc/image_processor.h"
+
+namespace arc {
+
+namespace {
+
+// A decode that takes longer than this is treated as a hung device.
+const int kDecodeTimeoutMs = 1000;
+// Frames in a row the device may fail before it is given up on for the
+// stream. Each failure costs a reconfiguration, or kDecodeTimeoutMs.
+const int kMaxFailures = 3;
+
+int Ioctl(int fd, unsigned long request, void* arg) {
+  return TEMP_FAILURE_RETRY(ioctl(fd, request, arg));
+}
+
+// Whether |fd| lists |fourcc| among the formats of buffers of |type|.
+bool SupportsFormat(int fd, v4l2_buf_type type, uint32_t fourcc) {
+  v4l2_fmtdesc desc;
+  memset(&desc, 0, sizeof(desc));
+  desc.type = type;
+  while (Ioctl(fd, VIDIOC_ENUM_FMT, &desc) == 0) {
+    if (desc.pixelformat == fourcc) {
+      return true;
+    }
+    ++desc.index;
+  }
+  return false;
+}
+
+}  // namespace
+
+std::unique_ptr<V4L2M2MJpegDecoder> V4L2M2MJpegDecoder::Probe() {
+  DIR* dir = opendir("/dev");
+  if (dir == nullptr) {
+    return nullptr;
+  }
+  std::vector<std::string> nodes;
+  dirent* ent;
+  while ((ent = readdir(dir))) {
+    if (strncmp(ent->d_name, "video", 5) == 0) {
+      nodes.push_back(std::string("/dev/") + ent->d_name);
+    }
+  }
+  closedir(dir);
+
+  for (const auto& node : nodes) {
+    base::ScopedFD fd(TEMP_FAILURE_RETRY(
+        open(node.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC)));
+    if (!fd.is_valid()) {
+      continue;
+    }
+    v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (Ioctl(fd.get(), VIDIOC_QUERYCAP, &cap)) {
+      continue;
+    }
+    uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS)
+                        ? cap.device_caps
+                        : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_M2M) || !(caps & V4L2_CAP_STREAMING)) {
+      continue;
+    }
+    if (!SupportsFormat(fd.get(), V4L2_BUF_TYPE_VIDEO_CAPTURE,
+                        V4L2_PIX_FMT_YUV420)) {
+      continue;
+    }
+    for (uint32_t fourcc : {V4L2_PIX_FMT_JPEG, V4L2_PIX_FMT_MJPEG}) {
+      if (SupportsFormat(fd.get(), V4L2_BUF_TYPE_VIDEO_OUTPUT, fourcc)) {
+        LOGF(INFO) << "Using JPEG decoder " << cap.card << " at " << node;
+        return std::unique_ptr<V4L2M2MJpegDecoder>(
+            new V4L2M2MJpegDecoder(std::move(fd), node, fourcc));
+      }
+    }
+  }
+  return nullptr;
+}
+
+V4L2M2MJpegDecoder::V4L2M2MJpegDecoder(base::ScopedFD fd,
+                                       const std::string& path,
+                                       uint32_t in_fourcc)
+    : fd_(std::move(fd)),
+      path_(path),
+      in_fourcc_(in_fourcc),
+      width_(0),
+      height_(0),
+      in_addr_(MAP_FAILED),
+      in_length_(0),
+      out_addr_(MAP_FAILED),
+      out_length_(0),
+      out_stride_(0),
+      failures_(0) {}
+
+V4L2M2MJpegDecoder::~V4L2M2MJpegDecoder() { Teardown(); }
+
+void V4L2M2MJpegDecoder::SetFallback(std::unique_ptr<JpegDecoder> fallback) {
+  fallback_ = std::move(fallback);
+}
+
+void V4L2M2MJpegDecoder::Reset() {
+  failures_ = 0;
+  if (fallback_) {
+    fallback_->Reset();
+  }
+}
+
+int V4L2M2MJpegDecoder::Decode(const FrameBuffer& in_frame,
+                               AllocatedFrameBuffer* out_frame,
+                               uint32_t min_width, uint32_t min_height) {
+  if (fallback_ && failures_ >= kMaxFailures) {
+    return fallback_->Decode(in_frame, out_frame, min_width, min_height);
+  }
+  int res = DecodeOnDevice(in_frame, out_frame);
+  if (res == 0) {
+    failures_ = 0;
+    return 0;
+  }
+  // Get the buffers back and start from scratch with the next frame.
+  Teardown();
+  if (fallback_) {
+    if (++failures_ >= kMaxFailures) {
+      LOGF(WARNING) << path_ << " failed to decode " << failures_
+                    << " frames in a row (" << res << "), using "
+                    << fallback_->GetName() << " for the rest of the stream";
+    } else {
+      LOGF(WARNING) << path_ << " failed to decode (" << res
+                    << "), falling back to " << fallback_->GetName();
+    }
+    return fallback_->Decode(in_frame, out_frame, min_width, min_height);
+  }
+  return res;
+}
+
+int V4L2M2MJpegDecoder::DecodeOnDevice(const FrameBuffer& in_frame,
+                                       AllocatedFrameBuffer* out_frame) {
+  if (in_frame.GetWidth() != width_ || in_frame.GetHeight() != height_) {
+    int res = Configure(in_frame.GetWidth(), in_frame.GetHeight());
+    if (res) {
+      return res;
+    }
+  }
+  if (in_frame.GetDataSize() > in_length_) {
+    LOGF(ERROR) << "Frame of " << in_frame.GetDataSize()
+                << " bytes does not fit the " << in_length_
+                << " byte input buffer";
+    return -ENOSPC;
+  }
+
+  memcpy(in_addr_, in_frame.GetData(), in_frame.GetDataSize());
+  v4l2_buffer in_buffer;
+  memset(&in_buffer, 0, sizeof(in_buffer));
+  in_buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+  in_buffer.memory = V4L2_MEMORY_MMAP;
+  in_buffer.index = 0;
+  in_buffer.bytesused = in_frame.GetDataSize();
+  v4l2_buffer out_buffer;
+  memset(&out_buffer, 0, sizeof(out_buffer));
+  out_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  out_buffer.memory = V4L2_MEMORY_MMAP;
+  out_buffer.index = 0;
+  if (Ioctl(fd_.get(), VIDIOC_QBUF, &out_buffer) ||
+      Ioctl(fd_.get(), VIDIOC_QBUF, &in_buffer)) {
+    int res = -errno;
+    LOGF(ERROR) << "VIDIOC_QBUF failed: " << strerror(-res);
+    return res;
+  }
+
+  // Both buffers have to come back before the next frame can use them.
+  int res = WaitForBuffer(POLLIN);
+  if (res == 0 && Ioctl(fd_.get(), VIDIOC_DQBUF, &out_buffer)) {
+    res = -errno;
+  }
+  int in_res = WaitForBuffer(POLLOUT);
+  if (in_res == 0 && Ioctl(fd_.get(), VIDIOC_DQBUF, &in_buffer)) {
+    in_res = -errno;
+  }
+  if (res || in_res) {
+    LOGF(ERROR) << "Failed to get buffers back from " << path_;
+    return res ? res : in_res;
+  }
+  if (out_buffer.flags & V4L2_BUF_FLAG_ERROR) {
+    LOGF(ERROR) << "Corrupt frame";
+    return -EINVAL;
+  }
+
+  out_frame->SetWidth(width_);
+  out_frame->SetHeight(height_);
+  out_frame->SetFourcc(V4L2_PIX_FMT_YUV420);
+  if (out_frame->SetDataSize(ImageProcessor::GetConvertedSize(
+          V4L2_PIX_FMT_YUV420, width_, height_))) {
+    LOGF(ERROR) << "Set data size failed";
+    return -EINVAL;
+  }
+  // Planes are packed in the device buffer, each with its own padding.
+  const uint8_t* src = static_cast<const uint8_t*>(out_addr_);
+  uint8_t* dst = out_frame->GetData();
+  for (int plane = 0; plane < 3; ++plane) {
+    uint32_t width = plane ? width_ / 2 : width_;
+    uint32_t height = plane ? height_ / 2 : height_;
+    uint32_t stride = plane ? out_stride_ / 2 : out_stride_;
+    for (uint32_t row = 0; row < height; ++row) {
+      memcpy(dst, src, width);
+      dst += width;
+      src += stride;
+    }
+  }
+  return 0;
+}
+
+int V4L2M2MJpegDecoder::Configure(uint32_t width, uint32_t height) {
+  Teardown();
+
+  v4l2_format format;
+  memset(&format, 0, sizeof(format));
+  format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+  format.fmt.pix.width = width;
+  format.fmt.pix.height = height;
+  format.fmt.pix.pixelformat = in_fourcc_;
+  // A compressed frame is smaller than a raw YUYV one.
+  format.fmt.pix.sizeimage = width * height * 2;
+  if (Ioctl(fd_.get(), VIDIOC_S_FMT, &format)) {
+    int res = -errno;
+    LOGF(ERROR) << "Failed to set input format: " << strerror(-res);
+    return res;
+  }
+
+  memset(&format, 0, sizeof(format));
+  format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  format.fmt.pix.width = width;
+  format.fmt.pix.height = height;
+  format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;
+  if (Ioctl(fd_.get(), VIDIOC_S_FMT, &format)) {
+    int res = -errno;
+    LOGF(ERROR) << "Failed to set output format: " << strerror(-res);
+    return res;
+  }
+  if (format.fmt.pix.width != width || format.fmt.pix.height != height ||
+      format.fmt.pix.pixelformat != V4L2_PIX_FMT_YUV420 ||
+      format.fmt.pix.bytesperline < width ||
+      format.fmt.pix.sizeimage <
+          format.fmt.pix.bytesperline * height * 3 / 2) {
+    LOGF(ERROR) << "Device can't decode " << width << "x" << height
+                << " to YU12";
+    return -EINVAL;
+  }
+  out_stride_ = format.fmt.pix.bytesperline;
+
+  for (v4l2_buf_type type :
+       {V4L2_BUF_TYPE_VIDEO_OUTPUT, V4L2_BUF_TYPE_VIDEO_CAPTURE}) {
+    v4l2_requestbuffers request;
+    memset(&request, 0, sizeof(request));
+    request.type = type;
+    request.memory = V4L2_MEMORY_MMAP;
+    request.count = 1;
+    if (Ioctl(fd_.get(), VIDIOC_REQBUFS, &request) || request.count < 1) {
+      LOGF(ERROR) << "Failed to allocate buffers: " << strerror(errno);
+      Teardown();
+      return -ENOMEM;
+    }
+
+    v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = type;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = 0;
+    if (Ioctl(fd_.get(), VIDIOC_QUERYBUF, &buffer)) {
+      int res = -errno;
+      LOGF(ERROR) << "VIDIOC_QUERYBUF failed: " << strerror(-res);
+      Teardown();
+      return res;
+    }
+    void* addr = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd_.get(), buffer.m.offset);
+    if (addr == MAP_FAILED) {
+      LOGF(ERROR) << "mmap failed: " << strerror(errno);
+      Teardown();
+      return -ENOMEM;
+    }
+    if (type == V4L2_BUF_TYPE_VIDEO_OUTPUT) {
+      in_addr_ = addr;
+      in_length_ = buffer.length;
+    } else {
+      out_addr_ = addr;
+      out_length_ = buffer.length;
+    }
+  }
+
+  for (int type : {V4L2_BUF_TYPE_VIDEO_OUTPUT, V4L2_BUF_TYPE_VIDEO_CAPTURE}) {
+    if (Ioctl(fd_.get(), VIDIOC_STREAMON, &type)) {
+      int res = -errno;
+      LOGF(ERROR) << "VIDIOC_STREAMON failed: " << strerror(-res);
+      Teardown();
+      return res;
+    }
+  }
+  width_ = width;
+  height_ = height;
+  return 0;
+}
+
+void V4L2M2MJpegDecoder::Teardown() {
+  for (int type : {V4L2_BUF_TYPE_VIDEO_OUTPUT, V4L2_BUF_TYPE_VIDEO_CAPTURE}) {
+    Ioctl(fd_.get(), VIDIOC_STREAMOFF, &type);
+  }
+  if (in_addr_ != MAP_FAILED) {
+    munmap(in_addr_, in_length_);
+    in_addr_ = MAP_FAILED;
+  }
+  if (out_addr_ != MAP_FAILED) {
+    munmap(out_addr_, out_length_);
+    out_addr_ = MAP_FAILED;
+  }
+  in_length_ = 0;
+  out_length_ = 0;
+  for (v4l2_buf_type type :
+       {V4L2_BUF_TYPE_VIDEO_OUTPUT, V4L2_BUF_TYPE_VIDEO_CAPTURE}) {
+    v4l2_requestbuffers request;
+    memset(&request, 0, sizeof(request));
+    request.type = type;
+    request.memory = V4L2_MEMORY_MMAP;
+    request.count = 0;
+    Ioctl(fd_.get(), VIDIOC_REQBUFS, &request);
+  }
+  width_ = 0;
+  height_ = 0;
+}
+
+int V4L2M2MJpegDecoder::WaitForBuffer(short events) {
+  pollfd fds = {fd_.get(), events, 0};
+  int res = TEMP_FAILURE_RETRY(poll(&fds, 1, kDecodeTimeoutMs));
+  if (res < 0) {
+    res = -errno;
+    LOGF(ERROR) << "poll failed: " << strerror(-res);
+    return res;
+  }
+  if (res == 0) {
+    LOGF(ERROR) << "Timed out waiting for " << path_;
+    return -ETIMEDOUT;
+  }
+  if (fds.revents & POLLERR) {
+    return -EIO;
+  }
+  return 0;
+}
+
+}  // namespace arc
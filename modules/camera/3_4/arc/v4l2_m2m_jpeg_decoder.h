@@ -0,0 +1,72 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef HAL_USB_V4L2_M2M_JPEG_DECODER_H_
+#define HAL_USB_V4L2_M2M_JPEG_DECODER_H_
+
+#include <memory>
+#include <string>
+
+#include <base/files/scoped_file.h>
+#include "arc/jpeg_decoder.h"
+
+namespace arc {
+
+// Decodes on a V4L2 mem-to-mem JPEG decoder (single-planar API), e.g. the
+// hardware JPEG block of the SoC. Frames are copied in and out of a single
+// pair of MMAP buffers, which are set up again when the frame size changes.
+// Always decodes at full size. After a few frames in a row fail, the rest of
+// the stream goes to the fallback decoder.
+class V4L2M2MJpegDecoder : public JpegDecoder {
+ public:
+  // Find a device decoding JPEG to YU12 among the /dev/video* nodes. Returns
+  // null if there is none.
+  static std::unique_ptr<V4L2M2MJpegDecoder> Probe();
+  ~V4L2M2MJpegDecoder() override;
+
+  // Decoder to use for frames the device fails on.
+  void SetFallback(std::unique_ptr<JpegDecoder> fallback);
+
+  const char* GetName() const override { return "v4l2-m2m"; }
+  void Reset() override;
+  int Decode(const FrameBuffer& in_frame, AllocatedFrameBuffer* out_frame,
+             uint32_t min_width, uint32_t min_height) override;
+
+ private:
+  V4L2M2MJpegDecoder(base::ScopedFD fd, const std::string& path,
+                     uint32_t in_fourcc);
+
+  int DecodeOnDevice(const FrameBuffer& in_frame,
+                     AllocatedFrameBuffer* out_frame);
+  // Set up formats and buffers for |width| x |height| frames.
+  int Configure(uint32_t width, uint32_t height);
+  // Stop streaming and free the buffers.
+  void Teardown();
+  // Wait for the device to have a buffer of |events| to dequeue.
+  int WaitForBuffer(short events);
+
+  base::ScopedFD fd_;
+  const std::string path_;
+  // V4L2_PIX_FMT_JPEG or V4L2_PIX_FMT_MJPEG, whichever the device takes.
+  const uint32_t in_fourcc_;
+
+  // Current configuration; zero sized when not configured.
+  uint32_t width_;
+  uint32_t height_;
+  void* in_addr_;
+  size_t in_length_;
+  void* out_addr_;
+  size_t out_length_;
+  uint32_t out_stride_;
+
+  std::unique_ptr<JpegDecoder> fallback_;
+  // Frames in a row the device failed to decode. Past kMaxFailures, frames
+  // go straight to |fallback_| until Reset().
+  int failures_;
+};
+
+}  // namespace arc
+
+#endif  // HAL_USB_V4L2_M2M_JPEG_DECODER_H_
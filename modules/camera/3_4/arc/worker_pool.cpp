@@ -0,0 +1,96 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "arc/worker_pool.h"
+
+#include <algorithm>
+
+namespace arc {
+
+// Frames are split in at most this many stripes by the default pool. More
+// threads than this mostly contend for memory bandwidth.
+static const size_t kMaxDefaultConcurrency = 4;
+
+WorkerPool::WorkerPool(size_t num_threads) : exiting_(false) {
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&WorkerPool::ThreadLoop, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    exiting_ = true;
+    work_cond_.notify_all();
+  }
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+WorkerPool* WorkerPool::GetDefault() {
+  static WorkerPool* pool = [] {
+    size_t cpus = std::max(std::thread::hardware_concurrency(), 1u);
+    return new WorkerPool(std::min<size_t>(cpus, kMaxDefaultConcurrency) - 1);
+  }();
+  return pool;
+}
+
+void WorkerPool::Run(size_t count, const std::function<void(size_t)>& task) {
+  if (count == 0) {
+    return;
+  }
+  if (count == 1 || threads_.empty()) {
+    for (size_t i = 0; i < count; ++i) {
+      task(i);
+    }
+    return;
+  }
+
+  Job job = {&task, count, 0, 0};
+  std::unique_lock<std::mutex> lock(lock_);
+  jobs_.push_back(&job);
+  work_cond_.notify_all();
+  while (job.next < job.count) {
+    size_t index = TakeIndex(&job);
+    lock.unlock();
+    task(index);
+    lock.lock();
+    ++job.done;
+  }
+  while (job.done < job.count) {
+    done_cond_.wait(lock);
+  }
+}
+
+size_t WorkerPool::TakeIndex(Job* job) {
+  size_t index = job->next++;
+  if (job->next == job->count) {
+    jobs_.erase(std::find(jobs_.begin(), jobs_.end(), job));
+  }
+  return index;
+}
+
+void WorkerPool::ThreadLoop() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (true) {
+    while (jobs_.empty() && !exiting_) {
+      work_cond_.wait(lock);
+    }
+    if (exiting_) {
+      return;
+    }
+    Job* job = jobs_.front();
+    size_t index = TakeIndex(job);
+    lock.unlock();
+    (*job->task)(index);
+    lock.lock();
+    if (++job->done == job->count) {
+      done_cond_.notify_all();
+    }
+  }
+}
+
+}  // namespace arc
@@ -0,0 +1,64 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef HAL_USB_WORKER_POOL_H_
+#define HAL_USB_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace arc {
+
+// A fixed set of threads to split image processing over, e.g. one stripe of
+// rows per task. Callers work on their own tasks too, so a pool with no
+// threads runs everything on the calling thread.
+class WorkerPool {
+ public:
+  explicit WorkerPool(size_t num_threads);
+  ~WorkerPool();
+
+  // Run |task| with every index in [0, |count|), and return once all are
+  // done. Thread-safe; tasks of concurrent calls share the threads.
+  void Run(size_t count, const std::function<void(size_t)>& task);
+
+  // Threads tasks may run on, counting the caller's.
+  size_t GetConcurrency() const { return threads_.size() + 1; }
+
+  // Pool shared by the HAL's frame processing, sized to the CPU.
+  static WorkerPool* GetDefault();
+
+ private:
+  struct Job {
+    const std::function<void(size_t)>* task;
+    size_t count;
+    // Next index to hand out, and indices done.
+    size_t next;
+    size_t done;
+  };
+
+  void ThreadLoop();
+  // Take the next index of |job|, dropping it from |jobs_| once every index
+  // has been handed out. Called with |lock_|.
+  size_t TakeIndex(Job* job);
+
+  std::mutex lock_;
+  std::condition_variable work_cond_;
+  std::condition_variable done_cond_;
+  // Jobs with indices left to hand out, oldest first.
+  std::deque<Job*> jobs_;
+  bool exiting_;
+  std::vector<std::thread> threads_;
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+};
+
+}  // namespace arc
+
+#endif  // HAL_USB_WORKER_POOL_H_
@@ -0,0 +1,58 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "arc/worker_pool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace arc {
+
+TEST(WorkerPoolTest, RunsEveryTask) {
+  for (size_t threads : {0, 1, 3}) {
+    WorkerPool pool(threads);
+    EXPECT_EQ(pool.GetConcurrency(), threads + 1);
+    for (size_t count : {0, 1, 2, 7, 64}) {
+      std::vector<std::atomic<int>> runs(count);
+      pool.Run(count, [&runs](size_t i) { ++runs[i]; });
+      for (size_t i = 0; i < count; ++i) {
+        EXPECT_EQ(runs[i].load(), 1) << threads << " threads, task " << i;
+      }
+    }
+  }
+}
+
+TEST(WorkerPoolTest, ConcurrentCallers) {
+  WorkerPool pool(2);
+  std::atomic<int> total(0);
+  std::vector<std::thread> callers;
+  for (int i = 0; i < 4; ++i) {
+    callers.emplace_back([&pool, &total] {
+      for (int j = 0; j < 50; ++j) {
+        std::atomic<int> runs(0);
+        pool.Run(5, [&runs](size_t) { ++runs; });
+        // Run() only returns once all of its own tasks are done.
+        EXPECT_EQ(runs.load(), 5);
+        total += runs;
+      }
+    });
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+  EXPECT_EQ(total.load(), 4 * 50 * 5);
+}
+
+TEST(WorkerPoolTest, Default) {
+  WorkerPool* pool = WorkerPool::GetDefault();
+  ASSERT_NE(pool, nullptr);
+  EXPECT_EQ(pool, WorkerPool::GetDefault());
+  EXPECT_GE(pool->GetConcurrency(), 1u);
+}
+
+}  // namespace arc
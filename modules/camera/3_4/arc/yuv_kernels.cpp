@@ -0,0 +1,159 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "arc/yuv_kernels.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ARC_YUV_X86 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ARC_YUV_NEON 1
+#endif
+
+namespace arc {
+
+namespace {
+
+typedef void (*MergeVURowFunc)(const uint8_t* src_v, const uint8_t* src_u,
+                               uint8_t* dst_vu, int width);
+
+void MergeVURowC(const uint8_t* src_v, const uint8_t* src_u, uint8_t* dst_vu,
+                 int width) {
+  for (int i = 0; i < width; ++i) {
+    dst_vu[2 * i] = src_v[i];
+    dst_vu[2 * i + 1] = src_u[i];
+  }
+}
+
+#if defined(ARC_YUV_X86)
+// SSE2 is part of the baseline for every x86 ABI Android supports.
+void MergeVURowSSE2(const uint8_t* src_v, const uint8_t* src_u,
+                    uint8_t* dst_vu, int width) {
+  int i = 0;
+  for (; i + 16 <= width; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src_v + i));
+    __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src_u + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst_vu + 2 * i),
+                     _mm_unpacklo_epi8(v, u));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst_vu + 2 * i + 16),
+                     _mm_unpackhi_epi8(v, u));
+  }
+  MergeVURowC(src_v + i, src_u + i, dst_vu + 2 * i, width - i);
+}
+
+__attribute__((target("avx2"))) void MergeVURowAVX2(const uint8_t* src_v,
+                                                    const uint8_t* src_u,
+                                                    uint8_t* dst_vu,
+                                                    int width) {
+  int i = 0;
+  for (; i + 32 <= width; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src_v + i));
+    __m256i u = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src_u + i));
+    // AVX2 unpacks within 128-bit lanes; swap the middle quarters back into
+    // order before storing.
+    __m256i lo = _mm256_unpacklo_epi8(v, u);
+    __m256i hi = _mm256_unpackhi_epi8(v, u);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst_vu + 2 * i),
+                        _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst_vu + 2 * i + 32),
+                        _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  MergeVURowSSE2(src_v + i, src_u + i, dst_vu + 2 * i, width - i);
+}
+#endif  // ARC_YUV_X86
+
+#if defined(ARC_YUV_NEON)
+void MergeVURowNEON(const uint8_t* src_v, const uint8_t* src_u,
+                    uint8_t* dst_vu, int width) {
+  int i = 0;
+  for (; i + 16 <= width; i += 16) {
+    uint8x16x2_t vu;
+    vu.val[0] = vld1q_u8(src_v + i);
+    vu.val[1] = vld1q_u8(src_u + i);
+    vst2q_u8(dst_vu + 2 * i, vu);
+  }
+  MergeVURowC(src_v + i, src_u + i, dst_vu + 2 * i, width - i);
+}
+#endif  // ARC_YUV_NEON
+
+struct MergeVUKernel {
+  MergeVURowFunc row;
+  const char* name;
+};
+
+MergeVUKernel SelectMergeVUKernel() {
+#if defined(ARC_YUV_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {MergeVURowAVX2, "avx2"};
+  }
+  return {MergeVURowSSE2, "sse2"};
+#elif defined(ARC_YUV_NEON)
+  return {MergeVURowNEON, "neon"};
+#else
+  return {MergeVURowC, "c"};
+#endif
+}
+
+const MergeVUKernel& GetMergeVUKernel() {
+  static const MergeVUKernel kernel = SelectMergeVUKernel();
+  return kernel;
+}
+
+void MergeVUPlaneWith(MergeVURowFunc row, const uint8_t* src_v,
+                      int src_stride_v, const uint8_t* src_u, int src_stride_u,
+                      uint8_t* dst_vu, int dst_stride_vu, int width,
+                      int height) {
+  // Treat contiguous planes as a single row.
+  if (src_stride_v == width && src_stride_u == width &&
+      dst_stride_vu == width * 2) {
+    width *= height;
+    height = 1;
+  }
+  for (int y = 0; y < height; ++y) {
+    row(src_v, src_u, dst_vu, width);
+    src_v += src_stride_v;
+    src_u += src_stride_u;
+    dst_vu += dst_stride_vu;
+  }
+}
+
+}  // namespace
+
+void CopyPlane(const uint8_t* src, int src_stride, uint8_t* dst,
+               int dst_stride, int width, int height) {
+  // memcpy is already vectorized by the C library; the win is in copying
+  // contiguous planes in one call rather than row by row.
+  if (src_stride == width && dst_stride == width) {
+    memcpy(dst, src, static_cast<size_t>(width) * height);
+    return;
+  }
+  for (int y = 0; y < height; ++y) {
+    memcpy(dst, src, width);
+    src += src_stride;
+    dst += dst_stride;
+  }
+}
+
+void MergeVUPlane(const uint8_t* src_v, int src_stride_v,
+                  const uint8_t* src_u, int src_stride_u, uint8_t* dst_vu,
+                  int dst_stride_vu, int width, int height) {
+  MergeVUPlaneWith(GetMergeVUKernel().row, src_v, src_stride_v, src_u,
+                   src_stride_u, dst_vu, dst_stride_vu, width, height);
+}
+
+void MergeVUPlaneC(const uint8_t* src_v, int src_stride_v,
+                   const uint8_t* src_u, int src_stride_u, uint8_t* dst_vu,
+                   int dst_stride_vu, int width, int height) {
+  MergeVUPlaneWith(MergeVURowC, src_v, src_stride_v, src_u, src_stride_u,
+                   dst_vu, dst_stride_vu, width, height);
+}
+
+const char* GetYuvKernelName() { return GetMergeVUKernel().name; }
+
+}  // namespace arc
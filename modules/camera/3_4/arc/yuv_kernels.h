@@ -0,0 +1,40 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef HAL_USB_YUV_KERNELS_H_
+#define HAL_USB_YUV_KERNELS_H_
+
+#include <cstdint>
+
+namespace arc {
+
+// Plane level kernels used by ImageProcessor for the YU12 conversions it does
+// itself rather than through libyuv. Each picks the widest SIMD version the
+// CPU supports (AVX2 or SSE2 on x86, NEON on ARM) the first time it is called,
+// and falls back to portable C otherwise.
+
+// Copy a |width| x |height| plane of bytes between buffers with the given
+// strides.
+void CopyPlane(const uint8_t* src, int src_stride, uint8_t* dst,
+               int dst_stride, int width, int height);
+
+// Interleave a V and a U plane, each |width| x |height|, into a single VU
+// plane |width| * 2 bytes wide, as used for the chroma of NV21.
+void MergeVUPlane(const uint8_t* src_v, int src_stride_v,
+                  const uint8_t* src_u, int src_stride_u, uint8_t* dst_vu,
+                  int dst_stride_vu, int width, int height);
+
+// Portable version of MergeVUPlane. Exposed for tests and benchmarks.
+void MergeVUPlaneC(const uint8_t* src_v, int src_stride_v,
+                   const uint8_t* src_u, int src_stride_u, uint8_t* dst_vu,
+                   int dst_stride_vu, int width, int height);
+
+// Name of the instruction set MergeVUPlane uses on this CPU: "avx2", "sse2",
+// "neon" or "c".
+const char* GetYuvKernelName();
+
+}  // namespace arc
+
+#endif  // HAL_USB_YUV_KERNELS_H_
@@ -0,0 +1,78 @@
+/* Copyright 2026 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "arc/yuv_kernels.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using testing::Test;
+
+namespace arc {
+
+class YuvKernelsTest : public Test {
+ protected:
+  // Fill planes of |stride| x |height| with distinct, non-repeating patterns.
+  void SetUpPlanes(int stride, int height) {
+    v_.resize(stride * height);
+    u_.resize(stride * height);
+    for (size_t i = 0; i < v_.size(); ++i) {
+      v_[i] = static_cast<uint8_t>(i * 7);
+      u_[i] = static_cast<uint8_t>(i * 13 + 1);
+    }
+  }
+
+  std::vector<uint8_t> v_;
+  std::vector<uint8_t> u_;
+};
+
+TEST_F(YuvKernelsTest, MergeVUPlaneMatchesC) {
+  // Widths around every vector size, so the tails are covered too.
+  for (int width : {1, 2, 15, 16, 17, 31, 32, 33, 63, 64, 65, 320}) {
+    for (int padding : {0, 5}) {
+      int stride = width + padding;
+      int height = 4;
+      SetUpPlanes(stride, height);
+      std::vector<uint8_t> expected(stride * 2 * height, 0);
+      std::vector<uint8_t> actual(stride * 2 * height, 0);
+      MergeVUPlaneC(v_.data(), stride, u_.data(), stride, expected.data(),
+                    stride * 2, width, height);
+      MergeVUPlane(v_.data(), stride, u_.data(), stride, actual.data(),
+                   stride * 2, width, height);
+      EXPECT_EQ(expected, actual) << "width " << width << ", stride " << stride
+                                  << " using " << GetYuvKernelName();
+    }
+  }
+}
+
+TEST_F(YuvKernelsTest, MergeVUPlaneInterleaves) {
+  SetUpPlanes(2, 1);
+  std::vector<uint8_t> actual(4, 0);
+  MergeVUPlaneC(v_.data(), 2, u_.data(), 2, actual.data(), 4, 2, 1);
+  EXPECT_EQ(std::vector<uint8_t>({v_[0], u_[0], v_[1], u_[1]}), actual);
+}
+
+TEST_F(YuvKernelsTest, CopyPlaneHonorsStrides) {
+  int width = 6;
+  int height = 3;
+  int src_stride = 8;
+  int dst_stride = 16;
+  SetUpPlanes(src_stride, height);
+  std::vector<uint8_t> dst(dst_stride * height, 0xAA);
+  CopyPlane(v_.data(), src_stride, dst.data(), dst_stride, width, height);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < dst_stride; ++x) {
+      if (x < width) {
+        EXPECT_EQ(v_[y * src_stride + x], dst[y * dst_stride + x]);
+      } else {
+        // Padding is left alone.
+        EXPECT_EQ(0xAA, dst[y * dst_stride + x]);
+      }
+    }
+  }
+}
+
+}  // namespace arc
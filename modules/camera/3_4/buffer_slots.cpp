@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "buffer_slots.h"
+
+namespace v4l2_camera_hal {
+
+namespace {
+
+uint64_t SlotBit(size_t slot) { return uint64_t(1) << slot; }
+
+}  // namespace
+
+const size_t BufferSlots::kMaxSlots;
+
+BufferSlots::BufferSlots() : free_mask_(0), queued_mask_(0) {}
+
+void BufferSlots::Reset(size_t count) {
+  if (count > kMaxSlots) {
+    count = kMaxSlots;
+  }
+  free_mask_ = count == kMaxSlots ? ~uint64_t(0) : SlotBit(count) - 1;
+  queued_mask_ = 0;
+}
+
+int BufferSlots::Acquire() {
+  uint64_t free_mask = free_mask_.load(std::memory_order_acquire);
+  while (free_mask) {
+    uint64_t lowest = free_mask & -free_mask;
+    if (free_mask_.compare_exchange_weak(free_mask, free_mask & ~lowest,
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+      return __builtin_ctzll(lowest);
+    }
+  }
+  return -1;
+}
+
+void BufferSlots::Release(size_t slot) {
+  free_mask_.fetch_or(SlotBit(slot), std::memory_order_release);
+}
+
+void BufferSlots::MarkQueued(size_t slot) {
+  queued_mask_.fetch_or(SlotBit(slot), std::memory_order_release);
+}
+
+bool BufferSlots::MarkDequeued(size_t slot) {
+  uint64_t previous =
+      queued_mask_.fetch_and(~SlotBit(slot), std::memory_order_acq_rel);
+  return previous & SlotBit(slot);
+}
+
+uint64_t BufferSlots::DequeueAll() {
+  return queued_mask_.exchange(0, std::memory_order_acq_rel);
+}
+
+size_t BufferSlots::QueuedCount() const {
+  return __builtin_popcountll(queued_mask_.load(std::memory_order_acquire));
+}
+
+}  // namespace v4l2_camera_hal
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef V4L2_CAMERA_HAL_BUFFER_SLOTS_H_
+#define V4L2_CAMERA_HAL_BUFFER_SLOTS_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <android-base/macros.h>
+
+namespace v4l2_camera_hal {
+
+// Lock-free tracking of device buffer slots. A slot is free, acquired (owned
+// by the thread setting it up), or queued (owned by the device until it is
+// dequeued). State lives in two bitmaps, so finding a free slot and counting
+// queued ones are single atomic operations.
+class BufferSlots {
+ public:
+  // Most slots that can be tracked.
+  static const size_t kMaxSlots = 64;
+
+  BufferSlots();
+
+  // Forget all state and make slots 0 through |count| - 1 free.
+  // Not safe to call concurrently with anything else.
+  void Reset(size_t count);
+
+  // Take the lowest free slot. Returns its index, or -1 if none are free.
+  int Acquire();
+  // Free a slot, either acquired and never queued, or dequeued.
+  void Release(size_t slot);
+
+  // Mark an acquired slot as queued. Writes made to the slot's data before
+  // this are visible to the thread that dequeues it.
+  void MarkQueued(size_t slot);
+  // Mark a queued slot as no longer queued; it stays owned by the caller
+  // until released. Returns false if it was not queued.
+  bool MarkDequeued(size_t slot);
+  // Mark every queued slot as dequeued, returning a mask of them.
+  uint64_t DequeueAll();
+
+  // Number of slots currently queued.
+  size_t QueuedCount() const;
+
+ private:
+  std::atomic<uint64_t> free_mask_;
+  std::atomic<uint64_t> queued_mask_;
+
+  DISALLOW_COPY_AND_ASSIGN(BufferSlots);
+};
+
+}  // namespace v4l2_camera_hal
+
+#endif  // V4L2_CAMERA_HAL_BUFFER_SLOTS_H_
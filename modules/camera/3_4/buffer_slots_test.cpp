@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "buffer_slots.h"
+
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using testing::Test;
+
+namespace v4l2_camera_hal {
+
+class BufferSlotsTest : public Test {
+ protected:
+  BufferSlots dut_;
+};
+
+TEST_F(BufferSlotsTest, StartsEmpty) {
+  EXPECT_EQ(dut_.Acquire(), -1);
+  EXPECT_EQ(dut_.QueuedCount(), 0u);
+}
+
+TEST_F(BufferSlotsTest, AcquireAll) {
+  dut_.Reset(3);
+  EXPECT_EQ(dut_.Acquire(), 0);
+  EXPECT_EQ(dut_.Acquire(), 1);
+  EXPECT_EQ(dut_.Acquire(), 2);
+  // Full.
+  EXPECT_EQ(dut_.Acquire(), -1);
+  // Released slots can be taken again.
+  dut_.Release(1);
+  EXPECT_EQ(dut_.Acquire(), 1);
+}
+
+TEST_F(BufferSlotsTest, MaxSlots) {
+  dut_.Reset(BufferSlots::kMaxSlots + 10);
+  for (size_t i = 0; i < BufferSlots::kMaxSlots; ++i) {
+    EXPECT_EQ(dut_.Acquire(), static_cast<int>(i));
+  }
+  EXPECT_EQ(dut_.Acquire(), -1);
+}
+
+TEST_F(BufferSlotsTest, QueueAndDequeue) {
+  dut_.Reset(4);
+  int slot = dut_.Acquire();
+  ASSERT_GE(slot, 0);
+  // Acquired isn't queued yet.
+  EXPECT_EQ(dut_.QueuedCount(), 0u);
+  dut_.MarkQueued(slot);
+  EXPECT_EQ(dut_.QueuedCount(), 1u);
+  EXPECT_TRUE(dut_.MarkDequeued(slot));
+  EXPECT_EQ(dut_.QueuedCount(), 0u);
+  // Can't dequeue twice.
+  EXPECT_FALSE(dut_.MarkDequeued(slot));
+  dut_.Release(slot);
+  EXPECT_EQ(dut_.Acquire(), slot);
+}
+
+TEST_F(BufferSlotsTest, DequeueAll) {
+  dut_.Reset(4);
+  for (int i = 0; i < 3; ++i) {
+    dut_.MarkQueued(dut_.Acquire());
+  }
+  EXPECT_EQ(dut_.QueuedCount(), 3u);
+  EXPECT_EQ(dut_.DequeueAll(), 0x7u);
+  EXPECT_EQ(dut_.QueuedCount(), 0u);
+  // Dequeued slots still need releasing.
+  EXPECT_EQ(dut_.Acquire(), 3);
+  EXPECT_EQ(dut_.Acquire(), -1);
+}
+
+TEST_F(BufferSlotsTest, ConcurrentAcquire) {
+  dut_.Reset(BufferSlots::kMaxSlots);
+  std::vector<int> results[4];
+  std::vector<std::thread> threads;
+  for (auto& result : results) {
+    threads.emplace_back([this, &result]() {
+      for (int slot = dut_.Acquire(); slot >= 0; slot = dut_.Acquire()) {
+        result.push_back(slot);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Every slot was handed out exactly once.
+  std::set<int> seen;
+  for (const auto& result : results) {
+    for (int slot : result) {
+      EXPECT_TRUE(seen.insert(slot).second) << "Slot " << slot << " reused";
+    }
+  }
+  EXPECT_EQ(seen.size(), BufferSlots::kMaxSlots);
+}
+
+}  // namespace v4l2_camera_hal
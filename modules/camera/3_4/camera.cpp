@@ -22,10 +22,11 @@
 #include "camera.h"
 
 #include <cstdlib>
+#include <cstring>
 #include <memory>
+#include <unistd.h>
 
 #include <hardware/camera3.h>
-#include <sync/sync.h>
 #include <system/camera_metadata.h>
 #include <system/graphics.h>
 #include "metadata/metadata_common.h"
@@ -52,6 +53,7 @@ Camera::Camera(int id)
   : mId(id),
     mSettingsSet(false),
     mBusy(false),
+    mFenceWaiter(CAMERA_SYNC_TIMEOUT),
     mCallbackOps(NULL),
     mInFlightTracker(new RequestTracker)
 {
@@ -201,6 +203,7 @@ int Camera::configureStreams(camera3_stream_configuration_t *stream_config)
     if (!res) {
         // Success, set up the in-flight trackers for the new streams.
         mInFlightTracker->SetStreamConfiguration(*stream_config);
+        mTimingStats.Clear();
         // Must provide new settings for the new configuration.
         mSettingsSet = false;
     } else if (res != -EINVAL) {
@@ -296,7 +299,6 @@ const camera_metadata_t* Camera::constructDefaultRequestSettings(int type)
 
 int Camera::processCaptureRequest(camera3_capture_request_t *temp_request)
 {
-    int res;
     // TODO(b/32917568): A capture request submitted or ongoing during a flush
     // should be returned with an error; for now they are mutually exclusive.
     android::Mutex::Autolock tl(mInFlightTrackerLock);
@@ -311,6 +313,7 @@ int Camera::processCaptureRequest(camera3_capture_request_t *temp_request)
     // Make a persistent copy of request, since otherwise it won't live
     // past the end of this method.
     std::shared_ptr<CaptureRequest> request = std::make_shared<CaptureRequest>(temp_request);
+    request->timings.accepted = FrameTimingNow();
 
     ALOGV("%s:%d: frame: %d", __func__, mId, request->frame_number);
 
@@ -345,10 +348,11 @@ int Camera::processCaptureRequest(camera3_capture_request_t *temp_request)
               request->output_buffers.size());
         return -EINVAL;
     }
+    std::vector<int> acquire_fences;
     for (auto& output_buffer : request->output_buffers) {
-        res = preprocessCaptureBuffer(&output_buffer);
-        if (res)
-            return -ENODEV;
+        preprocessCaptureBuffer(&output_buffer);
+        if (output_buffer.acquire_fence != -1)
+            acquire_fences.push_back(output_buffer.acquire_fence);
     }
 
     // Add the request to tracking.
@@ -363,8 +367,15 @@ int Camera::processCaptureRequest(camera3_capture_request_t *temp_request)
     // has been passed to the device, not that they've been set).
     mSettingsSet = true;
 
-    // Send the request off to the device for completion.
-    enqueueRequest(request);
+    // Send the request off to the device for completion, once its buffers
+    // are free to be written. Waiting happens off this thread; requests
+    // still reach the device in order.
+    if (!mFenceWaiter.Wait(acquire_fences,
+                           [this, request](int err) {
+                               onAcquireFencesDone(request, err);
+                           })) {
+        enqueueRequest(request);
+    }
 
     // Request is now in flight. The device will call completeRequest
     // asynchronously when it is done filling buffers and metadata.
@@ -412,6 +423,8 @@ void Camera::completeRequest(std::shared_ptr<CaptureRequest> request, int err)
     // TODO(b/31653322): Check all returned buffers for errors
     // (if any, send BUFFER error).
 
+    request->timings.returned = FrameTimingNow();
+    mTimingStats.Record(*request);
     sendResult(request);
 }
 
@@ -425,6 +438,10 @@ int Camera::flush()
     // thread, this function should behave nicely concurrently with that too.
     android::Mutex::Autolock tl(mInFlightTrackerLock);
 
+    // Requests still waiting on fences are errored out below, which hands
+    // the fences back to the framework; stop watching them first.
+    mFenceWaiter.Cancel();
+
     std::set<std::shared_ptr<CaptureRequest>> requests;
     mInFlightTracker->Clear(&requests);
     for (auto& request : requests) {
@@ -439,32 +456,40 @@ int Camera::flush()
     return flushBuffers();
 }
 
-int Camera::preprocessCaptureBuffer(camera3_stream_buffer_t *buffer)
+void Camera::preprocessCaptureBuffer(camera3_stream_buffer_t *buffer)
 {
-    int res;
-    // TODO(b/29334616): This probably should be non-blocking; part
-    // of the asynchronous request processing.
-    if (buffer->acquire_fence != -1) {
-        res = sync_wait(buffer->acquire_fence, CAMERA_SYNC_TIMEOUT);
-        if (res == -ETIME) {
-            ALOGE("%s:%d: Timeout waiting on buffer acquire fence",
-                    __func__, mId);
-            return res;
-        } else if (res) {
-            ALOGE("%s:%d: Error waiting on buffer acquire fence: %s(%d)",
-                    __func__, mId, strerror(-res), res);
-            return res;
-        }
-        ::close(buffer->acquire_fence);
-    }
-
-    // Acquire fence has been waited upon.
-    buffer->acquire_fence = -1;
+    // The acquire fence stays with the buffer until mFenceWaiter has seen
+    // it signal.
     // No release fence waiting unless the device sets it.
     buffer->release_fence = -1;
 
     buffer->status = CAMERA3_BUFFER_STATUS_OK;
-    return 0;
+}
+
+void Camera::onAcquireFencesDone(std::shared_ptr<CaptureRequest> request,
+                                 int err)
+{
+    {
+        android::Mutex::Autolock tl(mInFlightTrackerLock);
+        // A flush may have returned the request, with its fences, already.
+        if (!mInFlightTracker->InFlight(request->frame_number))
+            return;
+
+        if (!err) {
+            for (auto& buffer : request->output_buffers) {
+                if (buffer.acquire_fence != -1) {
+                    ::close(buffer.acquire_fence);
+                    buffer.acquire_fence = -1;
+                }
+            }
+            enqueueRequest(request);
+            return;
+        }
+    }
+
+    ALOGE("%s:%d: Error waiting on acquire fences for frame %d: %s(%d)",
+          __func__, mId, request->frame_number, strerror(-err), err);
+    completeRequest(request, err);
 }
 
 void Camera::notifyShutter(uint32_t frame_number, uint64_t timestamp)
@@ -488,9 +513,18 @@ void Camera::completeRequestWithError(std::shared_ptr<CaptureRequest> request)
     message.message.error.error_code = CAMERA3_MSG_ERROR_REQUEST;
     mCallbackOps->notify(mCallbackOps, &message);
 
-    // TODO(b/31856611): Ensure all the buffers indicate their error status.
+    // None of the buffers were filled. Those whose acquire fence was never
+    // waited on return it as their release fence.
+    for (auto& buffer : request->output_buffers) {
+        buffer.status = CAMERA3_BUFFER_STATUS_ERROR;
+        if (buffer.acquire_fence != -1) {
+            buffer.release_fence = buffer.acquire_fence;
+            buffer.acquire_fence = -1;
+        }
+    }
 
     // Send the errored out result.
+    mTimingStats.RecordError(*request);
     sendResult(request);
 }
 
@@ -519,6 +553,8 @@ void Camera::dump(int fd)
     android::Mutex::Autolock dl(mDeviceLock);
 
     dprintf(fd, "Camera ID: %d (Busy: %d)\n", mId, mBusy);
+    dumpDevice(fd);
+    mTimingStats.Dump(fd);
 
     // TODO: dump all settings
 }
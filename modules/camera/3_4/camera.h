@@ -25,6 +25,8 @@
 #include <utils/Mutex.h>
 
 #include "capture_request.h"
+#include "fence_waiter.h"
+#include "frame_timing.h"
 #include "metadata/metadata.h"
 #include "request_tracker.h"
 #include "static_properties.h"
@@ -85,6 +87,8 @@ class Camera {
             std::shared_ptr<CaptureRequest> request) = 0;
         // Flush in flight buffers.
         virtual int flushBuffers() = 0;
+        // Dump device specific state for debugging
+        virtual void dumpDevice(int fd) = 0;
 
 
         // Callback for when the device has filled in the requested data.
@@ -105,8 +109,11 @@ class Camera {
             const camera3_stream_configuration_t* stream_config);
         // Verify settings are valid for reprocessing an input buffer
         bool isValidReprocessSettings(const camera_metadata_t *settings);
-        // Pre-process an output buffer
-        int preprocessCaptureBuffer(camera3_stream_buffer_t *buffer);
+        // Pre-process an output buffer, leaving its acquire fence in place
+        void preprocessCaptureBuffer(camera3_stream_buffer_t *buffer);
+        // Called once the acquire fences of a request have been waited on
+        void onAcquireFencesDone(std::shared_ptr<CaptureRequest> request,
+                                 int err);
         // Send a shutter notify message with start of exposure time
         void notifyShutter(uint32_t frame_number, uint64_t timestamp);
         // Send an error message and return the errored out result.
@@ -139,6 +146,12 @@ class Camera {
         // Track in flight requests.
         std::unique_ptr<RequestTracker> mInFlightTracker;
         android::Mutex mInFlightTrackerLock;
+        // Waits on output buffer acquire fences, so requests can be
+        // accepted without blocking the framework.
+        FenceWaiter mFenceWaiter;
+        // Per-stream latencies of the requests returned since the streams
+        // were last configured.
+        FrameTimingStats mTimingStats;
 };
 }  // namespace default_camera_hal
 
@@ -25,6 +25,18 @@
 
 namespace default_camera_hal {
 
+// CLOCK_MONOTONIC times, in nanoseconds, at which a request reached each
+// stage of processing. A stage the request never reached (or that does not
+// apply to it, such as encoding for a request with no BLOB output) is 0.
+struct CaptureTimings {
+  int64_t accepted = 0;   // Taken in by process_capture_request.
+  int64_t queued = 0;     // Handed to the driver.
+  int64_t dequeued = 0;   // Returned by the driver.
+  int64_t converted = 0;  // Frame decoded and non-BLOB outputs written.
+  int64_t encoded = 0;    // BLOB outputs written.
+  int64_t returned = 0;   // Result sent to the framework.
+};
+
 // A simple wrapper for camera3_capture_request_t,
 // with a constructor that makes a deep copy from the original struct.
 struct CaptureRequest {
@@ -32,6 +44,7 @@ struct CaptureRequest {
   android::CameraMetadata settings;
   std::unique_ptr<camera3_stream_buffer_t> input_buffer;
   std::vector<camera3_stream_buffer_t> output_buffers;
+  CaptureTimings timings;
 
   CaptureRequest();
   // Create a deep copy of |request|.
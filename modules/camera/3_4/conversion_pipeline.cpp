@@ -0,0 +1,403 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ConversionPipeline"
+
+#include "conversion_pipeline.h"
+
+#include <algorithm>
+
+#include "arc/image_processor.h"
+#include "common.h"
+#include "frame_timing.h"
+#include "function_thread.h"
+#include "stream_format.h"
+
+namespace v4l2_camera_hal {
+
+using default_camera_hal::CaptureRequest;
+
+StreamConverter::StreamConverter(const camera3_stream_t* stream)
+    : stream_(stream),
+      scale_filter_(StreamFormat::HalToScaleFilter(stream->format)),
+      allocations_(1),
+      job_pending_(false),
+      job_done_(false),
+      exiting_(false),
+      job_result_(0),
+      job_frame_(nullptr),
+      job_settings_(nullptr),
+      job_buffer_(nullptr),
+      job_device_buffer_length_(0),
+      worker_(new FunctionThread(
+          std::bind(&StreamConverter::threadLoop, this))) {
+  // Scaling always produces YU12 at the stream size, whatever the final
+  // output format is.
+  size_t scaled_size = arc::ImageProcessor::GetConvertedSize(
+      V4L2_PIX_FMT_YUV420, stream->width, stream->height);
+  scaled_frame_.reset(new arc::AllocatedFrameBuffer(scaled_size));
+
+  android::status_t res = worker_->run("Stream converter");
+  HAL_LOGE_IF(res != android::OK, "Failed to start converter thread: %d", res);
+}
+
+StreamConverter::~StreamConverter() {
+  {
+    std::lock_guard<std::mutex> guard(job_lock_);
+    exiting_ = true;
+    job_cond_.notify_all();
+  }
+  worker_->requestExitAndWait();
+}
+
+int StreamConverter::Convert(const arc::CachedFrame& frame,
+                             const android::CameraMetadata& settings,
+                             const camera3_stream_buffer_t& buffer,
+                             uint32_t device_buffer_length) {
+  // Note that the device buffer length is passed to the output frame. If the
+  // GrallocFrameBuffer does not have support for the transformation to
+  // the output format, it will assume that the amount of data to lock is
+  // based on |device_buffer_length|, otherwise it will use
+  // ImageProcessor::GetConvertedSize.
+  arc::GrallocFrameBuffer output_frame(
+      *buffer.buffer, stream_->width, stream_->height,
+      StreamFormat::HalToV4L2PixelFormat(stream_->format),
+      device_buffer_length, stream_->usage);
+  if (output_frame.Map()) {
+    HAL_LOGE("Failed to map output frame.");
+    return -EINVAL;
+  }
+
+  const uint8_t* scaled_data = scaled_frame_->GetData();
+  int res = frame.ConvertWithBuffer(settings, &output_frame,
+                                    scaled_frame_.get(), scale_filter_);
+  if (scaled_frame_->GetData() != scaled_data) {
+    ++allocations_;
+  }
+  if (res) {
+    return res;
+  }
+  return output_frame.GetDataSize();
+}
+
+void StreamConverter::Start(const arc::CachedFrame& frame,
+                            const android::CameraMetadata& settings,
+                            const camera3_stream_buffer_t& buffer,
+                            uint32_t device_buffer_length) {
+  std::lock_guard<std::mutex> guard(job_lock_);
+  job_frame_ = &frame;
+  job_settings_ = &settings;
+  job_buffer_ = &buffer;
+  job_device_buffer_length_ = device_buffer_length;
+  job_done_ = false;
+  job_pending_ = true;
+  job_cond_.notify_all();
+}
+
+int StreamConverter::Wait() {
+  std::unique_lock<std::mutex> lock(job_lock_);
+  while (!job_done_) {
+    job_cond_.wait(lock);
+  }
+  return job_result_;
+}
+
+bool StreamConverter::threadLoop() {
+  std::unique_lock<std::mutex> lock(job_lock_);
+  while (!job_pending_ && !exiting_) {
+    job_cond_.wait(lock);
+  }
+  if (exiting_) {
+    return false;
+  }
+  job_pending_ = false;
+  lock.unlock();
+
+  int res = Convert(*job_frame_, *job_settings_, *job_buffer_,
+                    job_device_buffer_length_);
+
+  lock.lock();
+  job_result_ = res;
+  job_done_ = true;
+  job_cond_.notify_all();
+  return true;
+}
+
+ConversionPipeline::ConversionPipeline()
+    : frames_(0),
+      bytes_converted_(0),
+      bytes_copied_(0),
+      encodes_queued_(0),
+      encodes_inline_(0),
+      frame_allocations_(0) {}
+
+ConversionPipeline::~ConversionPipeline() {
+  // Stop the encoders before the state their callbacks use goes away.
+  encoders_.clear();
+}
+
+void ConversionPipeline::SetCompletionCallback(CompletionCallback callback) {
+  std::lock_guard<std::mutex> guard(delivery_lock_);
+  completion_callback_ = callback;
+}
+
+int ConversionPipeline::Configure(
+    const camera3_stream_configuration_t& stream_config,
+    uint32_t source_fourcc) {
+  HAL_LOG_ENTER();
+
+  converters_.clear();
+  encoders_.clear();
+  for (uint32_t i = 0; i < stream_config.num_streams; ++i) {
+    const camera3_stream_t* stream = stream_config.streams[i];
+    if (stream->format == HAL_PIXEL_FORMAT_BLOB) {
+      NewEncoder(stream);
+    } else {
+      converters_[stream].reset(new StreamConverter(stream));
+    }
+  }
+  cached_frame_.PrepareDecoder(source_fourcc);
+  conversions_.clear();
+  conversions_.reserve(stream_config.num_streams);
+  encodes_.clear();
+  encodes_.reserve(stream_config.num_streams);
+  return 0;
+}
+
+void ConversionPipeline::Clear() {
+  converters_.clear();
+  encoders_.clear();
+  conversions_.clear();
+  encodes_.clear();
+}
+
+StreamConverter* ConversionPipeline::GetConverter(
+    const camera3_stream_t* stream) {
+  auto converter = converters_.find(stream);
+  if (converter != converters_.end()) {
+    return converter->second.get();
+  }
+  HAL_LOGW("Stream %p was not configured, creating a converter for it.",
+           stream);
+  StreamConverter* result = new StreamConverter(stream);
+  converters_[stream].reset(result);
+  return result;
+}
+
+JpegEncoder* ConversionPipeline::GetEncoder(const camera3_stream_t* stream) {
+  auto encoder = encoders_.find(stream);
+  if (encoder != encoders_.end()) {
+    return encoder->second.get();
+  }
+  HAL_LOGW("Stream %p was not configured, creating an encoder for it.",
+           stream);
+  return NewEncoder(stream);
+}
+
+JpegEncoder* ConversionPipeline::NewEncoder(const camera3_stream_t* stream) {
+  JpegEncoder* result = new JpegEncoder(
+      stream, [this](std::shared_ptr<CaptureRequest> request, int res) {
+        EncodeDone(request, res);
+        DeliverCompleted();
+      });
+  encoders_[stream].reset(result);
+  return result;
+}
+
+int ConversionPipeline::Process(const arc::FrameBuffer& camera_buffer,
+                                uint32_t device_buffer_length,
+                                std::shared_ptr<CaptureRequest> request) {
+  ++frames_;
+  int res = Convert(camera_buffer, device_buffer_length, *request);
+  request->timings.converted = default_camera_hal::FrameTimingNow();
+
+  // Queue the request before handing off any encodes, so their completion
+  // always finds it.
+  {
+    std::lock_guard<std::mutex> guard(completion_lock_);
+    completions_.push_back({request, res, encodes_.size()});
+  }
+  for (const auto& encode : encodes_) {
+    int queued = encode.first->Queue(cached_frame_, request, encode.second,
+                                     device_buffer_length);
+    if (!queued) {
+      ++encodes_queued_;
+      continue;
+    }
+    if (queued == -EBUSY) {
+      // The encoder is backed up; do this one here.
+      ++encodes_inline_;
+      queued = encode.first->EncodeNow(cached_frame_, request->settings,
+                                       *encode.second, device_buffer_length);
+    }
+    EncodeDone(request, queued);
+  }
+  return res;
+}
+
+void ConversionPipeline::Finish(std::shared_ptr<CaptureRequest> request,
+                                int result) {
+  std::lock_guard<std::mutex> guard(completion_lock_);
+  completions_.push_back({request, result, 0});
+}
+
+void ConversionPipeline::EncodeDone(
+    const std::shared_ptr<CaptureRequest>& request, int result) {
+  std::lock_guard<std::mutex> guard(completion_lock_);
+  for (auto& completion : completions_) {
+    if (completion.request != request) {
+      continue;
+    }
+    if (result) {
+      HAL_LOGE("Failed to encode JPEG for frame %u: %d",
+               request->frame_number, result);
+      completion.result = result;
+    }
+    if (completion.pending_encodes > 0 && !--completion.pending_encodes) {
+      request->timings.encoded = default_camera_hal::FrameTimingNow();
+    }
+    return;
+  }
+  // Otherwise the request was flushed while its encode was running.
+}
+
+void ConversionPipeline::DeliverCompleted() {
+  std::lock_guard<std::mutex> delivery_guard(delivery_lock_);
+  while (true) {
+    Completion completion;
+    {
+      std::lock_guard<std::mutex> guard(completion_lock_);
+      if (completions_.empty() || completions_.front().pending_encodes) {
+        return;
+      }
+      completion = completions_.front();
+      completions_.pop_front();
+    }
+    if (completion_callback_) {
+      completion_callback_(completion.request, completion.result);
+    }
+  }
+}
+
+void ConversionPipeline::Flush() {
+  for (const auto& encoder : encoders_) {
+    encoder.second->Flush();
+  }
+  std::lock_guard<std::mutex> guard(completion_lock_);
+  completions_.clear();
+}
+
+int ConversionPipeline::Convert(const arc::FrameBuffer& camera_buffer,
+                                uint32_t device_buffer_length,
+                                const CaptureRequest& request) {
+  int res = 0;
+
+  // Outputs matching the capture format exactly are copied straight over;
+  // BLOB outputs are left to the encoders and the rest are converted below.
+  conversions_.clear();
+  encodes_.clear();
+  uint32_t max_width = 0;
+  uint32_t max_height = 0;
+  for (const auto& stream_buffer : request.output_buffers) {
+    const camera3_stream_t* stream = stream_buffer.stream;
+    uint32_t fourcc = StreamFormat::HalToV4L2PixelFormat(stream->format);
+    if (camera_buffer.GetFourcc() != fourcc ||
+        camera_buffer.GetWidth() != stream->width ||
+        camera_buffer.GetHeight() != stream->height) {
+      max_width = std::max(max_width, stream->width);
+      max_height = std::max(max_height, stream->height);
+      if (stream->format == HAL_PIXEL_FORMAT_BLOB) {
+        encodes_.emplace_back(GetEncoder(stream), &stream_buffer);
+      } else {
+        conversions_.emplace_back(GetConverter(stream), &stream_buffer);
+      }
+      continue;
+    }
+
+    arc::GrallocFrameBuffer output_frame(*stream_buffer.buffer, stream->width,
+                                         stream->height, fourcc,
+                                         device_buffer_length, stream->usage);
+    if (output_frame.Map()) {
+      HAL_LOGE("Failed to map output frame.");
+      res = -EINVAL;
+      continue;
+    }
+    memcpy(output_frame.GetData(), camera_buffer.GetData(),
+           camera_buffer.GetDataSize());
+    bytes_copied_ += camera_buffer.GetDataSize();
+  }
+  if (conversions_.empty() && encodes_.empty()) {
+    return res;
+  }
+
+  // Decode the frame to YU12 once, then scale/convert that into each of the
+  // remaining outputs. Those only read the shared frame, so all but the last
+  // run on their stream's worker thread while the last runs here.
+  // The device captures at the largest configured size, but requests that
+  // only target smaller streams (e.g. preview next to an idle still capture
+  // stream) let MJPEG frames be decoded at a reduced size.
+  const uint8_t* cached_data = cached_frame_.GetCachedBuffer();
+  cached_frame_.SetMinimumSize(max_width, max_height);
+  if (cached_frame_.SetSource(&camera_buffer, 0)) {
+    HAL_LOGE("Failed to convert frame to YU12.");
+    encodes_.clear();
+    return -EINVAL;
+  }
+  if (cached_frame_.GetCachedBuffer() != cached_data) {
+    ++frame_allocations_;
+  }
+  if (conversions_.empty()) {
+    return res;
+  }
+
+  size_t last = conversions_.size() - 1;
+  for (size_t i = 0; i < last; ++i) {
+    conversions_[i].first->Start(cached_frame_, request.settings,
+                                 *conversions_[i].second, device_buffer_length);
+  }
+  int last_converted = conversions_[last].first->Convert(
+      cached_frame_, request.settings, *conversions_[last].second,
+      device_buffer_length);
+  for (size_t i = 0; i <= last; ++i) {
+    int converted = i < last ? conversions_[i].first->Wait() : last_converted;
+    if (converted < 0) {
+      res = converted;
+    } else {
+      bytes_converted_ += converted;
+    }
+  }
+  return res;
+}
+
+ConversionStats ConversionPipeline::GetStats() const {
+  ConversionStats stats;
+  stats.frames = frames_;
+  stats.bytes_converted = bytes_converted_;
+  stats.bytes_copied = bytes_copied_;
+  stats.encodes_queued = encodes_queued_;
+  stats.encodes_inline = encodes_inline_;
+  stats.allocations = frame_allocations_;
+  for (const auto& converter : converters_) {
+    stats.allocations += converter.second->allocations();
+  }
+  for (const auto& encoder : encoders_) {
+    stats.allocations += encoder.second->allocations();
+  }
+  return stats;
+}
+
+}  // namespace v4l2_camera_hal
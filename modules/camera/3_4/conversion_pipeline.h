@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef V4L2_CAMERA_HAL_CONVERSION_PIPELINE_H_
+#define V4L2_CAMERA_HAL_CONVERSION_PIPELINE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <android-base/macros.h>
+#include <camera/CameraMetadata.h>
+#include <hardware/camera3.h>
+#include <utils/StrongPointer.h>
+#include <utils/Thread.h>
+#include "arc/cached_frame.h"
+#include "arc/frame_buffer.h"
+#include "arc/image_processor.h"
+#include "capture_request.h"
+#include "jpeg_encoder.h"
+
+namespace v4l2_camera_hal {
+
+// Counters describing the work done by a ConversionPipeline.
+struct ConversionStats {
+  // Frames passed through the pipeline.
+  uint64_t frames;
+  // Bytes written to output buffers by format conversion.
+  uint64_t bytes_converted;
+  // Bytes written to output buffers by plain copies.
+  uint64_t bytes_copied;
+  // JPEG encodes handed off to an encoder thread, and run inline.
+  uint64_t encodes_queued;
+  uint64_t encodes_inline;
+  // Scratch buffer (re)allocations. Should stay flat while streaming.
+  uint64_t allocations;
+};
+
+// Persistent conversion state for a single configured output stream.
+// Its scaling buffer is sized from the stream configuration up front, and it
+// owns a worker thread so several streams can be converted concurrently.
+// The scale filter is picked per kind of stream when it is configured, from
+// the persist.vendor.camera.v4l2.scale_filter.* properties.
+class StreamConverter {
+ public:
+  StreamConverter(const camera3_stream_t* stream);
+  ~StreamConverter();
+
+  // Convert |frame| into |buffer| on the calling thread.
+  // Returns the number of bytes written, or a negative error code.
+  int Convert(const arc::CachedFrame& frame,
+              const android::CameraMetadata& settings,
+              const camera3_stream_buffer_t& buffer,
+              uint32_t device_buffer_length);
+
+  // Same as Convert(), but on the worker thread. All arguments must remain
+  // valid until the matching Wait() returns the result.
+  void Start(const arc::CachedFrame& frame,
+             const android::CameraMetadata& settings,
+             const camera3_stream_buffer_t& buffer,
+             uint32_t device_buffer_length);
+  int Wait();
+
+  // Number of times the scaling buffer has been (re)allocated.
+  uint64_t allocations() const { return allocations_.load(); }
+
+ private:
+  bool threadLoop();
+
+  const camera3_stream_t* stream_;
+  const arc::ScaleFilter scale_filter_;
+  std::unique_ptr<arc::AllocatedFrameBuffer> scaled_frame_;
+  std::atomic<uint64_t> allocations_;
+
+  // Pending job for the worker thread.
+  std::mutex job_lock_;
+  std::condition_variable job_cond_;
+  bool job_pending_;
+  bool job_done_;
+  bool exiting_;
+  int job_result_;
+  const arc::CachedFrame* job_frame_;
+  const android::CameraMetadata* job_settings_;
+  const camera3_stream_buffer_t* job_buffer_;
+  uint32_t job_device_buffer_length_;
+  android::sp<android::Thread> worker_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamConverter);
+};
+
+// Converts captured frames into the output buffers of a request.
+// Everything needed per frame is allocated when streams are configured, so
+// steady-state capture does not touch the heap. BLOB outputs are encoded
+// asynchronously; requests are reported through the completion callback
+// strictly in the order they were processed.
+// Apart from DeliverCompleted(), not thread-safe; meant to be driven by the
+// single dequeuing thread under the owner's lock.
+class ConversionPipeline {
+ public:
+  typedef std::function<void(
+      std::shared_ptr<default_camera_hal::CaptureRequest> request, int result)>
+      CompletionCallback;
+
+  ConversionPipeline();
+  ~ConversionPipeline();
+
+  // Set the function that receives finished requests. It is called without
+  // any pipeline lock held other than the one serializing deliveries.
+  void SetCompletionCallback(CompletionCallback callback);
+
+  // Set up converters for every stream in |stream_config|, replacing any
+  // previous configuration, for source frames in |source_fourcc|.
+  int Configure(const camera3_stream_configuration_t& stream_config,
+                uint32_t source_fourcc);
+  // Drop all converters and encoders.
+  void Clear();
+
+  // Copy or convert |camera_buffer| into every output buffer of |request|.
+  // |request| becomes ready for delivery once its JPEG encodes (if any)
+  // are done. Returns the result of the synchronous part.
+  int Process(const arc::FrameBuffer& camera_buffer,
+              uint32_t device_buffer_length,
+              std::shared_ptr<default_camera_hal::CaptureRequest> request);
+  // Mark |request| ready for delivery without processing anything, e.g.
+  // because it was captured straight into its output buffer.
+  void Finish(std::shared_ptr<default_camera_hal::CaptureRequest> request,
+              int result);
+  // Pass every ready request at the head of the queue to the completion
+  // callback. Must not be called with locks the callback may take.
+  void DeliverCompleted();
+  // Stop pending encodes and forget requests not yet delivered. Their output
+  // buffers are no longer touched once this returns.
+  void Flush();
+
+  ConversionStats GetStats() const;
+
+ private:
+  // A processed request waiting for delivery.
+  struct Completion {
+    std::shared_ptr<default_camera_hal::CaptureRequest> request;
+    int result;
+    // JPEG encodes still running for |request|.
+    size_t pending_encodes;
+  };
+
+  StreamConverter* GetConverter(const camera3_stream_t* stream);
+  JpegEncoder* GetEncoder(const camera3_stream_t* stream);
+  JpegEncoder* NewEncoder(const camera3_stream_t* stream);
+  // The synchronous part of Process(): copies and conversions. Fills
+  // |encodes_| with the BLOB outputs left to encode.
+  int Convert(const arc::FrameBuffer& camera_buffer,
+              uint32_t device_buffer_length,
+              const default_camera_hal::CaptureRequest& request);
+  // Record the result of an encode for |request|.
+  void EncodeDone(
+      const std::shared_ptr<default_camera_hal::CaptureRequest>& request,
+      int result);
+
+  std::map<const camera3_stream_t*, std::unique_ptr<StreamConverter>>
+      converters_;
+  std::map<const camera3_stream_t*, std::unique_ptr<JpegEncoder>> encoders_;
+  // Shared YU12 decode of the current frame, reused across frames.
+  arc::CachedFrame cached_frame_;
+  // Per frame list of streams needing conversion, reserved up front.
+  std::vector<std::pair<StreamConverter*, const camera3_stream_buffer_t*>>
+      conversions_;
+  std::vector<std::pair<JpegEncoder*, const camera3_stream_buffer_t*>>
+      encodes_;
+
+  CompletionCallback completion_callback_;
+  // Requests in processing order.
+  std::mutex completion_lock_;
+  std::deque<Completion> completions_;
+  // Serializes calls to |completion_callback_|, keeping them in order.
+  std::mutex delivery_lock_;
+
+  std::atomic<uint64_t> frames_;
+  std::atomic<uint64_t> bytes_converted_;
+  std::atomic<uint64_t> bytes_copied_;
+  std::atomic<uint64_t> encodes_queued_;
+  std::atomic<uint64_t> encodes_inline_;
+  std::atomic<uint64_t> frame_allocations_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConversionPipeline);
+};
+
+}  // namespace v4l2_camera_hal
+
+#endif  // V4L2_CAMERA_HAL_CONVERSION_PIPELINE_H_
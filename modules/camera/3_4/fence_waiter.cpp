@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "FenceWaiter"
+
+#include "fence_waiter.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <utility>
+
+#include <cutils/log.h>
+#include <sync/sync.h>
+#include <utils/Timers.h>
+#include "function_thread.h"
+
+namespace default_camera_hal {
+
+namespace {
+
+const int kMaxEvents = 16;
+// Event data of the wakeup eventfd. Fences are tagged with their wait's id
+// and their index in it.
+const uint64_t kWakeupTag = ~uint64_t(0);
+
+uint64_t FenceTag(uint32_t id, size_t index) {
+  return (uint64_t(id) << 32) | index;
+}
+
+// A fence that signalled with an error still polls readable, so its status
+// has to be read back. Negative if it failed; 0 if |fence| isn't a sync_file.
+int FenceStatus(int fence) {
+  struct sync_file_info* info = sync_file_info(fence);
+  if (!info) {
+    return 0;
+  }
+  int status = info->status;
+  sync_file_info_free(info);
+  return status;
+}
+
+}  // namespace
+
+FenceWaiter::FenceWaiter(int timeout_ms)
+    : timeout_ns_(ms2ns(timeout_ms)),
+      epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+      wakeup_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+      dispatching_(0),
+      next_id_(0),
+      exiting_(false),
+      worker_(new v4l2_camera_hal::FunctionThread(
+          std::bind(&FenceWaiter::threadLoop, this))) {
+  if (epoll_fd_.get() < 0 || wakeup_fd_.get() < 0) {
+    ALOGE("%s: Failed to create fence waiter fds: %s", __func__,
+          strerror(errno));
+    return;
+  }
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u64 = kWakeupTag;
+  if (epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, wakeup_fd_.get(), &event)) {
+    ALOGE("%s: Failed to watch wakeup fd: %s", __func__, strerror(errno));
+    return;
+  }
+
+  android::status_t res = worker_->run("Fence waiter");
+  ALOGE_IF(res != android::OK, "%s: Failed to start thread: %d", __func__,
+           res);
+}
+
+FenceWaiter::~FenceWaiter() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    exiting_ = true;
+  }
+  uint64_t count = 1;
+  TEMP_FAILURE_RETRY(write(wakeup_fd_.get(), &count, sizeof(count)));
+  worker_->requestExitAndWait();
+}
+
+bool FenceWaiter::Wait(const std::vector<int>& fences, Callback callback) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (fences.empty() && entries_.empty() && dispatching_ == 0) {
+      return false;
+    }
+
+    entries_.push_back({next_id_++, fences, fences.size(),
+                        systemTime(SYSTEM_TIME_MONOTONIC) + timeout_ns_, 0,
+                        std::move(callback)});
+    Entry& entry = entries_.back();
+    for (size_t i = 0; i < entry.fences.size(); ++i) {
+      epoll_event event = {};
+      event.events = EPOLLIN;
+      event.data.u64 = FenceTag(entry.id, i);
+      if (epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, entry.fences[i], &event)) {
+        ALOGE("%s: Failed to watch fence %d: %s", __func__, entry.fences[i],
+              strerror(errno));
+        entry.fences.resize(i);
+        Unwatch(&entry);
+        entry.result = -EIO;
+        break;
+      }
+    }
+  }
+
+  // Have the thread pick up the new deadline (and release the wait right
+  // away if there is nothing to wait for).
+  uint64_t count = 1;
+  if (TEMP_FAILURE_RETRY(write(wakeup_fd_.get(), &count, sizeof(count))) < 0) {
+    ALOGE("%s: Failed to wake fence waiter: %s", __func__, strerror(errno));
+  }
+  return true;
+}
+
+void FenceWaiter::Cancel() {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (auto& entry : entries_) {
+    Unwatch(&entry);
+  }
+  entries_.clear();
+}
+
+void FenceWaiter::Unwatch(Entry* entry) {
+  for (int& fence : entry->fences) {
+    if (fence >= 0) {
+      epoll_ctl(epoll_fd_.get(), EPOLL_CTL_DEL, fence, nullptr);
+      fence = -1;
+    }
+  }
+  entry->pending = 0;
+}
+
+bool FenceWaiter::threadLoop() {
+  int timeout_ms = -1;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (exiting_) {
+      return false;
+    }
+    // Deadlines only ever grow, so the oldest wait expires first.
+    for (const auto& entry : entries_) {
+      if (entry.pending > 0) {
+        int64_t remaining = entry.deadline - systemTime(SYSTEM_TIME_MONOTONIC);
+        timeout_ms = remaining > 0 ? ns2ms(remaining + ms2ns(1) - 1) : 0;
+        break;
+      }
+    }
+  }
+
+  epoll_event events[kMaxEvents];
+  int count = TEMP_FAILURE_RETRY(
+      epoll_wait(epoll_fd_.get(), events, kMaxEvents, timeout_ms));
+  if (count < 0) {
+    ALOGE("%s: epoll_wait fails: %s", __func__, strerror(errno));
+    return false;
+  }
+
+  std::vector<std::pair<Callback, int>> ready;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (exiting_) {
+      return false;
+    }
+
+    for (int i = 0; i < count; ++i) {
+      uint64_t tag = events[i].data.u64;
+      if (tag == kWakeupTag) {
+        uint64_t value;
+        TEMP_FAILURE_RETRY(read(wakeup_fd_.get(), &value, sizeof(value)));
+        continue;
+      }
+      uint32_t id = tag >> 32;
+      size_t index = tag & 0xffffffff;
+      for (auto& entry : entries_) {
+        if (entry.id != id) {
+          continue;
+        }
+        // The fence may have been dropped since the event was reported.
+        int& fence = entry.fences[index];
+        if (fence < 0) {
+          break;
+        }
+        epoll_ctl(epoll_fd_.get(), EPOLL_CTL_DEL, fence, nullptr);
+        int status = FenceStatus(fence);
+        fence = -1;
+        --entry.pending;
+        if (!(events[i].events & EPOLLIN) || status < 0) {
+          ALOGE("%s: Fence of wait %u failed.", __func__, id);
+          entry.result = -EIO;
+          Unwatch(&entry);
+        }
+        break;
+      }
+    }
+
+    int64_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (auto& entry : entries_) {
+      if (entry.pending > 0 && now >= entry.deadline) {
+        ALOGE("%s: Timed out on wait %u.", __func__, entry.id);
+        entry.result = -ETIME;
+        Unwatch(&entry);
+      }
+    }
+
+    // Waits are released in order.
+    while (!entries_.empty() && entries_.front().pending == 0) {
+      ready.emplace_back(std::move(entries_.front().callback),
+                         entries_.front().result);
+      entries_.pop_front();
+    }
+    dispatching_ = ready.size();
+  }
+
+  for (auto& callback : ready) {
+    callback.first(callback.second);
+    std::lock_guard<std::mutex> guard(lock_);
+    --dispatching_;
+  }
+  return true;
+}
+
+}  // namespace default_camera_hal
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEFAULT_CAMERA_HAL_FENCE_WAITER_H_
+#define DEFAULT_CAMERA_HAL_FENCE_WAITER_H_
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <android-base/macros.h>
+#include <android-base/unique_fd.h>
+#include <utils/StrongPointer.h>
+#include <utils/Thread.h>
+
+namespace default_camera_hal {
+
+// Waits on acquire fences on a thread of its own, so callers don't have to
+// block on them. All fences are watched with a single epoll set.
+class FenceWaiter {
+ public:
+  // Called with 0 once every fence of a wait has signalled, or with an error
+  // (-ETIME if they didn't within the timeout, -EIO if a fence failed).
+  typedef std::function<void(int)> Callback;
+
+  explicit FenceWaiter(int timeout_ms);
+  ~FenceWaiter();
+
+  // Call |callback| once every fence in |fences| has signalled. Callbacks
+  // run on the waiter thread, in the order their waits were added, even if
+  // later fences signal first. The fences are not closed.
+  // If there is nothing to wait for (no fences, and no earlier waits still
+  // to call back), returns false without calling |callback|; the caller may
+  // go ahead right away.
+  bool Wait(const std::vector<int>& fences, Callback callback);
+  // Drop every wait without calling back. Callbacks already being made
+  // still complete.
+  void Cancel();
+
+ private:
+  struct Entry {
+    uint32_t id;
+    std::vector<int> fences;
+    size_t pending;
+    int64_t deadline;
+    int result;
+    Callback callback;
+  };
+
+  bool threadLoop();
+  // Stop watching the fences of |entry| still pending. Called with |lock_|.
+  void Unwatch(Entry* entry);
+
+  const int64_t timeout_ns_;
+  android::base::unique_fd epoll_fd_;
+  android::base::unique_fd wakeup_fd_;
+
+  std::mutex lock_;
+  // Waits not yet called back, oldest first.
+  std::deque<Entry> entries_;
+  // Callbacks taken off |entries_| but not yet made.
+  size_t dispatching_;
+  uint32_t next_id_;
+  bool exiting_;
+
+  android::sp<android::Thread> worker_;
+
+  DISALLOW_COPY_AND_ASSIGN(FenceWaiter);
+};
+
+}  // namespace default_camera_hal
+
+#endif  // DEFAULT_CAMERA_HAL_FENCE_WAITER_H_
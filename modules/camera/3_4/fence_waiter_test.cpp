@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fence_waiter.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using testing::Test;
+
+namespace default_camera_hal {
+
+// Pipes stand in for fences: the read end polls readable once written to.
+class FenceWaiterTest : public Test {
+ protected:
+  virtual void TearDown() {
+    for (int fd : fds_) {
+      close(fd);
+    }
+  }
+
+  int MakeFence() {
+    int fds[2];
+    EXPECT_EQ(pipe(fds), 0);
+    fds_.push_back(fds[0]);
+    fds_.push_back(fds[1]);
+    return fds[0];
+  }
+
+  void Signal(int fence) {
+    // The write end was created right after the read end.
+    for (size_t i = 0; i < fds_.size(); i += 2) {
+      if (fds_[i] == fence) {
+        char c = 0;
+        EXPECT_EQ(write(fds_[i + 1], &c, 1), 1);
+      }
+    }
+  }
+
+  FenceWaiter::Callback Record(int id) {
+    return [this, id](int res) {
+      std::lock_guard<std::mutex> guard(lock_);
+      results_.push_back({id, res});
+      cond_.notify_all();
+    };
+  }
+
+  // Wait for |count| callbacks in total to have been made.
+  bool WaitForResults(size_t count) {
+    std::unique_lock<std::mutex> lock(lock_);
+    return cond_.wait_for(lock, std::chrono::seconds(2),
+                          [this, count] { return results_.size() >= count; });
+  }
+
+  std::vector<int> fds_;
+  std::mutex lock_;
+  std::condition_variable cond_;
+  std::vector<std::pair<int, int>> results_;
+};
+
+TEST_F(FenceWaiterTest, NothingToWaitFor) {
+  FenceWaiter dut(1000);
+  EXPECT_FALSE(dut.Wait({}, Record(0)));
+}
+
+TEST_F(FenceWaiterTest, Signalled) {
+  FenceWaiter dut(1000);
+  int fence1 = MakeFence();
+  int fence2 = MakeFence();
+  ASSERT_TRUE(dut.Wait({fence1, fence2}, Record(0)));
+  Signal(fence1);
+  Signal(fence2);
+  ASSERT_TRUE(WaitForResults(1));
+  EXPECT_EQ(results_[0], std::make_pair(0, 0));
+}
+
+TEST_F(FenceWaiterTest, InOrder) {
+  FenceWaiter dut(1000);
+  int fence1 = MakeFence();
+  int fence2 = MakeFence();
+  ASSERT_TRUE(dut.Wait({fence1}, Record(1)));
+  ASSERT_TRUE(dut.Wait({fence2}, Record(2)));
+  // Nothing to wait for itself, but must still come after the others.
+  ASSERT_TRUE(dut.Wait({}, Record(3)));
+
+  Signal(fence2);
+  Signal(fence1);
+  ASSERT_TRUE(WaitForResults(3));
+  EXPECT_EQ(results_[0].first, 1);
+  EXPECT_EQ(results_[1].first, 2);
+  EXPECT_EQ(results_[2].first, 3);
+}
+
+TEST_F(FenceWaiterTest, Timeout) {
+  FenceWaiter dut(10);
+  ASSERT_TRUE(dut.Wait({MakeFence()}, Record(0)));
+  ASSERT_TRUE(WaitForResults(1));
+  EXPECT_EQ(results_[0].second, -ETIME);
+}
+
+TEST_F(FenceWaiterTest, Cancel) {
+  FenceWaiter dut(1000);
+  int fence = MakeFence();
+  ASSERT_TRUE(dut.Wait({fence}, Record(0)));
+  dut.Cancel();
+  // Nothing is left to wait behind.
+  EXPECT_FALSE(dut.Wait({}, Record(1)));
+  Signal(fence);
+  EXPECT_FALSE(WaitForResults(1));
+}
+
+}  // namespace default_camera_hal
@@ -0,0 +1,505 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "FormatCache"
+
+#include "format_cache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <tuple>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+#include <linux/videodev2.h>
+#include "common.h"
+
+namespace v4l2_camera_hal {
+
+const char FormatCache::kDefaultPath[] =
+    "/data/vendor/camera/v4l2_format_cache.bin";
+const char FormatCache::kReenumerateProperty[] =
+    "persist.vendor.camera.v4l2.reenumerate";
+
+namespace {
+
+const int32_t kStandardSizes[][2] = {
+  {4096, 2160}, // 4KDCI (for USB camera)
+  {3840, 2160}, // 4KUHD (for USB camera)
+  {3280, 2464}, // 8MP
+  {2560, 1440}, // QHD
+  {1920, 1080}, // HD1080
+  {1640, 1232}, // 2MP
+  {1280,  720}, // HD
+  {1024,  768}, // XGA
+  { 640,  480}, // VGA
+  { 320,  240}, // QVGA
+  { 176,  144}  // QCIF
+};
+
+// "V4FC", and the version of the layout below. Bump the version whenever
+// the layout or the meaning of any field changes.
+const uint32_t kMagic = 0x43463456;
+const uint32_t kVersion = 1;
+
+template <typename T>
+int Ioctl(int fd, unsigned long request, T data) {
+  return TEMP_FAILURE_RETRY(ioctl(fd, request, data));
+}
+
+// Converts a v4l2_fract with units of seconds to an int64_t with units of ns.
+inline int64_t FractToNs(const v4l2_fract& fract) {
+  return (1000000000LL * fract.numerator) / fract.denominator;
+}
+
+// The file is only ever read back on the device that wrote it, so values are
+// stored in native byte order.
+class Writer {
+ public:
+  explicit Writer(std::string* data) : data_(data) {}
+
+  template <typename T>
+  void Put(T value) {
+    data_->append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+  void PutString(const std::string& value) {
+    Put<uint32_t>(value.size());
+    data_->append(value);
+  }
+
+ private:
+  std::string* data_;
+};
+
+class Reader {
+ public:
+  explicit Reader(const std::string& data) : data_(data), offset_(0) {}
+
+  template <typename T>
+  bool Get(T* value) {
+    if (data_.size() - offset_ < sizeof(*value)) {
+      return false;
+    }
+    memcpy(value, data_.data() + offset_, sizeof(*value));
+    offset_ += sizeof(*value);
+    return true;
+  }
+  bool GetString(std::string* value) {
+    uint32_t size;
+    if (!Get(&size) || data_.size() - offset_ < size) {
+      return false;
+    }
+    value->assign(data_, offset_, size);
+    offset_ += size;
+    return true;
+  }
+  bool done() const { return offset_ == data_.size(); }
+
+ private:
+  const std::string& data_;
+  size_t offset_;
+};
+
+std::string ReadFirmwareVersion(const std::string& device_path) {
+  // USB cameras expose their firmware revision on the USB device, which is
+  // the parent of the interface the video node belongs to.
+  size_t slash = device_path.rfind('/');
+  std::string node =
+      slash == std::string::npos ? device_path : device_path.substr(slash + 1);
+  std::string version;
+  if (!android::base::ReadFileToString(
+          "/sys/class/video4linux/" + node + "/device/../bcdDevice",
+          &version)) {
+    return "";
+  }
+  return android::base::Trim(version);
+}
+
+}  // namespace
+
+bool DeviceIdentity::operator==(const DeviceIdentity& other) const {
+  return !(*this < other) && !(other < *this);
+}
+
+bool DeviceIdentity::operator<(const DeviceIdentity& other) const {
+  return std::tie(driver, card, bus_info, version, capabilities, firmware) <
+         std::tie(other.driver, other.card, other.bus_info, other.version,
+                  other.capabilities, other.firmware);
+}
+
+int QueryDeviceIdentity(int fd, const std::string& device_path,
+                        DeviceIdentity* identity) {
+  v4l2_capability caps;
+  memset(&caps, 0, sizeof(caps));
+  if (Ioctl(fd, VIDIOC_QUERYCAP, &caps) < 0) {
+    HAL_LOGE("QUERYCAP fails: %s", strerror(errno));
+    return -ENODEV;
+  }
+  // The strings are not guaranteed to be terminated when they fill the
+  // whole field.
+  identity->driver.assign(
+      reinterpret_cast<const char*>(caps.driver),
+      strnlen(reinterpret_cast<const char*>(caps.driver), sizeof(caps.driver)));
+  identity->card.assign(
+      reinterpret_cast<const char*>(caps.card),
+      strnlen(reinterpret_cast<const char*>(caps.card), sizeof(caps.card)));
+  identity->bus_info.assign(reinterpret_cast<const char*>(caps.bus_info),
+                            strnlen(reinterpret_cast<const char*>(caps.bus_info),
+                                    sizeof(caps.bus_info)));
+  identity->version = caps.version;
+  identity->capabilities = caps.capabilities;
+  identity->firmware = ReadFirmwareVersion(device_path);
+  return 0;
+}
+
+int EnumerateFormats(int fd, std::set<uint32_t>* v4l2_formats) {
+  v4l2_fmtdesc format_query;
+  memset(&format_query, 0, sizeof(format_query));
+  // TODO(b/30000211): multiplanar support.
+  format_query.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  while (Ioctl(fd, VIDIOC_ENUM_FMT, &format_query) >= 0) {
+    v4l2_formats->insert(format_query.pixelformat);
+    ++format_query.index;
+  }
+
+  if (errno != EINVAL) {
+    HAL_LOGE(
+        "ENUM_FMT fails at index %d: %s", format_query.index, strerror(errno));
+    return -ENODEV;
+  }
+  return 0;
+}
+
+int EnumerateFrameSizes(int fd, uint32_t v4l2_format,
+                        std::set<std::array<int32_t, 2>>* sizes) {
+  v4l2_frmsizeenum size_query;
+  memset(&size_query, 0, sizeof(size_query));
+  size_query.pixel_format = v4l2_format;
+  if (Ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size_query) < 0) {
+    HAL_LOGE("ENUM_FRAMESIZES failed: %s", strerror(errno));
+    return -ENODEV;
+  }
+  if (size_query.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+    // Discrete: enumerate all sizes using VIDIOC_ENUM_FRAMESIZES.
+    // Assuming that a driver with discrete frame sizes has a reasonable number
+    // of them.
+    do {
+      sizes->insert({{{static_cast<int32_t>(size_query.discrete.width),
+                       static_cast<int32_t>(size_query.discrete.height)}}});
+      ++size_query.index;
+    } while (Ioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size_query) >= 0);
+    if (errno != EINVAL) {
+      HAL_LOGE("ENUM_FRAMESIZES fails at index %d: %s",
+               size_query.index,
+               strerror(errno));
+      return -ENODEV;
+    }
+  } else {
+    // Continuous/Step-wise: based on the stepwise struct returned by the query.
+    // Fully listing all possible sizes, with large enough range/small enough
+    // step size, may produce far too many potential sizes. Instead, find the
+    // closest to a set of standard sizes.
+    for (const auto size : kStandardSizes) {
+      // Find the closest size, rounding up.
+      uint32_t desired_width = size[0];
+      uint32_t desired_height = size[1];
+      if (desired_width < size_query.stepwise.min_width ||
+          desired_height < size_query.stepwise.min_height) {
+        HAL_LOGV("Standard size %u x %u is too small for format %d",
+                 desired_width,
+                 desired_height,
+                 v4l2_format);
+        continue;
+      } else if (desired_width > size_query.stepwise.max_width ||
+                 desired_height > size_query.stepwise.max_height) {
+        HAL_LOGV("Standard size %u x %u is too big for format %d",
+                 desired_width,
+                 desired_height,
+                 v4l2_format);
+        continue;
+      }
+
+      // Round up.
+      uint32_t width_steps = (desired_width - size_query.stepwise.min_width +
+                              size_query.stepwise.step_width - 1) /
+                             size_query.stepwise.step_width;
+      uint32_t height_steps = (desired_height - size_query.stepwise.min_height +
+                               size_query.stepwise.step_height - 1) /
+                              size_query.stepwise.step_height;
+      sizes->insert(
+          {{{static_cast<int32_t>(size_query.stepwise.min_width +
+                                  width_steps * size_query.stepwise.step_width),
+             static_cast<int32_t>(size_query.stepwise.min_height +
+                                  height_steps *
+                                      size_query.stepwise.step_height)}}});
+    }
+  }
+  return 0;
+}
+
+int EnumerateFrameDurationRange(int fd, uint32_t v4l2_format,
+                                const std::array<int32_t, 2>& size,
+                                std::array<int64_t, 2>* duration_range) {
+  v4l2_frmivalenum duration_query;
+  memset(&duration_query, 0, sizeof(duration_query));
+  duration_query.pixel_format = v4l2_format;
+  duration_query.width = size[0];
+  duration_query.height = size[1];
+  if (Ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &duration_query) < 0) {
+    HAL_LOGE("ENUM_FRAMEINTERVALS failed: %s", strerror(errno));
+    return -ENODEV;
+  }
+
+  int64_t min = std::numeric_limits<int64_t>::max();
+  int64_t max = std::numeric_limits<int64_t>::min();
+  if (duration_query.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+    // Discrete: enumerate all durations using VIDIOC_ENUM_FRAMEINTERVALS.
+    do {
+      min = std::min(min, FractToNs(duration_query.discrete));
+      max = std::max(max, FractToNs(duration_query.discrete));
+      ++duration_query.index;
+    } while (Ioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &duration_query) >= 0);
+    if (errno != EINVAL) {
+      HAL_LOGE("ENUM_FRAMEINTERVALS fails at index %d: %s",
+               duration_query.index,
+               strerror(errno));
+      return -ENODEV;
+    }
+  } else {
+    // Continuous/Step-wise: simply convert the given min and max.
+    min = FractToNs(duration_query.stepwise.min);
+    max = FractToNs(duration_query.stepwise.max);
+  }
+  (*duration_range)[0] = min;
+  (*duration_range)[1] = max;
+  return 0;
+}
+
+int EnumerateCapabilities(int fd, FormatCapabilities* capabilities) {
+  capabilities->clear();
+  std::set<uint32_t> formats;
+  int res = EnumerateFormats(fd, &formats);
+  if (res) {
+    return res;
+  }
+  for (uint32_t format : formats) {
+    std::set<std::array<int32_t, 2>> sizes;
+    res = EnumerateFrameSizes(fd, format, &sizes);
+    if (res) {
+      return res;
+    }
+    FrameDurationRanges& ranges = (*capabilities)[format];
+    for (const auto& size : sizes) {
+      res = EnumerateFrameDurationRange(fd, format, size, &ranges[size]);
+      if (res) {
+        return res;
+      }
+    }
+  }
+  return 0;
+}
+
+FormatCache* FormatCache::GetInstance() {
+  static FormatCache* instance = new FormatCache(kDefaultPath);
+  return instance;
+}
+
+FormatCache::FormatCache(const std::string& path)
+    : path_(path), loaded_(false) {}
+
+bool FormatCache::Get(const DeviceIdentity& identity,
+                      FormatCapabilities* capabilities) {
+  std::lock_guard<std::mutex> guard(lock_);
+  LoadLocked();
+  auto entry = entries_.find(identity);
+  if (entry == entries_.end()) {
+    return false;
+  }
+  *capabilities = entry->second;
+  return true;
+}
+
+int FormatCache::Put(const DeviceIdentity& identity,
+                     const FormatCapabilities& capabilities) {
+  std::lock_guard<std::mutex> guard(lock_);
+  LoadLocked();
+  entries_[identity] = capabilities;
+  return SaveLocked();
+}
+
+bool FormatCache::Revalidate(const std::string& device_path,
+                             const DeviceIdentity& identity,
+                             const FormatCapabilities& cached) {
+  android::base::unique_fd fd(
+      TEMP_FAILURE_RETRY(open(device_path.c_str(), O_RDWR | O_NONBLOCK)));
+  if (fd.get() < 0) {
+    HAL_LOGW("Failed to open %s to revalidate formats: %s",
+             device_path.c_str(), strerror(errno));
+    return false;
+  }
+  DeviceIdentity current;
+  if (QueryDeviceIdentity(fd.get(), device_path, &current) ||
+      !(current == identity)) {
+    HAL_LOGV("Device at %s changed, not revalidating.", device_path.c_str());
+    return false;
+  }
+  FormatCapabilities fresh;
+  if (EnumerateCapabilities(fd.get(), &fresh)) {
+    HAL_LOGW("Failed to enumerate %s to revalidate formats.",
+             device_path.c_str());
+    return false;
+  }
+  if (fresh == cached) {
+    return false;
+  }
+  HAL_LOGW("Cached formats of %s (%s) are stale; updated for next time.",
+           device_path.c_str(), identity.card.c_str());
+  Put(identity, fresh);
+  return true;
+}
+
+void FormatCache::Encode(
+    const std::map<DeviceIdentity, FormatCapabilities>& entries,
+    std::string* data) {
+  data->clear();
+  Writer writer(data);
+  writer.Put(kMagic);
+  writer.Put(kVersion);
+  writer.Put<uint32_t>(entries.size());
+  for (const auto& entry : entries) {
+    const DeviceIdentity& identity = entry.first;
+    writer.PutString(identity.driver);
+    writer.PutString(identity.card);
+    writer.PutString(identity.bus_info);
+    writer.Put(identity.version);
+    writer.Put(identity.capabilities);
+    writer.PutString(identity.firmware);
+    writer.Put<uint32_t>(entry.second.size());
+    for (const auto& format : entry.second) {
+      writer.Put(format.first);
+      writer.Put<uint32_t>(format.second.size());
+      for (const auto& size : format.second) {
+        writer.Put(size.first[0]);
+        writer.Put(size.first[1]);
+        writer.Put(size.second[0]);
+        writer.Put(size.second[1]);
+      }
+    }
+  }
+}
+
+bool FormatCache::Decode(
+    const std::string& data,
+    std::map<DeviceIdentity, FormatCapabilities>* entries) {
+  entries->clear();
+  Reader reader(data);
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_entries;
+  if (!reader.Get(&magic) || magic != kMagic || !reader.Get(&version) ||
+      version != kVersion || !reader.Get(&num_entries)) {
+    return false;
+  }
+  // Counts are not trusted for reserving space; a truncated or corrupt file
+  // simply runs out of data.
+  for (uint32_t i = 0; i < num_entries; ++i) {
+    DeviceIdentity identity;
+    uint32_t num_formats;
+    if (!reader.GetString(&identity.driver) ||
+        !reader.GetString(&identity.card) ||
+        !reader.GetString(&identity.bus_info) ||
+        !reader.Get(&identity.version) ||
+        !reader.Get(&identity.capabilities) ||
+        !reader.GetString(&identity.firmware) || !reader.Get(&num_formats)) {
+      return false;
+    }
+    FormatCapabilities& capabilities = (*entries)[identity];
+    for (uint32_t j = 0; j < num_formats; ++j) {
+      uint32_t format;
+      uint32_t num_sizes;
+      if (!reader.Get(&format) || !reader.Get(&num_sizes)) {
+        return false;
+      }
+      FrameDurationRanges& ranges = capabilities[format];
+      for (uint32_t k = 0; k < num_sizes; ++k) {
+        std::array<int32_t, 2> size;
+        std::array<int64_t, 2> range;
+        if (!reader.Get(&size[0]) || !reader.Get(&size[1]) ||
+            !reader.Get(&range[0]) || !reader.Get(&range[1])) {
+          return false;
+        }
+        ranges[size] = range;
+      }
+    }
+  }
+  return reader.done();
+}
+
+void FormatCache::LoadLocked() {
+  if (loaded_) {
+    return;
+  }
+  loaded_ = true;
+  std::string data;
+  if (!android::base::ReadFileToString(path_, &data)) {
+    HAL_LOGV("No format cache at %s.", path_.c_str());
+    return;
+  }
+  if (!Decode(data, &entries_)) {
+    HAL_LOGW("Ignoring malformed format cache %s.", path_.c_str());
+    entries_.clear();
+  }
+}
+
+int FormatCache::SaveLocked() {
+  std::string data;
+  Encode(entries_, &data);
+  // The directory is normally created at boot by camera.v4l2.rc; create it
+  // here too in case the HAL is loaded by a process that is allowed to.
+  size_t slash = path_.rfind('/');
+  if (slash != std::string::npos && slash > 0 &&
+      mkdir(path_.substr(0, slash).c_str(), 0770) && errno != EEXIST) {
+    HAL_LOGV("Failed to create format cache directory: %s", strerror(errno));
+  }
+  // Write a new file and move it into place, so a crash midway never leaves
+  // a truncated cache behind.
+  std::string temp_path = path_ + ".tmp";
+  if (!android::base::WriteStringToFile(data, temp_path)) {
+    int res = -errno;
+    HAL_LOGW("Failed to write format cache %s: %s", temp_path.c_str(),
+             strerror(-res));
+    return res;
+  }
+  if (rename(temp_path.c_str(), path_.c_str())) {
+    int res = -errno;
+    HAL_LOGW("Failed to replace format cache %s: %s", path_.c_str(),
+             strerror(-res));
+    unlink(temp_path.c_str());
+    return res;
+  }
+  return 0;
+}
+
+}  // namespace v4l2_camera_hal
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef V4L2_CAMERA_HAL_FORMAT_CACHE_H_
+#define V4L2_CAMERA_HAL_FORMAT_CACHE_H_
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include <android-base/macros.h>
+
+namespace v4l2_camera_hal {
+
+// What identifies a particular camera, as far as its formats go.
+struct DeviceIdentity {
+  // From VIDIOC_QUERYCAP.
+  std::string driver;
+  std::string card;
+  std::string bus_info;
+  uint32_t version = 0;
+  uint32_t capabilities = 0;
+  // Device firmware revision (bcdDevice for USB cameras), if exposed.
+  std::string firmware;
+
+  bool operator==(const DeviceIdentity& other) const;
+  bool operator<(const DeviceIdentity& other) const;
+};
+
+// Everything VIDIOC_ENUM_FMT, VIDIOC_ENUM_FRAMESIZES and
+// VIDIOC_ENUM_FRAMEINTERVALS report for a device: for each pixel format,
+// the frame duration range (in ns) of each frame size.
+typedef std::map<std::array<int32_t, 2>, std::array<int64_t, 2>>
+    FrameDurationRanges;
+typedef std::map<uint32_t, FrameDurationRanges> FormatCapabilities;
+
+// Fill in |identity| for the device open at |fd|, whose node is
+// |device_path|. Returns 0 or a negative error code.
+int QueryDeviceIdentity(int fd, const std::string& device_path,
+                        DeviceIdentity* identity);
+
+// Enumeration of the device open at |fd|. These issue the ioctls directly;
+// callers sharing |fd| with other threads must serialize access themselves.
+// Each returns 0 or a negative error code.
+int EnumerateFormats(int fd, std::set<uint32_t>* v4l2_formats);
+int EnumerateFrameSizes(int fd, uint32_t v4l2_format,
+                        std::set<std::array<int32_t, 2>>* sizes);
+int EnumerateFrameDurationRange(int fd, uint32_t v4l2_format,
+                                const std::array<int32_t, 2>& size,
+                                std::array<int64_t, 2>* duration_range);
+// All of the above. Fails if any part of the enumeration does.
+int EnumerateCapabilities(int fd, FormatCapabilities* capabilities);
+
+// Enumeration results of every camera seen so far, kept in a file so later
+// boots can skip the (slow, on UVC cameras) enumeration ioctls.
+class FormatCache {
+ public:
+  // The cache shared by all cameras, stored at kDefaultPath.
+  static FormatCache* GetInstance();
+  static const char kDefaultPath[];
+  // When this system property is set, cached entries are ignored and every
+  // camera is enumerated again (which then refreshes the cache).
+  static const char kReenumerateProperty[];
+
+  explicit FormatCache(const std::string& path);
+
+  // Look up the capabilities of |identity|. False if not cached.
+  bool Get(const DeviceIdentity& identity, FormatCapabilities* capabilities);
+  // Store the capabilities of |identity| and rewrite the file.
+  // Returns 0 or a negative error code; on error the entry is still kept in
+  // memory.
+  int Put(const DeviceIdentity& identity,
+          const FormatCapabilities& capabilities);
+
+  // Enumerate the device at |device_path| again on a fresh fd, and update
+  // the entry for |identity| if it no longer matches |cached|. Does nothing
+  // if a different device is now at |device_path|.
+  // Returns true if the entry changed.
+  bool Revalidate(const std::string& device_path,
+                  const DeviceIdentity& identity,
+                  const FormatCapabilities& cached);
+
+  // Binary encoding of a set of entries. Decode returns false on malformed
+  // or unknown-version input.
+  static void Encode(const std::map<DeviceIdentity, FormatCapabilities>& entries,
+                     std::string* data);
+  static bool Decode(const std::string& data,
+                     std::map<DeviceIdentity, FormatCapabilities>* entries);
+
+ private:
+  // Read the file, once. Called with |lock_| held.
+  void LoadLocked();
+  // Write the file. Called with |lock_| held.
+  int SaveLocked();
+
+  const std::string path_;
+  std::mutex lock_;
+  bool loaded_;
+  std::map<DeviceIdentity, FormatCapabilities> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(FormatCache);
+};
+
+}  // namespace v4l2_camera_hal
+
+#endif  // V4L2_CAMERA_HAL_FORMAT_CACHE_H_
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "format_cache.h"
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+#include <linux/videodev2.h>
+
+using testing::Test;
+
+namespace v4l2_camera_hal {
+
+class FormatCacheTest : public Test {
+ protected:
+  virtual void SetUp() {
+    identity_.driver = "uvcvideo";
+    identity_.card = "USB Camera";
+    identity_.bus_info = "usb-xhci-hcd.0-1";
+    identity_.version = 0x040e00;
+    identity_.capabilities = 0x84a00001;
+    identity_.firmware = "0100";
+
+    capabilities_[V4L2_PIX_FMT_YUYV][{{640, 480}}] = {{33333333, 100000000}};
+    capabilities_[V4L2_PIX_FMT_YUYV][{{1280, 720}}] = {{100000000, 200000000}};
+    capabilities_[V4L2_PIX_FMT_MJPEG][{{1920, 1080}}] = {{33333333, 33333333}};
+  }
+
+  DeviceIdentity identity_;
+  FormatCapabilities capabilities_;
+};
+
+TEST_F(FormatCacheTest, EncodeDecode) {
+  DeviceIdentity other = identity_;
+  other.bus_info = "usb-xhci-hcd.0-2";
+  std::map<DeviceIdentity, FormatCapabilities> entries;
+  entries[identity_] = capabilities_;
+  entries[other] = {};
+
+  std::string data;
+  FormatCache::Encode(entries, &data);
+  std::map<DeviceIdentity, FormatCapabilities> decoded;
+  ASSERT_TRUE(FormatCache::Decode(data, &decoded));
+  EXPECT_EQ(decoded, entries);
+}
+
+TEST_F(FormatCacheTest, DecodeRejectsMalformed) {
+  std::map<DeviceIdentity, FormatCapabilities> entries;
+  entries[identity_] = capabilities_;
+  std::string data;
+  FormatCache::Encode(entries, &data);
+
+  std::map<DeviceIdentity, FormatCapabilities> decoded;
+  // Truncated anywhere.
+  for (size_t size = 0; size < data.size(); ++size) {
+    EXPECT_FALSE(FormatCache::Decode(data.substr(0, size), &decoded))
+        << "Accepted " << size << " of " << data.size() << " bytes";
+  }
+  // Trailing garbage.
+  EXPECT_FALSE(FormatCache::Decode(data + "x", &decoded));
+  // Wrong magic.
+  std::string bad = data;
+  bad[0] ^= 1;
+  EXPECT_FALSE(FormatCache::Decode(bad, &decoded));
+}
+
+TEST_F(FormatCacheTest, PersistsAcrossInstances) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/cache.bin";
+
+  FormatCapabilities result;
+  {
+    FormatCache cache(path);
+    EXPECT_FALSE(cache.Get(identity_, &result));
+    EXPECT_EQ(cache.Put(identity_, capabilities_), 0);
+    ASSERT_TRUE(cache.Get(identity_, &result));
+    EXPECT_EQ(result, capabilities_);
+  }
+
+  FormatCache cache(path);
+  ASSERT_TRUE(cache.Get(identity_, &result));
+  EXPECT_EQ(result, capabilities_);
+  // A different device (or firmware) misses.
+  DeviceIdentity other = identity_;
+  other.firmware = "0101";
+  EXPECT_FALSE(cache.Get(other, &result));
+}
+
+TEST_F(FormatCacheTest, IgnoresCorruptFile) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/cache.bin";
+  ASSERT_TRUE(android::base::WriteStringToFile("not a cache", path));
+
+  FormatCache cache(path);
+  FormatCapabilities result;
+  EXPECT_FALSE(cache.Get(identity_, &result));
+  // And it gets replaced.
+  EXPECT_EQ(cache.Put(identity_, capabilities_), 0);
+  FormatCache reloaded(path);
+  EXPECT_TRUE(reloaded.Get(identity_, &result));
+}
+
+}  // namespace v4l2_camera_hal
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "FrameDump"
+
+#include "frame_dump.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "common.h"
+
+namespace v4l2_camera_hal {
+
+namespace {
+
+const char kFrameDumpMagic[8] = {'V', '4', 'L', '2', 'D', 'M', 'P', '1'};
+
+// Read exactly |size| bytes. Returns 1 if done, 0 at end of file (even
+// partway), or a negative error code.
+int ReadFully(int fd, void* data, size_t size) {
+  uint8_t* dst = static_cast<uint8_t*>(data);
+  while (size > 0) {
+    ssize_t res = TEMP_FAILURE_RETRY(read(fd, dst, size));
+    if (res < 0) {
+      return -errno;
+    } else if (res == 0) {
+      return 0;
+    }
+    dst += res;
+    size -= res;
+  }
+  return 1;
+}
+
+int WriteFully(int fd, iovec* iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t res = TEMP_FAILURE_RETRY(writev(fd, iov, iovcnt));
+    if (res < 0) {
+      return -errno;
+    }
+    // Skip what was written, which may end partway through a vector.
+    while (iovcnt > 0 && static_cast<size_t>(res) >= iov->iov_len) {
+      res -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + res;
+      iov->iov_len -= res;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+FrameDumpWriter::FrameDumpWriter() : frames_left_(0) {}
+
+int FrameDumpWriter::Open(const std::string& path, uint32_t fourcc,
+                          uint32_t width, uint32_t height,
+                          uint32_t max_frames) {
+  Close();
+  fd_.reset(TEMP_FAILURE_RETRY(
+      open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)));
+  if (fd_.get() < 0) {
+    int res = -errno;
+    HAL_LOGE("Failed to create frame dump %s: %s", path.c_str(),
+             strerror(-res));
+    return res;
+  }
+
+  FrameDumpHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kFrameDumpMagic, sizeof(header.magic));
+  header.fourcc = fourcc;
+  header.width = width;
+  header.height = height;
+  iovec iov = {&header, sizeof(header)};
+  int res = WriteFully(fd_.get(), &iov, 1);
+  if (res) {
+    HAL_LOGE("Failed to write frame dump header: %s", strerror(-res));
+    Close();
+    return res;
+  }
+  frames_left_ = max_frames;
+  return 0;
+}
+
+void FrameDumpWriter::Close() {
+  fd_.reset();
+  frames_left_ = 0;
+}
+
+int FrameDumpWriter::Write(const uint8_t* data, uint32_t size,
+                           int64_t timestamp_ns, uint32_t sequence) {
+  if (!IsOpen()) {
+    return -EBADF;
+  }
+  if (frames_left_ == 0) {
+    return 0;
+  }
+
+  FrameDumpRecord record;
+  memset(&record, 0, sizeof(record));
+  record.timestamp_ns = timestamp_ns;
+  record.sequence = sequence;
+  record.size = size;
+  iovec iov[2] = {{&record, sizeof(record)},
+                  {const_cast<uint8_t*>(data), size}};
+  int res = WriteFully(fd_.get(), iov, 2);
+  if (res) {
+    HAL_LOGE("Failed to write frame %u to dump: %s", sequence,
+             strerror(-res));
+    Close();
+    return res;
+  }
+  --frames_left_;
+  return 0;
+}
+
+int ReadFrameDump(const std::string& path, size_t max_frames,
+                  FrameDump* dump) {
+  android::base::unique_fd fd(
+      TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd.get() < 0) {
+    int res = -errno;
+    HAL_LOGE("Failed to open frame dump %s: %s", path.c_str(),
+             strerror(-res));
+    return res;
+  }
+
+  FrameDumpHeader header;
+  int res = ReadFully(fd.get(), &header, sizeof(header));
+  if (res < 0) {
+    HAL_LOGE("Failed to read frame dump %s: %s", path.c_str(),
+             strerror(-res));
+    return res;
+  }
+  if (res == 0 ||
+      memcmp(header.magic, kFrameDumpMagic, sizeof(header.magic))) {
+    HAL_LOGE("%s is not a frame dump.", path.c_str());
+    return -EINVAL;
+  }
+
+  dump->fourcc = header.fourcc;
+  dump->width = header.width;
+  dump->height = header.height;
+  dump->frames.clear();
+  while (dump->frames.size() < max_frames) {
+    FrameDumpRecord record;
+    res = ReadFully(fd.get(), &record, sizeof(record));
+    if (res <= 0) {
+      break;
+    }
+    std::unique_ptr<arc::AllocatedFrameBuffer> buffer(
+        new arc::AllocatedFrameBuffer(record.size));
+    res = ReadFully(fd.get(), buffer->GetData(), record.size);
+    if (res <= 0) {
+      break;
+    }
+    buffer->SetDataSize(record.size);
+    buffer->SetFourcc(header.fourcc);
+    buffer->SetWidth(header.width);
+    buffer->SetHeight(header.height);
+    dump->frames.push_back(
+        {record.timestamp_ns, record.sequence, std::move(buffer)});
+  }
+  if (res < 0) {
+    HAL_LOGE("Failed to read frame dump %s: %s", path.c_str(),
+             strerror(-res));
+    return res;
+  }
+  if (dump->frames.empty()) {
+    HAL_LOGE("Frame dump %s holds no frames.", path.c_str());
+    return -EINVAL;
+  }
+  HAL_LOGV("Read %zu frames of %ux%u 0x%x from %s.", dump->frames.size(),
+           dump->width, dump->height, dump->fourcc, path.c_str());
+  return 0;
+}
+
+}  // namespace v4l2_camera_hal
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef V4L2_CAMERA_HAL_FRAME_DUMP_H_
+#define V4L2_CAMERA_HAL_FRAME_DUMP_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/macros.h>
+#include <android-base/unique_fd.h>
+#include "arc/frame_buffer.h"
+
+namespace v4l2_camera_hal {
+
+// Frame dumps record the frames a V4L2 device returned, so they can be
+// played back through the HAL without the device (see V4L2ReplayWrapper).
+// A dump is a FrameDumpHeader followed by a FrameDumpRecord and its payload
+// for each frame, all in host byte order.
+struct FrameDumpHeader {
+  char magic[8];
+  uint32_t fourcc;
+  uint32_t width;
+  uint32_t height;
+  uint32_t reserved;
+};
+
+struct FrameDumpRecord {
+  // CLOCK_MONOTONIC time the device captured the frame, 0 if unknown.
+  int64_t timestamp_ns;
+  uint32_t sequence;
+  // Size of the payload that follows.
+  uint32_t size;
+};
+
+// Appends frames to a dump file.
+class FrameDumpWriter {
+ public:
+  FrameDumpWriter();
+
+  // Start a dump of |fourcc| frames at |path|, replacing any file there.
+  // At most |max_frames| frames are written; later ones are ignored.
+  // Returns 0 or a negative error code.
+  int Open(const std::string& path, uint32_t fourcc, uint32_t width,
+           uint32_t height, uint32_t max_frames);
+  void Close();
+  bool IsOpen() const { return fd_.get() >= 0; }
+
+  // Append a frame. On failure the dump is closed, keeping the frames
+  // written so far.
+  int Write(const uint8_t* data, uint32_t size, int64_t timestamp_ns,
+            uint32_t sequence);
+
+ private:
+  android::base::unique_fd fd_;
+  uint32_t frames_left_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameDumpWriter);
+};
+
+// A dump read back into memory.
+struct FrameDump {
+  struct Frame {
+    int64_t timestamp_ns;
+    uint32_t sequence;
+    std::unique_ptr<arc::AllocatedFrameBuffer> buffer;
+  };
+
+  uint32_t fourcc = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<Frame> frames;
+};
+
+// Read up to |max_frames| frames of the dump at |path| into |dump|. A
+// truncated final frame (e.g. from a recording cut short) is dropped.
+// Returns 0, or a negative error code if the file can't be read, isn't a
+// dump, or holds no complete frame.
+int ReadFrameDump(const std::string& path, size_t max_frames, FrameDump* dump);
+
+}  // namespace v4l2_camera_hal
+
+#endif  // V4L2_CAMERA_HAL_FRAME_DUMP_H_
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frame_dump.h"
+
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+#include <linux/videodev2.h>
+
+using testing::Test;
+
+namespace v4l2_camera_hal {
+
+class FrameDumpTest : public Test {
+ protected:
+  virtual void SetUp() { path_ = std::string(dir_.path) + "/frames.dump"; }
+
+  // Write |count| 4x2 YUYV frames, each filled with its index.
+  void WriteFrames(size_t count, uint32_t max_frames) {
+    FrameDumpWriter writer;
+    ASSERT_EQ(writer.Open(path_, V4L2_PIX_FMT_YUYV, 4, 2, max_frames), 0);
+    for (size_t i = 0; i < count; ++i) {
+      std::vector<uint8_t> frame(16, i);
+      ASSERT_EQ(writer.Write(frame.data(), frame.size(), 1000 * i, i), 0);
+    }
+  }
+
+  TemporaryDir dir_;
+  std::string path_;
+};
+
+TEST_F(FrameDumpTest, RoundTrip) {
+  WriteFrames(3, 10);
+
+  FrameDump dump;
+  ASSERT_EQ(ReadFrameDump(path_, 10, &dump), 0);
+  EXPECT_EQ(dump.fourcc, V4L2_PIX_FMT_YUYV);
+  EXPECT_EQ(dump.width, 4u);
+  EXPECT_EQ(dump.height, 2u);
+  ASSERT_EQ(dump.frames.size(), 3u);
+  for (size_t i = 0; i < dump.frames.size(); ++i) {
+    const FrameDump::Frame& frame = dump.frames[i];
+    EXPECT_EQ(frame.timestamp_ns, static_cast<int64_t>(1000 * i));
+    EXPECT_EQ(frame.sequence, i);
+    ASSERT_EQ(frame.buffer->GetDataSize(), 16u);
+    EXPECT_EQ(frame.buffer->GetData()[15], i);
+    EXPECT_EQ(frame.buffer->GetFourcc(), V4L2_PIX_FMT_YUYV);
+    EXPECT_EQ(frame.buffer->GetWidth(), 4u);
+  }
+}
+
+TEST_F(FrameDumpTest, FrameLimits) {
+  // The writer stops at its limit, the reader at its own.
+  WriteFrames(5, 4);
+  FrameDump dump;
+  ASSERT_EQ(ReadFrameDump(path_, 10, &dump), 0);
+  EXPECT_EQ(dump.frames.size(), 4u);
+  ASSERT_EQ(ReadFrameDump(path_, 2, &dump), 0);
+  EXPECT_EQ(dump.frames.size(), 2u);
+}
+
+TEST_F(FrameDumpTest, DropsTruncatedFrame) {
+  WriteFrames(2, 10);
+  std::string data;
+  ASSERT_TRUE(android::base::ReadFileToString(path_, &data));
+  ASSERT_TRUE(
+      android::base::WriteStringToFile(data.substr(0, data.size() - 1), path_));
+
+  FrameDump dump;
+  ASSERT_EQ(ReadFrameDump(path_, 10, &dump), 0);
+  EXPECT_EQ(dump.frames.size(), 1u);
+}
+
+TEST_F(FrameDumpTest, RejectsBadDumps) {
+  FrameDump dump;
+  EXPECT_LT(ReadFrameDump(path_, 10, &dump), 0);
+
+  ASSERT_TRUE(android::base::WriteStringToFile("not a frame dump", path_));
+  EXPECT_EQ(ReadFrameDump(path_, 10, &dump), -EINVAL);
+
+  // A header alone has nothing to replay.
+  WriteFrames(0, 10);
+  EXPECT_EQ(ReadFrameDump(path_, 10, &dump), -EINVAL);
+}
+
+}  // namespace v4l2_camera_hal
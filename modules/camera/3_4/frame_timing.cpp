@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frame_timing.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <limits>
+#include <utility>
+
+#include <utils/Timers.h>
+
+namespace default_camera_hal {
+
+namespace {
+
+const int64_t kFirstBucketLimitNs = 250000;  // 250us.
+
+double ToMs(int64_t ns) { return ns / 1000000.0; }
+
+}  // namespace
+
+int64_t FrameTimingNow() { return systemTime(SYSTEM_TIME_MONOTONIC); }
+
+int64_t MonotonicToBoottime(int64_t monotonic_ns) {
+  // Bracket the boottime read, so the offset isn't skewed by a preemption
+  // between the two reads.
+  int64_t before = systemTime(SYSTEM_TIME_MONOTONIC);
+  int64_t boottime = systemTime(SYSTEM_TIME_BOOTTIME);
+  int64_t after = systemTime(SYSTEM_TIME_MONOTONIC);
+  return monotonic_ns + boottime - (before + (after - before) / 2);
+}
+
+uint32_t FrameSequenceTracker::Add(uint32_t sequence) {
+  // Sequence numbers wrap, and a frame repeated or out of order (which
+  // shouldn't happen) isn't a drop.
+  uint32_t skipped = sequence - next_;
+  if (skipped > std::numeric_limits<uint32_t>::max() / 2) {
+    skipped = 0;
+  }
+  next_ = sequence + 1;
+  ++frames_;
+  dropped_ += skipped;
+  return skipped;
+}
+
+void FrameSequenceTracker::Reset() {
+  next_ = 0;
+  frames_ = 0;
+  dropped_ = 0;
+}
+
+LatencyHistogram::LatencyHistogram() { Clear(); }
+
+void LatencyHistogram::Add(int64_t latency_ns) {
+  if (latency_ns < 0) {
+    latency_ns = 0;
+  }
+  ++count_;
+  sum_ += latency_ns;
+  if (latency_ns < min_) {
+    min_ = latency_ns;
+  }
+  if (latency_ns > max_) {
+    max_ = latency_ns;
+  }
+  ++buckets_[BucketFor(latency_ns)];
+}
+
+void LatencyHistogram::Clear() {
+  count_ = 0;
+  sum_ = 0;
+  min_ = std::numeric_limits<int64_t>::max();
+  max_ = 0;
+  buckets_.fill(0);
+}
+
+size_t LatencyHistogram::BucketFor(int64_t latency_ns) {
+  size_t i = 0;
+  while (i < kNumBuckets - 1 && latency_ns >= BucketLimit(i)) {
+    ++i;
+  }
+  return i;
+}
+
+int64_t LatencyHistogram::BucketLimit(size_t i) {
+  if (i >= kNumBuckets - 1) {
+    return std::numeric_limits<int64_t>::max();
+  }
+  return kFirstBucketLimitNs << i;
+}
+
+void LatencyHistogram::Dump(int fd, const char* name) const {
+  if (!count_) {
+    dprintf(fd, "    %s: no samples\n", name);
+    return;
+  }
+  dprintf(fd, "    %s: n=%" PRIu64 " min=%.2fms mean=%.2fms max=%.2fms\n", name,
+          count_, ToMs(min_), ToMs(mean()), ToMs(max_));
+  dprintf(fd, "     ");
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    if (!buckets_[i]) {
+      continue;
+    }
+    if (i < kNumBuckets - 1) {
+      dprintf(fd, " <%gms:%" PRIu64, ToMs(BucketLimit(i)), buckets_[i]);
+    } else {
+      dprintf(fd, " >=%gms:%" PRIu64, ToMs(BucketLimit(i - 1)), buckets_[i]);
+    }
+  }
+  dprintf(fd, "\n");
+}
+
+FrameTimingStats::FrameTimingStats() {}
+
+void FrameTimingStats::Record(const CaptureRequest& request) {
+  const CaptureTimings& timings = request.timings;
+  // The stages in order, each paired with the span that ends at it.
+  const std::pair<int64_t, Span> stages[] = {{timings.queued, kQueue},
+                                             {timings.dequeued, kCapture},
+                                             {timings.converted, kConvert},
+                                             {timings.encoded, kEncode},
+                                             {timings.returned, kReturn}};
+
+  std::lock_guard<std::mutex> guard(lock_);
+  for (const auto& output_buffer : request.output_buffers) {
+    StreamTimings& stream = GetStreamTimings(output_buffer.stream);
+    int64_t previous = timings.accepted;
+    for (const auto& stage : stages) {
+      if (!stage.first) {
+        continue;
+      }
+      if (previous) {
+        stream.spans[stage.second].Add(stage.first - previous);
+      }
+      previous = stage.first;
+    }
+    if (timings.accepted && timings.returned) {
+      stream.spans[kTotal].Add(timings.returned - timings.accepted);
+    }
+  }
+}
+
+void FrameTimingStats::RecordError(const CaptureRequest& request) {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (const auto& output_buffer : request.output_buffers) {
+    ++GetStreamTimings(output_buffer.stream).errors;
+  }
+}
+
+void FrameTimingStats::Clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  streams_.clear();
+}
+
+LatencyHistogram FrameTimingStats::Get(const camera3_stream_t* stream,
+                                       Span span) const {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto timings = streams_.find(stream);
+  if (timings == streams_.end()) {
+    return LatencyHistogram();
+  }
+  return timings->second.spans[span];
+}
+
+uint64_t FrameTimingStats::GetErrors(const camera3_stream_t* stream) const {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto timings = streams_.find(stream);
+  if (timings == streams_.end()) {
+    return 0;
+  }
+  return timings->second.errors;
+}
+
+void FrameTimingStats::Dump(int fd) const {
+  std::lock_guard<std::mutex> guard(lock_);
+  dprintf(fd, "Frame timing:\n");
+  if (streams_.empty()) {
+    dprintf(fd, "  No requests completed since streams were configured.\n");
+    return;
+  }
+  for (const auto& stream : streams_) {
+    dprintf(fd, "  Stream %p (%ux%u, format 0x%x): %" PRIu64 " errors\n",
+            stream.first, stream.second.width, stream.second.height,
+            stream.second.format, stream.second.errors);
+    for (int span = 0; span < kNumSpans; ++span) {
+      stream.second.spans[span].Dump(fd, SpanName(static_cast<Span>(span)));
+    }
+  }
+}
+
+FrameTimingStats::StreamTimings& FrameTimingStats::GetStreamTimings(
+    const camera3_stream_t* stream) {
+  auto timings = streams_.find(stream);
+  if (timings != streams_.end()) {
+    return timings->second;
+  }
+  StreamTimings& result = streams_[stream];
+  result.width = stream->width;
+  result.height = stream->height;
+  result.format = stream->format;
+  return result;
+}
+
+const char* FrameTimingStats::SpanName(Span span) {
+  switch (span) {
+    case kQueue:
+      return "accepted->queued";
+    case kCapture:
+      return "queued->dequeued";
+    case kConvert:
+      return "dequeued->converted";
+    case kEncode:
+      return "->encoded";
+    case kReturn:
+      return "->returned";
+    case kTotal:
+      return "total";
+    default:
+      return "unknown";
+  }
+}
+
+}  // namespace default_camera_hal
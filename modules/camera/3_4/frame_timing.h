@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEFAULT_CAMERA_HAL_FRAME_TIMING_H_
+#define DEFAULT_CAMERA_HAL_FRAME_TIMING_H_
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#include <android-base/macros.h>
+#include <hardware/camera3.h>
+#include "capture_request.h"
+
+namespace default_camera_hal {
+
+// The current CLOCK_MONOTONIC time, for stamping CaptureTimings.
+int64_t FrameTimingNow();
+
+// Convert a CLOCK_MONOTONIC time, such as a V4L2 buffer timestamp, to
+// CLOCK_BOOTTIME, which sensor timestamps are reported in. The clocks differ
+// by the time spent in suspend, measured at the time of the call.
+int64_t MonotonicToBoottime(int64_t monotonic_ns);
+
+// Counts frames the device skipped, from gaps in the sequence numbers of the
+// buffers it returns.
+class FrameSequenceTracker {
+ public:
+  FrameSequenceTracker() { Reset(); }
+
+  // Note the sequence number of the next returned frame, and return how many
+  // frames were skipped before it. The first frame after a reset is expected
+  // to be numbered 0, as V4L2 numbers frames from when streaming starts.
+  uint32_t Add(uint32_t sequence);
+  // Start over, e.g. because the stream was turned off.
+  void Reset();
+
+  uint64_t frames() const { return frames_; }
+  uint64_t dropped() const { return dropped_; }
+
+ private:
+  uint32_t next_;
+  uint64_t frames_;
+  uint64_t dropped_;
+};
+
+// Latency distribution in power-of-two buckets, from under 250us up to
+// over 512ms.
+class LatencyHistogram {
+ public:
+  static constexpr size_t kNumBuckets = 13;
+
+  LatencyHistogram();
+
+  void Add(int64_t latency_ns);
+  void Clear();
+
+  uint64_t count() const { return count_; }
+  int64_t min() const { return min_; }
+  int64_t max() const { return max_; }
+  int64_t mean() const { return count_ ? sum_ / count_ : 0; }
+  uint64_t bucket(size_t i) const { return buckets_[i]; }
+
+  // Bucket that |latency_ns| falls into.
+  static size_t BucketFor(int64_t latency_ns);
+  // Exclusive upper bound of bucket |i|, in ns; the last bucket is unbounded.
+  static int64_t BucketLimit(size_t i);
+
+  // Print a one line summary prefixed with |name|, followed by a line of
+  // the non-empty buckets.
+  void Dump(int fd, const char* name) const;
+
+ private:
+  uint64_t count_;
+  int64_t sum_;
+  int64_t min_;
+  int64_t max_;
+  std::array<uint64_t, kNumBuckets> buckets_;
+};
+
+// Per-stream latency histograms of each stage requests go through,
+// built from the CaptureTimings of completed requests.
+class FrameTimingStats {
+ public:
+  // Spans between consecutive stages. Stages a request skipped are folded
+  // into the next span it does have (e.g. a DMABUF capture that is never
+  // converted counts its dequeue to return time under kReturn).
+  enum Span {
+    kQueue,    // accepted -> queued
+    kCapture,  // queued -> dequeued
+    kConvert,  // dequeued -> converted
+    kEncode,   // converted -> encoded
+    kReturn,   // last stage reached -> returned
+    kTotal,    // accepted -> returned
+    kNumSpans
+  };
+
+  FrameTimingStats();
+
+  // Record the timings of a request that has been returned, against each of
+  // its output streams.
+  void Record(const CaptureRequest& request);
+  // Count a request that was returned in an error state, against each of its
+  // output streams. Its timings are not recorded.
+  void RecordError(const CaptureRequest& request);
+  // Forget everything, e.g. because the streams were reconfigured.
+  void Clear();
+
+  // Copy of the histogram for |span| of |stream|. Empty if there is none.
+  LatencyHistogram Get(const camera3_stream_t* stream, Span span) const;
+  uint64_t GetErrors(const camera3_stream_t* stream) const;
+
+  void Dump(int fd) const;
+
+ private:
+  struct StreamTimings {
+    // Copied from the stream, which may be gone by the time of a dump.
+    uint32_t width = 0;
+    uint32_t height = 0;
+    int format = 0;
+    std::array<LatencyHistogram, kNumSpans> spans;
+    uint64_t errors = 0;
+  };
+
+  // The entry for |stream|, created if needed. Called with |lock_| held.
+  StreamTimings& GetStreamTimings(const camera3_stream_t* stream);
+  static const char* SpanName(Span span);
+
+  mutable std::mutex lock_;
+  std::map<const camera3_stream_t*, StreamTimings> streams_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameTimingStats);
+};
+
+}  // namespace default_camera_hal
+
+#endif  // DEFAULT_CAMERA_HAL_FRAME_TIMING_H_
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frame_timing.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using testing::Test;
+
+namespace default_camera_hal {
+
+const int64_t kMs = 1000000;
+
+class FrameTimingTest : public Test {
+ protected:
+  virtual void SetUp() {
+    stream1_.width = 640;
+    stream1_.height = 480;
+    stream2_.width = 1920;
+    stream2_.height = 1080;
+  }
+
+  CaptureRequest MakeRequest(std::vector<camera3_stream_t*> streams) {
+    CaptureRequest request;
+    for (camera3_stream_t* stream : streams) {
+      camera3_stream_buffer_t buffer = {};
+      buffer.stream = stream;
+      request.output_buffers.push_back(buffer);
+    }
+    return request;
+  }
+
+  camera3_stream_t stream1_ = {};
+  camera3_stream_t stream2_ = {};
+  FrameTimingStats dut_;
+};
+
+TEST(LatencyHistogramTest, Buckets) {
+  EXPECT_EQ(LatencyHistogram::BucketFor(0), 0u);
+  EXPECT_EQ(LatencyHistogram::BucketFor(249999), 0u);
+  EXPECT_EQ(LatencyHistogram::BucketFor(250000), 1u);
+  EXPECT_EQ(LatencyHistogram::BucketFor(33 * kMs), 8u);
+  EXPECT_EQ(LatencyHistogram::BucketFor(10000 * kMs),
+            LatencyHistogram::kNumBuckets - 1);
+}
+
+TEST(LatencyHistogramTest, Add) {
+  LatencyHistogram histogram;
+  histogram.Add(1 * kMs);
+  histogram.Add(3 * kMs);
+  // Negative latencies (e.g. from clock adjustments) count as 0.
+  histogram.Add(-1);
+  EXPECT_EQ(histogram.count(), 3u);
+  EXPECT_EQ(histogram.min(), 0);
+  EXPECT_EQ(histogram.max(), 3 * kMs);
+  EXPECT_EQ(histogram.mean(), 4 * kMs / 3);
+  EXPECT_EQ(histogram.bucket(0), 1u);
+  EXPECT_EQ(histogram.bucket(LatencyHistogram::BucketFor(1 * kMs)), 1u);
+  EXPECT_EQ(histogram.bucket(LatencyHistogram::BucketFor(3 * kMs)), 1u);
+}
+
+TEST(MonotonicToBoottimeTest, Offset) {
+  // Boottime never runs behind monotonic time.
+  int64_t monotonic = FrameTimingNow();
+  EXPECT_GE(MonotonicToBoottime(monotonic), monotonic - kMs);
+  // The conversion is a constant offset.
+  EXPECT_NEAR(MonotonicToBoottime(monotonic + 100 * kMs) -
+                  MonotonicToBoottime(monotonic),
+              100 * kMs, kMs);
+}
+
+TEST(FrameSequenceTrackerTest, Gaps) {
+  FrameSequenceTracker dut;
+  EXPECT_EQ(dut.Add(0), 0u);
+  EXPECT_EQ(dut.Add(1), 0u);
+  EXPECT_EQ(dut.Add(4), 2u);
+  EXPECT_EQ(dut.Add(5), 0u);
+  EXPECT_EQ(dut.frames(), 4u);
+  EXPECT_EQ(dut.dropped(), 2u);
+
+  // A repeated frame is not a drop.
+  EXPECT_EQ(dut.Add(5), 0u);
+  EXPECT_EQ(dut.dropped(), 2u);
+
+  dut.Reset();
+  EXPECT_EQ(dut.frames(), 0u);
+  EXPECT_EQ(dut.dropped(), 0u);
+  // Frames before the first one returned were dropped too.
+  EXPECT_EQ(dut.Add(3), 3u);
+}
+
+TEST(FrameSequenceTrackerTest, Wraparound) {
+  FrameSequenceTracker dut;
+  dut.Add(0xfffffffe);
+  EXPECT_EQ(dut.Add(0xffffffff), 0u);
+  EXPECT_EQ(dut.Add(1), 1u);
+}
+
+TEST_F(FrameTimingTest, RecordAllStages) {
+  CaptureRequest request = MakeRequest({&stream1_, &stream2_});
+  request.timings.accepted = 100 * kMs;
+  request.timings.queued = 101 * kMs;
+  request.timings.dequeued = 134 * kMs;
+  request.timings.converted = 138 * kMs;
+  request.timings.encoded = 158 * kMs;
+  request.timings.returned = 159 * kMs;
+  dut_.Record(request);
+
+  for (const camera3_stream_t* stream : {&stream1_, &stream2_}) {
+    EXPECT_EQ(dut_.Get(stream, FrameTimingStats::kQueue).max(), 1 * kMs);
+    EXPECT_EQ(dut_.Get(stream, FrameTimingStats::kCapture).max(), 33 * kMs);
+    EXPECT_EQ(dut_.Get(stream, FrameTimingStats::kConvert).max(), 4 * kMs);
+    EXPECT_EQ(dut_.Get(stream, FrameTimingStats::kEncode).max(), 20 * kMs);
+    EXPECT_EQ(dut_.Get(stream, FrameTimingStats::kReturn).max(), 1 * kMs);
+    EXPECT_EQ(dut_.Get(stream, FrameTimingStats::kTotal).max(), 59 * kMs);
+  }
+}
+
+TEST_F(FrameTimingTest, SkippedStagesFoldIntoNext) {
+  // No conversion or encoding, as for a frame captured straight into its
+  // output buffer.
+  CaptureRequest request = MakeRequest({&stream1_});
+  request.timings.accepted = 100 * kMs;
+  request.timings.queued = 101 * kMs;
+  request.timings.dequeued = 134 * kMs;
+  request.timings.returned = 136 * kMs;
+  dut_.Record(request);
+
+  EXPECT_EQ(dut_.Get(&stream1_, FrameTimingStats::kConvert).count(), 0u);
+  EXPECT_EQ(dut_.Get(&stream1_, FrameTimingStats::kEncode).count(), 0u);
+  EXPECT_EQ(dut_.Get(&stream1_, FrameTimingStats::kReturn).max(), 2 * kMs);
+  EXPECT_EQ(dut_.Get(&stream1_, FrameTimingStats::kTotal).max(), 36 * kMs);
+  // Untouched streams have nothing.
+  EXPECT_EQ(dut_.Get(&stream2_, FrameTimingStats::kTotal).count(), 0u);
+}
+
+TEST_F(FrameTimingTest, ErrorsAndClear) {
+  CaptureRequest request = MakeRequest({&stream1_});
+  dut_.RecordError(request);
+  dut_.RecordError(request);
+  EXPECT_EQ(dut_.GetErrors(&stream1_), 2u);
+  EXPECT_EQ(dut_.Get(&stream1_, FrameTimingStats::kTotal).count(), 0u);
+
+  dut_.Clear();
+  EXPECT_EQ(dut_.GetErrors(&stream1_), 0u);
+}
+
+}  // namespace default_camera_hal
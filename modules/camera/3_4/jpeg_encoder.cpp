@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "JpegEncoder"
+
+#include "jpeg_encoder.h"
+
+#include <algorithm>
+
+#include "arc/image_processor.h"
+#include "common.h"
+#include "function_thread.h"
+#include "stream_format.h"
+
+namespace v4l2_camera_hal {
+
+using default_camera_hal::CaptureRequest;
+
+JpegEncoder::JpegEncoder(const camera3_stream_t* stream, DoneCallback done)
+    : stream_(stream),
+      scale_filter_(StreamFormat::HalToScaleFilter(stream->format)),
+      done_(done),
+      allocations_(1),
+      busy_(false),
+      exiting_(false),
+      worker_(new FunctionThread(std::bind(&JpegEncoder::threadLoop, this))) {
+  size_t frame_size = arc::ImageProcessor::GetConvertedSize(
+      V4L2_PIX_FMT_YUV420, stream->width, stream->height);
+  scaled_frame_.reset(new arc::AllocatedFrameBuffer(frame_size));
+
+  // One staging buffer per buffer the framework may have outstanding on this
+  // stream; beyond that, the caller encodes inline.
+  size_t num_slots = std::max<uint32_t>(stream->max_buffers, 1);
+  for (size_t i = 0; i < num_slots; ++i) {
+    staging_.emplace_back(new arc::AllocatedFrameBuffer(frame_size));
+    staging_.back()->SetFourcc(V4L2_PIX_FMT_YUV420);
+    staging_.back()->SetWidth(stream->width);
+    staging_.back()->SetHeight(stream->height);
+    free_slots_.push_back(i);
+  }
+  allocations_ += num_slots;
+
+  android::status_t res = worker_->run("JPEG encoder");
+  HAL_LOGE_IF(res != android::OK, "Failed to start encoder thread: %d", res);
+}
+
+JpegEncoder::~JpegEncoder() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    exiting_ = true;
+    jobs_.clear();
+    cond_.notify_all();
+  }
+  worker_->requestExitAndWait();
+}
+
+int JpegEncoder::Queue(const arc::CachedFrame& frame,
+                       std::shared_ptr<CaptureRequest> request,
+                       const camera3_stream_buffer_t* buffer,
+                       uint32_t device_buffer_length) {
+  size_t slot;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (free_slots_.empty()) {
+      return -EBUSY;
+    }
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  }
+
+  // Scale into the staging buffer now, while |frame| is still valid.
+  arc::AllocatedFrameBuffer* staging = staging_[slot].get();
+  const uint8_t* scaled_data = scaled_frame_->GetData();
+  int res = frame.ConvertWithBuffer(request->settings, staging,
+                                    scaled_frame_.get(), scale_filter_);
+  if (scaled_frame_->GetData() != scaled_data) {
+    ++allocations_;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (res) {
+    HAL_LOGE("Failed to stage frame for JPEG encoding: %d", res);
+    free_slots_.push_back(slot);
+    cond_.notify_all();
+    return res;
+  }
+  jobs_.push_back({slot, request, buffer, device_buffer_length});
+  cond_.notify_all();
+  return 0;
+}
+
+int JpegEncoder::EncodeNow(const arc::CachedFrame& frame,
+                           const android::CameraMetadata& settings,
+                           const camera3_stream_buffer_t& buffer,
+                           uint32_t device_buffer_length) {
+  arc::GrallocFrameBuffer output_frame(
+      *buffer.buffer, stream_->width, stream_->height, V4L2_PIX_FMT_JPEG,
+      device_buffer_length, stream_->usage);
+  if (output_frame.Map()) {
+    HAL_LOGE("Failed to map JPEG output frame.");
+    return -EINVAL;
+  }
+
+  const uint8_t* scaled_data = scaled_frame_->GetData();
+  int res = frame.ConvertWithBuffer(settings, &output_frame,
+                                    scaled_frame_.get(), scale_filter_);
+  if (scaled_frame_->GetData() != scaled_data) {
+    ++allocations_;
+  }
+  return res;
+}
+
+void JpegEncoder::Flush() {
+  std::unique_lock<std::mutex> lock(lock_);
+  for (const auto& job : jobs_) {
+    free_slots_.push_back(job.slot);
+  }
+  jobs_.clear();
+  while (busy_) {
+    cond_.wait(lock);
+  }
+  cond_.notify_all();
+}
+
+int JpegEncoder::Encode(const Job& job) {
+  return Compress(*staging_[job.slot], job.request->settings, *job.buffer,
+                  job.device_buffer_length);
+}
+
+int JpegEncoder::Compress(const arc::FrameBuffer& frame,
+                          const android::CameraMetadata& settings,
+                          const camera3_stream_buffer_t& buffer,
+                          uint32_t device_buffer_length) {
+  // The locked range is sized from |device_buffer_length|, and the
+  // compressor writes into it directly.
+  arc::GrallocFrameBuffer output_frame(
+      *buffer.buffer, stream_->width, stream_->height, V4L2_PIX_FMT_JPEG,
+      device_buffer_length, stream_->usage);
+  if (output_frame.Map()) {
+    HAL_LOGE("Failed to map JPEG output frame.");
+    return -EINVAL;
+  }
+  return arc::ImageProcessor::ConvertFormat(settings, frame, &output_frame);
+}
+
+bool JpegEncoder::threadLoop() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (jobs_.empty() && !exiting_) {
+    cond_.wait(lock);
+  }
+  if (exiting_) {
+    return false;
+  }
+  Job job = jobs_.front();
+  jobs_.pop_front();
+  busy_ = true;
+  lock.unlock();
+
+  int res = Encode(job);
+
+  // Release the slot before reporting, so Flush() never waits on whatever
+  // the done callback blocks on.
+  lock.lock();
+  busy_ = false;
+  free_slots_.push_back(job.slot);
+  cond_.notify_all();
+  lock.unlock();
+
+  done_(job.request, res);
+  return true;
+}
+
+}  // namespace v4l2_camera_hal
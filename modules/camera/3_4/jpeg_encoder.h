@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef V4L2_CAMERA_HAL_JPEG_ENCODER_H_
+#define V4L2_CAMERA_HAL_JPEG_ENCODER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <android-base/macros.h>
+#include <camera/CameraMetadata.h>
+#include <hardware/camera3.h>
+#include <utils/StrongPointer.h>
+#include <utils/Thread.h>
+#include "arc/cached_frame.h"
+#include "arc/frame_buffer.h"
+#include "arc/image_processor.h"
+#include "capture_request.h"
+
+namespace v4l2_camera_hal {
+
+// Encodes the frames of a single BLOB stream on a dedicated worker thread,
+// so JPEG compression does not hold up capture of the following frames.
+// Frames are scaled into one of a fixed pool of staging buffers on the
+// calling thread (with the box filter, stills being worth the time), then
+// compressed straight into the gralloc output buffer.
+// When every staging buffer is taken the caller encodes inline instead,
+// which throttles capture to the encoder without ever blocking on it.
+class JpegEncoder {
+ public:
+  // Called on the worker thread once the output buffer of |request| has been
+  // written, with 0 or a negative error code.
+  typedef std::function<void(
+      std::shared_ptr<default_camera_hal::CaptureRequest> request, int result)>
+      DoneCallback;
+
+  JpegEncoder(const camera3_stream_t* stream, DoneCallback done);
+  ~JpegEncoder();
+
+  // Stage |frame| for encoding into |buffer|, which belongs to |request|.
+  // |buffer| must stay valid until the done callback runs.
+  // Returns 0 if the job was queued, -EBUSY if no staging buffer is free,
+  // or another negative error code if staging failed. The done callback
+  // only runs for queued jobs.
+  int Queue(const arc::CachedFrame& frame,
+            std::shared_ptr<default_camera_hal::CaptureRequest> request,
+            const camera3_stream_buffer_t* buffer,
+            uint32_t device_buffer_length);
+
+  // Encode |frame| into |buffer| on the calling thread.
+  // Returns 0 or a negative error code.
+  int EncodeNow(const arc::CachedFrame& frame,
+                const android::CameraMetadata& settings,
+                const camera3_stream_buffer_t& buffer,
+                uint32_t device_buffer_length);
+
+  // Drop jobs that have not started yet and wait for the current one to stop
+  // touching its output buffer. Dropped jobs are not reported. Safe to call
+  // while holding locks taken by the done callback.
+  void Flush();
+
+  // Number of times the scaling buffer has been (re)allocated.
+  uint64_t allocations() const { return allocations_; }
+
+ private:
+  struct Job {
+    size_t slot;
+    std::shared_ptr<default_camera_hal::CaptureRequest> request;
+    const camera3_stream_buffer_t* buffer;
+    uint32_t device_buffer_length;
+  };
+
+  bool threadLoop();
+  int Encode(const Job& job);
+  // Map |buffer| and compress |frame| into it.
+  int Compress(const arc::FrameBuffer& frame,
+               const android::CameraMetadata& settings,
+               const camera3_stream_buffer_t& buffer,
+               uint32_t device_buffer_length);
+
+  const camera3_stream_t* stream_;
+  const arc::ScaleFilter scale_filter_;
+  DoneCallback done_;
+  // Scratch for scaling, only touched on the calling thread.
+  std::unique_ptr<arc::AllocatedFrameBuffer> scaled_frame_;
+  uint64_t allocations_;
+
+  // Staging buffers holding YU12 frames at the stream size.
+  std::vector<std::unique_ptr<arc::AllocatedFrameBuffer>> staging_;
+  std::mutex lock_;
+  std::condition_variable cond_;
+  std::vector<size_t> free_slots_;
+  std::deque<Job> jobs_;
+  // Whether the worker is in the middle of a job.
+  bool busy_;
+  bool exiting_;
+  android::sp<android::Thread> worker_;
+
+  DISALLOW_COPY_AND_ASSIGN(JpegEncoder);
+};
+
+}  // namespace v4l2_camera_hal
+
+#endif  // V4L2_CAMERA_HAL_JPEG_ENCODER_H_
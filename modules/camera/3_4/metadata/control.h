@@ -44,6 +44,7 @@ class Control : public PartialMetadataInterface {
       android::CameraMetadata* metadata) const override;
   virtual int PopulateDynamicFields(
       android::CameraMetadata* metadata) const override;
+  virtual bool DynamicFieldsVolatile() const override;
   virtual int PopulateTemplateRequest(
       int template_type, android::CameraMetadata* metadata) const override;
   virtual bool SupportsRequestValues(
@@ -113,6 +114,11 @@ int Control<T>::PopulateDynamicFields(android::CameraMetadata* metadata) const {
   return UpdateMetadata(metadata, delegate_->tag(), value);
 }
 
+template <typename T>
+bool Control<T>::DynamicFieldsVolatile() const {
+  return delegate_->IsVolatile();
+}
+
 template <typename T>
 int Control<T>::PopulateTemplateRequest(
     int template_type, android::CameraMetadata* metadata) const {
@@ -33,6 +33,9 @@ class ControlDelegateInterface : public StateDelegateInterface<T> {
   // or have a delay before setting the requested value).
   // Returns 0 on success, error code on failure.
   virtual int SetValue(const T& value) = 0;
+  // Whether the value may change without SetValue being called,
+  // e.g. because the device adjusts it on its own.
+  virtual bool IsVolatile() { return false; };
   // Children must also override GetValue from StateDelegateInterface.
 };
 
@@ -31,6 +31,7 @@ class ControlDelegateInterfaceMock : public ControlDelegateInterface<T> {
   ControlDelegateInterfaceMock(){};
   MOCK_METHOD1_T(GetValue, int(T*));
   MOCK_METHOD1_T(SetValue, int(const T&));
+  MOCK_METHOD0_T(IsVolatile, bool());
 };
 
 }  // namespace v4l2_camera_hal
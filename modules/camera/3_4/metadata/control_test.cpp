@@ -186,6 +186,18 @@ TEST_F(ControlTest, PopulateDynamicFail) {
   EXPECT_TRUE(metadata.isEmpty());
 }
 
+TEST_F(ControlTest, DynamicFieldsVolatile) {
+  EXPECT_CALL(*mock_delegate_, IsVolatile()).WillOnce(Return(true));
+  PrepareControl();
+  EXPECT_TRUE(control_->DynamicFieldsVolatile());
+}
+
+TEST_F(ControlTest, DynamicFieldsNotVolatile) {
+  EXPECT_CALL(*mock_delegate_, IsVolatile()).WillOnce(Return(false));
+  PrepareControl();
+  EXPECT_FALSE(control_->DynamicFieldsVolatile());
+}
+
 TEST_F(ControlTest, PopulateTemplate) {
   int template_type = 3;
   uint8_t default_value = 123;
@@ -26,7 +26,7 @@
 namespace v4l2_camera_hal {
 
 Metadata::Metadata(PartialMetadataSet components)
-    : components_(std::move(components)) {
+    : components_(std::move(components)), result_valid_(false) {
   HAL_LOG_ENTER();
 }
 
@@ -41,6 +41,26 @@ int Metadata::FillStaticMetadata(android::CameraMetadata* metadata) {
     return -EINVAL;
   }
 
+  std::lock_guard<std::mutex> guard(cache_lock_);
+  if (!static_metadata_) {
+    std::unique_ptr<android::CameraMetadata> result(
+        new android::CameraMetadata());
+    int res = BuildStaticMetadata(result.get());
+    if (res) {
+      return res;
+    }
+    static_metadata_ = std::move(result);
+  }
+
+  int res = metadata->append(*static_metadata_);
+  if (res != android::OK) {
+    HAL_LOGE("Failed to append cached static metadata.");
+    return res;
+  }
+  return 0;
+}
+
+int Metadata::BuildStaticMetadata(android::CameraMetadata* metadata) {
   std::vector<int32_t> static_tags;
   std::vector<int32_t> control_tags;
   std::vector<int32_t> dynamic_tags;
@@ -102,7 +122,6 @@ int Metadata::FillStaticMetadata(android::CameraMetadata* metadata) {
     return -ENODEV;
   }
 
-  // TODO(b/31018853): cache result.
   return 0;
 }
 
@@ -139,6 +158,27 @@ int Metadata::GetRequestTemplate(int template_type,
     return -EINVAL;
   }
 
+  std::lock_guard<std::mutex> guard(cache_lock_);
+  if (!templates_[template_type]) {
+    std::unique_ptr<android::CameraMetadata> result(
+        new android::CameraMetadata());
+    int res = BuildRequestTemplate(template_type, result.get());
+    if (res) {
+      return res;
+    }
+    templates_[template_type] = std::move(result);
+  }
+
+  int res = template_metadata->append(*templates_[template_type]);
+  if (res != android::OK) {
+    HAL_LOGE("Failed to append cached template %d.", template_type);
+    return res;
+  }
+  return 0;
+}
+
+int Metadata::BuildRequestTemplate(int template_type,
+                                   android::CameraMetadata* template_metadata) {
   for (auto& component : components_) {
     // Prevent components from potentially overriding others.
     android::CameraMetadata additional_metadata;
@@ -158,10 +198,38 @@ int Metadata::GetRequestTemplate(int template_type,
     }
   }
 
-  // TODO(b/31018853): cache result.
   return 0;
 }
 
+void Metadata::InvalidateCache() {
+  HAL_LOG_ENTER();
+  {
+    std::lock_guard<std::mutex> guard(cache_lock_);
+    static_metadata_.reset();
+    for (auto& request_template : templates_) {
+      request_template.reset();
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(result_lock_);
+  result_sources_.clear();
+  result_.clear();
+  result_valid_ = false;
+}
+
+void Metadata::InitResultSources() {
+  if (!result_sources_.empty()) {
+    return;
+  }
+  result_sources_.reserve(components_.size());
+  for (auto& component : components_) {
+    result_sources_.push_back({component.get(),
+                               component->ControlTags(),
+                               component->DynamicFieldsVolatile(),
+                               true});
+  }
+}
+
 int Metadata::SetRequestSettings(const android::CameraMetadata& metadata) {
   HAL_LOG_ENTER();
 
@@ -169,6 +237,21 @@ int Metadata::SetRequestSettings(const android::CameraMetadata& metadata) {
   if (metadata.isEmpty())
     return 0;
 
+  {
+    // Results of components with controls in the request must be refreshed,
+    // even if setting them fails part way.
+    std::lock_guard<std::mutex> guard(result_lock_);
+    InitResultSources();
+    for (auto& source : result_sources_) {
+      for (int32_t tag : source.control_tags) {
+        if (metadata.exists(tag)) {
+          source.stale = true;
+          break;
+        }
+      }
+    }
+  }
+
   for (auto& component : components_) {
     int res = component->SetRequestValues(metadata);
     if (res) {
@@ -187,23 +270,42 @@ int Metadata::FillResultMetadata(android::CameraMetadata* metadata) {
     return -EINVAL;
   }
 
-  for (auto& component : components_) {
-    // Prevent components from potentially overriding others.
-    android::CameraMetadata additional_metadata;
-    int res = component->PopulateDynamicFields(&additional_metadata);
+  std::lock_guard<std::mutex> guard(result_lock_);
+  InitResultSources();
+
+  // Components write straight into the previous result. Entries keeping
+  // their size are overwritten in place, so a steady stream of requests
+  // neither allocates nor re-sorts the result.
+  for (auto& source : result_sources_) {
+    if (result_valid_ && !source.stale && !source.volatile_fields) {
+      continue;
+    }
+    int res = source.component->PopulateDynamicFields(&result_);
     if (res) {
       HAL_LOGE("Failed to get all dynamic result fields.");
+      result_valid_ = false;
       return res;
     }
-    // Add it to the overall result.
-    if (!additional_metadata.isEmpty()) {
-      res = metadata->append(additional_metadata);
-      if (res != android::OK) {
-        HAL_LOGE("Failed to append all dynamic result fields.");
-        return res;
-      }
+    source.stale = false;
+  }
+  result_valid_ = true;
+
+  // Patch the result into |metadata|, replacing any requested values.
+  const camera_metadata_t* result = result_.getAndLock();
+  size_t entry_count = get_camera_metadata_entry_count(result);
+  int res = 0;
+  for (size_t i = 0; i < entry_count && !res; ++i) {
+    camera_metadata_ro_entry_t entry;
+    res = get_camera_metadata_ro_entry(result, i, &entry);
+    if (!res) {
+      res = metadata->update(entry);
     }
   }
+  result_.unlock(result);
+  if (res) {
+    HAL_LOGE("Failed to update all dynamic result fields.");
+    return res;
+  }
 
   return 0;
 }
@@ -17,8 +17,13 @@
 #ifndef V4L2_CAMERA_HAL_METADATA_H_
 #define V4L2_CAMERA_HAL_METADATA_H_
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include <android-base/macros.h>
 #include <camera/CameraMetadata.h>
+#include <hardware/camera3.h>
 
 #include "metadata_common.h"
 
@@ -33,13 +38,49 @@ class Metadata {
   int GetRequestTemplate(int template_type,
                          android::CameraMetadata* template_metadata);
   int SetRequestSettings(const android::CameraMetadata& metadata);
+  // Results are kept from one frame to the next. Only components that are
+  // volatile, or whose controls were set since the last result, are asked
+  // to populate their fields again.
   int FillResultMetadata(android::CameraMetadata* metadata);
 
+  // Static metadata and request templates are built from the components once
+  // and then copied out of a cache. Drop the cache (and the previous result)
+  // so they are rebuilt on next use, e.g. after the device has been
+  // reconfigured.
+  void InvalidateCache();
+
  private:
+  int BuildStaticMetadata(android::CameraMetadata* metadata);
+  int BuildRequestTemplate(int template_type,
+                           android::CameraMetadata* template_metadata);
+  // Fill |result_sources_| if it is empty. Requires |result_lock_|.
+  void InitResultSources();
+
+  // A component contributing to the result, and whether its fields in
+  // |result_| are out of date.
+  struct ResultSource {
+    PartialMetadataInterface* component;
+    std::vector<int32_t> control_tags;
+    bool volatile_fields;
+    bool stale;
+  };
+
   // The overall metadata is broken down into several distinct pieces.
   // Note: it is undefined behavior if multiple components share tags.
   PartialMetadataSet components_;
 
+  // Cached results of BuildStaticMetadata and BuildRequestTemplate.
+  std::mutex cache_lock_;
+  std::unique_ptr<const android::CameraMetadata> static_metadata_;
+  std::unique_ptr<const android::CameraMetadata>
+      templates_[CAMERA3_TEMPLATE_COUNT];
+
+  // The dynamic fields reported for the previous frame.
+  std::mutex result_lock_;
+  std::vector<ResultSource> result_sources_;
+  android::CameraMetadata result_;
+  bool result_valid_;
+
   DISALLOW_COPY_AND_ASSIGN(Metadata);
 };
 
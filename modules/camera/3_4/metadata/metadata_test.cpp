@@ -25,8 +25,10 @@
 #include <gtest/gtest.h>
 #include "metadata_common.h"
 #include "partial_metadata_interface_mock.h"
+#include "test_common.h"
 
 using testing::AtMost;
+using testing::Invoke;
 using testing::Return;
 using testing::Test;
 using testing::_;
@@ -248,6 +250,82 @@ TEST_F(MetadataTest, GetTemplateInvalid) {
   EXPECT_EQ(dut_->GetRequestTemplate(template_type, metadata_.get()), -EINVAL);
 }
 
+TEST_F(MetadataTest, FillStaticCached) {
+  // Components should only be polled for the first fill.
+  EXPECT_CALL(*component1_, PopulateStaticFields(_)).WillOnce(Return(0));
+  EXPECT_CALL(*component2_, PopulateStaticFields(_)).WillOnce(Return(0));
+  EXPECT_CALL(*component1_, StaticTags()).WillOnce(Return(empty_tags_));
+  EXPECT_CALL(*component1_, ControlTags()).WillOnce(Return(empty_tags_));
+  EXPECT_CALL(*component1_, DynamicTags()).WillOnce(Return(empty_tags_));
+  EXPECT_CALL(*component2_, StaticTags()).WillOnce(Return(empty_tags_));
+  EXPECT_CALL(*component2_, ControlTags()).WillOnce(Return(empty_tags_));
+  EXPECT_CALL(*component2_, DynamicTags()).WillOnce(Return(empty_tags_));
+
+  AddComponents();
+  ASSERT_EQ(dut_->FillStaticMetadata(metadata_.get()), 0);
+  android::CameraMetadata second;
+  ASSERT_EQ(dut_->FillStaticMetadata(&second), 0);
+  // The cached copy should match what was built.
+  EXPECT_EQ(second.entryCount(), metadata_->entryCount());
+  EXPECT_TRUE(second.exists(ANDROID_REQUEST_AVAILABLE_CHARACTERISTICS_KEYS));
+}
+
+TEST_F(MetadataTest, FillStaticFailNotCached) {
+  int err = -99;
+  // Only use one component, so it is always polled.
+  EXPECT_CALL(*component1_, PopulateStaticFields(_))
+      .WillOnce(Return(err))
+      .WillOnce(Return(0));
+  EXPECT_CALL(*component1_, StaticTags()).WillOnce(Return(empty_tags_));
+  EXPECT_CALL(*component1_, ControlTags()).WillOnce(Return(empty_tags_));
+  EXPECT_CALL(*component1_, DynamicTags()).WillOnce(Return(empty_tags_));
+
+  PartialMetadataSet components;
+  components.insert(std::move(component1_));
+  dut_.reset(new Metadata(std::move(components)));
+
+  // The failure should not be cached; the next fill tries again.
+  EXPECT_EQ(dut_->FillStaticMetadata(metadata_.get()), err);
+  EXPECT_EQ(dut_->FillStaticMetadata(metadata_.get()), 0);
+}
+
+TEST_F(MetadataTest, GetTemplateCached) {
+  int template_type = 3;
+
+  // Components should only be polled for the first request of each type.
+  EXPECT_CALL(*component1_, PopulateTemplateRequest(template_type, _))
+      .WillOnce(Return(0));
+  EXPECT_CALL(*component2_, PopulateTemplateRequest(template_type, _))
+      .WillOnce(Return(0));
+  EXPECT_CALL(*component1_, PopulateTemplateRequest(template_type + 1, _))
+      .WillOnce(Return(0));
+  EXPECT_CALL(*component2_, PopulateTemplateRequest(template_type + 1, _))
+      .WillOnce(Return(0));
+
+  AddComponents();
+  EXPECT_EQ(dut_->GetRequestTemplate(template_type, metadata_.get()), 0);
+  EXPECT_EQ(dut_->GetRequestTemplate(template_type, metadata_.get()), 0);
+  EXPECT_EQ(dut_->GetRequestTemplate(template_type + 1, metadata_.get()), 0);
+  EXPECT_EQ(dut_->GetRequestTemplate(template_type + 1, metadata_.get()), 0);
+}
+
+TEST_F(MetadataTest, InvalidateCache) {
+  int template_type = 3;
+
+  // Invalidating should cause the template to be rebuilt.
+  EXPECT_CALL(*component1_, PopulateTemplateRequest(template_type, _))
+      .Times(2)
+      .WillRepeatedly(Return(0));
+  EXPECT_CALL(*component2_, PopulateTemplateRequest(template_type, _))
+      .Times(2)
+      .WillRepeatedly(Return(0));
+
+  AddComponents();
+  EXPECT_EQ(dut_->GetRequestTemplate(template_type, metadata_.get()), 0);
+  dut_->InvalidateCache();
+  EXPECT_EQ(dut_->GetRequestTemplate(template_type, metadata_.get()), 0);
+}
+
 TEST_F(MetadataTest, SetSettingsSuccess) {
   // Should check if all the components set successfully.
   EXPECT_CALL(*component1_, SetRequestValues(_)).WillOnce(Return(0));
@@ -318,4 +396,89 @@ TEST_F(MetadataTest, FillResultNull) {
   EXPECT_EQ(dut_->FillResultMetadata(nullptr), -EINVAL);
 }
 
+TEST_F(MetadataTest, FillResultCached) {
+  // Component 1 is volatile and must be repopulated every time.
+  // Component 2 is only populated once.
+  EXPECT_CALL(*component1_, DynamicFieldsVolatile()).WillOnce(Return(true));
+  EXPECT_CALL(*component2_, DynamicFieldsVolatile()).WillOnce(Return(false));
+  EXPECT_CALL(*component1_, PopulateDynamicFields(_))
+      .Times(2)
+      .WillRepeatedly(Return(0));
+  EXPECT_CALL(*component2_, PopulateDynamicFields(_)).WillOnce(Return(0));
+
+  AddComponents();
+  EXPECT_EQ(dut_->FillResultMetadata(metadata_.get()), 0);
+  EXPECT_EQ(dut_->FillResultMetadata(metadata_.get()), 0);
+}
+
+TEST_F(MetadataTest, FillResultCachedValues) {
+  uint8_t val = 3;
+  EXPECT_CALL(*component1_, DynamicFieldsVolatile()).WillOnce(Return(false));
+  EXPECT_CALL(*component1_, PopulateDynamicFields(_))
+      .WillOnce(Invoke([val](android::CameraMetadata* metadata) {
+        return UpdateMetadata(metadata, ANDROID_COLOR_CORRECTION_MODE, val);
+      }));
+  EXPECT_CALL(*component2_, PopulateDynamicFields(_))
+      .Times(AtMost(1))
+      .WillOnce(Return(0));
+
+  AddComponents();
+  // The request value should be replaced by the result, both times.
+  ASSERT_EQ(dut_->FillResultMetadata(non_empty_metadata_.get()), 0);
+  android::CameraMetadata second;
+  ASSERT_EQ(dut_->FillResultMetadata(&second), 0);
+  for (auto result : {non_empty_metadata_.get(), &second}) {
+    EXPECT_EQ(result->entryCount(), 1u);
+    ExpectMetadataEq(*result, ANDROID_COLOR_CORRECTION_MODE, val);
+  }
+}
+
+TEST_F(MetadataTest, FillResultAfterSettings) {
+  // Only the component whose control was set should be repopulated.
+  int32_t set_tag = ANDROID_COLOR_CORRECTION_MODE;
+  std::vector<int32_t> set_tags{set_tag};
+  std::vector<int32_t> other_tags{ANDROID_CONTROL_MODE};
+  EXPECT_CALL(*component1_, ControlTags()).WillOnce(Return(set_tags));
+  EXPECT_CALL(*component2_, ControlTags()).WillOnce(Return(other_tags));
+  EXPECT_CALL(*component1_, SetRequestValues(_)).WillOnce(Return(0));
+  EXPECT_CALL(*component2_, SetRequestValues(_)).WillOnce(Return(0));
+  EXPECT_CALL(*component1_, PopulateDynamicFields(_))
+      .Times(2)
+      .WillRepeatedly(Return(0));
+  EXPECT_CALL(*component2_, PopulateDynamicFields(_)).WillOnce(Return(0));
+
+  AddComponents();
+  EXPECT_EQ(dut_->FillResultMetadata(metadata_.get()), 0);
+  EXPECT_EQ(dut_->SetRequestSettings(*non_empty_metadata_), 0);
+  EXPECT_EQ(dut_->FillResultMetadata(metadata_.get()), 0);
+}
+
+TEST_F(MetadataTest, FillResultFailNotCached) {
+  int err = -99;
+  EXPECT_CALL(*component1_, PopulateDynamicFields(_))
+      .WillOnce(Return(err))
+      .WillOnce(Return(0));
+  EXPECT_CALL(*component2_, PopulateDynamicFields(_))
+      .Times(AtMost(2))
+      .WillRepeatedly(Return(0));
+
+  AddComponents();
+  EXPECT_EQ(dut_->FillResultMetadata(metadata_.get()), err);
+  EXPECT_EQ(dut_->FillResultMetadata(metadata_.get()), 0);
+}
+
+TEST_F(MetadataTest, InvalidateCacheResult) {
+  EXPECT_CALL(*component1_, PopulateDynamicFields(_))
+      .Times(2)
+      .WillRepeatedly(Return(0));
+  EXPECT_CALL(*component2_, PopulateDynamicFields(_))
+      .Times(2)
+      .WillRepeatedly(Return(0));
+
+  AddComponents();
+  EXPECT_EQ(dut_->FillResultMetadata(metadata_.get()), 0);
+  dut_->InvalidateCache();
+  EXPECT_EQ(dut_->FillResultMetadata(metadata_.get()), 0);
+}
+
 }  // namespace v4l2_camera_hal
@@ -41,6 +41,10 @@ class PartialMetadataInterface {
   // is responsible for to |metadata|.
   virtual int PopulateDynamicFields(
       android::CameraMetadata* metadata) const = 0;
+  // Whether the dynamic states may change between calls even when none of
+  // the controls this partial metadata owns have been set in between.
+  // If not, the previous PopulateDynamicFields result may be reused.
+  virtual bool DynamicFieldsVolatile() const = 0;
   // Add default request values for a given template type for all the controls
   // this partial metadata owns.
   virtual int PopulateTemplateRequest(
@@ -33,6 +33,7 @@ class PartialMetadataInterfaceMock : public PartialMetadataInterface {
   MOCK_CONST_METHOD0(DynamicTags, std::vector<int32_t>());
   MOCK_CONST_METHOD1(PopulateStaticFields, int(android::CameraMetadata*));
   MOCK_CONST_METHOD1(PopulateDynamicFields, int(android::CameraMetadata*));
+  MOCK_CONST_METHOD0(DynamicFieldsVolatile, bool());
   MOCK_CONST_METHOD2(PopulateTemplateRequest,
                      int(int, android::CameraMetadata*));
   MOCK_CONST_METHOD1(SupportsRequestValues,
@@ -44,6 +44,8 @@ class Property : public PartialMetadataInterface {
     return 0;
   };
 
+  virtual bool DynamicFieldsVolatile() const override { return false; };
+
   virtual int PopulateTemplateRequest(
       int /*template_type*/, android::CameraMetadata* /*metadata*/) const override {
     return 0;
@@ -39,6 +39,8 @@ class State : public PartialMetadataInterface {
       android::CameraMetadata* metadata) const override;
   virtual int PopulateDynamicFields(
       android::CameraMetadata* metadata) const override;
+  // States have no controls; their values may change at any time.
+  virtual bool DynamicFieldsVolatile() const override { return true; };
   virtual int PopulateTemplateRequest(
       int template_type, android::CameraMetadata* metadata) const override;
   virtual bool SupportsRequestValues(
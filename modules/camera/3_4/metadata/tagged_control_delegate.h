@@ -39,6 +39,7 @@ class TaggedControlDelegate : public ControlDelegateInterface<T> {
   virtual int SetValue(const T& value) override {
     return delegate_->SetValue(value);
   };
+  virtual bool IsVolatile() override { return delegate_->IsVolatile(); };
 
  private:
   const int32_t tag_;
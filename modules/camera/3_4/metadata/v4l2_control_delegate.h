@@ -55,6 +55,11 @@ class V4L2ControlDelegate : public ControlDelegateInterface<TMetadata> {
     return device_->SetControl(control_id_, v4l2_value);
   };
 
+  bool IsVolatile() override {
+    // Values the wrapper doesn't cache have to be read back every time.
+    return !device_->IsControlCacheable(control_id_);
+  };
+
  private:
   std::shared_ptr<V4L2Wrapper> device_;
   int control_id_;
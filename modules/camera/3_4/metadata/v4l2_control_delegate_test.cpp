@@ -76,6 +76,14 @@ TEST_F(V4L2ControlDelegateTest, GetDeviceFailure) {
   ASSERT_EQ(dut_->GetValue(&unused), err);
 }
 
+TEST_F(V4L2ControlDelegateTest, Volatile) {
+  EXPECT_CALL(*mock_device_, IsControlCacheable(control_id_))
+      .WillOnce(Return(false))
+      .WillOnce(Return(true));
+  EXPECT_TRUE(dut_->IsVolatile());
+  EXPECT_FALSE(dut_->IsVolatile());
+}
+
 TEST_F(V4L2ControlDelegateTest, SetSuccess) {
   uint8_t input = 10;
   int32_t conversion_result = 99;
@@ -0,0 +1,575 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Drives capture requests through the whole HAL, from process_capture_request
+// to the result callback, with frames played back from a frame dump instead
+// of a camera. Reports the frame rate, the CPU time spent per frame and the
+// latency of each stage of the request path, and fails if the frame rate is
+// under --min-fps, so it can serve as a performance regression check.
+//
+// Frames come from --dump (recorded by setting
+// vendor.camera.v4l2.record_path while a camera streams), or are made up
+// according to --source. Output buffers are allocated from gralloc.
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <hardware/camera3.h>
+#include <linux/videodev2.h>
+#include <system/camera_metadata.h>
+#include <ui/GraphicBuffer.h>
+#include "arc/frame_buffer.h"
+#include "arc/jpeg_compressor.h"
+#include "frame_dump.h"
+#include "frame_timing.h"
+#include "v4l2_camera.h"
+#include "v4l2_replay_wrapper.h"
+
+namespace v4l2_camera_hal {
+
+namespace {
+
+// Frames made up when there is no dump to replay, 30 frames per second.
+const size_t kSyntheticFrames = 8;
+const int64_t kSyntheticFrameDurationNs = 33333333;
+// Give up waiting for results after this long without any.
+const auto kResultTimeout = std::chrono::seconds(5);
+
+struct StreamSpec {
+  int format;
+  uint32_t width;
+  uint32_t height;
+};
+
+// Parse "WxH".
+bool ParseSize(const std::string& text, uint32_t* width, uint32_t* height) {
+  return sscanf(text.c_str(), "%ux%u", width, height) == 2 && *width > 0 &&
+         *height > 0;
+}
+
+// Parse "yuyv:WxH" or "mjpeg:WxH".
+bool ParseSource(const std::string& text, uint32_t* fourcc, uint32_t* width,
+                 uint32_t* height) {
+  size_t colon = text.find(':');
+  if (colon == std::string::npos ||
+      !ParseSize(text.substr(colon + 1), width, height)) {
+    return false;
+  }
+  std::string name = text.substr(0, colon);
+  if (name == "yuyv") {
+    *fourcc = V4L2_PIX_FMT_YUYV;
+  } else if (name == "mjpeg") {
+    *fourcc = V4L2_PIX_FMT_MJPEG;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Parse a comma separated list of "preview:WxH", "yuv:WxH" or "jpeg:WxH".
+bool ParseStreams(const std::string& text, std::vector<StreamSpec>* streams) {
+  size_t start = 0;
+  while (start <= text.size()) {
+    size_t end = text.find(',', start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    std::string item = text.substr(start, end - start);
+    size_t colon = item.find(':');
+    StreamSpec spec;
+    if (colon == std::string::npos ||
+        !ParseSize(item.substr(colon + 1), &spec.width, &spec.height)) {
+      return false;
+    }
+    std::string name = item.substr(0, colon);
+    if (name == "preview") {
+      spec.format = HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED;
+    } else if (name == "yuv") {
+      spec.format = HAL_PIXEL_FORMAT_YCbCr_420_888;
+    } else if (name == "jpeg") {
+      spec.format = HAL_PIXEL_FORMAT_BLOB;
+    } else {
+      return false;
+    }
+    streams->push_back(spec);
+    start = end + 1;
+  }
+  return !streams->empty();
+}
+
+// Make up a dump of |fourcc| frames. Each frame differs, so nothing along
+// the way gets to reuse the work done for the previous one.
+std::unique_ptr<FrameDump> MakeSyntheticDump(uint32_t fourcc, uint32_t width,
+                                             uint32_t height) {
+  std::unique_ptr<FrameDump> dump(new FrameDump);
+  dump->fourcc = fourcc;
+  dump->width = width;
+  dump->height = height;
+
+  size_t yu12_size = width * height * 3 / 2;
+  std::vector<uint8_t> yu12(yu12_size);
+  arc::JpegCompressor compressor;
+  for (size_t i = 0; i < kSyntheticFrames; ++i) {
+    std::unique_ptr<arc::AllocatedFrameBuffer> buffer;
+    if (fourcc == V4L2_PIX_FMT_YUYV) {
+      buffer.reset(new arc::AllocatedFrameBuffer(width * height * 2));
+      for (size_t j = 0; j < buffer->GetBufferSize(); ++j) {
+        buffer->GetData()[j] = static_cast<uint8_t>((j + i * 8) * 31 / 7);
+      }
+      buffer->SetDataSize(buffer->GetBufferSize());
+    } else {
+      for (size_t j = 0; j < yu12_size; ++j) {
+        yu12[j] = static_cast<uint8_t>((j % width + j / width + i * 8) / 4);
+      }
+      if (!compressor.CompressImage(yu12.data(), width, height, 90, nullptr,
+                                    0)) {
+        fprintf(stderr, "Failed to compress synthetic frame.\n");
+        return nullptr;
+      }
+      buffer.reset(
+          new arc::AllocatedFrameBuffer(compressor.GetCompressedImageSize()));
+      memcpy(buffer->GetData(), compressor.GetCompressedImagePtr(),
+             compressor.GetCompressedImageSize());
+      buffer->SetDataSize(compressor.GetCompressedImageSize());
+    }
+    buffer->SetFourcc(fourcc);
+    buffer->SetWidth(width);
+    buffer->SetHeight(height);
+    dump->frames.push_back({static_cast<int64_t>(i + 1) *
+                                kSyntheticFrameDurationNs,
+                            static_cast<uint32_t>(i), std::move(buffer)});
+  }
+  return dump;
+}
+
+int64_t CpuTimeNow() {
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Stands in for the camera framework: submits requests as fast as output
+// buffers come back, and takes in the results.
+class ReplayHarness {
+ public:
+  ReplayHarness() : device_(nullptr) {
+    memset(&callbacks_, 0, sizeof(callbacks_));
+    callbacks_.ops.process_capture_result = ProcessCaptureResult;
+    callbacks_.ops.notify = Notify;
+    callbacks_.harness = this;
+  }
+
+  // Open |camera| and configure |specs| on it.
+  int Open(V4L2Camera* camera, const std::vector<StreamSpec>& specs);
+  // Submit |num_frames| requests and wait for their results.
+  int Run(uint32_t num_frames);
+  void Close();
+
+  uint64_t completed() const { return completed_; }
+  uint64_t errors() const { return errors_; }
+  // Frame rate and CPU time per frame, from the first result to the last.
+  double fps() const;
+  double cpu_ms_per_frame() const;
+  double cpu_load() const;
+
+  void Dump(int fd) { device_->ops->dump(device_, fd); }
+
+ private:
+  struct CallbackOps {
+    camera3_callback_ops_t ops;  // Must come first.
+    ReplayHarness* harness;
+  };
+
+  static void ProcessCaptureResult(const camera3_callback_ops_t* ops,
+                                   const camera3_capture_result_t* result);
+  static void Notify(const camera3_callback_ops_t* ops,
+                     const camera3_notify_msg_t* msg);
+  void OnResult(const camera3_capture_result_t* result);
+
+  CallbackOps callbacks_;
+  camera3_device_t* device_;
+  std::vector<camera3_stream_t> streams_;
+  // Per stream: every buffer, and the indices of those not in flight.
+  std::vector<std::vector<android::sp<android::GraphicBuffer>>> buffers_;
+  std::vector<std::vector<buffer_handle_t>> handles_;
+  std::vector<std::deque<size_t>> free_buffers_;
+
+  std::mutex lock_;
+  std::condition_variable cond_;
+  uint64_t completed_ = 0;
+  uint64_t errors_ = 0;
+  int64_t first_result_ns_ = 0;
+  int64_t last_result_ns_ = 0;
+  int64_t first_result_cpu_ns_ = 0;
+  int64_t last_result_cpu_ns_ = 0;
+};
+
+int ReplayHarness::Open(V4L2Camera* camera,
+                        const std::vector<StreamSpec>& specs) {
+  camera_info info;
+  int res = camera->getInfo(&info);
+  if (res) {
+    fprintf(stderr, "Failed to get camera info: %d\n", res);
+    return res;
+  }
+  camera_metadata_ro_entry_t entry;
+  int32_t jpeg_max_size = 0;
+  if (!find_camera_metadata_ro_entry(info.static_camera_characteristics,
+                                     ANDROID_JPEG_MAX_SIZE, &entry)) {
+    jpeg_max_size = entry.data.i32[0];
+  }
+
+  static hw_module_t module = {};
+  hw_device_t* device;
+  res = camera->openDevice(&module, &device);
+  if (res) {
+    fprintf(stderr, "Failed to open camera: %d\n", res);
+    return res;
+  }
+  device_ = reinterpret_cast<camera3_device_t*>(device);
+  res = device_->ops->initialize(device_, &callbacks_.ops);
+  if (res) {
+    fprintf(stderr, "Failed to initialize camera: %d\n", res);
+    return res;
+  }
+
+  streams_.resize(specs.size());
+  std::vector<camera3_stream_t*> stream_list;
+  for (size_t i = 0; i < specs.size(); ++i) {
+    camera3_stream_t* stream = &streams_[i];
+    memset(stream, 0, sizeof(*stream));
+    stream->stream_type = CAMERA3_STREAM_OUTPUT;
+    stream->width = specs[i].width;
+    stream->height = specs[i].height;
+    stream->format = specs[i].format;
+    stream->usage = specs[i].format == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED
+                        ? GRALLOC_USAGE_HW_TEXTURE
+                        : GRALLOC_USAGE_SW_READ_OFTEN;
+    stream->data_space = specs[i].format == HAL_PIXEL_FORMAT_BLOB
+                             ? HAL_DATASPACE_V0_JFIF
+                             : HAL_DATASPACE_UNKNOWN;
+    stream_list.push_back(stream);
+  }
+  camera3_stream_configuration_t config;
+  memset(&config, 0, sizeof(config));
+  config.num_streams = stream_list.size();
+  config.streams = stream_list.data();
+  config.operation_mode = CAMERA3_STREAM_CONFIGURATION_NORMAL_MODE;
+  res = device_->ops->configure_streams(device_, &config);
+  if (res) {
+    fprintf(stderr, "Failed to configure streams: %d\n", res);
+    return res;
+  }
+
+  // Allocate what the HAL asked for, the way the framework would.
+  buffers_.resize(streams_.size());
+  handles_.resize(streams_.size());
+  free_buffers_.resize(streams_.size());
+  for (size_t i = 0; i < streams_.size(); ++i) {
+    const camera3_stream_t& stream = streams_[i];
+    uint32_t width = stream.width;
+    uint32_t height = stream.height;
+    if (stream.format == HAL_PIXEL_FORMAT_BLOB) {
+      width = jpeg_max_size;
+      height = 1;
+    }
+    for (uint32_t j = 0; j < stream.max_buffers; ++j) {
+      android::sp<android::GraphicBuffer> buffer = new android::GraphicBuffer(
+          width, height, stream.format, 1, stream.usage,
+          "camera.v4l2_replay_benchmark");
+      if (buffer->initCheck() != android::OK) {
+        fprintf(stderr, "Failed to allocate %ux%u buffer of format 0x%x.\n",
+                width, height, stream.format);
+        return -ENOMEM;
+      }
+      buffers_[i].push_back(buffer);
+      handles_[i].push_back(buffer->handle);
+      free_buffers_[i].push_back(j);
+    }
+  }
+  return 0;
+}
+
+int ReplayHarness::Run(uint32_t num_frames) {
+  const camera_metadata_t* settings =
+      device_->ops->construct_default_request_settings(
+          device_, CAMERA3_TEMPLATE_PREVIEW);
+  if (!settings) {
+    fprintf(stderr, "Failed to get default request settings.\n");
+    return -ENODEV;
+  }
+
+  std::vector<camera3_stream_buffer_t> output_buffers(streams_.size());
+  for (uint32_t frame = 0; frame < num_frames; ++frame) {
+    {
+      // Wait for every stream to have a buffer to capture into.
+      std::unique_lock<std::mutex> lock(lock_);
+      for (size_t i = 0; i < streams_.size(); ++i) {
+        if (!cond_.wait_for(lock, kResultTimeout, [this, i] {
+              return !free_buffers_[i].empty();
+            })) {
+          fprintf(stderr, "Timed out waiting for buffers of frame %u.\n",
+                  frame);
+          return -ETIMEDOUT;
+        }
+      }
+      for (size_t i = 0; i < streams_.size(); ++i) {
+        size_t index = free_buffers_[i].front();
+        free_buffers_[i].pop_front();
+        camera3_stream_buffer_t& buffer = output_buffers[i];
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.stream = &streams_[i];
+        buffer.buffer = &handles_[i][index];
+        buffer.status = CAMERA3_BUFFER_STATUS_OK;
+        buffer.acquire_fence = -1;
+        buffer.release_fence = -1;
+      }
+    }
+
+    camera3_capture_request_t request;
+    memset(&request, 0, sizeof(request));
+    request.frame_number = frame;
+    // Like the framework, only send settings when they change.
+    request.settings = frame == 0 ? settings : nullptr;
+    request.num_output_buffers = output_buffers.size();
+    request.output_buffers = output_buffers.data();
+    int res = device_->ops->process_capture_request(device_, &request);
+    if (res) {
+      fprintf(stderr, "Failed to submit frame %u: %d\n", frame, res);
+      return res;
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(lock_);
+  if (!cond_.wait_for(lock, kResultTimeout,
+                      [this, num_frames] { return completed_ >= num_frames; })) {
+    fprintf(stderr, "Timed out with %" PRIu64 " of %u results.\n", completed_,
+            num_frames);
+    return -ETIMEDOUT;
+  }
+  return 0;
+}
+
+void ReplayHarness::Close() {
+  if (device_) {
+    device_->common.close(&device_->common);
+    device_ = nullptr;
+  }
+}
+
+double ReplayHarness::fps() const {
+  int64_t elapsed = last_result_ns_ - first_result_ns_;
+  return completed_ > 1 && elapsed > 0 ? (completed_ - 1) * 1e9 / elapsed
+                                       : 0;
+}
+
+double ReplayHarness::cpu_ms_per_frame() const {
+  return completed_ > 1
+             ? (last_result_cpu_ns_ - first_result_cpu_ns_) / 1e6 /
+                   (completed_ - 1)
+             : 0;
+}
+
+double ReplayHarness::cpu_load() const {
+  int64_t elapsed = last_result_ns_ - first_result_ns_;
+  return elapsed > 0
+             ? static_cast<double>(last_result_cpu_ns_ - first_result_cpu_ns_) /
+                   elapsed
+             : 0;
+}
+
+void ReplayHarness::ProcessCaptureResult(
+    const camera3_callback_ops_t* ops, const camera3_capture_result_t* result) {
+  reinterpret_cast<const CallbackOps*>(ops)->harness->OnResult(result);
+}
+
+void ReplayHarness::Notify(const camera3_callback_ops_t* ops,
+                           const camera3_notify_msg_t* msg) {
+  if (msg->type != CAMERA3_MSG_ERROR) {
+    return;
+  }
+  ReplayHarness* harness = reinterpret_cast<const CallbackOps*>(ops)->harness;
+  std::lock_guard<std::mutex> guard(harness->lock_);
+  ++harness->errors_;
+}
+
+void ReplayHarness::OnResult(const camera3_capture_result_t* result) {
+  int64_t now = default_camera_hal::FrameTimingNow();
+  int64_t cpu_now = CpuTimeNow();
+  std::lock_guard<std::mutex> guard(lock_);
+  for (uint32_t i = 0; i < result->num_output_buffers; ++i) {
+    const camera3_stream_buffer_t& buffer = result->output_buffers[i];
+    if (buffer.release_fence >= 0) {
+      close(buffer.release_fence);
+    }
+    size_t stream = buffer.stream - streams_.data();
+    free_buffers_[stream].push_back(buffer.buffer - handles_[stream].data());
+  }
+  if (completed_ == 0) {
+    first_result_ns_ = now;
+    first_result_cpu_ns_ = cpu_now;
+  }
+  last_result_ns_ = now;
+  last_result_cpu_ns_ = cpu_now;
+  ++completed_;
+  cond_.notify_all();
+}
+
+void Usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --dump=PATH       frame dump to replay\n"
+          "  --source=FMT:WxH  made up frames to replay instead, FMT being\n"
+          "                    yuyv or mjpeg (default yuyv:1280x720)\n"
+          "  --streams=LIST    comma separated streams to configure, each\n"
+          "                    preview:WxH, yuv:WxH or jpeg:WxH (default one\n"
+          "                    preview stream at the source size)\n"
+          "  --frames=N        requests to submit (default 300)\n"
+          "  --fast            don't pace frames as recorded; measure how\n"
+          "                    fast the HAL can go\n"
+          "  --min-fps=FPS     fail if the frame rate is lower\n",
+          name);
+}
+
+int RunReplayBenchmark(int argc, char** argv) {
+  std::string dump_path;
+  uint32_t fourcc = V4L2_PIX_FMT_YUYV;
+  uint32_t width = 1280;
+  uint32_t height = 720;
+  std::vector<StreamSpec> streams;
+  uint32_t num_frames = 300;
+  double min_fps = 0;
+  V4L2ReplayWrapper::Options options;
+
+  const option long_options[] = {{"dump", required_argument, nullptr, 'd'},
+                                 {"source", required_argument, nullptr, 's'},
+                                 {"streams", required_argument, nullptr, 't'},
+                                 {"frames", required_argument, nullptr, 'n'},
+                                 {"fast", no_argument, nullptr, 'f'},
+                                 {"min-fps", required_argument, nullptr, 'm'},
+                                 {nullptr, 0, nullptr, 0}};
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+    switch (opt) {
+      case 'd':
+        dump_path = optarg;
+        break;
+      case 's':
+        if (!ParseSource(optarg, &fourcc, &width, &height)) {
+          Usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 't':
+        if (!ParseStreams(optarg, &streams)) {
+          Usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'n':
+        num_frames = strtoul(optarg, nullptr, 10);
+        break;
+      case 'f':
+        options.real_time = false;
+        break;
+      case 'm':
+        min_fps = strtod(optarg, nullptr);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  std::shared_ptr<V4L2ReplayWrapper> wrapper;
+  if (!dump_path.empty()) {
+    wrapper.reset(V4L2ReplayWrapper::NewV4L2ReplayWrapper(dump_path, options));
+  } else {
+    wrapper.reset(V4L2ReplayWrapper::NewV4L2ReplayWrapper(
+        MakeSyntheticDump(fourcc, width, height), options));
+  }
+  if (!wrapper) {
+    fprintf(stderr, "Nothing to replay.\n");
+    return 1;
+  }
+  if (streams.empty()) {
+    // A single preview stream at the recorded size, the largest offered.
+    std::set<uint32_t> formats;
+    std::set<std::array<int32_t, 2>> sizes;
+    wrapper->GetFormats(&formats);
+    wrapper->GetFormatFrameSizes(*formats.begin(), &sizes);
+    const std::array<int32_t, 2>& largest = *sizes.rbegin();
+    streams.push_back({HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED,
+                       static_cast<uint32_t>(largest[0]),
+                       static_cast<uint32_t>(largest[1])});
+  }
+
+  // The camera's request threads run for the rest of the process, as they
+  // do in the HAL, so it is never deleted.
+  V4L2Camera* camera = V4L2Camera::NewV4L2Camera(0, wrapper);
+  ReplayHarness harness;
+  int res = harness.Open(camera, streams);
+  if (!res) {
+    res = harness.Run(num_frames);
+  }
+  if (res) {
+    harness.Close();
+    return 1;
+  }
+
+  printf("Frames: %" PRIu64 " (%" PRIu64 " errors)\n", harness.completed(),
+         harness.errors());
+  printf("Frame rate: %.2f fps\n", harness.fps());
+  printf("CPU time: %.3f ms per frame (%.1f%% of a core)\n",
+         harness.cpu_ms_per_frame(), harness.cpu_load() * 100);
+  fflush(stdout);
+  harness.Dump(STDOUT_FILENO);
+  harness.Close();
+
+  if (harness.errors() > 0) {
+    fprintf(stderr, "FAIL: %" PRIu64 " requests failed.\n", harness.errors());
+    return 1;
+  }
+  if (harness.fps() < min_fps) {
+    fprintf(stderr, "FAIL: %.2f fps is below the minimum of %.2f fps.\n",
+            harness.fps(), min_fps);
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace
+
+}  // namespace v4l2_camera_hal
+
+int main(int argc, char** argv) {
+  return v4l2_camera_hal::RunReplayBenchmark(argc, argv);
+}
@@ -19,6 +19,9 @@
 
 #include "stream_format.h"
 
+#include <cstring>
+
+#include <cutils/properties.h>
 #include <system/graphics.h>
 #include "arc/image_processor.h"
 #include "common.h"
@@ -28,6 +31,31 @@ namespace v4l2_camera_hal {
 using arc::SupportedFormat;
 using arc::SupportedFormats;
 
+// Scale filter of each kind of stream: "none", "bilinear" or "box".
+static const char kPreviewScaleFilterProperty[] =
+    "persist.vendor.camera.v4l2.scale_filter.preview";
+static const char kYuvScaleFilterProperty[] =
+    "persist.vendor.camera.v4l2.scale_filter.yuv";
+static const char kJpegScaleFilterProperty[] =
+    "persist.vendor.camera.v4l2.scale_filter.jpeg";
+
+static arc::ScaleFilter GetScaleFilterProperty(
+    const char* property, arc::ScaleFilter default_filter) {
+  char value[PROPERTY_VALUE_MAX];
+  if (property_get(property, value, "") <= 0) {
+    return default_filter;
+  }
+  if (!strcmp(value, "none")) {
+    return arc::ScaleFilter::kNone;
+  } else if (!strcmp(value, "bilinear")) {
+    return arc::ScaleFilter::kBilinear;
+  } else if (!strcmp(value, "box")) {
+    return arc::ScaleFilter::kBox;
+  }
+  HAL_LOGW("Ignoring unknown %s \"%s\".", property, value);
+  return default_filter;
+}
+
 static const std::vector<uint32_t> GetSupportedFourCCs() {
   // The preference of supported fourccs in the list is from high to low.
   static const std::vector<uint32_t> kSupportedFourCCs = {V4L2_PIX_FMT_YUYV,
@@ -41,7 +69,8 @@ StreamFormat::StreamFormat(int format, uint32_t width, uint32_t height)
       v4l2_pixel_format_(StreamFormat::HalToV4L2PixelFormat(format)),
       width_(width),
       height_(height),
-      bytes_per_line_(0) {}
+      bytes_per_line_(0),
+      min_buffer_size_(0) {}
 
 StreamFormat::StreamFormat(const v4l2_format& format)
     : type_(format.type),
@@ -49,14 +78,16 @@ StreamFormat::StreamFormat(const v4l2_format& format)
       v4l2_pixel_format_(format.fmt.pix.pixelformat),
       width_(format.fmt.pix.width),
       height_(format.fmt.pix.height),
-      bytes_per_line_(format.fmt.pix.bytesperline) {}
+      bytes_per_line_(format.fmt.pix.bytesperline),
+      min_buffer_size_(format.fmt.pix.sizeimage) {}
 
 StreamFormat::StreamFormat(const arc::SupportedFormat& format)
     : type_(V4L2_BUF_TYPE_VIDEO_CAPTURE),
       v4l2_pixel_format_(format.fourcc),
       width_(format.width),
       height_(format.height),
-      bytes_per_line_(0) {}
+      bytes_per_line_(0),
+      min_buffer_size_(0) {}
 
 void StreamFormat::FillFormatRequest(v4l2_format* format) const {
   memset(format, 0, sizeof(*format));
@@ -142,6 +173,20 @@ uint32_t StreamFormat::HalToV4L2PixelFormat(int hal_pixel_format) {
   return -1;
 }
 
+arc::ScaleFilter StreamFormat::HalToScaleFilter(int hal_pixel_format) {
+  switch (hal_pixel_format) {
+    case HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED:
+      return GetScaleFilterProperty(kPreviewScaleFilterProperty,
+                                    arc::ScaleFilter::kBilinear);
+    case HAL_PIXEL_FORMAT_BLOB:
+      return GetScaleFilterProperty(kJpegScaleFilterProperty,
+                                    arc::ScaleFilter::kBox);
+    default:
+      return GetScaleFilterProperty(kYuvScaleFilterProperty,
+                                    arc::ScaleFilter::kBox);
+  }
+}
+
 // Copy the qualified format into out_format and return true if there is a
 // proper and fitting format in the given format lists.
 bool StreamFormat::FindBestFitFormat(const SupportedFormats& supported_formats,
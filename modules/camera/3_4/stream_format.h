@@ -21,6 +21,7 @@
 
 #include <linux/videodev2.h>
 #include "arc/common_types.h"
+#include "arc/image_processor.h"
 
 namespace v4l2_camera_hal {
 
@@ -48,6 +49,7 @@ class StreamFormat {
   inline uint32_t height() const { return height_; };
   inline uint32_t v4l2_pixel_format() const { return v4l2_pixel_format_; }
   inline uint32_t bytes_per_line() const { return bytes_per_line_; };
+  inline uint32_t min_buffer_size() const { return min_buffer_size_; };
 
   bool operator==(const StreamFormat& other) const;
   bool operator!=(const StreamFormat& other) const;
@@ -57,6 +59,12 @@ class StreamFormat {
   static uint32_t HalToV4L2PixelFormat(int hal_pixel_format);
   // Returns -1 for unrecognized.
   static int V4L2ToHalPixelFormat(uint32_t v4l2_pixel_format);
+  // Filter to scale outputs in |hal_pixel_format| with, as set by the
+  // persist.vendor.camera.v4l2.scale_filter.* properties. Preview and video
+  // streams (IMPLEMENTATION_DEFINED) default to bilinear to keep up with the
+  // frame rate; streams handed to the application default to the slower,
+  // better looking box filter.
+  static arc::ScaleFilter HalToScaleFilter(int hal_pixel_format);
 
   // ARC++ SupportedFormat Helpers
   static bool FindBestFitFormat(const arc::SupportedFormats& supported_formats,
@@ -76,6 +84,7 @@ class StreamFormat {
   uint32_t width_;
   uint32_t height_;
   uint32_t bytes_per_line_;
+  uint32_t min_buffer_size_;
 };
 
 }  // namespace v4l2_camera_hal
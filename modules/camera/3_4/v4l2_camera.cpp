@@ -19,6 +19,7 @@
 
 #include "v4l2_camera.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <fcntl.h>
 
@@ -46,22 +47,22 @@ V4L2Camera* V4L2Camera::NewV4L2Camera(int id, const std::string path) {
     return nullptr;
   }
 
-  std::unique_ptr<Metadata> metadata;
-  int res = GetV4L2Metadata(v4l2_wrapper, &metadata);
-  if (res) {
-    HAL_LOGE("Failed to initialize V4L2 metadata: %d", res);
+  return NewV4L2Camera(id, std::move(v4l2_wrapper));
+}
+
+V4L2Camera* V4L2Camera::NewV4L2Camera(
+    int id, std::shared_ptr<V4L2Wrapper> v4l2_wrapper) {
+  if (!v4l2_wrapper) {
+    HAL_LOGE("No V4L2 wrapper given.");
     return nullptr;
   }
-
-  return new V4L2Camera(id, std::move(v4l2_wrapper), std::move(metadata));
+  return new V4L2Camera(id, std::move(v4l2_wrapper));
 }
 
-V4L2Camera::V4L2Camera(int id,
-                       std::shared_ptr<V4L2Wrapper> v4l2_wrapper,
-                       std::unique_ptr<Metadata> metadata)
+V4L2Camera::V4L2Camera(int id, std::shared_ptr<V4L2Wrapper> v4l2_wrapper)
     : default_camera_hal::Camera(id),
       device_(std::move(v4l2_wrapper)),
-      metadata_(std::move(metadata)),
+      pipeline_depth_(1),
       buffer_enqueuer_(new FunctionThread(
           std::bind(&V4L2Camera::enqueueRequestBuffers, this))),
       buffer_dequeuer_(new FunctionThread(
@@ -75,6 +76,20 @@ V4L2Camera::~V4L2Camera() {
   HAL_LOG_ENTER();
 }
 
+int V4L2Camera::loadMetadata() {
+  std::lock_guard<std::mutex> guard(metadata_lock_);
+  if (metadata_) {
+    return 0;
+  }
+
+  int res = GetV4L2Metadata(device_, &metadata_);
+  if (res) {
+    HAL_LOGE("Failed to initialize V4L2 metadata: %d", res);
+    metadata_.reset();
+  }
+  return res;
+}
+
 int V4L2Camera::connect() {
   HAL_LOG_ENTER();
 
@@ -89,6 +104,18 @@ int V4L2Camera::connect() {
     return connection_->status();
   }
 
+  int res = loadMetadata();
+  if (res) {
+    connection_.reset();
+    return res;
+  }
+
+  // Requests come back from the device in order, but may finish on an
+  // encoder thread rather than the dequeuer.
+  device_->SetRequestCallback(
+      [this](std::shared_ptr<default_camera_hal::CaptureRequest> request,
+             int res) { completeDequeued(request, res); });
+
   // TODO(b/29185945): confirm this is a supported device.
   // This is checked by the HAL, but the device at |device_|'s path may
   // not be the same one that was there when the HAL was loaded.
@@ -104,6 +131,7 @@ int V4L2Camera::connect() {
 void V4L2Camera::disconnect() {
   HAL_LOG_ENTER();
 
+  device_->SetRequestCallback(nullptr);
   connection_.reset();
 
   // TODO(b/29158098): Inform service of any flashes that are available again
@@ -112,13 +140,29 @@ void V4L2Camera::disconnect() {
 
 int V4L2Camera::flushBuffers() {
   HAL_LOG_ENTER();
-  return device_->StreamOff();
+
+  int res = device_->StreamOff();
+  if (res) {
+    return res;
+  }
+
+  // Turning the stream off returns every buffer, so nothing is in flight
+  // (the Camera class completes the requests). Kick the dequeuer out of its
+  // wait so it notices.
+  cancelInFlight();
+  device_->InterruptWait();
+  return 0;
 }
 
 int V4L2Camera::initStaticInfo(android::CameraMetadata* out) {
   HAL_LOG_ENTER();
 
-  int res = metadata_->FillStaticMetadata(out);
+  int res = loadMetadata();
+  if (res) {
+    return res;
+  }
+
+  res = metadata_->FillStaticMetadata(out);
   if (res) {
     HAL_LOGE("Failed to get static metadata.");
     return res;
@@ -184,7 +228,7 @@ int V4L2Camera::enqueueRequest(
   HAL_LOG_ENTER();
 
   // Assume request validated before calling this function.
-  // (For now, always exactly 1 output buffer, no inputs).
+  // (At least 1 output buffer, no inputs).
   {
     std::lock_guard<std::mutex> guard(request_queue_lock_);
     request_queue_.push(request);
@@ -207,29 +251,31 @@ V4L2Camera::dequeueRequest() {
   return request;
 }
 
-bool V4L2Camera::enqueueRequestBuffers() {
-  // Get a request from the queue (blocks this thread until one is available).
-  std::shared_ptr<default_camera_hal::CaptureRequest> request =
-      dequeueRequest();
-
-  // Assume request validated before being added to the queue
-  // (For now, always exactly 1 output buffer, no inputs).
+int V4L2Camera::applyRequestSettings(
+    std::shared_ptr<default_camera_hal::CaptureRequest> request,
+    uint8_t pipeline_depth) {
+  std::lock_guard<std::mutex> guard(settings_lock_);
 
   // Setting and getting settings are best effort here,
   // since there's no way to know through V4L2 exactly what
   // settings are used for a buffer unless we were to enqueue them
   // one at a time, which would be too slow.
 
-  // Set the requested settings
+  // Set the requested settings. Controls are collected and applied together,
+  // skipping any already at the requested value.
+  device_->BeginControlBatch();
   int res = metadata_->SetRequestSettings(request->settings);
+  int commit_res = device_->CommitControls();
+  if (!res) {
+    res = commit_res;
+  }
   if (res) {
     HAL_LOGE("Failed to set settings.");
-    completeRequest(request, res);
-    return true;
+    return res;
   }
 
   // Replace the requested settings with a snapshot of
-  // the used settings/state immediately before enqueue.
+  // the used settings/state immediately before capture.
   res = metadata_->FillResultMetadata(&request->settings);
   if (res) {
     // Note: since request is a shared pointer, this may happen if another
@@ -237,13 +283,97 @@ bool V4L2Camera::enqueueRequestBuffers() {
     // since that locks the metadata (in that case, this failing is fine,
     // and completeRequest will simply do nothing).
     HAL_LOGE("Failed to fill result metadata.");
-    completeRequest(request, res);
-    return true;
+    return res;
+  }
+  res = UpdateMetadata(
+      &request->settings, ANDROID_REQUEST_PIPELINE_DEPTH, pipeline_depth);
+  if (res) {
+    HAL_LOGE("Failed to report pipeline depth.");
+    return res;
+  }
+  return 0;
+}
+
+void V4L2Camera::applyQueuedSettings(
+    std::shared_ptr<default_camera_hal::CaptureRequest> request,
+    uint8_t pipeline_depth) {
+  int res = applyRequestSettings(request, pipeline_depth);
+  if (res) {
+    // The device may still write into the buffer, so the request can't be
+    // handed back yet.
+    std::lock_guard<std::mutex> guard(in_flight_lock_);
+    settings_errors_[request.get()] = res;
+  }
+}
+
+void V4L2Camera::completeDequeued(
+    std::shared_ptr<default_camera_hal::CaptureRequest> request, int err) {
+  {
+    std::lock_guard<std::mutex> guard(in_flight_lock_);
+    auto error = settings_errors_.find(request.get());
+    if (error != settings_errors_.end()) {
+      if (!err) {
+        err = error->second;
+      }
+      settings_errors_.erase(error);
+    }
+  }
+  completeRequest(request, err);
+}
+
+std::vector<std::shared_ptr<default_camera_hal::CaptureRequest>>
+V4L2Camera::cancelInFlight() {
+  std::vector<std::shared_ptr<default_camera_hal::CaptureRequest>> requests;
+  std::lock_guard<std::mutex> guard(in_flight_lock_);
+  for (const InFlightRequest& in_flight : in_flight_) {
+    requests.push_back(in_flight.request);
+  }
+  in_flight_.clear();
+  settings_errors_.clear();
+  buffers_available_.notify_one();
+  buffers_in_flight_.notify_one();
+  return requests;
+}
+
+bool V4L2Camera::enqueueRequestBuffers() {
+  // Get a request from the queue (blocks this thread until one is available).
+  std::shared_ptr<default_camera_hal::CaptureRequest> request =
+      dequeueRequest();
+
+  // Assume request validated before being added to the queue
+  // (At least 1 output buffer, no inputs).
+
+  // Keep up to |pipeline_depth_| frames queued in the driver, so the device
+  // never waits on the HAL for a buffer.
+  std::unique_lock<std::mutex> lock(in_flight_lock_);
+  while (in_flight_.size() >= pipeline_depth_) {
+    buffers_available_.wait(lock);
+  }
+  // The frames queued ahead of this one, this one, and conversion.
+  uint8_t pipeline_depth = in_flight_.size() + 2;
+  // Unless two or more frames are queued ahead, the settings must be in
+  // place before the device starts the frame after the current one, which
+  // may be this one. Otherwise the dequeuer applies them once this request
+  // is second in line. |in_flight_lock_| is held until the request is in
+  // |in_flight_|, so frames ahead can't be taken off meanwhile and leave it
+  // second in line unnoticed; and the settings are never written once the
+  // buffer is queued and the dequeuer may be reading them.
+  bool apply_now = in_flight_.size() < 2;
+
+  int res = 0;
+  if (apply_now) {
+    res = applyRequestSettings(request, pipeline_depth);
+    if (res) {
+      lock.unlock();
+      completeRequest(request, res);
+      return true;
+    }
   }
 
   // Actually enqueue the buffer for capture.
   res = device_->EnqueueRequest(request);
   if (res) {
+    lock.unlock();
     HAL_LOGE("Device failed to enqueue buffer.");
     completeRequest(request, res);
     return true;
@@ -252,45 +382,96 @@ bool V4L2Camera::enqueueRequestBuffers() {
   // Make sure the stream is on (no effect if already on).
   res = device_->StreamOn();
   if (res) {
+    lock.unlock();
     HAL_LOGE("Device failed to turn on stream.");
-    // Don't really want to send an error for only the request here,
-    // since this is a full device error.
+    // Nothing comes back from a stream that isn't on. Take the buffers back
+    // from the driver before handing them back to the framework.
     // TODO: Should trigger full flush.
+    device_->StreamOff();
+    for (auto& cancelled : cancelInFlight()) {
+      completeRequest(cancelled, res);
+    }
+    completeRequest(request, res);
     return true;
   }
 
-  std::unique_lock<std::mutex> lock(in_flight_lock_);
-  in_flight_buffer_count_++;
+  // Only count the request once its buffer is queued and the stream is on;
+  // until then there is nothing for the dequeuer to wait for.
+  in_flight_.push_back({request, pipeline_depth, apply_now});
   buffers_in_flight_.notify_one();
   return true;
 }
 
-bool V4L2Camera::dequeueRequestBuffers() {
-  // Dequeue a buffer.
-  std::shared_ptr<default_camera_hal::CaptureRequest> request;
-  int res;
+void V4L2Camera::waitForFlush(
+    const std::shared_ptr<default_camera_hal::CaptureRequest>& front) {
+  std::unique_lock<std::mutex> lock(in_flight_lock_);
+  while (!in_flight_.empty() && in_flight_.front().request == front) {
+    buffers_in_flight_.wait(lock);
+  }
+}
 
+bool V4L2Camera::dequeueRequestBuffers() {
+  // Nothing can come back from the device until something has been sent.
+  std::shared_ptr<default_camera_hal::CaptureRequest> front;
   {
     std::unique_lock<std::mutex> lock(in_flight_lock_);
-    res = device_->DequeueRequest(&request);
-    if (!res) {
-      if (request) {
-        completeRequest(request, res);
-        in_flight_buffer_count_--;
-      }
-      return true;
+    while (in_flight_.empty()) {
+      buffers_in_flight_.wait(lock);
     }
+    front = in_flight_.front().request;
   }
 
-  if (res == -EAGAIN) {
-    // EAGAIN just means nothing to dequeue right now.
-    // Wait until something is available before looping again.
-    std::unique_lock<std::mutex> lock(in_flight_lock_);
-    while (in_flight_buffer_count_ == 0) {
-      buffers_in_flight_.wait(lock);
+  // Sleep until the device has a filled buffer ready.
+  int res = device_->WaitForBuffer();
+  if (res == -EINTR || res == -EAGAIN) {
+    // Interrupted (e.g. by a flush) or nothing queued; recheck what's in
+    // flight before waiting again.
+    return true;
+  } else if (res == -ENODEV) {
+    // The device is gone, so waiting on it again would fail right away.
+    HAL_LOGW("Device lost while waiting for buffer.");
+    waitForFlush(front);
+    return true;
+  } else if (res) {
+    HAL_LOGW("Device failed waiting for buffer: %d", res);
+    return true;
+  }
+
+  // Dequeue a buffer. The request is completed through the request callback;
+  // no lock is held here, since completing takes the framework-facing lock
+  // that flush() holds while turning the stream off.
+  std::shared_ptr<default_camera_hal::CaptureRequest> request;
+  res = device_->DequeueRequest(&request);
+  if (res) {
+    if (res != -EAGAIN) {
+      HAL_LOGW("Device failed to dequeue buffer: %d", res);
+    }
+    if (res == -ENODEV) {
+      waitForFlush(front);
     }
-  } else {
-    HAL_LOGW("Device failed to dequeue buffer: %d", res);
+    return true;
+  }
+
+  // The device has moved on to the next frame, so the settings of the one
+  // after that are due.
+  InFlightRequest next;
+  {
+    std::lock_guard<std::mutex> guard(in_flight_lock_);
+    // A flush may have already forgotten the request.
+    for (auto it = in_flight_.begin(); it != in_flight_.end(); ++it) {
+      if (it->request == request) {
+        in_flight_.erase(it);
+        buffers_available_.notify_one();
+        break;
+      }
+    }
+    if (in_flight_.size() >= 2 && !in_flight_[1].settings_applied) {
+      in_flight_[1].settings_applied = true;
+      next = in_flight_[1];
+    }
+  }
+  if (next.request) {
+    applyQueuedSettings(next.request, next.pipeline_depth);
   }
   return true;
 }
@@ -320,40 +501,24 @@ int V4L2Camera::setupStreams(camera3_stream_configuration_t* stream_config) {
     HAL_LOGE("Can't set device format while frames are in flight.");
     return -EINVAL;
   }
-  in_flight_buffer_count_ = 0;
+  in_flight_.clear();
+  settings_errors_.clear();
+  buffers_in_flight_.notify_one();
 
   // stream_config should have been validated; assume at least 1 stream.
+  // V4L2 only produces one stream of frames, so capture at the largest
+  // configured size; every output is copied or converted from that frame.
   camera3_stream_t* stream = stream_config->streams[0];
+  for (uint32_t i = 1; i < stream_config->num_streams; ++i) {
+    camera3_stream_t* candidate = stream_config->streams[i];
+    if (candidate->width * candidate->height > stream->width * stream->height) {
+      stream = candidate;
+    }
+  }
   int format = stream->format;
   uint32_t width = stream->width;
   uint32_t height = stream->height;
 
-  if (stream_config->num_streams > 1) {
-    // TODO(b/29939583):  V4L2 doesn't actually support more than 1
-    // stream at a time. If not all streams are the same format
-    // and size, error. Note that this means the HAL is not spec-compliant.
-    // Technically, this error should be thrown during validation, but
-    // since it isn't a spec-valid error validation isn't set up to check it.
-    for (uint32_t i = 1; i < stream_config->num_streams; ++i) {
-      stream = stream_config->streams[i];
-      if (stream->format != format || stream->width != width ||
-          stream->height != height) {
-        HAL_LOGE(
-            "V4L2 only supports 1 stream configuration at a time "
-            "(stream 0 is format %d, width %u, height %u, "
-            "stream %d is format %d, width %u, height %u).",
-            format,
-            width,
-            height,
-            i,
-            stream->format,
-            stream->width,
-            stream->height);
-        return -EINVAL;
-      }
-    }
-  }
-
   // Ensure the stream is off.
   int res = device_->StreamOff();
   if (res) {
@@ -363,7 +528,10 @@ int V4L2Camera::setupStreams(camera3_stream_configuration_t* stream_config) {
 
   StreamFormat stream_format(format, width, height);
   uint32_t max_buffers = 0;
-  res = device_->SetFormat(stream_format, &max_buffers);
+  // Frames can only go straight into the output buffers if no other stream
+  // needs them.
+  res = device_->SetFormat(
+      stream_format, stream_config->num_streams == 1, &max_buffers);
   if (res) {
     HAL_LOGE("Failed to set device to correct format for stream: %d.", res);
     return -ENODEV;
@@ -376,6 +544,14 @@ int V4L2Camera::setupStreams(camera3_stream_configuration_t* stream_config) {
     return -ENODEV;
   }
 
+  // The driver may grant more buffers than asked for; only keep as many
+  // queued as configured.
+  pipeline_depth_ = std::min(max_buffers, V4L2Wrapper::PipelineDepth());
+
+  // Controls without a fixed default report their current value in
+  // templates, which may change with the format; rebuild cached metadata.
+  metadata_->InvalidateCache();
+
   // Set all the streams dataspaces, usages, and max buffers.
   for (uint32_t i = 0; i < stream_config->num_streams; ++i) {
     stream = stream_config->streams[i];
@@ -412,9 +588,20 @@ int V4L2Camera::setupStreams(camera3_stream_configuration_t* stream_config) {
     stream->data_space = HAL_DATASPACE_V0_JFIF;
   }
 
+  // Set up the per stream conversion state now that formats are final.
+  res = device_->ConfigureOutputStreams(*stream_config);
+  if (res) {
+    HAL_LOGE("Failed to configure output stream conversion: %d.", res);
+    return -ENODEV;
+  }
+
   return 0;
 }
 
+void V4L2Camera::dumpDevice(int fd) {
+  device_->Dump(fd);
+}
+
 bool V4L2Camera::isValidRequestSettings(
     const android::CameraMetadata& settings) {
   if (!metadata_->IsValidRequest(settings)) {
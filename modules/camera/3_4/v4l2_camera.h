@@ -21,8 +21,12 @@
 
 #include <array>
 #include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
 #include <queue>
 #include <string>
+#include <vector>
 
 #include <camera/CameraMetadata.h>
 #include <utils/StrongPointer.h>
@@ -42,14 +46,20 @@ class V4L2Camera : public default_camera_hal::Camera {
   // Use this method to create V4L2Camera objects. Functionally equivalent
   // to "new V4L2Camera", except that it may return nullptr in case of failure.
   static V4L2Camera* NewV4L2Camera(int id, const std::string path);
+  // Same, but around an existing wrapper, e.g. a V4L2ReplayWrapper.
+  static V4L2Camera* NewV4L2Camera(int id,
+                                   std::shared_ptr<V4L2Wrapper> v4l2_wrapper);
   ~V4L2Camera();
 
  private:
   // Constructor private to allow failing on bad input.
   // Use NewV4L2Camera instead.
-  V4L2Camera(int id,
-             std::shared_ptr<V4L2Wrapper> v4l2_wrapper,
-             std::unique_ptr<Metadata> metadata);
+  V4L2Camera(int id, std::shared_ptr<V4L2Wrapper> v4l2_wrapper);
+
+  // Build |metadata_| if it hasn't been yet. Building it queries the device,
+  // so it is put off until the camera is first used (its info is read or it
+  // is opened) rather than done when the HAL is loaded.
+  int loadMetadata();
 
   // default_camera_hal::Camera virtual methods.
   // Connect to the device: open dev nodes, etc.
@@ -77,12 +87,40 @@ class V4L2Camera : public default_camera_hal::Camera {
       std::shared_ptr<default_camera_hal::CaptureRequest> request) override;
   // Flush in flight buffers.
   int flushBuffers() override;
+  // Dump device specific state.
+  void dumpDevice(int fd) override;
 
   // Async request processing helpers.
   // Dequeue a request from the waiting queue.
   // Blocks until a request is available.
   std::shared_ptr<default_camera_hal::CaptureRequest> dequeueRequest();
 
+  // Apply the settings of |request| to the device and replace them with
+  // the resulting metadata, reporting |pipeline_depth|.
+  int applyRequestSettings(
+      std::shared_ptr<default_camera_hal::CaptureRequest> request,
+      uint8_t pipeline_depth);
+  // As above, for a request whose buffer is already queued in the driver.
+  // On failure it can only be completed once its buffer comes back, so the
+  // error is kept for completeDequeued.
+  void applyQueuedSettings(
+      std::shared_ptr<default_camera_hal::CaptureRequest> request,
+      uint8_t pipeline_depth);
+  // Complete a request whose buffer came back from the device, with the
+  // error its settings failed with, if any.
+  void completeDequeued(
+      std::shared_ptr<default_camera_hal::CaptureRequest> request,
+      int err);
+  // Forget every request in flight, once the stream has been turned off
+  // (which takes their buffers back from the driver). Returns them.
+  std::vector<std::shared_ptr<default_camera_hal::CaptureRequest>>
+  cancelInFlight();
+
+  // Block until |front| is no longer the first request in flight, e.g. once
+  // a flush has forgotten it. For when the device can't be waited on.
+  void waitForFlush(
+      const std::shared_ptr<default_camera_hal::CaptureRequest>& front);
+
   // Thread functions. Return true to loop, false to exit.
   // Pass buffers for enqueued requests to the device.
   bool enqueueRequestBuffers();
@@ -92,17 +130,36 @@ class V4L2Camera : public default_camera_hal::Camera {
   // V4L2 helper.
   std::shared_ptr<V4L2Wrapper> device_;
   std::unique_ptr<V4L2Wrapper::Connection> connection_;
+  // Built by loadMetadata() under |metadata_lock_|, then never changed.
+  std::mutex metadata_lock_;
   std::unique_ptr<Metadata> metadata_;
   std::mutex request_queue_lock_;
   std::queue<std::shared_ptr<default_camera_hal::CaptureRequest>>
       request_queue_;
   std::mutex in_flight_lock_;
-  uint32_t in_flight_buffer_count_;
+  // How many requests may be queued in the driver at once.
+  uint32_t pipeline_depth_;
+  // Requests whose buffers are queued in the driver, in capture order; the
+  // first is the frame being captured. V4L2 controls take effect on the
+  // frame after the one being captured, so the settings of each request
+  // are applied once it is second in line (or before it is queued, if it
+  // will be second or first).
+  struct InFlightRequest {
+    std::shared_ptr<default_camera_hal::CaptureRequest> request;
+    uint8_t pipeline_depth;
+    bool settings_applied;
+  };
+  std::deque<InFlightRequest> in_flight_;
+  // Errors applying the settings of requests still queued in the driver.
+  std::map<const default_camera_hal::CaptureRequest*, int> settings_errors_;
+  // Serializes applying settings, which both request threads may do.
+  std::mutex settings_lock_;
   // Threads require holding an Android strong pointer.
   android::sp<android::Thread> buffer_enqueuer_;
   android::sp<android::Thread> buffer_dequeuer_;
   std::condition_variable requests_available_;
   std::condition_variable buffers_in_flight_;
+  std::condition_variable buffers_available_;
 
   int32_t max_input_streams_;
   std::array<int, 3> max_output_streams_;  // {raw, non-stalling, stalling}.
@@ -30,7 +30,10 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <memory>
+#include <thread>
 #include <unordered_set>
 
 #include <android-base/parseint.h>
@@ -51,6 +54,46 @@ namespace v4l2_camera_hal {
 // Default global camera hal.
 static V4L2CameraHAL gCameraHAL;
 
+namespace {
+
+// Opening a node can take a while (e.g. powering up a USB camera), so nodes
+// are probed a few at a time.
+const size_t kMaxProbeThreads = 4;
+
+struct ProbeResult {
+  bool capture_device = false;
+  std::string bus;
+};
+
+// Check whether |node| is a V4L2 video capture device, and get its bus.
+ProbeResult ProbeNode(const std::string& node) {
+  ProbeResult result;
+  int fd = TEMP_FAILURE_RETRY(open(node.c_str(), O_RDWR));
+  if (fd < 0) {
+    HAL_LOGE("failed to open %s (%s).", node.c_str(), strerror(errno));
+    return result;
+  }
+  // Read V4L2 capabilities.
+  v4l2_capability cap;
+  if (TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_QUERYCAP, &cap)) != 0) {
+    HAL_LOGE("VIDIOC_QUERYCAP on %s fail: %s.", node.c_str(), strerror(errno));
+  } else if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
+    HAL_LOGE("%s is not a V4L2 video capture device.", node.c_str());
+  } else {
+    result.capture_device = true;
+    result.bus = reinterpret_cast<char*>(cap.bus_info);
+  }
+  close(fd);
+  return result;
+}
+
+// Node number of a /dev/videoN path.
+int NodeNumber(const std::string& node) {
+  return std::atoi(node.c_str() + strlen("/dev/video"));
+}
+
+}  // namespace
+
 V4L2CameraHAL::V4L2CameraHAL() : mCameras(), mCallbacks(NULL) {
   HAL_LOG_ENTER();
   // Adds all available V4L2 devices.
@@ -74,44 +117,88 @@ V4L2CameraHAL::V4L2CameraHAL() : mCameras(), mCallbacks(NULL) {
       }
     }
   }
-  // Test each for V4L2 support and uniqueness.
+  closedir(dir);
+  // readdir order is arbitrary; number cameras in node order so ids are the
+  // same from boot to boot.
+  std::sort(nodes.begin(), nodes.end(),
+            [](const std::string& a, const std::string& b) {
+              return NodeNumber(a) < NodeNumber(b);
+            });
+
+  // Test each for V4L2 support, in parallel.
+  std::vector<ProbeResult> results(nodes.size());
+  std::atomic<size_t> next_node(0);
+  auto prober = [&nodes, &results, &next_node]() {
+    for (size_t i = next_node++; i < nodes.size(); i = next_node++) {
+      results[i] = ProbeNode(nodes[i]);
+    }
+  };
+  std::vector<std::thread> probers;
+  size_t num_probers = std::min(nodes.size(), kMaxProbeThreads);
+  for (size_t i = 1; i < num_probers; ++i) {
+    probers.emplace_back(prober);
+  }
+  prober();
+  for (auto& thread : probers) {
+    thread.join();
+  }
+
+  // Add a camera for each unique device. Cameras only query their device
+  // (to build their metadata) once they are first used, or warmed up below.
   std::unordered_set<std::string> buses;
-  std::string bus;
-  v4l2_capability cap;
-  int fd;
   int id = 0;
-  for (const auto& node : nodes) {
-    // Open the node.
-    fd = TEMP_FAILURE_RETRY(open(node.c_str(), O_RDWR));
-    if (fd < 0) {
-      HAL_LOGE("failed to open %s (%s).", node.c_str(), strerror(errno));
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (!results[i].capture_device || !buses.insert(results[i].bus).second) {
       continue;
     }
-    // Read V4L2 capabilities.
-    if (TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_QUERYCAP, &cap)) != 0) {
-      HAL_LOGE(
-          "VIDIOC_QUERYCAP on %s fail: %s.", node.c_str(), strerror(errno));
-    } else if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
-      HAL_LOGE("%s is not a V4L2 video capture device.", node.c_str());
+    HAL_LOGV("Found unique bus at %s.", nodes[i].c_str());
+    std::unique_ptr<V4L2Camera> cam(V4L2Camera::NewV4L2Camera(id, nodes[i]));
+    if (cam) {
+      mCameras.push_back(std::move(cam));
+      ++id;
     } else {
-      // If the node is unique, add a camera for it.
-      bus = reinterpret_cast<char*>(cap.bus_info);
-      if (buses.insert(bus).second) {
-        HAL_LOGV("Found unique bus at %s.", node.c_str());
-        std::unique_ptr<V4L2Camera> cam(V4L2Camera::NewV4L2Camera(id++, node));
-        if (cam) {
-          mCameras.push_back(std::move(cam));
-        } else {
-          HAL_LOGE("Failed to initialize camera at %s.", node.c_str());
+      HAL_LOGE("Failed to initialize camera at %s.", nodes[i].c_str());
+    }
+  }
+
+  // The framework reads every camera's info right after loading the HAL, so
+  // build it in the background as many at a time as nodes were probed,
+  // rather than one at a time as the framework asks. A camera that can't be
+  // used is reported as not present, since it is already counted.
+  auto next_camera = std::make_shared<std::atomic<size_t>>(0);
+  size_t num_warmers = std::min(mCameras.size(), kMaxProbeThreads);
+  for (size_t i = 0; i < num_warmers; ++i) {
+    mWarmers.emplace_back([this, next_camera]() {
+      for (size_t id = (*next_camera)++; id < mCameras.size();
+           id = (*next_camera)++) {
+        camera_info_t info;
+        if (mCameras[id]->getInfo(&info)) {
+          reportUnavailable(id);
         }
       }
-    }
-    close(fd);
+    });
   }
 }
 
 V4L2CameraHAL::~V4L2CameraHAL() {
   HAL_LOG_ENTER();
+  for (auto& thread : mWarmers) {
+    thread.join();
+  }
+}
+
+void V4L2CameraHAL::reportUnavailable(int id) {
+  HAL_LOGE("Camera %d can't be used, reporting it as not present.", id);
+  const camera_module_callbacks_t* callbacks;
+  {
+    std::lock_guard<std::mutex> guard(mStatusLock);
+    mUnavailable.push_back(id);
+    callbacks = mCallbacks;
+  }
+  if (callbacks) {
+    callbacks->camera_device_status_change(callbacks, id,
+                                           CAMERA_DEVICE_STATUS_NOT_PRESENT);
+  }
 }
 
 int V4L2CameraHAL::getNumberOfCameras() {
@@ -130,7 +217,19 @@ int V4L2CameraHAL::getCameraInfo(int id, camera_info_t* info) {
 
 int V4L2CameraHAL::setCallbacks(const camera_module_callbacks_t* callbacks) {
   HAL_LOG_ENTER();
-  mCallbacks = callbacks;
+  std::vector<int> unavailable;
+  {
+    std::lock_guard<std::mutex> guard(mStatusLock);
+    mCallbacks = callbacks;
+    if (callbacks) {
+      unavailable = mUnavailable;
+    }
+  }
+  // The framework assumes every camera is present until told otherwise.
+  for (int id : unavailable) {
+    callbacks->camera_device_status_change(callbacks, id,
+                                           CAMERA_DEVICE_STATUS_NOT_PRESENT);
+  }
   return 0;
 }
 
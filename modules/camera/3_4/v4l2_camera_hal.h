@@ -19,6 +19,8 @@
 #ifndef V4L2_CAMERA_HAL_V4L2_CAMERA_HAL_H_
 #define V4L2_CAMERA_HAL_V4L2_CAMERA_HAL_H_
 
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <hardware/camera_common.h>
@@ -53,10 +55,19 @@ class V4L2CameraHAL {
   int openDevice(const hw_module_t* mod, const char* name, hw_device_t** dev);
 
  private:
+  // Report camera |id| as not present, now or once callbacks are set.
+  void reportUnavailable(int id);
+
   // Vector of cameras.
   std::vector<std::unique_ptr<default_camera_hal::Camera>> mCameras;
+  // Build the static info of |mCameras| in the background.
+  std::vector<std::thread> mWarmers;
+  // Guards |mCallbacks| and |mUnavailable|.
+  std::mutex mStatusLock;
   // Callback handle.
   const camera_module_callbacks_t* mCallbacks;
+  // Cameras whose static info couldn't be built.
+  std::vector<int> mUnavailable;
 
   DISALLOW_COPY_AND_ASSIGN(V4L2CameraHAL);
 };
@@ -439,7 +439,7 @@ int GetV4L2Metadata(std::shared_ptr<V4L2Wrapper> device,
   components.insert(std::unique_ptr<PartialMetadataInterface>(
       new Property<int32_t>(ANDROID_JPEG_MAX_SIZE, kV4L2MaxJpegSize)));
   // TODO(b/31021672): Other JPEG controls (GPS, quality, orientation).
-  // TODO(b/29939583): V4L2 can only support 1 stream at a time.
+  // V4L2 only captures 1 stream at a time, which is fanned out in software.
   // For now, just reporting minimum allowable for LIMITED devices.
   components.insert(std::unique_ptr<PartialMetadataInterface>(
       new Property<std::array<int32_t, 3>>(
@@ -448,11 +448,14 @@ int GetV4L2Metadata(std::shared_ptr<V4L2Wrapper> device,
   // Reprocessing not supported.
   components.insert(std::unique_ptr<PartialMetadataInterface>(
       new Property<int32_t>(ANDROID_REQUEST_MAX_NUM_INPUT_STREAMS, 0)));
-  // No way to know pipeline depth for V4L2, so fake with max allowable latency.
-  // Doesn't mean much without per-frame controls anyways.
+  // Frames pass through the driver queue and then one conversion stage.
+  // V4L2Camera overwrites the per-result depth with the actual queue length.
+  uint8_t max_pipeline_depth = V4L2Wrapper::PipelineDepth() + 1;
   components.insert(std::unique_ptr<PartialMetadataInterface>(
-      new Property<uint8_t>(ANDROID_REQUEST_PIPELINE_MAX_DEPTH, 4)));
-  components.insert(FixedState<uint8_t>(ANDROID_REQUEST_PIPELINE_DEPTH, 4));
+      new Property<uint8_t>(ANDROID_REQUEST_PIPELINE_MAX_DEPTH,
+                            max_pipeline_depth)));
+  components.insert(
+      FixedState<uint8_t>(ANDROID_REQUEST_PIPELINE_DEPTH, max_pipeline_depth));
   // "LIMITED devices are strongly encouraged to use a non-negative value.
   // If UNKNOWN is used here then app developers do not have a way to know
   // when sensor settings have been applied." - Unfortunately, V4L2 doesn't
@@ -499,7 +502,10 @@ int GetV4L2Metadata(std::shared_ptr<V4L2Wrapper> device,
   components.insert(std::unique_ptr<PartialMetadataInterface>(
       new Property<std::array<float, 2>>(ANDROID_SENSOR_INFO_PHYSICAL_SIZE,
                                          {{3.674, 2.760}})));
-  // HAL uses BOOTTIME timestamps.
+  // HAL uses BOOTTIME timestamps. This is the time result metadata is filled
+  // in, replaced by the driver's capture time when the driver reports
+  // monotonic buffer timestamps (see V4L2Wrapper::StampSensorTimestamp).
+  // Since that isn't guaranteed, the source is left UNKNOWN.
   // TODO(b/29457051): make sure timestamps are consistent throughout the HAL.
   components.insert(std::unique_ptr<PartialMetadataInterface>(
       new Property<uint8_t>(ANDROID_SENSOR_INFO_TIMESTAMP_SOURCE,
@@ -0,0 +1,424 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "V4L2ReplayWrapper"
+
+#include "v4l2_replay_wrapper.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "common.h"
+#include "frame_timing.h"
+#include "metadata/metadata_common.h"
+#include "stream_format.h"
+
+namespace v4l2_camera_hal {
+
+using default_camera_hal::CaptureRequest;
+using default_camera_hal::FrameTimingNow;
+
+namespace {
+
+// Spacing of frames in dumps without usable timestamps.
+const int64_t kDefaultFrameDurationNs = 33333333;
+
+// Sizes the recorded format is offered at, besides the recorded size, when
+// they fit within it.
+const uint32_t kReplaySizes[][2] = {
+    {3840, 2160}, {2560, 1440}, {1920, 1080}, {1280, 720},
+    {640, 480},   {320, 240},   {176, 144}};
+
+}  // namespace
+
+V4L2ReplayWrapper* V4L2ReplayWrapper::NewV4L2ReplayWrapper(
+    const std::string& dump_path, const Options& options) {
+  std::unique_ptr<FrameDump> dump(new FrameDump);
+  if (ReadFrameDump(dump_path, options.max_frames, dump.get())) {
+    return nullptr;
+  }
+  return NewV4L2ReplayWrapper(std::move(dump), options);
+}
+
+V4L2ReplayWrapper* V4L2ReplayWrapper::NewV4L2ReplayWrapper(
+    std::unique_ptr<FrameDump> dump, const Options& options) {
+  if (!dump || dump->frames.empty()) {
+    HAL_LOGE("Nothing to replay.");
+    return nullptr;
+  }
+  return new V4L2ReplayWrapper(std::move(dump), options);
+}
+
+V4L2ReplayWrapper::V4L2ReplayWrapper(std::unique_ptr<FrameDump> dump,
+                                     const Options& options)
+    : V4L2Wrapper(""),
+      dump_(std::move(dump)),
+      real_time_(options.real_time),
+      connections_(0),
+      max_buffers_(0),
+      streaming_(false),
+      interrupted_(false),
+      stream_start_(0),
+      next_frame_(0),
+      frames_captured_(0),
+      frames_dropped_(0) {
+  // Keep the recorded spacing if the timestamps allow it.
+  const std::vector<FrameDump::Frame>& frames = dump_->frames;
+  bool timestamps_valid = frames[0].timestamp_ns > 0;
+  for (size_t i = 1; i < frames.size() && timestamps_valid; ++i) {
+    timestamps_valid = frames[i].timestamp_ns > frames[i - 1].timestamp_ns;
+  }
+  for (size_t i = 0; i < frames.size(); ++i) {
+    frame_offsets_.push_back(
+        timestamps_valid ? frames[i].timestamp_ns - frames[0].timestamp_ns
+                         : i * kDefaultFrameDurationNs);
+  }
+  frame_duration_ = frames.size() > 1
+                        ? frame_offsets_.back() / (frames.size() - 1)
+                        : kDefaultFrameDurationNs;
+  loop_duration_ = frame_offsets_.back() + frame_duration_;
+
+  arc::SupportedFormat format;
+  format.fourcc = dump_->fourcc;
+  format.width = dump_->width;
+  format.height = dump_->height;
+  format.frameRates.push_back(1e9f / frame_duration_);
+  formats_.push_back(format);
+  for (const auto& size : kReplaySizes) {
+    if (size[0] * size[1] < dump_->width * dump_->height &&
+        size[0] <= dump_->width && size[1] <= dump_->height) {
+      format.width = size[0];
+      format.height = size[1];
+      formats_.push_back(format);
+    }
+  }
+  convertible_formats_ = StreamFormat::GetQualifiedFormats(formats_);
+
+  HAL_LOGI("Replaying %zu frames of %ux%u 0x%x every %" PRId64 " ns.",
+           frames.size(), dump_->width, dump_->height, dump_->fourcc,
+           frame_duration_);
+}
+
+V4L2ReplayWrapper::~V4L2ReplayWrapper() {}
+
+int V4L2ReplayWrapper::Connect() {
+  std::lock_guard<std::mutex> guard(lock_);
+  ++connections_;
+  return 0;
+}
+
+void V4L2ReplayWrapper::Disconnect() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (connections_ == 0) {
+      HAL_LOGE("Replay device is not connected, cannot disconnect.");
+      return;
+    }
+    if (--connections_ > 0) {
+      return;
+    }
+    streaming_ = false;
+    max_buffers_ = 0;
+    ClearQueueLocked();
+  }
+  std::lock_guard<std::mutex> guard(pipeline_lock_);
+  pipeline_.Clear();
+}
+
+int V4L2ReplayWrapper::StreamOn() {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (max_buffers_ == 0) {
+    HAL_LOGE("Stream format must be set before turning on stream.");
+    return -EINVAL;
+  }
+  if (!streaming_) {
+    streaming_ = true;
+    stream_start_ = FrameTimingNow();
+    next_frame_ = 0;
+    cond_.notify_all();
+  }
+  return 0;
+}
+
+int V4L2ReplayWrapper::StreamOff() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    streaming_ = false;
+    ClearQueueLocked();
+  }
+  // As with a device, pending encodes must stop writing to buffers that are
+  // about to be returned to the framework.
+  std::lock_guard<std::mutex> guard(pipeline_lock_);
+  pipeline_.Flush();
+  return 0;
+}
+
+int V4L2ReplayWrapper::QueryControl(uint32_t /*control_id*/,
+                                    v4l2_query_ext_ctrl* /*result*/) {
+  return -EINVAL;
+}
+
+int V4L2ReplayWrapper::GetControl(uint32_t /*control_id*/,
+                                  int32_t* /*value*/) {
+  return -EINVAL;
+}
+
+int V4L2ReplayWrapper::SetControl(uint32_t /*control_id*/,
+                                  int32_t /*desired*/,
+                                  int32_t* /*result*/) {
+  return -EINVAL;
+}
+
+void V4L2ReplayWrapper::BeginControlBatch() {}
+
+int V4L2ReplayWrapper::CommitControls() {
+  return 0;
+}
+
+bool V4L2ReplayWrapper::IsControlCacheable(uint32_t /*control_id*/) {
+  return false;
+}
+
+int V4L2ReplayWrapper::GetFormats(std::set<uint32_t>* v4l2_formats) {
+  v4l2_formats->insert(dump_->fourcc);
+  return 0;
+}
+
+int V4L2ReplayWrapper::GetQualifiedFormats(
+    std::vector<uint32_t>* v4l2_formats) {
+  v4l2_formats->clear();
+  if (!convertible_formats_.empty()) {
+    v4l2_formats->push_back(dump_->fourcc);
+  }
+  return 0;
+}
+
+int V4L2ReplayWrapper::GetFormatFrameSizes(
+    uint32_t v4l2_format, std::set<std::array<int32_t, 2>>* sizes) {
+  if (v4l2_format != dump_->fourcc) {
+    HAL_LOGE("Format 0x%x is not supported.", v4l2_format);
+    return -ENODEV;
+  }
+  for (const auto& format : formats_) {
+    sizes->insert({{static_cast<int32_t>(format.width),
+                    static_cast<int32_t>(format.height)}});
+  }
+  return 0;
+}
+
+int V4L2ReplayWrapper::GetFormatFrameDurationRange(
+    uint32_t v4l2_format,
+    const std::array<int32_t, 2>& /*size*/,
+    std::array<int64_t, 2>* duration_range) {
+  if (v4l2_format != dump_->fourcc) {
+    HAL_LOGE("Format 0x%x is not supported.", v4l2_format);
+    return -ENODEV;
+  }
+  *duration_range = {{frame_duration_, frame_duration_}};
+  return 0;
+}
+
+int V4L2ReplayWrapper::SetFormat(const StreamFormat& desired_format,
+                                 bool /*direct_output*/,
+                                 uint32_t* result_max_buffers) {
+  // Frames are never captured straight into the output buffers; they always
+  // come from the dump.
+  arc::SupportedFormat format;
+  if (!StreamFormat::FindBestFitFormat(formats_, convertible_formats_,
+                                       desired_format.v4l2_pixel_format(),
+                                       desired_format.width(),
+                                       desired_format.height(), &format)) {
+    HAL_LOGE("Replay doesn't support %ux%u 0x%x.", desired_format.width(),
+             desired_format.height(), desired_format.v4l2_pixel_format());
+    return -EINVAL;
+  }
+
+  std::lock_guard<std::mutex> guard(lock_);
+  max_buffers_ = PipelineDepth();
+  *result_max_buffers = max_buffers_;
+  return 0;
+}
+
+int V4L2ReplayWrapper::ConfigureOutputStreams(
+    const camera3_stream_configuration_t& stream_config) {
+  std::lock_guard<std::mutex> guard(pipeline_lock_);
+  return pipeline_.Configure(stream_config, dump_->fourcc);
+}
+
+void V4L2ReplayWrapper::SetRequestCallback(
+    ConversionPipeline::CompletionCallback callback) {
+  pipeline_.SetCompletionCallback(callback);
+}
+
+int V4L2ReplayWrapper::EnqueueRequest(std::shared_ptr<CaptureRequest> request) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (max_buffers_ == 0) {
+    HAL_LOGE("Stream format must be set before enqueuing buffers.");
+    return -ENODEV;
+  }
+  if (queue_.size() >= max_buffers_) {
+    HAL_LOGE("Cannot enqueue buffer: stream is already full.");
+    return -ENODEV;
+  }
+
+  int64_t now = FrameTimingNow();
+  request->timings.queued = now;
+  queue_.push_back({std::move(request), now, -1, 0});
+  cond_.notify_all();
+  return 0;
+}
+
+int64_t V4L2ReplayWrapper::FrameDueTime(int64_t index) const {
+  int64_t count = frame_offsets_.size();
+  return stream_start_ + (index / count) * loop_duration_ +
+         frame_offsets_[index % count];
+}
+
+void V4L2ReplayWrapper::CaptureDueFramesLocked() {
+  if (!streaming_) {
+    return;
+  }
+  // Buffers are filled in the order they were queued.
+  auto next = std::find_if(queue_.begin(), queue_.end(),
+                           [](const QueuedRequest& queued) {
+                             return queued.frame < 0;
+                           });
+  int64_t now = FrameTimingNow();
+  if (!real_time_) {
+    for (; next != queue_.end(); ++next) {
+      next->frame = next_frame_++;
+      next->captured_ns = now;
+      ++frames_captured_;
+    }
+    return;
+  }
+
+  for (int64_t due = FrameDueTime(next_frame_); due <= now;
+       due = FrameDueTime(++next_frame_)) {
+    if (next != queue_.end() && next->queued_ns <= due) {
+      next->frame = next_frame_;
+      next->captured_ns = due;
+      ++next;
+      ++frames_captured_;
+    } else {
+      // No buffer to capture into.
+      ++frames_dropped_;
+    }
+  }
+}
+
+void V4L2ReplayWrapper::ClearQueueLocked() {
+  queue_.clear();
+  cond_.notify_all();
+}
+
+int V4L2ReplayWrapper::WaitForBuffer() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (true) {
+    if (interrupted_) {
+      interrupted_ = false;
+      return -EINTR;
+    }
+    CaptureDueFramesLocked();
+    if (!queue_.empty() && queue_.front().frame >= 0) {
+      return 0;
+    }
+    if (streaming_ && !queue_.empty()) {
+      // steady_clock is CLOCK_MONOTONIC, which frame times are taken from.
+      cond_.wait_until(lock, std::chrono::steady_clock::time_point(
+                                 std::chrono::nanoseconds(
+                                     FrameDueTime(next_frame_))));
+    } else {
+      cond_.wait(lock);
+    }
+  }
+}
+
+void V4L2ReplayWrapper::InterruptWait() {
+  std::lock_guard<std::mutex> guard(lock_);
+  interrupted_ = true;
+  cond_.notify_all();
+}
+
+int V4L2ReplayWrapper::DequeueRequest(
+    std::shared_ptr<CaptureRequest>* request) {
+  // Taken before |lock_| is released, so frames reach the pipeline in the
+  // order they were dequeued.
+  std::unique_lock<std::mutex> pipeline_lock(pipeline_lock_);
+  QueuedRequest dequeued;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    CaptureDueFramesLocked();
+    if (queue_.empty() || queue_.front().frame < 0) {
+      return -EAGAIN;
+    }
+    dequeued = std::move(queue_.front());
+    queue_.pop_front();
+  }
+  dequeued.request->timings.dequeued = FrameTimingNow();
+
+  int res = UpdateMetadata(
+      &dequeued.request->settings, ANDROID_SENSOR_TIMESTAMP,
+      default_camera_hal::MonotonicToBoottime(dequeued.captured_ns));
+  HAL_LOGE_IF(res, "Failed to update sensor timestamp: %d", res);
+
+  if (request) {
+    *request = dequeued.request;
+  }
+
+  // The enqueuing thread keeps going while the frame is converted.
+  const arc::FrameBuffer& frame =
+      *dump_->frames[dequeued.frame % dump_->frames.size()].buffer;
+  res = pipeline_.Process(frame, frame.GetDataSize(), dequeued.request);
+  HAL_LOGE_IF(res, "Failed to process frame: %d", res);
+  pipeline_lock.unlock();
+
+  // Deliver outside the locks; the receiver may call back into the wrapper.
+  pipeline_.DeliverCompleted();
+  return 0;
+}
+
+int V4L2ReplayWrapper::GetInFlightBufferCount() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return queue_.size();
+}
+
+void V4L2ReplayWrapper::Dump(int fd) {
+  ConversionStats stats;
+  {
+    std::lock_guard<std::mutex> guard(pipeline_lock_);
+    stats = pipeline_.GetStats();
+  }
+  std::lock_guard<std::mutex> guard(lock_);
+  dprintf(fd, "  Replaying: %zu frames of %ux%u 0x%x (%s)\n",
+          dump_->frames.size(), dump_->width, dump_->height, dump_->fourcc,
+          real_time_ ? "real time" : "as fast as possible");
+  dprintf(fd, "  Frames dropped by replay: %" PRIu64 " of %" PRIu64 "\n",
+          frames_dropped_, frames_dropped_ + frames_captured_);
+  dprintf(fd, "  Frames processed: %" PRIu64 "\n", stats.frames);
+  dprintf(fd, "  Bytes converted: %" PRIu64 "\n", stats.bytes_converted);
+  dprintf(fd, "  Bytes copied: %" PRIu64 "\n", stats.bytes_copied);
+  dprintf(fd, "  JPEG encodes queued: %" PRIu64 "\n", stats.encodes_queued);
+  dprintf(fd, "  JPEG encodes inline: %" PRIu64 "\n", stats.encodes_inline);
+  dprintf(fd, "  Conversion buffer allocations: %" PRIu64 "\n",
+          stats.allocations);
+}
+
+}  // namespace v4l2_camera_hal
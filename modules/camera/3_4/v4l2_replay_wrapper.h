@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef V4L2_CAMERA_HAL_V4L2_REPLAY_WRAPPER_H_
+#define V4L2_CAMERA_HAL_V4L2_REPLAY_WRAPPER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "arc/common_types.h"
+#include "conversion_pipeline.h"
+#include "frame_dump.h"
+#include "v4l2_wrapper.h"
+
+namespace v4l2_camera_hal {
+
+// A V4L2Wrapper that plays back a FrameDump rather than talking to a device,
+// so the whole request path can be run (and timed) without a camera.
+//
+// The device it stands in for has no controls, and offers the recorded
+// format at the recorded size and at every standard size below it. Frames
+// always come out at the recorded size, leaving any scaling to the
+// conversion pipeline. They are played in a loop, each captured into the
+// oldest buffer queued by the time it is due, as a driver would; frames
+// that come due with no buffer queued are dropped.
+class V4L2ReplayWrapper : public V4L2Wrapper {
+ public:
+  struct Options {
+    // Frames kept in memory and played in a loop.
+    size_t max_frames = 30;
+    // Deliver frames with the spacing they were recorded with. Otherwise
+    // every frame is due as soon as a buffer is queued for it, which
+    // measures how fast the HAL can go.
+    bool real_time = true;
+  };
+
+  // Play the dump at |dump_path|. Returns nullptr if it can't be read.
+  static V4L2ReplayWrapper* NewV4L2ReplayWrapper(const std::string& dump_path,
+                                                 const Options& options);
+  // Play |dump|, which must hold at least one frame.
+  static V4L2ReplayWrapper* NewV4L2ReplayWrapper(
+      std::unique_ptr<FrameDump> dump, const Options& options);
+  ~V4L2ReplayWrapper();
+
+  // V4L2Wrapper methods.
+  int StreamOn() override;
+  int StreamOff() override;
+  int QueryControl(uint32_t control_id, v4l2_query_ext_ctrl* result) override;
+  int GetControl(uint32_t control_id, int32_t* value) override;
+  int SetControl(uint32_t control_id,
+                 int32_t desired,
+                 int32_t* result = nullptr) override;
+  void BeginControlBatch() override;
+  int CommitControls() override;
+  bool IsControlCacheable(uint32_t control_id) override;
+  int GetFormats(std::set<uint32_t>* v4l2_formats) override;
+  int GetQualifiedFormats(std::vector<uint32_t>* v4l2_formats) override;
+  int GetFormatFrameSizes(uint32_t v4l2_format,
+                          std::set<std::array<int32_t, 2>>* sizes) override;
+  int GetFormatFrameDurationRange(
+      uint32_t v4l2_format,
+      const std::array<int32_t, 2>& size,
+      std::array<int64_t, 2>* duration_range) override;
+  int SetFormat(const StreamFormat& desired_format,
+                bool direct_output,
+                uint32_t* result_max_buffers) override;
+  int ConfigureOutputStreams(
+      const camera3_stream_configuration_t& stream_config) override;
+  void SetRequestCallback(
+      ConversionPipeline::CompletionCallback callback) override;
+  int EnqueueRequest(
+      std::shared_ptr<default_camera_hal::CaptureRequest> request) override;
+  int DequeueRequest(
+      std::shared_ptr<default_camera_hal::CaptureRequest>* request) override;
+  int GetInFlightBufferCount() override;
+  int WaitForBuffer() override;
+  void InterruptWait() override;
+  void Dump(int fd) override;
+
+ protected:
+  int Connect() override;
+  void Disconnect() override;
+
+ private:
+  V4L2ReplayWrapper(std::unique_ptr<FrameDump> dump, const Options& options);
+
+  // A request handed to the "device", and the frame captured into it once
+  // there is one.
+  struct QueuedRequest {
+    std::shared_ptr<default_camera_hal::CaptureRequest> request;
+    int64_t queued_ns;
+    // Index into the endless replay of the dump, or -1.
+    int64_t frame;
+    // CLOCK_MONOTONIC time |frame| was captured.
+    int64_t captured_ns;
+  };
+
+  // CLOCK_MONOTONIC time frame |index| of the replay is due.
+  int64_t FrameDueTime(int64_t index) const;
+  // Capture every frame due by now into the queued requests. Called with
+  // |lock_| held.
+  void CaptureDueFramesLocked();
+  // Drop everything queued. Called with |lock_| held.
+  void ClearQueueLocked();
+
+  const std::unique_ptr<FrameDump> dump_;
+  const bool real_time_;
+  // Offset of each frame from the first, in ns. The replay starts over
+  // every |loop_duration_| ns.
+  std::vector<int64_t> frame_offsets_;
+  int64_t loop_duration_;
+  // Spacing of frames, for the advertised frame rate.
+  int64_t frame_duration_;
+  // The dump's format at each size it is offered at, and those of them the
+  // image processor can convert from.
+  arc::SupportedFormats formats_;
+  arc::SupportedFormats convertible_formats_;
+
+  std::mutex lock_;
+  std::condition_variable cond_;
+  int connections_;
+  uint32_t max_buffers_;
+  bool streaming_;
+  bool interrupted_;
+  int64_t stream_start_;
+  // Next frame of the replay to come due.
+  int64_t next_frame_;
+  std::deque<QueuedRequest> queue_;
+  uint64_t frames_captured_;
+  uint64_t frames_dropped_;
+  // Serializes use of |pipeline_|, which is held while a frame is
+  // converted. Taken before |lock_| when both are needed.
+  std::mutex pipeline_lock_;
+  ConversionPipeline pipeline_;
+
+  DISALLOW_COPY_AND_ASSIGN(V4L2ReplayWrapper);
+};
+
+}  // namespace v4l2_camera_hal
+
+#endif  // V4L2_CAMERA_HAL_V4L2_REPLAY_WRAPPER_H_
@@ -20,14 +20,24 @@
 #include "v4l2_wrapper.h"
 
 #include <algorithm>
+#include <cstdio>
 #include <fcntl.h>
-#include <limits>
+#include <inttypes.h>
 
 #include <android-base/unique_fd.h>
+#include <cutils/properties.h>
+#include <hardware/gralloc.h>
 #include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include "arc/cached_frame.h"
+#include "format_cache.h"
+#include "frame_timing.h"
+#include "function_thread.h"
+#include "metadata/metadata_common.h"
 
 namespace v4l2_camera_hal {
 
@@ -36,28 +46,41 @@ using arc::SupportedFormat;
 using arc::SupportedFormats;
 using default_camera_hal::CaptureRequest;
 
-const int32_t kStandardSizes[][2] = {
-  {4096, 2160}, // 4KDCI (for USB camera)
-  {3840, 2160}, // 4KUHD (for USB camera)
-  {3280, 2464}, // 8MP
-  {2560, 1440}, // QHD
-  {1920, 1080}, // HD1080
-  {1640, 1232}, // 2MP
-  {1280,  720}, // HD
-  {1024,  768}, // XGA
-  { 640,  480}, // VGA
-  { 320,  240}, // QVGA
-  { 176,  144}  // QCIF
-};
+const char V4L2Wrapper::kPipelineDepthProperty[] =
+    "persist.vendor.camera.v4l2.pipeline_depth";
+const uint32_t V4L2Wrapper::kDefaultPipelineDepth;
+const char V4L2Wrapper::kRecordPathProperty[] =
+    "vendor.camera.v4l2.record_path";
+const uint32_t V4L2Wrapper::kMaxRecordedFrames;
+
+uint32_t V4L2Wrapper::PipelineDepth() {
+  int32_t depth =
+      property_get_int32(kPipelineDepthProperty, kDefaultPipelineDepth);
+  return std::min(static_cast<uint32_t>(std::max(depth, 1)),
+                  static_cast<uint32_t>(BufferSlots::kMaxSlots));
+}
 
 V4L2Wrapper* V4L2Wrapper::NewV4L2Wrapper(const std::string device_path) {
   return new V4L2Wrapper(device_path);
 }
 
 V4L2Wrapper::V4L2Wrapper(const std::string device_path)
-    : device_path_(std::move(device_path)), connection_count_(0) {}
+    : device_path_(std::move(device_path)),
+      wakeup_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+      memory_type_(V4L2_MEMORY_USERPTR),
+      import_checked_(false),
+      batching_controls_(false),
+      connection_count_(0),
+      capabilities_valid_(false) {
+  HAL_LOGE_IF(wakeup_fd_.get() < 0, "Failed to create wakeup eventfd: %s",
+              strerror(errno));
+}
 
-V4L2Wrapper::~V4L2Wrapper() {}
+V4L2Wrapper::~V4L2Wrapper() {
+  if (revalidation_thread_ != nullptr) {
+    revalidation_thread_->requestExitAndWait();
+  }
+}
 
 int V4L2Wrapper::Connect() {
   HAL_LOG_ENTER();
@@ -90,12 +113,60 @@ int V4L2Wrapper::Connect() {
   // by disabling cameras that get disconnected and checking newly connected
   // cameras, so Connect() is never called on an unsupported camera)
 
+  LoadCapabilities();
   supported_formats_ = GetSupportedFormats();
   qualified_formats_ = StreamFormat::GetQualifiedFormats(supported_formats_);
 
   return 0;
 }
 
+void V4L2Wrapper::LoadCapabilities() {
+  capabilities_valid_ = false;
+  DeviceIdentity identity;
+  if (QueryDeviceIdentity(device_fd_.get(), device_path_, &identity)) {
+    HAL_LOGW("Unable to identify %s, formats will not be cached.",
+             device_path_.c_str());
+    return;
+  }
+
+  FormatCache* cache = FormatCache::GetInstance();
+  if (!property_get_bool(FormatCache::kReenumerateProperty, false) &&
+      cache->Get(identity, &capabilities_)) {
+    HAL_LOGV("Using cached formats for %s.", device_path_.c_str());
+    capabilities_valid_ = true;
+    // Check in the background that the cache is still right, once per
+    // device. Any change only takes effect on the next connection, so the
+    // answers given during this one stay consistent.
+    if (revalidation_thread_ == nullptr) {
+      std::string device_path = device_path_;
+      FormatCapabilities cached = capabilities_;
+      revalidation_thread_ = new FunctionThread([=]() {
+        cache->Revalidate(device_path, identity, cached);
+        return false;
+      });
+      android::status_t res = revalidation_thread_->run("V4L2 formats");
+      HAL_LOGE_IF(res != android::OK,
+                  "Failed to start format revalidation thread: %d", res);
+    }
+    return;
+  }
+
+  int res;
+  {
+    std::lock_guard<std::mutex> lock(device_lock_);
+    res = EnumerateCapabilities(device_fd_.get(), &capabilities_);
+  }
+  if (res) {
+    // Leave it to the individual queries, as if there were no cache.
+    HAL_LOGW("Failed to enumerate formats of %s: %d", device_path_.c_str(),
+             res);
+    capabilities_.clear();
+    return;
+  }
+  capabilities_valid_ = true;
+  cache->Put(identity, capabilities_);
+}
+
 void V4L2Wrapper::Disconnect() {
   HAL_LOG_ENTER();
   std::lock_guard<std::mutex> lock(connection_lock_);
@@ -114,12 +185,21 @@ void V4L2Wrapper::Disconnect() {
     return;
   }
 
-  device_fd_.reset(-1);  // Includes close().
-  format_.reset();
   {
+    // Mapped buffers must be released before the device is closed.
     std::lock_guard<std::mutex> buffer_lock(buffer_queue_lock_);
     buffers_.clear();
+    slots_.Reset(0);
+    conversion_pipeline_.Clear();
   }
+  // Don't leave a waiting thread polling the closed device.
+  InterruptWait();
+  device_fd_.reset(-1);  // Includes close().
+  format_.reset();
+  capabilities_valid_ = false;
+  // The next device at this path may not be the same one.
+  ClearControlCache();
+  memory_type_ = V4L2_MEMORY_USERPTR;
 }
 
 // Helper function. Should be used instead of ioctl throughout this class.
@@ -147,6 +227,17 @@ int V4L2Wrapper::StreamOn() {
     return -ENODEV;
   }
 
+  char record_path[PROPERTY_VALUE_MAX];
+  if (property_get(kRecordPathProperty, record_path, "") > 0) {
+    std::lock_guard<std::mutex> lock(buffer_queue_lock_);
+    // Failing to record is no reason to fail the stream.
+    if (!recorder_.Open(record_path, format_->v4l2_pixel_format(),
+                        format_->width(), format_->height(),
+                        kMaxRecordedFrames)) {
+      HAL_LOGI("Recording frames to %s.", record_path);
+    }
+  }
+
   HAL_LOGV("Stream turned on.");
   return 0;
 }
@@ -167,10 +258,19 @@ int V4L2Wrapper::StreamOff() {
     return -ENODEV;
   }
   std::lock_guard<std::mutex> lock(buffer_queue_lock_);
-  for (auto& buffer : buffers_) {
-    buffer.active = false;
-    buffer.request.reset();
+  // Frames are numbered afresh when the stream is next turned on.
+  sequence_tracker_.Reset();
+  recorder_.Close();
+  uint64_t dequeued = slots_.DequeueAll();
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    if (dequeued & (uint64_t(1) << i)) {
+      buffers_[i].request.reset();
+      slots_.Release(i);
+    }
   }
+  // Pending JPEG encodes must stop writing to buffers that are about to be
+  // returned to the framework.
+  conversion_pipeline_.Flush();
   HAL_LOGV("Stream turned off.");
   return 0;
 }
@@ -236,6 +336,24 @@ int V4L2Wrapper::QueryControl(uint32_t control_id,
 }
 
 int V4L2Wrapper::GetControl(uint32_t control_id, int32_t* value) {
+  {
+    std::lock_guard<std::mutex> guard(control_lock_);
+    auto cached = control_values_.find(control_id);
+    if (cached != control_values_.end()) {
+      *value = cached->second;
+      return 0;
+    }
+  }
+
+  int res = GetControlNow(control_id, value);
+  if (res) {
+    return res;
+  }
+  CacheControl(control_id, *value);
+  return 0;
+}
+
+int V4L2Wrapper::GetControlNow(uint32_t control_id, int32_t* value) {
   // For extended controls (any control class other than "user"),
   // G_EXT_CTRL must be used instead of G_CTRL.
   if (V4L2_CTRL_ID2CLASS(control_id) != V4L2_CTRL_CLASS_USER) {
@@ -268,6 +386,156 @@ int V4L2Wrapper::GetControl(uint32_t control_id, int32_t* value) {
 int V4L2Wrapper::SetControl(uint32_t control_id,
                             int32_t desired,
                             int32_t* result) {
+  {
+    std::lock_guard<std::mutex> guard(control_lock_);
+    auto cached = control_values_.find(control_id);
+    if (cached != control_values_.end() && cached->second == desired) {
+      // Already applied; nothing to do.
+      pending_controls_.erase(control_id);
+      if (result != nullptr) {
+        *result = desired;
+      }
+      return 0;
+    }
+    if (batching_controls_ && result == nullptr) {
+      pending_controls_[control_id] = desired;
+      return 0;
+    }
+  }
+
+  int32_t result_value = 0;
+  int res = SetControlNow(control_id, desired, &result_value);
+  if (res) {
+    return res;
+  }
+  CacheControl(control_id, result_value);
+
+  // If the caller wants to know the result, pass it back.
+  if (result != nullptr) {
+    *result = result_value;
+  }
+  return 0;
+}
+
+void V4L2Wrapper::BeginControlBatch() {
+  std::lock_guard<std::mutex> guard(control_lock_);
+  pending_controls_.clear();
+  batching_controls_ = true;
+}
+
+int V4L2Wrapper::CommitControls() {
+  std::map<uint32_t, int32_t> pending;
+  {
+    std::lock_guard<std::mutex> guard(control_lock_);
+    pending.swap(pending_controls_);
+    batching_controls_ = false;
+  }
+
+  int res = 0;
+  std::vector<v4l2_ext_control> controls;
+  auto next = pending.begin();
+  while (next != pending.end()) {
+    uint32_t control_class = V4L2_CTRL_ID2CLASS(next->first);
+    controls.clear();
+    for (; next != pending.end() &&
+           V4L2_CTRL_ID2CLASS(next->first) == control_class;
+         ++next) {
+      v4l2_ext_control control;
+      memset(&control, 0, sizeof(control));
+      control.id = next->first;
+      control.value = next->second;
+      controls.push_back(control);
+    }
+    int class_res = SetControlsNow(control_class, &controls);
+    if (class_res) {
+      res = class_res;
+    }
+  }
+  return res;
+}
+
+int V4L2Wrapper::SetControlsNow(uint32_t control_class,
+                                std::vector<v4l2_ext_control>* controls) {
+  v4l2_ext_controls ext_controls;
+  memset(&ext_controls, 0, sizeof(ext_controls));
+  ext_controls.ctrl_class = control_class;
+  ext_controls.count = controls->size();
+  ext_controls.controls = controls->data();
+
+  if (IoctlLocked(VIDIOC_S_EXT_CTRLS, &ext_controls) < 0) {
+    if (control_class != V4L2_CTRL_CLASS_USER) {
+      HAL_LOGE("S_EXT_CTRLS fails for %zu controls: %s", controls->size(),
+               strerror(errno));
+      // Some of the controls may have been applied; forget them all.
+      std::lock_guard<std::mutex> guard(control_lock_);
+      for (const auto& control : *controls) {
+        control_values_.erase(control.id);
+      }
+      return -ENODEV;
+    }
+    // Drivers not using the control framework may only take user controls
+    // through S_CTRL, one at a time.
+    int res = 0;
+    for (const auto& control : *controls) {
+      int32_t result_value = 0;
+      int control_res = SetControlNow(control.id, control.value, &result_value);
+      if (control_res) {
+        res = control_res;
+        std::lock_guard<std::mutex> guard(control_lock_);
+        control_values_.erase(control.id);
+      } else {
+        CacheControl(control.id, result_value);
+      }
+    }
+    return res;
+  }
+
+  // The driver writes back the values it actually applied.
+  for (const auto& control : *controls) {
+    CacheControl(control.id, control.value);
+  }
+  return 0;
+}
+
+bool V4L2Wrapper::IsControlCacheable(uint32_t control_id) {
+  {
+    std::lock_guard<std::mutex> guard(control_lock_);
+    auto entry = control_cacheable_.find(control_id);
+    if (entry != control_cacheable_.end()) {
+      return entry->second;
+    }
+  }
+
+  // Controls the driver updates on its own must always be read back.
+  v4l2_query_ext_ctrl query;
+  bool cacheable = QueryControl(control_id, &query) == 0 &&
+                   !(query.flags & (V4L2_CTRL_FLAG_VOLATILE |
+                                    V4L2_CTRL_FLAG_WRITE_ONLY));
+
+  std::lock_guard<std::mutex> guard(control_lock_);
+  control_cacheable_[control_id] = cacheable;
+  return cacheable;
+}
+
+void V4L2Wrapper::CacheControl(uint32_t control_id, int32_t value) {
+  if (!IsControlCacheable(control_id)) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(control_lock_);
+  control_values_[control_id] = value;
+}
+
+void V4L2Wrapper::ClearControlCache() {
+  std::lock_guard<std::mutex> guard(control_lock_);
+  control_values_.clear();
+  control_cacheable_.clear();
+  pending_controls_.clear();
+  batching_controls_ = false;
+}
+
+int V4L2Wrapper::SetControlNow(uint32_t control_id,
+                               int32_t desired,
+                               int32_t* result) {
   int32_t result_value = 0;
 
   // TODO(b/29334616): When async, this may need to check if the stream
@@ -302,10 +570,7 @@ int V4L2Wrapper::SetControl(uint32_t control_id,
     result_value = control.value;
   }
 
-  // If the caller wants to know the result, pass it back.
-  if (result != nullptr) {
-    *result = result_value;
-  }
+  *result = result_value;
   return 0;
 }
 
@@ -342,21 +607,18 @@ const SupportedFormats V4L2Wrapper::GetSupportedFormats() {
 int V4L2Wrapper::GetFormats(std::set<uint32_t>* v4l2_formats) {
   HAL_LOG_ENTER();
 
-  v4l2_fmtdesc format_query;
-  memset(&format_query, 0, sizeof(format_query));
-  // TODO(b/30000211): multiplanar support.
-  format_query.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-  while (IoctlLocked(VIDIOC_ENUM_FMT, &format_query) >= 0) {
-    v4l2_formats->insert(format_query.pixelformat);
-    ++format_query.index;
+  if (capabilities_valid_) {
+    for (const auto& format : capabilities_) {
+      v4l2_formats->insert(format.first);
+    }
+    return 0;
   }
-
-  if (errno != EINVAL) {
-    HAL_LOGE(
-        "ENUM_FMT fails at index %d: %s", format_query.index, strerror(errno));
+  std::lock_guard<std::mutex> lock(device_lock_);
+  if (!connected()) {
+    HAL_LOGE("Device %s not connected.", device_path_.c_str());
     return -ENODEV;
   }
-  return 0;
+  return EnumerateFormats(device_fd_.get(), v4l2_formats);
 }
 
 int V4L2Wrapper::GetQualifiedFormats(std::vector<uint32_t>* v4l2_formats) {
@@ -377,74 +639,23 @@ int V4L2Wrapper::GetQualifiedFormats(std::vector<uint32_t>* v4l2_formats) {
 
 int V4L2Wrapper::GetFormatFrameSizes(uint32_t v4l2_format,
                                      std::set<std::array<int32_t, 2>>* sizes) {
-  v4l2_frmsizeenum size_query;
-  memset(&size_query, 0, sizeof(size_query));
-  size_query.pixel_format = v4l2_format;
-  if (IoctlLocked(VIDIOC_ENUM_FRAMESIZES, &size_query) < 0) {
-    HAL_LOGE("ENUM_FRAMESIZES failed: %s", strerror(errno));
-    return -ENODEV;
-  }
-  if (size_query.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
-    // Discrete: enumerate all sizes using VIDIOC_ENUM_FRAMESIZES.
-    // Assuming that a driver with discrete frame sizes has a reasonable number
-    // of them.
-    do {
-      sizes->insert({{{static_cast<int32_t>(size_query.discrete.width),
-                       static_cast<int32_t>(size_query.discrete.height)}}});
-      ++size_query.index;
-    } while (IoctlLocked(VIDIOC_ENUM_FRAMESIZES, &size_query) >= 0);
-    if (errno != EINVAL) {
-      HAL_LOGE("ENUM_FRAMESIZES fails at index %d: %s",
-               size_query.index,
-               strerror(errno));
+  if (capabilities_valid_) {
+    auto format = capabilities_.find(v4l2_format);
+    if (format == capabilities_.end()) {
+      HAL_LOGE("Format 0x%x is not supported.", v4l2_format);
       return -ENODEV;
     }
-  } else {
-    // Continuous/Step-wise: based on the stepwise struct returned by the query.
-    // Fully listing all possible sizes, with large enough range/small enough
-    // step size, may produce far too many potential sizes. Instead, find the
-    // closest to a set of standard sizes.
-    for (const auto size : kStandardSizes) {
-      // Find the closest size, rounding up.
-      uint32_t desired_width = size[0];
-      uint32_t desired_height = size[1];
-      if (desired_width < size_query.stepwise.min_width ||
-          desired_height < size_query.stepwise.min_height) {
-        HAL_LOGV("Standard size %u x %u is too small for format %d",
-                 desired_width,
-                 desired_height,
-                 v4l2_format);
-        continue;
-      } else if (desired_width > size_query.stepwise.max_width ||
-                 desired_height > size_query.stepwise.max_height) {
-        HAL_LOGV("Standard size %u x %u is too big for format %d",
-                 desired_width,
-                 desired_height,
-                 v4l2_format);
-        continue;
-      }
-
-      // Round up.
-      uint32_t width_steps = (desired_width - size_query.stepwise.min_width +
-                              size_query.stepwise.step_width - 1) /
-                             size_query.stepwise.step_width;
-      uint32_t height_steps = (desired_height - size_query.stepwise.min_height +
-                               size_query.stepwise.step_height - 1) /
-                              size_query.stepwise.step_height;
-      sizes->insert(
-          {{{static_cast<int32_t>(size_query.stepwise.min_width +
-                                  width_steps * size_query.stepwise.step_width),
-             static_cast<int32_t>(size_query.stepwise.min_height +
-                                  height_steps *
-                                      size_query.stepwise.step_height)}}});
+    for (const auto& size : format->second) {
+      sizes->insert(size.first);
     }
+    return 0;
   }
-  return 0;
-}
-
-// Converts a v4l2_fract with units of seconds to an int64_t with units of ns.
-inline int64_t FractToNs(const v4l2_fract& fract) {
-  return (1000000000LL * fract.numerator) / fract.denominator;
+  std::lock_guard<std::mutex> lock(device_lock_);
+  if (!connected()) {
+    HAL_LOGE("Device %s not connected.", device_path_.c_str());
+    return -ENODEV;
+  }
+  return EnumerateFrameSizes(device_fd_.get(), v4l2_format, sizes);
 }
 
 int V4L2Wrapper::GetFormatFrameDurationRange(
@@ -453,46 +664,33 @@ int V4L2Wrapper::GetFormatFrameDurationRange(
     std::array<int64_t, 2>* duration_range) {
   // Potentially called so many times logging entry is a bad idea.
 
-  v4l2_frmivalenum duration_query;
-  memset(&duration_query, 0, sizeof(duration_query));
-  duration_query.pixel_format = v4l2_format;
-  duration_query.width = size[0];
-  duration_query.height = size[1];
-  if (IoctlLocked(VIDIOC_ENUM_FRAMEINTERVALS, &duration_query) < 0) {
-    HAL_LOGE("ENUM_FRAMEINTERVALS failed: %s", strerror(errno));
-    return -ENODEV;
-  }
-
-  int64_t min = std::numeric_limits<int64_t>::max();
-  int64_t max = std::numeric_limits<int64_t>::min();
-  if (duration_query.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
-    // Discrete: enumerate all durations using VIDIOC_ENUM_FRAMEINTERVALS.
-    do {
-      min = std::min(min, FractToNs(duration_query.discrete));
-      max = std::max(max, FractToNs(duration_query.discrete));
-      ++duration_query.index;
-    } while (IoctlLocked(VIDIOC_ENUM_FRAMEINTERVALS, &duration_query) >= 0);
-    if (errno != EINVAL) {
-      HAL_LOGE("ENUM_FRAMEINTERVALS fails at index %d: %s",
-               duration_query.index,
-               strerror(errno));
+  if (capabilities_valid_) {
+    auto format = capabilities_.find(v4l2_format);
+    if (format == capabilities_.end() ||
+        format->second.find(size) == format->second.end()) {
+      HAL_LOGE("Format 0x%x at %d x %d is not supported.", v4l2_format,
+               size[0], size[1]);
       return -ENODEV;
     }
-  } else {
-    // Continuous/Step-wise: simply convert the given min and max.
-    min = FractToNs(duration_query.stepwise.min);
-    max = FractToNs(duration_query.stepwise.max);
+    *duration_range = format->second.at(size);
+    return 0;
   }
-  (*duration_range)[0] = min;
-  (*duration_range)[1] = max;
-  return 0;
+  std::lock_guard<std::mutex> lock(device_lock_);
+  if (!connected()) {
+    HAL_LOGE("Device %s not connected.", device_path_.c_str());
+    return -ENODEV;
+  }
+  return EnumerateFrameDurationRange(device_fd_.get(), v4l2_format, size,
+                                     duration_range);
 }
 
 int V4L2Wrapper::SetFormat(const StreamFormat& desired_format,
+                           bool direct_output,
                            uint32_t* result_max_buffers) {
   HAL_LOG_ENTER();
 
-  if (format_ && desired_format == *format_) {
+  if (format_ && desired_format == *format_ &&
+      (direct_output || memory_type_ != V4L2_MEMORY_DMABUF)) {
     HAL_LOGV("Already in correct format, skipping format setting.");
     *result_max_buffers = buffers_.size();
     return 0;
@@ -545,8 +743,16 @@ int V4L2Wrapper::SetFormat(const StreamFormat& desired_format,
   // Keep track of our new format.
   format_.reset(new StreamFormat(new_format));
 
-  // Format changed, request new buffers.
-  int res = RequestBuffers(1);
+  // If the device produces exactly what the stream wants, frames can be
+  // captured straight into the output buffers.
+  direct_output =
+      direct_output &&
+      format_->v4l2_pixel_format() == desired_format.v4l2_pixel_format() &&
+      format_->width() == desired_format.width() &&
+      format_->height() == desired_format.height();
+
+  // Format changed, request enough buffers to keep the pipeline full.
+  int res = SetupBuffers(PipelineDepth(), direct_output);
   if (res) {
     HAL_LOGE("Requesting buffers for new format failed.");
     return res;
@@ -555,11 +761,75 @@ int V4L2Wrapper::SetFormat(const StreamFormat& desired_format,
   return 0;
 }
 
+int V4L2Wrapper::SetupBuffers(uint32_t num_requested, bool direct_output) {
+  // In order of preference: import the output buffers (no copy at all),
+  // export driver allocated buffers (no staging allocation), and finally
+  // HAL allocated user pointers, which every streaming driver supports.
+  std::vector<uint32_t> memory_types;
+  if (direct_output) {
+    memory_types.push_back(V4L2_MEMORY_DMABUF);
+  }
+  memory_types.push_back(V4L2_MEMORY_MMAP);
+  memory_types.push_back(V4L2_MEMORY_USERPTR);
+
+  for (uint32_t memory_type : memory_types) {
+    memory_type_ = memory_type;
+    if (RequestBuffers(num_requested)) {
+      HAL_LOGV("Memory type %u not supported, trying next.", memory_type);
+      continue;
+    }
+    if (memory_type_ == V4L2_MEMORY_MMAP && ExportBuffers()) {
+      HAL_LOGV("Unable to export MMAP buffers, trying next.");
+      RequestBuffers(0);
+      continue;
+    }
+    HAL_LOGV("Using memory type %u.", memory_type_);
+    return 0;
+  }
+  return -ENODEV;
+}
+
+int V4L2Wrapper::ExportBuffers() {
+  std::lock_guard<std::mutex> guard(buffer_queue_lock_);
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    const v4l2_buffer& device_buffer = buffers_[i].device_buffer;
+
+    v4l2_exportbuffer export_buffer;
+    memset(&export_buffer, 0, sizeof(export_buffer));
+    export_buffer.type = format_->type();
+    export_buffer.index = i;
+    export_buffer.flags = O_RDONLY | O_CLOEXEC;
+    if (IoctlLocked(VIDIOC_EXPBUF, &export_buffer) < 0) {
+      HAL_LOGV("EXPBUF fails: %s", strerror(errno));
+      return -ENODEV;
+    }
+
+    std::shared_ptr<arc::V4L2FrameBuffer> mapped_buffer =
+        std::make_shared<arc::V4L2FrameBuffer>(
+            base::ScopedFD(export_buffer.fd), device_buffer.length,
+            format_->width(), format_->height(), format_->v4l2_pixel_format());
+    if (mapped_buffer->Map()) {
+      HAL_LOGE("Failed to map exported buffer %zu.", i);
+      return -ENODEV;
+    }
+    buffers_[i].mapped_buffer = std::move(mapped_buffer);
+  }
+  return 0;
+}
+
 int V4L2Wrapper::RequestBuffers(uint32_t num_requested) {
+  // The dequeuing thread may still be looking at the slots.
+  std::lock_guard<std::mutex> guard(buffer_queue_lock_);
+  // Exported buffers keep the driver memory busy, so they must be dropped
+  // before the driver is asked to free or reallocate it.
+  buffers_.clear();
+  slots_.Reset(0);
+  import_checked_ = false;
+
   v4l2_requestbuffers req_buffers;
   memset(&req_buffers, 0, sizeof(req_buffers));
   req_buffers.type = format_->type();
-  req_buffers.memory = V4L2_MEMORY_USERPTR;
+  req_buffers.memory = memory_type_;
   req_buffers.count = num_requested;
 
   int res = IoctlLocked(VIDIOC_REQBUFS, &req_buffers);
@@ -574,7 +844,112 @@ int V4L2Wrapper::RequestBuffers(uint32_t num_requested) {
     HAL_LOGE("REQBUFS claims it can't handle any buffers.");
     return -ENODEV;
   }
+  if (req_buffers.count > BufferSlots::kMaxSlots) {
+    HAL_LOGV("Using %zu of %u buffers.", BufferSlots::kMaxSlots,
+             req_buffers.count);
+    req_buffers.count = BufferSlots::kMaxSlots;
+  }
   buffers_.resize(req_buffers.count);
+
+  // Query each buffer once up front rather than on every enqueue.
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    v4l2_buffer* device_buffer = &buffers_[i].device_buffer;
+    device_buffer->type = format_->type();
+    device_buffer->memory = memory_type_;
+    device_buffer->index = i;
+    if (IoctlLocked(VIDIOC_QUERYBUF, device_buffer) < 0) {
+      HAL_LOGE("QUERYBUF fails: %s", strerror(errno));
+      buffers_.clear();
+      return -ENODEV;
+    }
+  }
+  slots_.Reset(buffers_.size());
+  return 0;
+}
+
+bool V4L2Wrapper::CanImportBuffer(const native_handle_t* handle) {
+  if (handle->numFds < 1) {
+    HAL_LOGV("Output buffer has no dma-buf to import.");
+    return false;
+  }
+  off_t size = lseek(handle->data[0], 0, SEEK_END);
+  if (size < 0 || static_cast<uint64_t>(size) < format_->min_buffer_size()) {
+    HAL_LOGV("Output buffer of %jd bytes can't hold a %u byte frame.",
+             static_cast<intmax_t>(size), format_->min_buffer_size());
+    return false;
+  }
+  return true;
+}
+
+bool V4L2Wrapper::MatchesDeviceLayout(const native_handle_t* handle) {
+  if (format_->v4l2_pixel_format() == V4L2_PIX_FMT_JPEG) {
+    // Compressed frames have no layout to match.
+    return true;
+  }
+  if (format_->v4l2_pixel_format() != V4L2_PIX_FMT_YUV420) {
+    // gralloc only reports the layout of YCbCr buffers.
+    HAL_LOGV("Can't check the layout of format %u.",
+             format_->v4l2_pixel_format());
+    return false;
+  }
+
+  const hw_module_t* module = nullptr;
+  if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module) || !module) {
+    HAL_LOGE("Failed to get gralloc module.");
+    return false;
+  }
+  const gralloc_module_t* gralloc =
+      reinterpret_cast<const gralloc_module_t*>(module);
+  android_ycbcr ycbcr;
+  if (!gralloc->lock_ycbcr ||
+      gralloc->lock_ycbcr(gralloc, handle, GRALLOC_USAGE_SW_WRITE_OFTEN, 0, 0,
+                          format_->width(), format_->height(), &ycbcr)) {
+    HAL_LOGV("Failed to lock output buffer to check its layout.");
+    return false;
+  }
+  gralloc->unlock(gralloc, handle);
+
+  // V4L2 YUV420 is three contiguous planes, Y then Cb then Cr, the chroma
+  // rows half as long as the luma rows.
+  const uint8_t* y = static_cast<const uint8_t*>(ycbcr.y);
+  const uint8_t* cb = static_cast<const uint8_t*>(ycbcr.cb);
+  const uint8_t* cr = static_cast<const uint8_t*>(ycbcr.cr);
+  uint32_t stride = format_->bytes_per_line();
+  uint32_t height = format_->height();
+  bool matches = ycbcr.ystride == stride && ycbcr.cstride == stride / 2 &&
+                 ycbcr.chroma_step == 1 && cb == y + stride * height &&
+                 cr == cb + (stride / 2) * (height / 2);
+  if (!matches) {
+    HAL_LOGV(
+        "Output buffer layout (stride %zu/%zu, step %zu) doesn't match the "
+        "device's (stride %u).",
+        ycbcr.ystride, ycbcr.cstride, ycbcr.chroma_step, stride);
+  }
+  return matches;
+}
+
+int V4L2Wrapper::CheckImportLayout(const native_handle_t* handle) {
+  if (CanImportBuffer(handle) && MatchesDeviceLayout(handle)) {
+    import_checked_ = true;
+    return 0;
+  }
+  if (slots_.QueuedCount() > 0) {
+    HAL_LOGE("Output buffer can't be imported while others are queued.");
+    return -EINVAL;
+  }
+
+  // Nothing has been queued yet, so the buffers can still be swapped for
+  // driver allocated ones, which frames are copied out of.
+  HAL_LOGI("Output buffers don't match the device format, not importing.");
+  size_t num_buffers = buffers_.size();
+  int res = SetupBuffers(num_buffers, false);
+  if (res) {
+    HAL_LOGE("Failed to fall back from importing output buffers: %d", res);
+    return res;
+  }
+  HAL_LOGW_IF(buffers_.size() < num_buffers,
+              "Device granted %zu buffers instead of %zu.", buffers_.size(),
+              num_buffers);
   return 0;
 }
 
@@ -585,68 +960,68 @@ int V4L2Wrapper::EnqueueRequest(
     return -ENODEV;
   }
 
-  // Find a free buffer index. Could use some sort of persistent hinting
-  // here to improve expected efficiency, but buffers_.size() is expected
-  // to be low enough (<10 experimentally) that it's not worth it.
-  int index = -1;
-  {
-    std::lock_guard<std::mutex> guard(buffer_queue_lock_);
-    for (size_t i = 0; i < buffers_.size(); ++i) {
-      if (!buffers_[i].active) {
-        index = i;
-        break;
-      }
+  if (memory_type_ == V4L2_MEMORY_DMABUF) {
+    // Whether the driver can write into the output buffers can only be told
+    // once there is one to look at.
+    const native_handle_t* handle = *request->output_buffers[0].buffer;
+    int res = import_checked_ ? 0 : CheckImportLayout(handle);
+    if (res) {
+      return res;
+    }
+    // The rest of the stream's buffers share the layout, but may differ in
+    // size.
+    if (memory_type_ == V4L2_MEMORY_DMABUF && !CanImportBuffer(handle)) {
+      HAL_LOGE("Output buffer can't be imported.");
+      return -EINVAL;
     }
   }
+
+  // Take a free slot. Until it is marked queued, this thread owns its
+  // context, so no lock is needed to fill it in.
+  int index = slots_.Acquire();
   if (index < 0) {
     // Note: The HAL should be tracking the number of buffers in flight
     // for each stream, and should never overflow the device.
     HAL_LOGE("Cannot enqueue buffer: stream is already full.");
     return -ENODEV;
   }
+  RequestContext* request_context = &buffers_[index];
 
-  // Set up a v4l2 buffer struct.
-  v4l2_buffer device_buffer;
-  memset(&device_buffer, 0, sizeof(device_buffer));
-  device_buffer.type = format_->type();
-  device_buffer.index = index;
-
-  // Use QUERYBUF to ensure our buffer/device is in good shape,
-  // and fill out remaining fields.
-  if (IoctlLocked(VIDIOC_QUERYBUF, &device_buffer) < 0) {
-    HAL_LOGE("QUERYBUF fails: %s", strerror(errno));
-    // Return buffer index.
-    std::lock_guard<std::mutex> guard(buffer_queue_lock_);
-    buffers_[index].active = false;
-    return -ENODEV;
-  }
-
-  // Setup our request context and fill in the user pointer field.
-  RequestContext* request_context;
-  void* data;
-  {
-    std::lock_guard<std::mutex> guard(buffer_queue_lock_);
-    request_context = &buffers_[index];
+  // Start from the cached QUERYBUF result and fill in the memory specific
+  // fields.
+  v4l2_buffer device_buffer = request_context->device_buffer;
+  if (memory_type_ == V4L2_MEMORY_USERPTR) {
     request_context->camera_buffer->SetDataSize(device_buffer.length);
     request_context->camera_buffer->Reset();
     request_context->camera_buffer->SetFourcc(format_->v4l2_pixel_format());
     request_context->camera_buffer->SetWidth(format_->width());
     request_context->camera_buffer->SetHeight(format_->height());
-    request_context->request = request;
-    data = request_context->camera_buffer->GetData();
+    device_buffer.m.userptr = reinterpret_cast<unsigned long>(
+        request_context->camera_buffer->GetData());
+  } else if (memory_type_ == V4L2_MEMORY_DMABUF) {
+    // Have the driver write directly into the gralloc output buffer, whose
+    // layout was checked above.
+    const native_handle_t* handle = *request->output_buffers[0].buffer;
+    device_buffer.m.fd = handle->data[0];
+    device_buffer.length = lseek(handle->data[0], 0, SEEK_END);
   }
-  device_buffer.m.userptr = reinterpret_cast<unsigned long>(data);
+  request_context->request = request;
+  request->timings.queued = default_camera_hal::FrameTimingNow();
+
+  // Mark the buffer as in flight before the driver can possibly return it,
+  // which also hands the context over to the dequeuing thread.
+  slots_.MarkQueued(index);
 
   // Pass the buffer to the camera.
   if (IoctlLocked(VIDIOC_QBUF, &device_buffer) < 0) {
     HAL_LOGE("QBUF fails: %s", strerror(errno));
+    if (slots_.MarkDequeued(index)) {
+      request_context->request.reset();
+      slots_.Release(index);
+    }
     return -ENODEV;
   }
 
-  // Mark the buffer as in flight.
-  std::lock_guard<std::mutex> guard(buffer_queue_lock_);
-  request_context->active = true;
-
   return 0;
 }
 
@@ -661,7 +1036,7 @@ int V4L2Wrapper::DequeueRequest(std::shared_ptr<CaptureRequest>* request) {
   v4l2_buffer buffer;
   memset(&buffer, 0, sizeof(buffer));
   buffer.type = format_->type();
-  buffer.memory = V4L2_MEMORY_USERPTR;
+  buffer.memory = memory_type_;
   int res = IoctlLocked(VIDIOC_DQBUF, &buffer);
   if (res) {
     if (errno == EAGAIN) {
@@ -674,63 +1049,196 @@ int V4L2Wrapper::DequeueRequest(std::shared_ptr<CaptureRequest>* request) {
     }
   }
 
-  std::lock_guard<std::mutex> guard(buffer_queue_lock_);
-  RequestContext* request_context = &buffers_[buffer.index];
-
-  // Lock the camera stream buffer for painting.
-  const camera3_stream_buffer_t* stream_buffer =
-      &request_context->request->output_buffers[0];
-  uint32_t fourcc =
-      StreamFormat::HalToV4L2PixelFormat(stream_buffer->stream->format);
-
-  if (request) {
-    *request = request_context->request;
-  }
-
-  // Note that the device buffer length is passed to the output frame. If the
-  // GrallocFrameBuffer does not have support for the transformation to
-  // |fourcc|, it will assume that the amount of data to lock is based on
-  // |buffer.length|, otherwise it will use the ImageProcessor::ConvertedSize.
-  arc::GrallocFrameBuffer output_frame(
-      *stream_buffer->buffer, stream_buffer->stream->width,
-      stream_buffer->stream->height, fourcc, buffer.length,
-      stream_buffer->stream->usage);
-  res = output_frame.Map();
-  if (res) {
-    HAL_LOGE("Failed to map output frame.");
+  {
+    std::lock_guard<std::mutex> guard(buffer_queue_lock_);
+    if (buffer.index >= buffers_.size() || !slots_.MarkDequeued(buffer.index)) {
+      // Already reclaimed by turning the stream off.
+      HAL_LOGW("Dequeued buffer %u is not in flight.", buffer.index);
+      return -EAGAIN;
+    }
+    RequestContext* request_context = &buffers_[buffer.index];
+    request_context->request->timings.dequeued =
+        default_camera_hal::FrameTimingNow();
+
+    uint32_t dropped = sequence_tracker_.Add(buffer.sequence);
+    HAL_LOGW_IF(dropped, "Device dropped %u frame(s) before frame %u.",
+                dropped, buffer.sequence);
+    StampSensorTimestamp(buffer, request_context->request.get());
+
+    if (request) {
+      *request = request_context->request;
+    }
+
+    if (memory_type_ == V4L2_MEMORY_DMABUF) {
+      // The frame was captured straight into the output buffer.
+      conversion_pipeline_.Finish(request_context->request, 0);
+    } else {
+      arc::FrameBuffer* camera_buffer;
+      if (memory_type_ == V4L2_MEMORY_MMAP) {
+        camera_buffer = request_context->mapped_buffer.get();
+        camera_buffer->SetDataSize(buffer.bytesused ? buffer.bytesused
+                                                    : buffer.length);
+      } else {
+        camera_buffer = request_context->camera_buffer.get();
+      }
+      if (recorder_.IsOpen()) {
+        RecordFrame(buffer, *camera_buffer);
+      }
+
+      // Failures are reported with the request itself.
+      res = conversion_pipeline_.Process(*camera_buffer, buffer.length,
+                                         request_context->request);
+      HAL_LOGE_IF(res, "Failed to process frame: %d", res);
+    }
+
     request_context->request.reset();
-    return -EINVAL;
-  }
-  if (request_context->camera_buffer->GetFourcc() == fourcc &&
-      request_context->camera_buffer->GetWidth() ==
-          stream_buffer->stream->width &&
-      request_context->camera_buffer->GetHeight() ==
-          stream_buffer->stream->height) {
-    // If no format conversion needs to be applied, directly copy the data over.
-    memcpy(output_frame.GetData(), request_context->camera_buffer->GetData(),
-           request_context->camera_buffer->GetDataSize());
-  } else {
-    // Perform the format conversion.
-    arc::CachedFrame cached_frame;
-    cached_frame.SetSource(request_context->camera_buffer.get(), 0);
-    cached_frame.Convert(request_context->request->settings, &output_frame);
+    slots_.Release(buffer.index);
   }
 
-  request_context->request.reset();
-  // Mark the buffer as not in flight.
-  request_context->active = false;
+  // Deliver outside the lock; the receiver may call back into the wrapper.
+  conversion_pipeline_.DeliverCompleted();
   return 0;
 }
 
-int V4L2Wrapper::GetInFlightBufferCount() {
-  int count = 0;
+void V4L2Wrapper::StampSensorTimestamp(const v4l2_buffer& buffer,
+                                       CaptureRequest* request) {
+  // Only monotonic timestamps can be converted; otherwise the result keeps
+  // the time its metadata was filled in.
+  if ((buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) !=
+      V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+    return;
+  }
+  int64_t timestamp = buffer.timestamp.tv_sec * 1000000000LL +
+                      buffer.timestamp.tv_usec * 1000LL;
+  if (timestamp == 0) {
+    return;
+  }
+
+  // The shutter is the start of exposure; some devices stamp its end.
+  if ((buffer.flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) ==
+      V4L2_BUF_FLAG_TSTAMP_SRC_EOF) {
+    int64_t exposure = 0;
+    if (!SingleTagValue(
+            request->settings, ANDROID_SENSOR_EXPOSURE_TIME, &exposure)) {
+      timestamp -= exposure;
+    }
+  }
+
+  int res = UpdateMetadata(&request->settings, ANDROID_SENSOR_TIMESTAMP,
+                           default_camera_hal::MonotonicToBoottime(timestamp));
+  HAL_LOGE_IF(res, "Failed to update sensor timestamp: %d", res);
+}
+
+void V4L2Wrapper::RecordFrame(const v4l2_buffer& buffer,
+                               const arc::FrameBuffer& frame) {
+  int64_t timestamp = 0;
+  if ((buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+      V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+    timestamp = buffer.timestamp.tv_sec * 1000000000LL +
+                buffer.timestamp.tv_usec * 1000LL;
+  }
+  if (timestamp == 0) {
+    // Replay only needs the spacing of frames, which this still gives.
+    timestamp = default_camera_hal::FrameTimingNow();
+  }
+  // USERPTR frames span the whole buffer; only keep what the driver filled.
+  size_t size = frame.GetDataSize();
+  if (buffer.bytesused > 0 && buffer.bytesused < size) {
+    size = buffer.bytesused;
+  }
+  recorder_.Write(frame.GetData(), size, timestamp, buffer.sequence);
+}
+
+void V4L2Wrapper::SetRequestCallback(
+    ConversionPipeline::CompletionCallback callback) {
+  conversion_pipeline_.SetCompletionCallback(callback);
+}
+
+int V4L2Wrapper::ConfigureOutputStreams(
+    const camera3_stream_configuration_t& stream_config) {
+  HAL_LOG_ENTER();
+  if (!format_) {
+    HAL_LOGE("Stream format must be set before configuring output streams.");
+    return -EINVAL;
+  }
   std::lock_guard<std::mutex> guard(buffer_queue_lock_);
-  for (auto& buffer : buffers_) {
-    if (buffer.active) {
-      count++;
+  return conversion_pipeline_.Configure(stream_config,
+                                        format_->v4l2_pixel_format());
+}
+
+void V4L2Wrapper::Dump(int fd) {
+  ConversionStats stats;
+  uint64_t captured_frames;
+  uint64_t dropped_frames;
+  {
+    std::lock_guard<std::mutex> guard(buffer_queue_lock_);
+    stats = conversion_pipeline_.GetStats();
+    captured_frames = sequence_tracker_.frames();
+    dropped_frames = sequence_tracker_.dropped();
+  }
+  dprintf(fd, "  Memory type: %u\n", memory_type_);
+  dprintf(fd, "  Frames processed: %" PRIu64 "\n", stats.frames);
+  dprintf(fd, "  Frames dropped by device: %" PRIu64 " of %" PRIu64 "\n",
+          dropped_frames, dropped_frames + captured_frames);
+  dprintf(fd, "  Bytes converted: %" PRIu64 "\n", stats.bytes_converted);
+  dprintf(fd, "  Bytes copied: %" PRIu64 "\n", stats.bytes_copied);
+  dprintf(fd, "  JPEG encodes queued: %" PRIu64 "\n", stats.encodes_queued);
+  dprintf(fd, "  JPEG encodes inline: %" PRIu64 "\n", stats.encodes_inline);
+  dprintf(fd, "  Conversion buffer allocations: %" PRIu64 "\n",
+          stats.allocations);
+}
+
+int V4L2Wrapper::WaitForBuffer() {
+  // Wait on a duplicate, so that disconnecting (which interrupts the wait)
+  // can't close the fd, or let it be reused, while it is being polled.
+  android::base::unique_fd device_fd;
+  {
+    std::lock_guard<std::mutex> guard(connection_lock_);
+    if (!connected()) {
+      return -ENODEV;
     }
+    device_fd.reset(dup(device_fd_.get()));
+  }
+  if (device_fd.get() < 0) {
+    HAL_LOGE("Failed to duplicate device fd: %s", strerror(errno));
+    return -ENODEV;
   }
-  return count;
+
+  pollfd fds[2];
+  fds[0].fd = device_fd.get();
+  fds[0].events = POLLIN | POLLRDNORM;
+  fds[0].revents = 0;
+  fds[1].fd = wakeup_fd_.get();
+  fds[1].events = POLLIN;
+  fds[1].revents = 0;
+
+  int res = TEMP_FAILURE_RETRY(poll(fds, 2, -1));
+  if (res < 0) {
+    HAL_LOGE("poll fails: %s", strerror(errno));
+    return -ENODEV;
+  }
+
+  if (fds[1].revents & POLLIN) {
+    uint64_t count;
+    TEMP_FAILURE_RETRY(read(wakeup_fd_.get(), &count, sizeof(count)));
+    return -EINTR;
+  }
+  if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+    // Not streaming, or nothing queued.
+    return -EAGAIN;
+  }
+  return 0;
+}
+
+void V4L2Wrapper::InterruptWait() {
+  uint64_t count = 1;
+  if (TEMP_FAILURE_RETRY(write(wakeup_fd_.get(), &count, sizeof(count))) < 0) {
+    HAL_LOGE("Failed to signal wakeup eventfd: %s", strerror(errno));
+  }
+}
+
+int V4L2Wrapper::GetInFlightBufferCount() {
+  return slots_.QueuedCount();
 }
 
 }  // namespace v4l2_camera_hal
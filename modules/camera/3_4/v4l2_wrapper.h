@@ -18,6 +18,8 @@
 #define V4L2_CAMERA_HAL_V4L2_WRAPPER_H_
 
 #include <array>
+#include <cstring>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <set>
@@ -25,10 +27,17 @@
 #include <vector>
 
 #include <android-base/unique_fd.h>
+#include <utils/StrongPointer.h>
+#include <utils/Thread.h>
 #include "arc/common_types.h"
 #include "arc/frame_buffer.h"
+#include "buffer_slots.h"
 #include "capture_request.h"
 #include "common.h"
+#include "conversion_pipeline.h"
+#include "format_cache.h"
+#include "frame_dump.h"
+#include "frame_timing.h"
 #include "stream_format.h"
 
 namespace v4l2_camera_hal {
@@ -40,6 +49,17 @@ class V4L2Wrapper {
   static V4L2Wrapper* NewV4L2Wrapper(const std::string device_path);
   virtual ~V4L2Wrapper();
 
+  // System property setting how many frames are kept queued in the driver.
+  static const char kPipelineDepthProperty[];
+  static const uint32_t kDefaultPipelineDepth = 4;
+  // The configured depth, limited to what the buffer slots can track.
+  static uint32_t PipelineDepth();
+  // System property naming a file to record captured frames to, for replay
+  // with V4L2ReplayWrapper. Each time the stream is turned on, the file is
+  // started over and up to kMaxRecordedFrames frames are written to it.
+  static const char kRecordPathProperty[];
+  static const uint32_t kMaxRecordedFrames = 300;
+
   // Helper class to ensure all opened connections are closed.
   class Connection {
    public:
@@ -67,6 +87,15 @@ class V4L2Wrapper {
   virtual int SetControl(uint32_t control_id,
                          int32_t desired,
                          int32_t* result = nullptr);
+  // Between these calls, SetControl only records the desired values (unless
+  // the caller asks for the result). CommitControls then applies those that
+  // differ from the last known device values, with one VIDIOC_S_EXT_CTRLS
+  // per control class.
+  virtual void BeginControlBatch();
+  virtual int CommitControls();
+  // Whether GetControl can be answered from the cache. Controls the driver
+  // may change on its own (volatile) and write-only controls are not cached.
+  virtual bool IsControlCacheable(uint32_t control_id);
   // Manage format.
   virtual int GetFormats(std::set<uint32_t>* v4l2_formats);
   virtual int GetQualifiedFormats(std::vector<uint32_t>* v4l2_formats);
@@ -78,29 +107,89 @@ class V4L2Wrapper {
       uint32_t v4l2_format,
       const std::array<int32_t, 2>& size,
       std::array<int64_t, 2>* duration_range);
+  // |direct_output| indicates the device may capture straight into the
+  // output buffers if it supports |desired_format| exactly; it must be false
+  // when frames are shared between several streams. PipelineDepth() buffers
+  // are requested; the driver may grant more.
   virtual int SetFormat(const StreamFormat& desired_format,
+                        bool direct_output,
                         uint32_t* result_max_buffers);
+  // Prepare for converting frames into the given output streams.
+  virtual int ConfigureOutputStreams(
+      const camera3_stream_configuration_t& stream_config);
+  // Set the function finished requests are passed to, in capture order.
+  // It may be called from DequeueRequest or from an encoder thread, but
+  // never with any of the wrapper's locks held.
+  virtual void SetRequestCallback(
+      ConversionPipeline::CompletionCallback callback);
   // Manage buffers.
   virtual int EnqueueRequest(
       std::shared_ptr<default_camera_hal::CaptureRequest> request);
+  // On success, |request| is the request whose buffer was dequeued. It is
+  // completed through the request callback, possibly later.
   virtual int DequeueRequest(
       std::shared_ptr<default_camera_hal::CaptureRequest>* request);
   virtual int GetInFlightBufferCount();
+  // Block until a buffer can be dequeued, or until InterruptWait is called
+  // (which disconnecting also does). Returns 0 when a buffer is ready,
+  // -EINTR if interrupted, -ENODEV if not connected.
+  virtual int WaitForBuffer();
+  virtual void InterruptWait();
+  // Print debugging state, including conversion counters.
+  virtual void Dump(int fd);
 
- private:
-  // Constructor is private to allow failing on bad input.
+ protected:
+  // Constructor is protected to allow failing on bad input.
   // Use NewV4L2Wrapper instead.
   V4L2Wrapper(const std::string device_path);
 
   // Connect or disconnect to the device. Access by creating/destroying
   // a V4L2Wrapper::Connection object.
-  int Connect();
-  void Disconnect();
+  virtual int Connect();
+  virtual void Disconnect();
+
+ private:
+  // Fill |capabilities_| from the format cache, or by enumerating the device
+  // (and caching the result). Called while connecting.
+  void LoadCapabilities();
   // Perform an ioctl call in a thread-safe fashion.
   template <typename T>
   int IoctlLocked(unsigned long request, T data);
-  // Request/release userspace buffer mode via VIDIOC_REQBUFS.
+  // Request/release buffers of |memory_type_| via VIDIOC_REQBUFS.
   int RequestBuffers(uint32_t num_buffers);
+  // Pick the cheapest memory type the driver supports for the current format
+  // and request |num_buffers| buffers of it. DMABUF import of the output
+  // buffers is only attempted when |direct_output| is set, i.e. when frames
+  // need no conversion; USERPTR is the last resort.
+  int SetupBuffers(uint32_t num_buffers, bool direct_output);
+  // Export each MMAP buffer as a dma-buf and map it for reading.
+  int ExportBuffers();
+  // Whether the gralloc buffer |handle| has a dma-buf big enough for a frame
+  // of the current format.
+  bool CanImportBuffer(const native_handle_t* handle);
+  // Whether gralloc lays out |handle| the way the driver writes frames of
+  // the current format. Locks the buffer, so only checked once per stream.
+  bool MatchesDeviceLayout(const native_handle_t* handle);
+  // Check the first output buffer after configuring for DMABUF, and switch
+  // to exported MMAP buffers if the driver can't write into it.
+  int CheckImportLayout(const native_handle_t* handle);
+  // Report the time the device captured |buffer| as the sensor timestamp
+  // of |request|, when the driver provides one.
+  void StampSensorTimestamp(const v4l2_buffer& buffer,
+                            default_camera_hal::CaptureRequest* request);
+  // Append the frame in |buffer| to the recording. Called with
+  // |buffer_queue_lock_| held.
+  void RecordFrame(const v4l2_buffer& buffer, const arc::FrameBuffer& frame);
+  // Get or set a single control on the device, bypassing the cache.
+  int GetControlNow(uint32_t control_id, int32_t* value);
+  int SetControlNow(uint32_t control_id, int32_t desired, int32_t* result);
+  // Set |controls|, all of class |control_class|, in one ioctl.
+  int SetControlsNow(uint32_t control_class,
+                     std::vector<v4l2_ext_control>* controls);
+  // Remember |value| as the device value of |control_id|, unless the driver
+  // may change it on its own (volatile controls).
+  void CacheControl(uint32_t control_id, int32_t value);
+  void ClearControlCache();
 
   inline bool connected() { return device_fd_.get() >= 0; }
 
@@ -111,20 +200,43 @@ class V4L2Wrapper {
   const std::string device_path_;
   // The opened device fd.
   android::base::unique_fd device_fd_;
+  // Event fd used to break out of WaitForBuffer.
+  android::base::unique_fd wakeup_fd_;
   // The underlying gralloc module.
   // std::unique_ptr<V4L2Gralloc> gralloc_;
   // Whether or not the device supports the extended control query.
   bool extended_query_supported_;
   // The format this device is set up for.
   std::unique_ptr<StreamFormat> format_;
+  // How buffers are shared with the driver (V4L2_MEMORY_*).
+  uint32_t memory_type_;
+  // Whether the output buffer layout has been checked against the format
+  // since DMABUF buffers were last requested.
+  bool import_checked_;
   // Lock protecting use of the buffer tracker.
   std::mutex buffer_queue_lock_;
   // Lock protecting use of the device.
   std::mutex device_lock_;
   // Lock protecting connecting/disconnecting the device.
   std::mutex connection_lock_;
+  // Lock protecting the control cache and batch below.
+  std::mutex control_lock_;
+  // Last value read from or applied to each cacheable control.
+  std::map<uint32_t, int32_t> control_values_;
+  // Whether each control seen so far may be cached.
+  std::map<uint32_t, bool> control_cacheable_;
+  // Values recorded since BeginControlBatch. Ordered by id, which keeps each
+  // control class contiguous.
+  std::map<uint32_t, int32_t> pending_controls_;
+  bool batching_controls_;
   // Reference count connections.
   int connection_count_;
+  // Formats, sizes and frame durations of the connected device, when
+  // |capabilities_valid_|. Otherwise the format queries go to the device.
+  FormatCapabilities capabilities_;
+  bool capabilities_valid_;
+  // Checks cached capabilities against the device in the background.
+  android::sp<android::Thread> revalidation_thread_;
   // Supported formats.
   arc::SupportedFormats supported_formats_;
   // Qualified formats.
@@ -133,20 +245,35 @@ class V4L2Wrapper {
   class RequestContext {
    public:
     RequestContext()
-        : active(false),
-          camera_buffer(std::make_shared<arc::AllocatedFrameBuffer>(0)){};
+        : camera_buffer(std::make_shared<arc::AllocatedFrameBuffer>(0)) {
+      memset(&device_buffer, 0, sizeof(device_buffer));
+    };
     ~RequestContext(){};
-    // Indicates whether this request context is in use.
-    bool active;
+    // QUERYBUF result for this slot, filled once after REQBUFS.
+    v4l2_buffer device_buffer;
     // Buffer handles of the context.
+    // HAL allocated memory, used in V4L2_MEMORY_USERPTR mode.
     std::shared_ptr<arc::AllocatedFrameBuffer> camera_buffer;
+    // Exported driver memory, used in V4L2_MEMORY_MMAP mode.
+    std::shared_ptr<arc::V4L2FrameBuffer> mapped_buffer;
     std::shared_ptr<default_camera_hal::CaptureRequest> request;
   };
 
   // Map of in flight requests.
   // |buffers_.size()| will always be the maximum number of buffers this device
-  // can handle in its current format.
+  // can handle in its current format. The vector only changes when the format
+  // is set; which slots are in use is tracked by |slots_|, and a slot's
+  // context is only touched by the thread that owns it.
   std::vector<RequestContext> buffers_;
+  BufferSlots slots_;
+  // Converts dequeued frames into the output streams.
+  ConversionPipeline conversion_pipeline_;
+  // Frames captured and dropped since the stream was turned on. Protected by
+  // |buffer_queue_lock_|.
+  default_camera_hal::FrameSequenceTracker sequence_tracker_;
+  // Records captured frames when kRecordPathProperty is set. Protected by
+  // |buffer_queue_lock_|.
+  FrameDumpWriter recorder_;
 
   friend class Connection;
   friend class V4L2WrapperMock;
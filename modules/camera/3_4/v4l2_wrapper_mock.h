@@ -35,6 +35,7 @@ class V4L2WrapperMock : public V4L2Wrapper {
   MOCK_METHOD2(GetControl, int(uint32_t control_id, int32_t* value));
   MOCK_METHOD3(SetControl,
                int(uint32_t control_id, int32_t desired, int32_t* result));
+  MOCK_METHOD1(IsControlCacheable, bool(uint32_t control_id));
   MOCK_METHOD1(GetFormats, int(std::set<uint32_t>*));
   MOCK_METHOD1(GetQualifiedFormats, int(std::vector<uint32_t>*));
   MOCK_METHOD2(GetFormatFrameSizes,
@@ -43,7 +44,8 @@ class V4L2WrapperMock : public V4L2Wrapper {
                int(uint32_t,
                    const std::array<int32_t, 2>&,
                    std::array<int64_t, 2>*));
-  MOCK_METHOD2(SetFormat, int(const StreamFormat& desired_format,
+  MOCK_METHOD3(SetFormat, int(const StreamFormat& desired_format,
+                              bool direct_output,
                               uint32_t* result_max_buffers));
   MOCK_METHOD2(EnqueueBuffer,
                int(const camera3_stream_buffer_t* camera_buffer,
@@ -29,6 +29,7 @@ LOCAL_CFLAGS := -Wall -Werror -DLOG_TAG=\"MultiHal\"
 
 LOCAL_SRC_FILES := \
     multihal.cpp \
+    MultiHalStats.cpp \
     SensorEventQueue.cpp \
 
 LOCAL_HEADER_LIBRARIES := \
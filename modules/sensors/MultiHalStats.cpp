@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "MultiHalStats.h"
+
+void Log2Histogram::add(uint64_t value) {
+    int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+    if (bucket >= BUCKET_COUNT) {
+        bucket = BUCKET_COUNT - 1;
+    }
+    mBuckets[bucket].add(1);
+}
+
+uint64_t Log2Histogram::getCount() const {
+    uint64_t count = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        count += mBuckets[i].get();
+    }
+    return count;
+}
+
+uint64_t Log2Histogram::getPercentile(double fraction) const {
+    uint64_t counts[BUCKET_COUNT];
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        counts[i] = mBuckets[i].get();
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        seen += counts[i];
+        if (seen >= fraction * total) {
+            return (uint64_t) 1 << i;
+        }
+    }
+    return (uint64_t) 1 << (BUCKET_COUNT - 1);
+}
+
+void Log2Histogram::dump(int fd, const char* unit) const {
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        uint64_t count = mBuckets[i].get();
+        if (count > 0) {
+            dprintf(fd, " <%" PRIu64 "%s:%" PRIu64, (uint64_t) 1 << i, unit, count);
+        }
+    }
+    dprintf(fd, "\n");
+}
+
+void SubHalStats::dump(int fd, const char* name, int queueCapacity, int64_t elapsedNs) const {
+    double seconds = elapsedNs > 0 ? elapsedNs / 1e9 : 1;
+    dprintf(fd, "%s:\n", name);
+    dprintf(fd, "  polls %" PRIu64 " (%" PRIu64 " errors), events written %" PRIu64
+            " (%.1f/s), read %" PRIu64 ", dropped %" PRIu64 "\n",
+            polls.get(), pollErrors.get(), eventsWritten.get(), eventsWritten.get() / seconds,
+            eventsRead.get(), eventsDropped.get());
+    dprintf(fd, "  queue high water %" PRIu64 "/%d, waited for space %" PRIu64
+            " times for %.3f ms\n",
+            queueHighWater.get(), queueCapacity, spaceWaits.get(), spaceWaitNs.get() / 1e6);
+    dprintf(fd, "  latency p50 <%" PRIu64 "us p99 <%" PRIu64 "us:",
+            latencyUs.getPercentile(0.5), latencyUs.getPercentile(0.99));
+    latencyUs.dump(fd, "us");
+}
+
+void PollStats::dump(int fd) const {
+    dprintf(fd, "poll: %" PRIu64 " calls, %" PRIu64 " waits for data, batch sizes:",
+            polls.get(), dataWaits.get());
+    batchSizes.dump(fd, "");
+}
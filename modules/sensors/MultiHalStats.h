@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MULTIHALSTATS_H_
+#define MULTIHALSTATS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+/*
+ * A statistic with a single writer thread, readable from any thread for dumping.
+ * Updates are relaxed loads and stores rather than atomic read-modify-writes, so they cost next
+ * to nothing on the event path; a dump may see different counters slightly out of step.
+ */
+class StatCounter {
+    std::atomic<uint64_t> mValue;
+
+public:
+    StatCounter() : mValue(0) {}
+
+    void add(uint64_t n) {
+        mValue.store(mValue.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // Raises the value to n if it is lower.
+    void raiseTo(uint64_t n) {
+        if (n > mValue.load(std::memory_order_relaxed)) {
+            mValue.store(n, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t get() const {
+        return mValue.load(std::memory_order_relaxed);
+    }
+};
+
+/*
+ * Histogram with power-of-two buckets, with the same single-writer rule as StatCounter.
+ * Bucket 0 counts zeroes, and bucket i counts values in [2^(i-1), 2^i).
+ */
+class Log2Histogram {
+public:
+    static const int BUCKET_COUNT = 40;
+
+    void add(uint64_t value);
+    uint64_t getCount() const;
+    // Exclusive upper bound of the bucket in which the given fraction of the values, from 0 to
+    // 1, is reached; so at most twice the true percentile. Returns 0 if there are no values.
+    uint64_t getPercentile(double fraction) const;
+    // Prints one line of the non-empty buckets.
+    void dump(int fd, const char* unit) const;
+
+private:
+    StatCounter mBuckets[BUCKET_COUNT];
+};
+
+// Statistics on one sub-HAL.
+struct SubHalStats {
+    // Updated by the sub-HAL's writer thread.
+    StatCounter polls;
+    StatCounter pollErrors;
+    StatCounter eventsWritten;
+    // Times the writer found the queue full and had to wait for space, and for how long.
+    StatCounter spaceWaits;
+    StatCounter spaceWaitNs;
+    StatCounter queueHighWater;
+
+    // Updated by the multihal poll().
+    StatCounter eventsRead;
+    StatCounter eventsDropped;
+    // From each event's timestamp to its being handed out by poll(), in microseconds.
+    Log2Histogram latencyUs;
+
+    void dump(int fd, const char* name, int queueCapacity, int64_t elapsedNs) const;
+};
+
+// Statistics on the multihal poll(), updated only by the thread calling it.
+struct PollStats {
+    StatCounter polls;
+    StatCounter dataWaits;
+    // Events returned by each poll().
+    Log2Histogram batchSizes;
+
+    void dump(int fd) const;
+};
+
+#endif // MULTIHALSTATS_H_
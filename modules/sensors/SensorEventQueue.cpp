@@ -14,7 +14,11 @@
  * limitations under the License.
  */
 
-#include <pthread.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #include <algorithm>
 
@@ -23,71 +27,124 @@
 #include <hardware/sensors.h>
 #include "SensorEventQueue.h"
 
-SensorEventQueue::SensorEventQueue(int capacity) {
+EventSignal::EventSignal() : mWaiting(false) {
+    mFd = eventfd(0, EFD_CLOEXEC);
+    LOG_ALWAYS_FATAL_IF(mFd < 0, "eventfd() failed: %s", strerror(errno));
+}
+
+EventSignal::~EventSignal() {
+    close(mFd);
+}
+
+void EventSignal::prepareToWait() {
+    mWaiting.store(true);
+    // Order the flag before the caller's re-check of its condition; signal() orders the
+    // condition change before its check of the flag. One of the two sides sees the other.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void EventSignal::cancelWait() {
+    mWaiting.store(false);
+}
+
+void EventSignal::wait(int timeoutMs) {
+    struct pollfd pfd = { mFd, POLLIN, 0 };
+    int res = TEMP_FAILURE_RETRY(poll(&pfd, 1, timeoutMs));
+    if (res > 0) {
+        // Only the one waiter reads, so this cannot block.
+        uint64_t count;
+        res = TEMP_FAILURE_RETRY(read(mFd, &count, sizeof(count)));
+    }
+    if (res < 0) {
+        ALOGE("EventSignal wait failed: %s", strerror(errno));
+    }
+    mWaiting.store(false);
+}
+
+void EventSignal::signal() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mWaiting.load(std::memory_order_relaxed) && mWaiting.exchange(false)) {
+        uint64_t one = 1;
+        if (TEMP_FAILURE_RETRY(write(mFd, &one, sizeof(one))) < 0) {
+            ALOGE("EventSignal write() failed: %s", strerror(errno));
+        }
+    }
+}
+
+SensorEventQueue::SensorEventQueue(int capacity) : mWritten(0), mRead(0) {
     mCapacity = capacity;
 
-    mStart = 0;
-    mSize = 0;
+    mWriteIndex = 0;
+    mReadIndex = 0;
     mData = new sensors_event_t[mCapacity];
-    pthread_cond_init(&mSpaceAvailableCondition, NULL);
 }
 
 SensorEventQueue::~SensorEventQueue() {
     delete[] mData;
     mData = NULL;
-    pthread_cond_destroy(&mSpaceAvailableCondition);
 }
 
 int SensorEventQueue::getWritableRegion(int requestedLength, sensors_event_t** out) {
-    if (mSize == mCapacity || requestedLength <= 0) {
+    int size = mWritten.load(std::memory_order_relaxed) - mRead.load(std::memory_order_acquire);
+    if (size == mCapacity || requestedLength <= 0) {
         *out = NULL;
         return 0;
     }
-    // Start writing after the last readable record.
-    int firstWritable = (mStart + mSize) % mCapacity;
-
-    int lastWritable = firstWritable + requestedLength - 1;
-
-    // Don't go past the end of the data array.
-    if (lastWritable > mCapacity - 1) {
-        lastWritable = mCapacity - 1;
-    }
-    // Don't go into the readable region.
-    if (firstWritable < mStart && lastWritable >= mStart) {
-        lastWritable = mStart - 1;
-    }
-    *out = &mData[firstWritable];
-    return lastWritable - firstWritable + 1;
+    // Start writing after the last readable record, without going into the readable region
+    // or past the end of the data array.
+    int length = std::min(requestedLength, mCapacity - size);
+    length = std::min(length, mCapacity - mWriteIndex);
+    *out = &mData[mWriteIndex];
+    return length;
 }
 
 void SensorEventQueue::markAsWritten(int count) {
-    mSize += count;
+    mWriteIndex = (mWriteIndex + count) % mCapacity;
+    mWritten.store(mWritten.load(std::memory_order_relaxed) + count, std::memory_order_release);
 }
 
 int SensorEventQueue::getSize() {
-    return mSize;
+    return mWritten.load(std::memory_order_acquire) - mRead.load(std::memory_order_acquire);
 }
 
 sensors_event_t* SensorEventQueue::peek() {
-    if (mSize == 0) return NULL;
-    return &mData[mStart];
+    if (getSize() == 0) return NULL;
+    return &mData[mReadIndex];
 }
 
 void SensorEventQueue::dequeue() {
-    if (mSize == 0) return;
-    if (mSize == mCapacity) {
-        pthread_cond_broadcast(&mSpaceAvailableCondition);
+    if (getSize() == 0) return;
+    markAsRead(1);
+}
+
+int SensorEventQueue::getReadableRegion(int maxLength, sensors_event_t** out) {
+    int length = std::min(maxLength, getSize());
+    if (length <= 0) {
+        *out = NULL;
+        return 0;
     }
-    mSize--;
-    mStart = (mStart + 1) % mCapacity;
+    length = std::min(length, mCapacity - mReadIndex);
+    *out = &mData[mReadIndex];
+    return length;
+}
+
+void SensorEventQueue::markAsRead(int count) {
+    mReadIndex = (mReadIndex + count) % mCapacity;
+    mRead.store(mRead.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    mSpaceAvailable.signal();
 }
 
 // returns true if it waited, or false if it was a no-op.
-bool SensorEventQueue::waitForSpace(pthread_mutex_t* mutex) {
-    bool waited = false;
-    while (mSize == mCapacity) {
-        waited = true;
-        pthread_cond_wait(&mSpaceAvailableCondition, mutex);
+bool SensorEventQueue::waitForSpace() {
+    if (getSize() < mCapacity) {
+        return false;
+    }
+    while (true) {
+        mSpaceAvailable.prepareToWait();
+        if (getSize() < mCapacity) {
+            mSpaceAvailable.cancelWait();
+            return true;
+        }
+        mSpaceAvailable.wait();
     }
-    return waited;
 }
@@ -18,7 +18,31 @@
 #define SENSOREVENTQUEUE_H_
 
 #include <hardware/sensors.h>
-#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/*
+ * Wakes a thread sleeping in wait() from other threads, without any of them taking a lock.
+ * The sleeper calls prepareToWait(), checks its condition once more, and only then calls
+ * wait() (or cancelWait() if the condition now holds), so a signal() sent after the condition
+ * changed is never lost. signal() is a no-op unless someone is waiting.
+ * Backed by an eventfd, so a spurious early return from wait() is possible; callers loop.
+ */
+class EventSignal {
+    int mFd;
+    std::atomic<bool> mWaiting;
+
+public:
+    EventSignal();
+    ~EventSignal();
+
+    void prepareToWait();
+    void cancelWait();
+    // Sleeps until signalled, or for at most timeoutMs if it is not negative.
+    void wait(int timeoutMs = -1);
+    void signal();
+};
 
 /*
  * Fixed-size circular queue, with an API developed around the sensor HAL poll() method.
@@ -27,15 +51,24 @@
  * write to, instead of using an intermediate buffer and a memcpy.
  *
  * Thread safety:
- * Reading can be done safely after grabbing the mutex lock, while poll() writing in a separate
- * thread without a mutex lock. But there can only be one writer at a time.
+ * The queue is lock-free for exactly one writer thread and one reader thread. The writer owns
+ * getWritableRegion(), markAsWritten() and waitForSpace(); the reader owns peek(), dequeue(),
+ * getReadableRegion() and markAsRead().
+ * getSize() may be called from either.
  */
 class SensorEventQueue {
     int mCapacity;
-    int mStart; // start of readable region
-    int mSize; // number of readable items
     sensors_event_t* mData;
-    pthread_cond_t mSpaceAvailableCondition;
+    // Slot of the next write; only touched by the writer.
+    int mWriteIndex;
+    // Slot of the first readable record; only touched by the reader.
+    int mReadIndex;
+    // Running totals of records written and dequeued. Their difference is the size, which
+    // stays correct when they wrap. Kept on separate cache lines, as each is written by a
+    // different thread.
+    alignas(64) std::atomic<uint32_t> mWritten;
+    alignas(64) std::atomic<uint32_t> mRead;
+    EventSignal mSpaceAvailable;
 
 public:
     explicit SensorEventQueue(int capacity);
@@ -45,32 +78,35 @@ public:
     // writable space, it will return a region of at least one. Because it must return
     // a pointer to a contiguous region, it may return smaller regions as we approach the end of
     // the data array.
-    // Only call while holding the lock.
     // The region is not marked internally in any way. Subsequent calls may return overlapping
     // regions. This class expects there to be exactly one writer at a time.
     int getWritableRegion(int requestedLength, sensors_event_t** out);
 
     // After writing to the region returned by getWritableRegion(), call this to indicate how
-    // many records were actually written.
+    // many records were actually written, publishing them to the reader.
     // This increases size() by count.
-    // Only call while holding the lock.
     void markAsWritten(int count);
 
     // Gets the number of readable records.
-    // Only call while holding the lock.
     int getSize();
 
     // Returns pointer to the first readable record, or NULL if size() is zero.
-    // Only call this while holding the lock.
     sensors_event_t* peek();
 
     // This will decrease the size by one, freeing up the oldest readable event's slot for writing.
-    // Only call while holding the lock.
     void dequeue();
 
+    // The reading counterpart of getWritableRegion(): points *out at the oldest readable
+    // records and returns how many of them, up to maxLength, are contiguous. Returns zero if
+    // the queue is empty. Records past the end of the data array need a second call.
+    int getReadableRegion(int maxLength, sensors_event_t** out);
+
+    // Frees the first count readable records for writing, as count calls to dequeue() would.
+    void markAsRead(int count);
+
     // Blocks until space is available. No-op if there is already space.
     // Returns true if it had to wait.
-    bool waitForSpace(pthread_mutex_t* mutex);
+    bool waitForSpace();
 };
 
 #endif // SENSOREVENTQUEUE_H_
@@ -14,41 +14,40 @@
  * limitations under the License.
  */
 
+#include "MultiHalStats.h"
 #include "SensorEventQueue.h"
 #include "multihal.h"
 
 #define LOG_NDEBUG 1
 #include <log/log.h>
 #include <cutils/atomic.h>
+#include <cutils/properties.h>
 #include <hardware/sensors.h>
 
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <fstream>
-#include <map>
+#include <functional>
+#include <utility>
 
 #include <dirent.h>
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <math.h>
 #include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 
 static pthread_mutex_t init_modules_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t init_sensors_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-// This mutex is shared by all queues
-static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-// Used to pause the multihal poll(). Broadcasted by sub-polling tasks if waiting_for_data.
-static pthread_cond_t data_available_cond = PTHREAD_COND_INITIALIZER;
-bool waiting_for_data = false;
-
 // Vector of sub modules, whose indexes are referred to in this file as module_index.
 static std::vector<hw_module_t *> *sub_hw_modules = nullptr;
 
@@ -56,46 +55,91 @@ static std::vector<hw_module_t *> *sub_hw_modules = nullptr;
 static std::vector<void *> *so_handles = nullptr;
 
 /*
- * Comparable class that globally identifies a sensor, by module index and local handle.
+ * Globally identifies a sensor, by module index and local handle.
  * A module index is the module's index in sub_hw_modules.
  * A local handle is the handle the sub-module assigns to a sensor.
  */
 struct FullHandle {
     int moduleIndex;
     int localHandle;
+};
 
-    bool operator<(const FullHandle &that) const {
-        if (moduleIndex < that.moduleIndex) {
-            return true;
-        }
-        if (moduleIndex > that.moduleIndex) {
-            return false;
-        }
-        return localHandle < that.localHandle;
-    }
+/*
+ * Handle translation tables, built once by lazy_init_sensors_list(), so translating a handle
+ * is a couple of array loads rather than map lookups.
+ */
+
+// Indexed by global handle. Global handles are handed out densely from 1, so slot 0 is unused.
+static std::vector<FullHandle> global_to_full(1, FullHandle{ -1, -1 });
 
-    bool operator==(const FullHandle &that) const {
-        return moduleIndex == that.moduleIndex && localHandle == that.localHandle;
+// Local handles spanning more than this within one sub-module are not given a dense table.
+static const int MAX_DENSE_LOCAL_HANDLE_SPAN = 4096;
+
+/*
+ * The global handles of one sub-module's sensors. Sub-HALs number their sensors compactly in
+ * practice, so these are indexed by local handle minus the lowest one, with -1 for gaps. The
+ * odd sub-HAL with widely spread handles gets a sorted list of (local, global) pairs instead.
+ */
+struct LocalHandleTable {
+    int base = 0;
+    std::vector<int> dense;
+    std::vector<std::pair<int, int>> sparse;
+
+    // Returns the global handle, or -1 if local_handle is unknown.
+    int lookup(int local_handle) const {
+        if (sparse.empty()) {
+            unsigned index = (unsigned) local_handle - (unsigned) base;
+            return index < dense.size() ? dense[index] : -1;
+        }
+        auto it = std::lower_bound(sparse.begin(), sparse.end(),
+                std::pair<int, int>(local_handle, INT_MIN));
+        return it != sparse.end() && it->first == local_handle ? it->second : -1;
     }
 };
 
-std::map<int, FullHandle> global_to_full;
-std::map<FullHandle, int> full_to_global;
-int next_global_handle = 1;
+// Indexed by module index.
+static std::vector<LocalHandleTable> local_to_global;
 
 static int assign_global_handle(int module_index, int local_handle) {
-    int global_handle = next_global_handle++;
-    FullHandle full_handle;
-    full_handle.moduleIndex = module_index;
-    full_handle.localHandle = local_handle;
-    full_to_global[full_handle] = global_handle;
-    global_to_full[global_handle] = full_handle;
+    int global_handle = (int) global_to_full.size();
+    global_to_full.push_back(FullHandle{ module_index, local_handle });
     return global_handle;
 }
 
+// Builds local_to_global from global_to_full, once all global handles are assigned.
+static void build_local_handle_tables(int module_count) {
+    std::vector<std::vector<std::pair<int, int>>> handles(module_count);
+    for (int global_handle = 1; global_handle < (int) global_to_full.size(); global_handle++) {
+        const FullHandle& full_handle = global_to_full[global_handle];
+        handles[full_handle.moduleIndex].push_back(
+                std::pair<int, int>(full_handle.localHandle, global_handle));
+    }
+    local_to_global.assign(module_count, LocalHandleTable());
+    for (int module_index = 0; module_index < module_count; module_index++) {
+        std::vector<std::pair<int, int>>& pairs = handles[module_index];
+        LocalHandleTable& table = local_to_global[module_index];
+        if (pairs.empty()) {
+            continue;
+        }
+        std::sort(pairs.begin(), pairs.end());
+        int64_t span = (int64_t) pairs.back().first - pairs.front().first + 1;
+        if (span > MAX_DENSE_LOCAL_HANDLE_SPAN) {
+            ALOGW("module_index %d local handles span %" PRId64 ", using a sparse table",
+                    module_index, span);
+            table.sparse = pairs;
+            continue;
+        }
+        table.base = pairs.front().first;
+        table.dense.assign(span, -1);
+        for (const auto& pair : pairs) {
+            table.dense[pair.first - table.base] = pair.second;
+        }
+    }
+}
+
 // Returns the local handle, or -1 if it does not exist.
 static int get_local_handle(int global_handle) {
-    if (global_to_full.count(global_handle) == 0) {
+    if (global_handle <= 0 || global_handle >= (int) global_to_full.size()) {
         ALOGW("Unknown global_handle %d", global_handle);
         return -1;
     }
@@ -105,33 +149,35 @@ static int get_local_handle(int global_handle) {
 // Returns the sub_hw_modules index of the module that contains the sensor associates with this
 // global_handle, or -1 if that global_handle does not exist.
 static int get_module_index(int global_handle) {
-    if (global_to_full.count(global_handle) == 0) {
+    if (global_handle <= 0 || global_handle >= (int) global_to_full.size()) {
         ALOGW("Unknown global_handle %d", global_handle);
         return -1;
     }
-    FullHandle f = global_to_full[global_handle];
+    const FullHandle& f = global_to_full[global_handle];
     ALOGV("FullHandle for global_handle %d: moduleIndex %d, localHandle %d",
             global_handle, f.moduleIndex, f.localHandle);
     return f.moduleIndex;
 }
 
-// Returns the global handle for this full_handle, or -1 if the full_handle is unknown.
-static int get_global_handle(FullHandle* full_handle) {
-    int global_handle = -1;
-    if (full_to_global.count(*full_handle)) {
-        global_handle = full_to_global[*full_handle];
-    } else {
-        ALOGW("Unknown FullHandle: moduleIndex %d, localHandle %d",
-            full_handle->moduleIndex, full_handle->localHandle);
-    }
-    return global_handle;
-}
-
 static const int SENSOR_EVENT_QUEUE_CAPACITY = 36;
 
+// Milliseconds poll() may hold an event back in case another sub-HAL still has an older one
+// to report. Unset or negative reads the queues round-robin instead, in no particular order.
+static const char* MERGE_WINDOW_PROPERTY = "vendor.sensors.multihal.merge_window_ms";
+
+// Sensor event timestamps are on this clock.
+static int64_t elapsed_realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 struct TaskContext {
   sensors_poll_device_t* device;
   SensorEventQueue* queue;
+  // Wakes the multihal poll(), which waits on it once every queue is empty.
+  EventSignal* data_available;
+  SubHalStats* stats;
 };
 
 void *writerTask(void* ptr) {
@@ -139,35 +185,41 @@ void *writerTask(void* ptr) {
     TaskContext* ctx = (TaskContext*)ptr;
     sensors_poll_device_t* device = ctx->device;
     SensorEventQueue* queue = ctx->queue;
+    EventSignal* data_available = ctx->data_available;
+    SubHalStats* stats = ctx->stats;
     sensors_event_t* buffer;
     int eventsPolled;
     while (1) {
-        pthread_mutex_lock(&queue_mutex);
-        if (queue->waitForSpace(&queue_mutex)) {
-            ALOGV("writerTask waited for space");
+        // This thread is the queue's only writer, so this needs no lock, and the region stays
+        // writable while the sub-HAL blocks in poll(). The clock is only read when the queue is
+        // full and the wait may block.
+        if (queue->getSize() >= SENSOR_EVENT_QUEUE_CAPACITY) {
+            int64_t waitStartNs = elapsed_realtime_ns();
+            if (queue->waitForSpace()) {
+                ALOGV("writerTask waited for space");
+                stats->spaceWaits.add(1);
+                stats->spaceWaitNs.add(elapsed_realtime_ns() - waitStartNs);
+            }
         }
         int bufferSize = queue->getWritableRegion(SENSOR_EVENT_QUEUE_CAPACITY, &buffer);
-        // Do blocking poll outside of lock
-        pthread_mutex_unlock(&queue_mutex);
 
         ALOGV("writerTask before poll() - bufferSize = %d", bufferSize);
         eventsPolled = device->poll(device, buffer, bufferSize);
         ALOGV("writerTask poll() got %d events.", eventsPolled);
+        stats->polls.add(1);
         if (eventsPolled <= 0) {
             if (eventsPolled < 0) {
+                stats->pollErrors.add(1);
                 ALOGV("writerTask ignored error %d from %s", eventsPolled, device->common.module->name);
                 ALOGE("ERROR: Fix %s so it does not return error from poll()", device->common.module->name);
             }
             continue;
         }
-        pthread_mutex_lock(&queue_mutex);
         queue->markAsWritten(eventsPolled);
         ALOGV("writerTask wrote %d events", eventsPolled);
-        if (waiting_for_data) {
-            ALOGV("writerTask - broadcast data_available_cond");
-            pthread_cond_broadcast(&data_available_cond);
-        }
-        pthread_mutex_unlock(&queue_mutex);
+        data_available->signal();
+        stats->eventsWritten.add(eventsPolled);
+        stats->queueHighWater.raiseTo(queue->getSize());
     }
     // never actually returns
     return NULL;
@@ -195,6 +247,8 @@ struct sensors_poll_context_t {
     int activate(int handle, int enabled);
     int setDelay(int handle, int64_t ns);
     int poll(sensors_event_t* data, int count);
+    int poll_round_robin(sensors_event_t* data, int count);
+    int poll_merged(sensors_event_t* data, int count);
     int batch(int handle, int flags, int64_t period_ns, int64_t timeout);
     int flush(int handle);
     int inject_sensor_data(const sensors_event_t *data);
@@ -209,13 +263,37 @@ struct sensors_poll_context_t {
     std::vector<SensorEventQueue*> queues;
     std::vector<pthread_t> threads;
     int nextReadIndex;
+    // Shared with the writer threads, which never exit, so it is never freed, like the queues.
+    EventSignal* data_available;
+
+    // Whether poll() merges the queues in timestamp order, and for how long it may hold an
+    // event back waiting for the other queues.
+    bool mergeByTimestamp;
+    int64_t mergeWindowNs;
+    // When poll() started holding back heldHead, the (timestamp, queue index) of the oldest
+    // queued event, or -1 while nothing is held back.
+    int64_t holdingSinceNs;
+    std::pair<int64_t, int> heldHead;
+    // Scratch min-heap of (head timestamp, queue index) for poll_merged().
+    std::vector<std::pair<int64_t, int>> mergeHeap;
+
+    // Parallel to queues, and shared with the writer threads in the same way.
+    std::vector<SubHalStats*> stats;
+    PollStats pollStats;
+    int64_t openTimeNs;
+
+    void dump(int fd);
 
     sensors_poll_device_t* get_v0_device_by_handle(int global_handle);
     sensors_poll_device_1_t* get_v1_device_by_handle(int global_handle);
     sensors_poll_device_1_t* get_primary_v1_device();
     int get_device_version_by_handle(int global_handle);
 
-    void copy_event_remap_handle(sensors_event_t* src, sensors_event_t* dest, int sub_index);
+    int copy_events_remap_handles(sensors_event_t* dest, const sensors_event_t* src, int count,
+            int sub_index);
+    int read_events(int sub_index, sensors_event_t* dest, int count);
+    int count_nonempty_queues();
+    void wait_for_data(int nonempty_queues, int64_t timeout_ns);
 };
 
 void sensors_poll_context_t::addSubHwDevice(struct hw_device_t* sub_hw_device) {
@@ -228,6 +306,9 @@ void sensors_poll_context_t::addSubHwDevice(struct hw_device_t* sub_hw_device) {
     TaskContext* taskContext = new TaskContext();
     taskContext->device = (sensors_poll_device_t*) sub_hw_device;
     taskContext->queue = queue;
+    taskContext->data_available = this->data_available;
+    taskContext->stats = new SubHalStats();
+    this->stats.push_back(taskContext->stats);
 
     pthread_t writerThread;
     pthread_create(&writerThread, NULL, writerTask, taskContext);
@@ -336,67 +417,198 @@ int sensors_poll_context_t::setDelay(int handle, int64_t ns) {
     return retval;
 }
 
-void sensors_poll_context_t::copy_event_remap_handle(sensors_event_t* dest, sensors_event_t* src,
-        int sub_index) {
-    memcpy(dest, src, sizeof(struct sensors_event_t));
-    // A normal event's "sensor" field is a local handle. Convert it to a global handle.
-    // A meta-data event must have its sensor set to 0, but it has a nested event
-    // with a local handle that needs to be converted to a global handle.
-    FullHandle full_handle;
-    full_handle.moduleIndex = sub_index;
-
-    // If it's a metadata event, rewrite the inner payload, not the sensor field.
-    // If the event's sensor field is unregistered for any reason, rewrite the sensor field
-    // with a -1, instead of writing an incorrect but plausible sensor number, because
-    // get_global_handle() returns -1 for unknown FullHandles.
-    if (dest->type == SENSOR_TYPE_META_DATA) {
-        full_handle.localHandle = dest->meta_data.sensor;
-        dest->meta_data.sensor = get_global_handle(&full_handle);
-    } else {
-        full_handle.localHandle = dest->sensor;
-        dest->sensor = get_global_handle(&full_handle);
+// Copies a run of count events from sub-module sub_index in one go, then converts their handles
+// in place. Returns the number of events left in dest, which is smaller than count if any had
+// to be dropped.
+int sensors_poll_context_t::copy_events_remap_handles(sensors_event_t* dest,
+        const sensors_event_t* src, int count, int sub_index) {
+    memcpy(dest, src, count * sizeof(struct sensors_event_t));
+    const LocalHandleTable* table = sub_index < (int) local_to_global.size() ?
+            &local_to_global[sub_index] : NULL;
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        sensors_event_t* event = &dest[i];
+        // A normal event's "sensor" field is a local handle. Convert it to a global handle.
+        // A meta-data event must have its sensor set to 0, but it has a nested event
+        // with a local handle that needs to be converted to a global handle.
+        // If the handle is unregistered for any reason, rewrite it with a -1, instead of
+        // an incorrect but plausible sensor number.
+        int32_t* handle = event->type == SENSOR_TYPE_META_DATA ?
+                &event->meta_data.sensor : &event->sensor;
+        int local_handle = *handle;
+        *handle = table != NULL ? table->lookup(local_handle) : -1;
+        if (*handle < 0) {
+            ALOGW("Unknown FullHandle: moduleIndex %d, localHandle %d", sub_index, local_handle);
+        }
+        if (event->sensor == SENSORS_HANDLE_BASE - 1) {
+            // Bad handle, do not pass corrupted event upstream !
+            ALOGW("Dropping bad local handle event packet on the floor");
+            this->stats[sub_index]->eventsDropped.add(1);
+            continue;
+        }
+        if (kept != i) {
+            dest[kept] = *event;
+        }
+        kept++;
     }
+    return kept;
+}
+
+// Moves up to count events from the front of queue sub_index to dest, a contiguous run at a
+// time, with their handles remapped. Returns the number of events written to dest.
+int sensors_poll_context_t::read_events(int sub_index, sensors_event_t* dest, int count) {
+    SensorEventQueue* queue = this->queues[sub_index];
+    int eventsRead = 0;
+    sensors_event_t* run;
+    int runLength;
+    while (eventsRead < count &&
+            (runLength = queue->getReadableRegion(count - eventsRead, &run)) > 0) {
+        eventsRead += this->copy_events_remap_handles(&dest[eventsRead], run, runLength,
+                sub_index);
+        queue->markAsRead(runLength);
+    }
+
+    // poll() returns as soon as it has read its events, so this is their latency.
+    SubHalStats* stats = this->stats[sub_index];
+    stats->eventsRead.add(eventsRead);
+    int64_t now = elapsed_realtime_ns();
+    for (int i = 0; i < eventsRead; i++) {
+        // Meta-data events carry no meaningful timestamp.
+        if (dest[i].type != SENSOR_TYPE_META_DATA && dest[i].timestamp > 0 &&
+                dest[i].timestamp <= now) {
+            stats->latencyUs.add((now - dest[i].timestamp) / 1000);
+        }
+    }
+    return eventsRead;
+}
+
+int sensors_poll_context_t::count_nonempty_queues() {
+    int count = 0;
+    for (size_t i = 0; i < this->queues.size(); i++) {
+        if (this->queues[i]->getSize() > 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Waits until a writer adds events to more than nonempty_queues queues, or until timeout_ns
+// passes if it is not negative. May return early.
+void sensors_poll_context_t::wait_for_data(int nonempty_queues, int64_t timeout_ns) {
+    // Check the queues once more after announcing the wait, as a writer may have added
+    // events since they were scanned.
+    this->data_available->prepareToWait();
+    if (this->count_nonempty_queues() > nonempty_queues) {
+        this->data_available->cancelWait();
+        return;
+    }
+    ALOGV("poll stopping to wait for data");
+    this->pollStats.dataWaits.add(1);
+    this->data_available->wait(timeout_ns < 0 ? -1 : (int) ((timeout_ns + 999999) / 1000000));
 }
 
 int sensors_poll_context_t::poll(sensors_event_t *data, int maxReads) {
     ALOGV("poll");
+    // This is the only reader of the queues, so they are read without a lock while the
+    // writer threads keep filling them.
+    int eventsRead = this->mergeByTimestamp ? this->poll_merged(data, maxReads)
+                                            : this->poll_round_robin(data, maxReads);
+    this->pollStats.polls.add(1);
+    this->pollStats.batchSizes.add(eventsRead);
+    ALOGV("poll returning %d events.", eventsRead);
+    return eventsRead;
+}
+
+int sensors_poll_context_t::poll_round_robin(sensors_event_t *data, int maxReads) {
     int empties = 0;
-    int queueCount = 0;
+    int queueCount = (int)this->queues.size();
     int eventsRead = 0;
-
-    pthread_mutex_lock(&queue_mutex);
-    queueCount = (int)this->queues.size();
     while (eventsRead == 0) {
         while (empties < queueCount && eventsRead < maxReads) {
-            SensorEventQueue* queue = this->queues.at(this->nextReadIndex);
-            sensors_event_t* event = queue->peek();
-            if (event == NULL) {
+            if (this->queues[this->nextReadIndex]->getSize() == 0) {
                 empties++;
             } else {
+                // Take everything the queue has, as far as there is room.
                 empties = 0;
-                this->copy_event_remap_handle(&data[eventsRead], event, nextReadIndex);
-                if (data[eventsRead].sensor == SENSORS_HANDLE_BASE - 1) {
-                    // Bad handle, do not pass corrupted event upstream !
-                    ALOGW("Dropping bad local handle event packet on the floor");
-                } else {
-                    eventsRead++;
-                }
-                queue->dequeue();
+                eventsRead += this->read_events(this->nextReadIndex, &data[eventsRead],
+                        maxReads - eventsRead);
             }
             this->nextReadIndex = (this->nextReadIndex + 1) % queueCount;
         }
         if (eventsRead == 0) {
             // The queues have been scanned and none contain data, so wait.
-            ALOGV("poll stopping to wait for data");
-            waiting_for_data = true;
-            pthread_cond_wait(&data_available_cond, &queue_mutex);
-            waiting_for_data = false;
+            this->wait_for_data(0, -1);
             empties = 0;
         }
     }
-    pthread_mutex_unlock(&queue_mutex);
-    ALOGV("poll returning %d events.", eventsRead);
+    return eventsRead;
+}
 
+/*
+ * Delivers events in timestamp order across the queues, with a k-way merge of their heads.
+ * Each queue is already in order, so the merge is only exact while every queue has something
+ * in it: an empty queue could still receive an event older than the oldest head. So while any
+ * queue is empty, events newer than mergeWindowNs are held back. Holding an event stops once
+ * it has gone on for mergeWindowNs, and everything queued by then goes out in timestamp order,
+ * so an idle sub-HAL delays the others by at most the window. The next event held back gets a
+ * window of its own.
+ */
+int sensors_poll_context_t::poll_merged(sensors_event_t *data, int maxReads) {
+    typedef std::pair<int64_t, int> Head;
+    int queueCount = (int)this->queues.size();
+    int eventsRead = 0;
+    while (eventsRead == 0) {
+        std::vector<Head>& heap = this->mergeHeap;
+        heap.clear();
+        for (int i = 0; i < queueCount; i++) {
+            sensors_event_t* event = this->queues[i]->peek();
+            if (event != NULL) {
+                heap.push_back(Head(event->timestamp, i));
+            }
+        }
+        std::make_heap(heap.begin(), heap.end(), std::greater<Head>());
+
+        int64_t now = elapsed_realtime_ns();
+        int64_t waitNs = -1;
+        bool holding = false;
+        bool flushing = false;
+        while (!heap.empty() && eventsRead < maxReads) {
+            Head head = heap.front();
+            if (!flushing && (int)heap.size() < queueCount &&
+                    head.first > now - this->mergeWindowNs) {
+                if (this->holdingSinceNs < 0 || this->heldHead != head) {
+                    this->holdingSinceNs = now;
+                    this->heldHead = head;
+                }
+                int64_t heldNs = now - this->holdingSinceNs;
+                if (heldNs < this->mergeWindowNs) {
+                    waitNs = std::min(this->mergeWindowNs - heldNs,
+                                      head.first + this->mergeWindowNs - now);
+                    holding = true;
+                    break;
+                }
+                // The window is up: everything queued by now goes out.
+                flushing = true;
+            }
+            std::pop_heap(heap.begin(), heap.end(), std::greater<Head>());
+            heap.pop_back();
+            eventsRead += this->read_events(head.second, &data[eventsRead], 1);
+            sensors_event_t* next = this->queues[head.second]->peek();
+            if (next != NULL) {
+                heap.push_back(Head(next->timestamp, head.second));
+                std::push_heap(heap.begin(), heap.end(), std::greater<Head>());
+            }
+        }
+        if (!holding) {
+            // Whatever was held back has gone out.
+            this->holdingSinceNs = -1;
+        }
+        if (eventsRead == 0) {
+            // Either there is nothing to deliver, or it is being held back until the window
+            // closes; wake up early if an empty queue gets data.
+            this->wait_for_data((int)heap.size(), waitNs);
+        }
+    }
     return eventsRead;
 }
 
@@ -497,6 +709,18 @@ int sensors_poll_context_t::config_direct_report(int sensor_handle,
     ALOGV("retval %d", retval);
     return retval;
 }
+
+void sensors_poll_context_t::dump(int fd) {
+    int64_t elapsedNs = elapsed_realtime_ns() - this->openTimeNs;
+    dprintf(fd, "MultiHal, up %.1f s, %s\n", elapsedNs / 1e9,
+            this->mergeByTimestamp ? "merging in timestamp order" : "round-robin");
+    this->pollStats.dump(fd);
+    for (size_t i = 0; i < this->sub_hw_devices.size(); i++) {
+        const hw_device_t* device = this->sub_hw_devices[i];
+        this->stats[i]->dump(fd, device->module->name, SENSOR_EVENT_QUEUE_CAPACITY, elapsedNs);
+    }
+}
+
 int sensors_poll_context_t::close() {
     ALOGV("close");
     for (std::vector<hw_device_t*>::iterator it = this->sub_hw_devices.begin();
@@ -534,6 +758,11 @@ static int device__close(struct hw_device_t *dev) {
     return 0;
 }
 
+void dump_multi_hal_stats(struct hw_device_t* device, int fd) {
+    sensors_poll_context_t* ctx = (sensors_poll_context_t*) device;
+    ctx->dump(fd);
+}
+
 static int device__activate(struct sensors_poll_device_t *dev, int handle,
         int enabled) {
     sensors_poll_context_t* ctx = (sensors_poll_context_t*) dev;
@@ -742,6 +971,7 @@ static void lazy_init_sensors_list() {
         }
         module_index++;
     }
+    build_local_handle_tables(module_index);
     // Set the const static global_sensors_list to the mutable one allocated by this function.
     global_sensors_list = mutable_sensor_list;
 
@@ -807,6 +1037,14 @@ static int open_sensors(const struct hw_module_t* hw_module, const char* name,
     dev->proxy_device.config_direct_report = device__config_direct_report;
 
     dev->nextReadIndex = 0;
+    dev->data_available = new EventSignal();
+    int32_t mergeWindowMs = property_get_int32(MERGE_WINDOW_PROPERTY, -1);
+    dev->mergeByTimestamp = mergeWindowMs >= 0;
+    dev->mergeWindowNs = (int64_t) std::max(mergeWindowMs, 0) * 1000000LL;
+    dev->holdingSinceNs = -1;
+    dev->openTimeNs = elapsed_realtime_ns();
+    ALOGI_IF(dev->mergeByTimestamp, "Merging events in timestamp order, window %d ms",
+            mergeWindowMs);
 
     // Open() the subhal modules. Remember their devices in a vector parallel to sub_hw_modules.
     for (std::vector<hw_module_t*>::iterator it = sub_hw_modules->begin();
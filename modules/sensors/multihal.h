@@ -26,4 +26,12 @@ static const char* DEPRECATED_MULTI_HAL_CONFIG_FILE_PATH = "/system/etc/sensors/
 
 struct sensors_module_t *get_multi_hal_module_info(void);
 
+// Writes per-sub-HAL event counts, queue usage and latencies, and poll() batch sizes, to fd.
+// device must be a device opened from the multihal module.
+// sensors_poll_device_1 has no dump entry of its own, so this is meant for the service that loads
+// the multihal through get_multi_hal_module_info() from the static library, e.g. the
+// android.hardware.sensors@1.0 default implementation, to call from its debug() with the fd it
+// is given, e.g. by `lshal debug android.hardware.sensors@1.0::ISensors/default`.
+void dump_multi_hal_stats(struct hw_device_t* device, int fd);
+
 #endif // HARDWARE_LIBHARDWARE_MODULES_SENSORS_MULTIHAL_H_
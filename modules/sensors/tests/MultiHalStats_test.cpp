@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "MultiHalStats.h"
+
+// Unit tests for the multihal statistics.
+
+// Run it like this:
+//
+// m multihalstatstests && \
+// out/host/linux-x86/nativetest64/multihalstatstests/multihalstatstests
+
+bool checkUint(const char* msg, uint64_t expected, uint64_t actual) {
+    if (actual != expected) {
+        printf("%s; expected %llu; actual was %llu\n", msg, (unsigned long long) expected,
+                (unsigned long long) actual);
+        return false;
+    }
+    return true;
+}
+
+bool testCounter() {
+    printf("testCounter\n");
+    StatCounter counter;
+    counter.add(3);
+    counter.add(4);
+    if (!checkUint("sum", 7, counter.get())) return false;
+    counter.raiseTo(5);
+    if (!checkUint("raiseTo lower", 7, counter.get())) return false;
+    counter.raiseTo(9);
+    if (!checkUint("raiseTo higher", 9, counter.get())) return false;
+    printf("passed\n");
+    return true;
+}
+
+bool testHistogramPercentiles() {
+    printf("testHistogramPercentiles\n");
+    Log2Histogram histogram;
+    if (!checkUint("empty percentile", 0, histogram.getPercentile(0.5))) return false;
+
+    // 0 falls in [0, 1), 1 in [1, 2), 2 and 3 in [2, 4), 1000 in [512, 1024).
+    histogram.add(0);
+    histogram.add(1);
+    histogram.add(2);
+    histogram.add(3);
+    histogram.add(1000);
+    if (!checkUint("count", 5, histogram.getCount())) return false;
+    if (!checkUint("p0", 1, histogram.getPercentile(0))) return false;
+    if (!checkUint("p50", 4, histogram.getPercentile(0.5))) return false;
+    if (!checkUint("p80", 4, histogram.getPercentile(0.8))) return false;
+    if (!checkUint("p100", 1024, histogram.getPercentile(1))) return false;
+
+    // Values too large for the buckets land in the last one.
+    histogram.add(UINT64_MAX);
+    if (!checkUint("p100 saturated", 1ULL << (Log2Histogram::BUCKET_COUNT - 1),
+            histogram.getPercentile(1))) return false;
+    printf("passed\n");
+    return true;
+}
+
+int main(int argc __attribute((unused)), char **argv __attribute((unused))) {
+    if (testCounter() &&
+            testHistogramPercentiles()) {
+        printf("ALL PASSED\n");
+    } else {
+        printf("SOMETHING FAILED\n");
+    }
+    return EXIT_SUCCESS;
+}
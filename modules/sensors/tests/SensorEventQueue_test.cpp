@@ -88,6 +88,45 @@ bool testWrappingWriteSizeCounts() {
     return true;
 }
 
+bool checkReadableBufferSize(SensorEventQueue* queue, int requested, int expected) {
+    sensors_event_t* buffer;
+    int actual = queue->getReadableRegion(requested, &buffer);
+    if (actual != expected) {
+        printf("Expected readable size was %d; actual was %d\n", expected, actual);
+        return false;
+    }
+    return true;
+}
+
+bool testReadableRegions() {
+    printf("testReadableRegions\n");
+    SensorEventQueue* queue = new SensorEventQueue(10);
+    if (!checkReadableBufferSize(queue, 10, 0)) return false;
+
+    queue->markAsWritten(8);
+    if (!checkReadableBufferSize(queue, 100, 8)) return false;
+    if (!checkReadableBufferSize(queue, 3, 3)) return false;
+    queue->markAsRead(6);
+    if (!checkSize(queue, 2)) return false;
+
+    // Wrap the written region around the end of the array.
+    if (!checkWritableBufferSize(queue, 100, 2)) return false;
+    queue->markAsWritten(2);
+    if (!checkWritableBufferSize(queue, 100, 6)) return false;
+    queue->markAsWritten(3);
+    if (!checkSize(queue, 7)) return false;
+
+    // The readable region stops at the end of the array; the rest follows from the front.
+    if (!checkReadableBufferSize(queue, 100, 4)) return false;
+    queue->markAsRead(4);
+    if (!checkReadableBufferSize(queue, 100, 3)) return false;
+    queue->markAsRead(3);
+    if (!checkSize(queue, 0)) return false;
+
+    printf("passed\n");
+    return true;
+}
+
 
 
 struct TaskContext {
@@ -110,8 +149,8 @@ void *fullQueueWriterTask(void* ptr) {
     sensors_event_t* buffer;
 
     while (totalWrites < FULL_QUEUE_EVENT_COUNT) {
-        pthread_mutex_lock(&mutex);
-        if (queue->waitForSpace(&mutex)) {
+        // The queue needs no lock; the mutex only guards the reader's wait on dataAvailableCond.
+        if (queue->waitForSpace()) {
             totalWaits++;
             printf(".");
         }
@@ -121,6 +160,7 @@ void *fullQueueWriterTask(void* ptr) {
         for (int i = 0; i < writableSize; i++) {
             printf("w");
         }
+        pthread_mutex_lock(&mutex);
         pthread_cond_broadcast(&dataAvailableCond);
         pthread_mutex_unlock(&mutex);
     }
@@ -151,10 +191,10 @@ void* fullQueueReaderTask(void* ptr) {
         while (!fullQueueReaderShouldRead(queue->getSize(), totalReads)) {
             pthread_cond_wait(&dataAvailableCond, &mutex);
         }
+        pthread_mutex_unlock(&mutex);
         queue->dequeue();
         totalReads++;
         printf("r");
-        pthread_mutex_unlock(&mutex);
     }
     printf("\n");
     ctx->success = ctx->success && checkInt("totalreads", FULL_QUEUE_EVENT_COUNT, totalReads);
@@ -190,6 +230,7 @@ bool testFullQueueIo() {
 int main(int argc __attribute((unused)), char **argv __attribute((unused))) {
     if (testSimpleWriteSizeCounts() &&
             testWrappingWriteSizeCounts() &&
+            testReadableRegions() &&
             testFullQueueIo()) {
         printf("ALL PASSED\n");
     } else {
@@ -40,10 +40,12 @@ static CameraHAL gCameraHAL;
 
 CameraHAL::CameraHAL()
   : mCallbacks(NULL) {
-    // Should not allocate the camera devices for now, as it is unclear if the device is plugged.
+    // Cameras already plugged in are counted by getNumberOfCameras(); the
+    // ones plugged in later are announced through the callbacks.
+    mHotplugThread = new HotplugThread(this);
+    mHotplugThread->enumerateDevices();
 
     // Start hotplug thread
-    mHotplugThread = new HotplugThread(this);
     mHotplugThread->run("usb-camera-hotplug");
 }
 
@@ -55,7 +57,6 @@ CameraHAL::~CameraHAL() {
             mHotplugThread->requestExit();
         }
 
-        // Delete camera device from mCameras
     }
 
     // Joining done without holding mLock, otherwise deadlocks may ensue
@@ -65,6 +66,10 @@ CameraHAL::~CameraHAL() {
     }
 
     delete mHotplugThread;
+
+    for (size_t i = 0; i < mCameras.size(); i++) {
+        delete mCameras[i];
+    }
 }
 
 int CameraHAL::getNumberOfCameras() {
@@ -79,6 +84,9 @@ int CameraHAL::getCameraInfo(int id, struct camera_info* info) {
     if (id < 0 || id >= static_cast<int>(mCameras.size())) {
         ALOGE("%s: Invalid camera id %d", __func__, id);
         return -ENODEV;
+    } else if (!mPresent[id]) {
+        ALOGE("%s: Camera %d is unplugged", __func__, id);
+        return -ENODEV;
     }
 
     return mCameras[id]->getInfo(info);
@@ -86,6 +94,7 @@ int CameraHAL::getCameraInfo(int id, struct camera_info* info) {
 
 int CameraHAL::setCallbacks(const camera_module_callbacks_t *callbacks) {
     ALOGV("%s : callbacks=%p", __func__, callbacks);
+    android::Mutex::Autolock al(mModuleLock);
     mCallbacks = callbacks;
     return 0;
 }
@@ -107,10 +116,91 @@ int CameraHAL::open(const hw_module_t* mod, const char* name, hw_device_t** dev)
     } else if (id < 0 || id >= static_cast<int>(mCameras.size())) {
         ALOGE("%s: Invalid camera id %d", __func__, id);
         return -ENODEV;
+    } else if (!mPresent[id]) {
+        ALOGE("%s: Camera %d is unplugged", __func__, id);
+        return -ENODEV;
     }
     return mCameras[id]->open(mod, dev);
 }
 
+void CameraHAL::addCamera(const android::String8& devPath) {
+    int id;
+    Camera *camera = NULL;
+    {
+        android::Mutex::Autolock al(mModuleLock);
+        ssize_t index = mCameraIds.indexOfKey(devPath);
+        if (index >= 0) {
+            id = mCameraIds.valueAt(index);
+            if (mPresent[id]) {
+                return;
+            }
+        } else {
+            id = static_cast<int>(mCameras.size());
+            camera = new UsbCamera(id);
+            mCameras.push_back(camera);
+            mPresent.push_back(false);
+            mCameraIds.add(devPath, id);
+        }
+    }
+
+    // Probe the static info of new cameras before announcing them, without
+    // holding the module lock, so the framework never waits on the device.
+    // Cameras plugged in again keep theirs.
+    if (camera != NULL) {
+        camera->updateInfo();
+    }
+
+    {
+        android::Mutex::Autolock al(mModuleLock);
+        mPresent.editItemAt(id) = true;
+    }
+    ALOGI("%s: Camera %d plugged in at %s", __func__, id, devPath.string());
+    notifyStatus(id, CAMERA_DEVICE_STATUS_PRESENT);
+}
+
+void CameraHAL::removeCamera(const android::String8& devPath) {
+    int id;
+    {
+        android::Mutex::Autolock al(mModuleLock);
+        ssize_t index = mCameraIds.indexOfKey(devPath);
+        if (index < 0) {
+            return;
+        }
+        id = mCameraIds.valueAt(index);
+        if (!mPresent[id]) {
+            return;
+        }
+        // The camera instance is kept (it may still be open, until the
+        // framework closes it), for the device to be plugged in again.
+        mPresent.editItemAt(id) = false;
+    }
+    ALOGI("%s: Camera %d unplugged from %s", __func__, id, devPath.string());
+    notifyStatus(id, CAMERA_DEVICE_STATUS_NOT_PRESENT);
+}
+
+void CameraHAL::getPresentDevices(android::SortedVector<android::String8>* devPaths) {
+    android::Mutex::Autolock al(mModuleLock);
+    devPaths->clear();
+    for (size_t i = 0; i < mCameraIds.size(); i++) {
+        if (mPresent[mCameraIds.valueAt(i)]) {
+            devPaths->add(mCameraIds.keyAt(i));
+        }
+    }
+}
+
+void CameraHAL::notifyStatus(int id, camera_device_status_t status) {
+    const camera_module_callbacks_t *callbacks;
+    {
+        android::Mutex::Autolock al(mModuleLock);
+        callbacks = mCallbacks;
+    }
+    // Called without the module lock: the framework may call back into the
+    // module from the callback.
+    if (callbacks != NULL) {
+        callbacks->camera_device_status_change(callbacks, id, status);
+    }
+}
+
 extern "C" {
 
 static int get_number_of_cameras() {
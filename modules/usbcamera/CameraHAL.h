@@ -19,8 +19,11 @@
 
 #include <hardware/hardware.h>
 #include <hardware/camera_common.h>
-#include <utils/Vector.h>
+#include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
 #include "HotplugThread.h"
 #include "Camera.h"
 
@@ -45,10 +48,24 @@ class CameraHAL {
         // Hardware Module Interface (see <hardware/hardware.h>)
         int open(const hw_module_t* mod, const char* name, hw_device_t** dev);
 
+        // Called by the hotplug thread when the capture device |devPath| is
+        // plugged in or out. A device plugged in again gets its old camera id
+        // back, and the camera instance is reused.
+        void addCamera(const android::String8& devPath);
+        void removeCamera(const android::String8& devPath);
+        // Device nodes of the cameras currently plugged in.
+        void getPresentDevices(android::SortedVector<android::String8>* devPaths);
+
     private:
+        void notifyStatus(int id, camera_device_status_t status);
+
         // Callback handle
         const camera_module_callbacks_t *mCallbacks;
         android::Vector<Camera*> mCameras;
+        // Whether the device of each camera in mCameras is plugged in.
+        android::Vector<bool> mPresent;
+        // Camera id of each device node ever seen.
+        android::KeyedVector<android::String8, int> mCameraIds;
         // Lock to protect the module method calls.
         android::Mutex mModuleLock;
         // Hot plug thread managing camera hot plug.
@@ -17,45 +17,243 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "HotplugThread"
 
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cutils/uevent.h>
 #include <log/log.h>
+#include <utils/SortedVector.h>
 
 #include "HotplugThread.h"
 
 namespace usb_camera_hal {
 
-HotplugThread::HotplugThread(CameraHAL *hal)
-    : mModule(hal) {
+// Receive buffer of the uevent socket, large enough for bursts of events
+// (e.g. a hub with several devices being plugged in).
+static const int kUeventSocketBufferSize = 256 * 1024;
+// Largest single uevent message.
+static const size_t kUeventMsgSize = 2048;
+static const char kVideoSubsystem[] = "video4linux";
+static const char kVideoSysfsDir[] = "/sys/class/video4linux";
+static const char kVideoDevicePrefix[] = "video";
+// On add, the uevent may arrive before ueventd has created the node.
+static const int kNodeWaitAttempts = 20;
+static const useconds_t kNodeWaitIntervalUs = 50000;
+
+// Whether |devPath| is a streaming video capture node. UVC cameras also
+// expose metadata nodes, which are not cameras.
+static bool isCaptureDevice(const char *devPath, bool waitForNode) {
+    int fd = -1;
+    for (int i = 0; i < kNodeWaitAttempts; i++) {
+        fd = TEMP_FAILURE_RETRY(::open(devPath, O_RDWR | O_NONBLOCK | O_CLOEXEC));
+        if (fd >= 0 || errno != ENOENT || !waitForNode) {
+            break;
+        }
+        usleep(kNodeWaitIntervalUs);
+    }
+    if (fd < 0) {
+        ALOGE("%s: Failed to open %s: %s", __func__, devPath, strerror(errno));
+        return false;
+    }
+
+    struct v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    int res = TEMP_FAILURE_RETRY(ioctl(fd, VIDIOC_QUERYCAP, &cap));
+    ::close(fd);
+    if (res < 0) {
+        ALOGE("%s: VIDIOC_QUERYCAP on %s failed: %s", __func__, devPath, strerror(errno));
+        return false;
+    }
 
+    uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps
+                                                               : cap.capabilities;
+    return (caps & V4L2_CAP_VIDEO_CAPTURE) && (caps & V4L2_CAP_STREAMING);
+}
+
+HotplugThread::HotplugThread(CameraHAL *hal)
+    : mModule(hal),
+      mUeventFd(uevent_open_socket(kUeventSocketBufferSize, true)),
+      mWakeupFd(eventfd(0, EFD_CLOEXEC)) {
+    if (mUeventFd < 0) {
+        ALOGE("%s: Failed to open uevent socket: %s", __func__, strerror(errno));
+    }
+    if (mWakeupFd < 0) {
+        ALOGE("%s: Failed to create wakeup eventfd: %s", __func__, strerror(errno));
+    }
 }
 
 HotplugThread::~HotplugThread() {
+    if (mUeventFd >= 0) {
+        ::close(mUeventFd);
+    }
+    if (mWakeupFd >= 0) {
+        ::close(mWakeupFd);
+    }
+}
+
+void HotplugThread::listDevices(android::SortedVector<android::String8>* devPaths) {
+    devPaths->clear();
+    DIR *dir = opendir(kVideoSysfsDir);
+    if (dir == NULL) {
+        ALOGI("%s: No video devices: %s", __func__, strerror(errno));
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!strncmp(entry->d_name, kVideoDevicePrefix, strlen(kVideoDevicePrefix))) {
+            devPaths->add(android::String8("/dev/") + entry->d_name);
+        }
+    }
+    closedir(dir);
+}
+
+void HotplugThread::enumerateDevices() {
+    // readdir order is arbitrary; the sorted list keeps camera ids stable
+    // across boots.
+    android::SortedVector<android::String8> devPaths;
+    listDevices(&devPaths);
+    for (size_t i = 0; i < devPaths.size(); i++) {
+        addDevice(devPaths[i], false);
+    }
+}
 
+void HotplugThread::drainUevents() {
+    char msg[kUeventMsgSize];
+    // The first recv reports the overflow (ENOBUFS), which clears it.
+    while (TEMP_FAILURE_RETRY(recv(mUeventFd, msg, sizeof(msg), MSG_DONTWAIT)) >= 0 ||
+            errno == ENOBUFS) {
+    }
+}
+
+void HotplugThread::reconcileDevices() {
+    android::SortedVector<android::String8> devPaths;
+    listDevices(&devPaths);
+    android::SortedVector<android::String8> present;
+    mModule->getPresentDevices(&present);
+
+    for (size_t i = 0; i < present.size(); i++) {
+        if (devPaths.indexOf(present[i]) < 0) {
+            mModule->removeCamera(present[i]);
+        }
+    }
+    for (size_t i = 0; i < devPaths.size(); i++) {
+        if (present.indexOf(devPaths[i]) < 0) {
+            addDevice(devPaths[i], false);
+        }
+    }
 }
 
 void HotplugThread::requestExit() {
     // Call parent to set up shutdown
     Thread::requestExit();
 
-    // Cleanup other states?
+    // Unblock threadLoop().
+    uint64_t count = 1;
+    if (TEMP_FAILURE_RETRY(write(mWakeupFd, &count, sizeof(count))) < 0) {
+        ALOGE("%s: Failed to wake hotplug thread: %s", __func__, strerror(errno));
+    }
 }
 
 bool HotplugThread::threadLoop() {
-    (void)mModule;  // silence warning about unused member.
-
-    /**
-     * Check camera connection status change, if connected, do below:
-     * 1. Create camera device, add to mCameras.
-     * 2. Init static info (mCameras[id]->initStaticInfo())
-     * 3. Notify on_status_change callback
-     *
-     * If unconnected, similarly, do below:
-     * 1. Destroy camera device and remove it from mCameras.
-     * 2. Notify on_status_change callback
-     *
-     * DO NOT have a tight polling loop here, to avoid excessive CPU utilization.
-     */
+    if (mUeventFd < 0 || mWakeupFd < 0) {
+        return false;
+    }
 
+    struct pollfd fds[2];
+    fds[0].fd = mUeventFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = mWakeupFd;
+    fds[1].events = POLLIN;
+
+    // Sleep until there is an event, or until asked to exit.
+    int res = TEMP_FAILURE_RETRY(poll(fds, 2, -1));
+    if (res < 0) {
+        ALOGE("%s: poll failed: %s", __func__, strerror(errno));
+        return false;
+    }
+    if (fds[1].revents || exitPending()) {
+        return false;
+    }
+    if (fds[0].revents & POLLHUP) {
+        ALOGE("%s: uevent socket closed", __func__);
+        return false;
+    }
+    if (fds[0].revents & POLLERR) {
+        // The socket buffer overflowed (ENOBUFS), so uevents were lost.
+        // Rather than trust what is left of them, go by sysfs.
+        ALOGW("%s: uevents lost, rescanning video devices", __func__);
+        drainUevents();
+        reconcileDevices();
+        return true;
+    }
+
+    char msg[kUeventMsgSize + 2];
+    // Drops (returns <= 0 for) messages not sent by the kernel.
+    ssize_t len = uevent_kernel_multicast_recv(mUeventFd, msg, kUeventMsgSize);
+    if (len <= 0) {
+        return true;
+    }
+    if (static_cast<size_t>(len) >= kUeventMsgSize) {
+        ALOGW("%s: Dropping oversized uevent", __func__);
+        return true;
+    }
+    msg[len] = '\0';
+    msg[len + 1] = '\0';
+    handleUevent(msg, len);
     return true;
 }
 
+void HotplugThread::handleUevent(const char *msg, size_t len) {
+    const char *action = NULL;
+    const char *subsystem = NULL;
+    const char *devName = NULL;
+
+    // The message is "action@devpath" followed by "KEY=value" strings,
+    // all NUL terminated.
+    for (const char *field = msg; field < msg + len; field += strlen(field) + 1) {
+        if (!strncmp(field, "ACTION=", 7)) {
+            action = field + 7;
+        } else if (!strncmp(field, "SUBSYSTEM=", 10)) {
+            subsystem = field + 10;
+        } else if (!strncmp(field, "DEVNAME=", 8)) {
+            devName = field + 8;
+        }
+    }
+
+    if (action == NULL || subsystem == NULL || devName == NULL ||
+            strcmp(subsystem, kVideoSubsystem) ||
+            strncmp(devName, kVideoDevicePrefix, strlen(kVideoDevicePrefix))) {
+        return;
+    }
+
+    // DEVNAME is relative to /dev.
+    android::String8 devPath(devName[0] == '/' ? "" : "/dev/");
+    devPath += devName;
+    ALOGV("%s: %s %s", __func__, action, devPath.string());
+    if (!strcmp(action, "add")) {
+        addDevice(devPath, true);
+    } else if (!strcmp(action, "remove")) {
+        mModule->removeCamera(devPath);
+    }
+}
+
+void HotplugThread::addDevice(const android::String8& devPath, bool waitForNode) {
+    // Probing opens the device, so it is done here rather than in the
+    // framework's calls into the module.
+    if (!isCaptureDevice(devPath.string(), waitForNode)) {
+        ALOGV("%s: Ignoring %s, not a capture device", __func__, devPath.string());
+        return;
+    }
+    mModule->addCamera(devPath);
+}
+
 } // namespace usb_camera_hal
@@ -16,6 +16,8 @@
 #ifndef HOTPLUG_THREAD_H_
 #define HOTPLUG_THREAD_H_
 
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
 #include <utils/Thread.h>
 #include "CameraHAL.h"
 
@@ -29,6 +31,10 @@ namespace usb_camera_hal {
  *    static metadata. As an optimization option, the camera device instance (including
  *    the static info) could be cached when the same camera plugged/unplugged multiple
  *    times.
+ *
+ * Hotplug events come from a NETLINK_KOBJECT_UEVENT socket; the thread blocks
+ * on it (and on an eventfd to be told to exit), so it only wakes up when a
+ * device comes or goes.
  */
 
 class CameraHAL;
@@ -39,12 +45,34 @@ class HotplugThread : public android::Thread {
         explicit HotplugThread(CameraHAL *hal);
         ~HotplugThread();
 
+        // Add the video capture devices already present. Called once, before
+        // the thread is started; devices plugged in from then on are reported
+        // by uevents, which are queued on the socket opened in the constructor.
+        void enumerateDevices();
+
         // Override below two methods for proper cleanup.
         virtual bool threadLoop();
         virtual void requestExit();
 
     private:
+        // The video device nodes currently in sysfs.
+        void listDevices(android::SortedVector<android::String8>* devPaths);
+        // Discard the uevents queued on the socket, after it overflowed.
+        void drainUevents();
+        // Add and remove cameras to match the devices in sysfs, when uevents
+        // have been lost.
+        void reconcileDevices();
+        // Parse one uevent message of |len| bytes, and add/remove the camera
+        // it is about, if any.
+        void handleUevent(const char *msg, size_t len);
+        // Probe |devPath|, and add it to the module if it is a capture device.
+        void addDevice(const android::String8& devPath, bool waitForNode);
+
         CameraHAL *mModule;
+        // Kernel uevent socket.
+        int mUeventFd;
+        // Signalled by requestExit() to unblock threadLoop().
+        int mWakeupFd;
 };
 
 } // namespace usb_camera_hal